@@ -237,6 +237,12 @@ class TableLayout {
     return lookupKeys_;
   }
 
+  /// True if no two rows of the layout have the same values in all of
+  /// 'lookupKeys()'.
+  virtual bool lookupKeysUnique() const {
+    return false;
+  }
+
   /// True if a full table scan is supported. Some lookup sources prohibit this.
   /// At the same time the dataset may be available in a scannable form in
   /// another layout.
@@ -417,6 +423,18 @@ struct LookupKeys {
   bool isAscending{true};
 };
 
+enum class MetadataAggregateKind { kCount, kMin, kMax };
+
+/// An aggregate over all rows of a TableLayout that a connector may be able
+/// to answer from metadata, e.g. row counts and column statistics in file
+/// footers, without reading the data.
+struct MetadataAggregate {
+  MetadataAggregateKind kind;
+
+  /// Aggregated column. Empty for count(*).
+  std::string column;
+};
+
 /// Contains the information for an in-progress write operation. This may
 /// include insert, update, or delete of an existing table, or insertion into a
 /// new table. The ConnectorWriteHandle is generated when a table write
@@ -536,6 +554,17 @@ class ConnectorMetadata {
       velox::RowTypePtr dataColumns = nullptr,
       std::optional<LookupKeys> = std::nullopt) = 0;
 
+  /// Returns the values of 'aggregates' over all rows of 'layout' if these are
+  /// known exactly from metadata. A count is a BIGINT. A min or max has the
+  /// type of the column and is null if the column has no non-null values.
+  /// Returns std::nullopt if any of 'aggregates' is not known, in which case
+  /// the data must be scanned.
+  virtual std::optional<std::vector<velox::Variant>> aggregateFromMetadata(
+      const TableLayout& layout,
+      const std::vector<MetadataAggregate>& aggregates) {
+    return std::nullopt;
+  }
+
   /// Return a ConnectorTablePtr given the table name. Table name is provided
   /// without the connector ID prefix for the connector. The returned Table
   /// object is immutable. If updates to the Table object are required, the
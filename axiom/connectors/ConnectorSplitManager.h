@@ -51,6 +51,11 @@ struct SplitOptions {
 
   /// Target size of split.
   uint64_t fileBytesPerSplit{128ULL << 20U};
+
+  /// If set, the scan needs no more than this many rows, e.g. under a LIMIT.
+  /// A source that knows the row count of its splits may stop once its
+  /// splits cover this many rows and the table handle has no filters.
+  std::optional<int64_t> maxRows;
 };
 
 /// Describes a single partition of a TableLayout. A TableLayout has at least
@@ -27,6 +27,8 @@
 #include "velox/dwio/common/BufferedInput.h"
 #include "velox/dwio/common/Reader.h"
 #include "velox/dwio/common/ReaderFactory.h"
+#include "velox/dwio/dwrf/reader/DwrfReader.h"
+#include "velox/dwio/parquet/reader/ParquetReader.h"
 #include "velox/expression/Expr.h"
 #include "velox/type/fbhive/HiveTypeParser.h"
 #include "velox/type/fbhive/HiveTypeSerializer.h"
@@ -58,6 +60,16 @@ std::shared_ptr<SplitSource> LocalHiveSplitManager::getSplitSource(
   for (auto& file : files) {
     selectedFiles.push_back(file.get());
   }
+
+  // The rows of a split bound the rows of the scan only if nothing is
+  // filtered out.
+  auto* hiveHandle =
+      dynamic_cast<const velox::connector::hive::HiveTableHandle*>(
+          tableHandle.get());
+  if (hiveHandle == nullptr || !hiveHandle->subfieldFilters().empty() ||
+      hiveHandle->remainingFilter() != nullptr) {
+    options.maxRows = std::nullopt;
+  }
   return std::make_shared<LocalHiveSplitSource>(
       std::move(selectedFiles),
       layout->fileFormat(),
@@ -71,8 +83,99 @@ template <typename T>
 T ceil2(T x, T y) {
   return (x + y - 1) / y;
 }
+
+// Groups consecutive 'stripes' into at most 'numSplits' ranges with about equal
+// row counts. Returns the start offset of each range. The first range starts
+// at 0 so that it covers the file header.
+std::vector<uint64_t> stripeAlignedStarts(
+    const std::vector<StripeInfo>& stripes,
+    int64_t numSplits) {
+  uint64_t totalRows = 0;
+  for (const auto& stripe : stripes) {
+    totalRows += stripe.numRows;
+  }
+
+  numSplits = std::clamp<int64_t>(numSplits, 1, stripes.size());
+  std::vector<uint64_t> starts = {0};
+  uint64_t rowsBefore = 0;
+  for (const auto& stripe : stripes) {
+    if (rowsBefore > 0 && starts.size() < numSplits &&
+        rowsBefore * numSplits >= totalRows * starts.size()) {
+      starts.push_back(stripe.offset);
+    }
+    rowsBefore += stripe.numRows;
+  }
+  return starts;
+}
 } // namespace
 
+int64_t LocalHiveSplitSource::numSplitsForFile(uint64_t fileSize) const {
+  if (options_.wholeFile) {
+    return 1;
+  }
+  int64_t splitsPerFile = ceil2<uint64_t>(fileSize, options_.fileBytesPerSplit);
+  if (options_.targetSplitCount) {
+    auto numFiles = files_.size();
+    if (splitsPerFile * numFiles < options_.targetSplitCount) {
+      // Divide the file into more splits but still not smaller than 32MB.
+      auto perFile = ceil2<uint64_t>(options_.targetSplitCount, numFiles);
+      int64_t bytesInSplit = ceil2<uint64_t>(fileSize, perFile);
+      splitsPerFile = ceil2<uint64_t>(
+          fileSize, std::max<uint64_t>(bytesInSplit, 32 << 20));
+    }
+  }
+  return std::max<int64_t>(splitsPerFile, 1);
+}
+
+void LocalHiveSplitSource::makeFileSplits(const FileInfo& file) {
+  const auto fileSize =
+      file.size.has_value() ? file.size.value() : fs::file_size(file.path);
+  const auto numSplits = numSplitsForFile(fileSize);
+
+  // Start offsets of the splits. A split ends where the next one starts.
+  std::vector<uint64_t> starts;
+  if (!file.stripes.empty()) {
+    starts = stripeAlignedStarts(file.stripes, numSplits);
+  } else {
+    // Take the upper bound.
+    const uint64_t splitSize = ceil2<uint64_t>(fileSize, numSplits);
+    for (auto i = 0; i < numSplits; ++i) {
+      starts.push_back(i * splitSize);
+    }
+  }
+
+  for (auto i = 0; i < starts.size(); ++i) {
+    const auto end = i + 1 < starts.size() ? starts[i + 1] : fileSize;
+
+    // A split reads the stripes that start in its range.
+    uint64_t numRows = 0;
+    if (!file.stripes.empty()) {
+      for (const auto& stripe : file.stripes) {
+        if (stripe.offset >= starts[i] && stripe.offset < end) {
+          numRows += stripe.numRows;
+        }
+      }
+    } else if (starts.size() == 1) {
+      numRows = file.numRows.value_or(0);
+    }
+    fileSplitRows_.push_back(numRows);
+
+    auto builder = velox::connector::hive::HiveConnectorSplitBuilder(file.path)
+                       .connectorId(connectorId_)
+                       .fileFormat(format_)
+                       .start(starts[i])
+                       .length(end - starts[i]);
+
+    if (file.bucketNumber.has_value()) {
+      builder.tableBucketNumber(file.bucketNumber.value());
+    }
+    for (auto& pair : file.partitionKeys) {
+      builder.partitionKey(pair.first, pair.second);
+    }
+    fileSplits_.push_back(builder.build());
+  }
+}
+
 std::vector<SplitSource::SplitAndGroup> LocalHiveSplitSource::getSplits(
     uint64_t targetBytes) {
   std::vector<SplitAndGroup> result;
@@ -83,8 +186,17 @@ std::vector<SplitSource::SplitAndGroup> LocalHiveSplitSource::getSplits(
       return result;
     }
 
+    if (options_.maxRows.has_value() &&
+        numRows_ >= static_cast<uint64_t>(options_.maxRows.value())) {
+      // The splits so far have enough rows.
+      currentFile_ = static_cast<int32_t>(files_.size());
+      result.push_back(SplitSource::SplitAndGroup{nullptr, 0});
+      return result;
+    }
+
     if (currentSplit_ >= fileSplits_.size()) {
       fileSplits_.clear();
+      fileSplitRows_.clear();
       ++currentFile_;
       if (currentFile_ >= files_.size()) {
         result.push_back(SplitSource::SplitAndGroup{nullptr, 0});
@@ -92,40 +204,9 @@ std::vector<SplitSource::SplitAndGroup> LocalHiveSplitSource::getSplits(
       }
 
       currentSplit_ = 0;
-      const auto& filePath = files_[currentFile_]->path;
-      const auto fileSize = fs::file_size(filePath);
-      int64_t splitsPerFile =
-          ceil2<uint64_t>(fileSize, options_.fileBytesPerSplit);
-      if (options_.targetSplitCount) {
-        auto numFiles = files_.size();
-        if (splitsPerFile * numFiles < options_.targetSplitCount) {
-          // Divide the file into more splits but still not smaller than 64MB.
-          auto perFile = ceil2<uint64_t>(options_.targetSplitCount, numFiles);
-          int64_t bytesInSplit = ceil2<uint64_t>(fileSize, perFile);
-          splitsPerFile = ceil2<uint64_t>(
-              fileSize, std::max<uint64_t>(bytesInSplit, 32 << 20));
-        }
-      }
-      // Take the upper bound.
-      const int64_t splitSize = ceil2<uint64_t>(fileSize, splitsPerFile);
-      for (int i = 0; i < splitsPerFile; ++i) {
-        auto builder =
-            velox::connector::hive::HiveConnectorSplitBuilder(filePath)
-                .connectorId(connectorId_)
-                .fileFormat(format_)
-                .start(i * splitSize)
-                .length(splitSize);
-
-        auto* info = files_[currentFile_];
-        if (info->bucketNumber.has_value()) {
-          builder.tableBucketNumber(info->bucketNumber.value());
-        }
-        for (auto& pair : info->partitionKeys) {
-          builder.partitionKey(pair.first, pair.second);
-        }
-        fileSplits_.push_back(builder.build());
-      }
+      makeFileSplits(*files_[currentFile_]);
     }
+    numRows_ += fileSplitRows_[currentSplit_];
     result.push_back(SplitAndGroup{std::move(fileSplits_[currentSplit_++]), 0});
     bytes +=
         reinterpret_cast<const velox::connector::hive::HiveConnectorSplit*>(
@@ -483,7 +564,7 @@ void listFiles(
     std::string_view path,
     std::function<int32_t(std::string_view)> parseBucketNumber,
     int32_t prefixSize,
-    std::vector<std::unique_ptr<const FileInfo>>& result) {
+    std::vector<std::unique_ptr<FileInfo>>& result) {
   for (auto const& dirEntry : fs::directory_iterator{path}) {
     // Ignore hidden files.
     if (dirEntry.path().filename().c_str()[0] == '.') {
@@ -517,6 +598,98 @@ void listFiles(
     result.push_back(std::move(file));
   }
 }
+
+// Returns the offsets and row counts of the stripes or row groups read by
+// 'reader'. Returns an empty vector if the format does not expose these or if
+// the offsets are not usable as split boundaries.
+std::vector<StripeInfo> readStripes(
+    velox::dwio::common::Reader& reader,
+    uint64_t fileSize) {
+  std::vector<StripeInfo> stripes;
+  if (auto* dwrfReader = dynamic_cast<velox::dwrf::DwrfReader*>(&reader)) {
+    const auto numStripes = dwrfReader->getNumberOfStripes();
+    stripes.reserve(numStripes);
+    for (auto i = 0; i < numStripes; ++i) {
+      const auto stripe = dwrfReader->getStripe(i);
+      stripes.push_back(
+          StripeInfo{stripe->getOffset(), stripe->getNumberOfRows()});
+    }
+  } else if (
+      auto* parquetReader =
+          dynamic_cast<velox::parquet::ParquetReader*>(&reader)) {
+    const auto fileMetaData = parquetReader->fileMetaData();
+    const auto numRowGroups = fileMetaData.numRowGroups();
+    stripes.reserve(numRowGroups);
+    for (auto i = 0; i < numRowGroups; ++i) {
+      const auto rowGroup = fileMetaData.rowGroup(i);
+      if (!rowGroup.hasFileOffset()) {
+        return {};
+      }
+      stripes.push_back(StripeInfo{
+          static_cast<uint64_t>(rowGroup.fileOffset()),
+          static_cast<uint64_t>(rowGroup.numRows())});
+    }
+  }
+
+  for (auto i = 0; i < stripes.size(); ++i) {
+    if (stripes[i].offset >= fileSize ||
+        (i > 0 && stripes[i].offset <= stripes[i - 1].offset)) {
+      return {};
+    }
+  }
+  return stripes;
+}
+
+// Returns 'value' as a Variant of 'kind'.
+template <typename T>
+std::optional<velox::Variant> toVariant(T value, velox::TypeKind kind) {
+  switch (kind) {
+    case velox::TypeKind::TINYINT:
+      return velox::Variant(static_cast<int8_t>(value));
+    case velox::TypeKind::SMALLINT:
+      return velox::Variant(static_cast<int16_t>(value));
+    case velox::TypeKind::INTEGER:
+      return velox::Variant(static_cast<int32_t>(value));
+    case velox::TypeKind::BIGINT:
+      return velox::Variant(static_cast<int64_t>(value));
+    case velox::TypeKind::REAL:
+      return velox::Variant(static_cast<float>(value));
+    case velox::TypeKind::DOUBLE:
+      return velox::Variant(static_cast<double>(value));
+    default:
+      return std::nullopt;
+  }
+}
+
+// Returns the footer statistics of a column of 'type'. Decimals are left
+// without bounds since their statistics are not kept as integers.
+FileColumnStats fileColumnStats(
+    const velox::dwio::common::ColumnStatistics& stats,
+    const velox::TypePtr& type) {
+  FileColumnStats result;
+  result.numValues = stats.getNumberOfValues();
+  if (type->isDecimal()) {
+    return result;
+  }
+  if (auto* ints =
+          dynamic_cast<const velox::dwio::common::IntegerColumnStatistics*>(
+              &stats)) {
+    if (ints->getMinimum().has_value() && ints->getMaximum().has_value()) {
+      result.min = toVariant(ints->getMinimum().value(), type->kind());
+      result.max = toVariant(ints->getMaximum().value(), type->kind());
+    }
+  } else if (
+      auto* doubles =
+          dynamic_cast<const velox::dwio::common::DoubleColumnStatistics*>(
+              &stats)) {
+    if (doubles->getMinimum().has_value() &&
+        doubles->getMaximum().has_value()) {
+      result.min = toVariant(doubles->getMinimum().value(), type->kind());
+      result.max = toVariant(doubles->getMaximum().value(), type->kind());
+    }
+  }
+  return result;
+}
 } // namespace
 
 void LocalHiveConnectorMetadata::loadTable(
@@ -536,11 +709,13 @@ void LocalHiveConnectorMetadata::loadTable(
     parseBucketNumber = extractDigitsAfterLastSlash;
   }
 
-  std::vector<std::unique_ptr<const FileInfo>> files;
+  std::vector<std::unique_ptr<FileInfo>> files;
   std::string pathString = tablePath;
   listFiles(pathString, parseBucketNumber, pathString.size(), files);
 
   for (auto& info : files) {
+    info->size = fs::file_size(info->path);
+
     // If the table has a schema it has a layout that gives the file format.
     // Otherwise we default it from 'this'.
     velox::dwio::common::ReaderOptions readerOptions{schemaPool_.get()};
@@ -556,6 +731,8 @@ void LocalHiveConnectorMetadata::loadTable(
         velox::dwio::common::getReaderFactory(readerOptions.fileFormat())
             ->createReader(std::move(input), readerOptions);
 
+    info->stripes = readStripes(*reader, info->size.value());
+
     const auto& fileType = reader->rowType();
     if (!tableType) {
       tableType = fileType;
@@ -578,7 +755,11 @@ void LocalHiveConnectorMetadata::loadTable(
     if (rows.has_value()) {
       table->numRows_ += rows.value();
     }
+    info->numRows = rows;
 
+    // Footer statistics are indexed by the node id of the column in the file
+    // schema. The id of the root is 0.
+    const auto& typeWithId = reader->typeWithId();
     for (auto i = 0; i < fileType->size(); ++i) {
       const auto& name = fileType->nameOf(i);
 
@@ -592,7 +773,10 @@ void LocalHiveConnectorMetadata::loadTable(
         table->columns()[name] = std::move(newColumn);
       }
 
-      if (auto readerStats = reader->columnStatistics(i)) {
+      auto& fileStats = info->columnStats[name];
+      if (auto readerStats =
+              reader->columnStatistics(typeWithId->childAt(i)->id())) {
+        fileStats = fileColumnStats(*readerStats, fileType->childAt(i));
         column->mutableStats()->numValues +=
             readerStats->getNumberOfValues().value_or(0);
 
@@ -606,7 +790,12 @@ void LocalHiveConnectorMetadata::loadTable(
   }
   VELOX_CHECK_NOT_NULL(table, "Table directory {} is empty", tablePath);
 
-  table->makeDefaultLayout(std::move(files), *this);
+  std::vector<std::unique_ptr<const FileInfo>> fileInfos;
+  fileInfos.reserve(files.size());
+  for (auto& info : files) {
+    fileInfos.push_back(std::move(info));
+  }
+  table->makeDefaultLayout(std::move(fileInfos), *this);
   float pct = 10;
   if (table->numRows() > 1'000'000) {
     // Set pct to sample ~100K rows.
@@ -748,6 +937,89 @@ const folly::F14FastMap<std::string, const Column*>& LocalTable::columnMap()
   return exportedColumns_;
 }
 
+namespace {
+
+// Returns 'aggregate' over the rows of 'files' or std::nullopt if a file does
+// not have the needed statistics. 'type' is the type of the aggregated column.
+std::optional<velox::Variant> aggregateFiles(
+    const std::vector<std::unique_ptr<const FileInfo>>& files,
+    const MetadataAggregate& aggregate,
+    const velox::TypePtr& type) {
+  const bool isCount = aggregate.kind == MetadataAggregateKind::kCount;
+  const bool isMin = aggregate.kind == MetadataAggregateKind::kMin;
+  int64_t count = 0;
+  std::optional<velox::Variant> bound;
+  for (const auto& file : files) {
+    if (!file->numRows.has_value()) {
+      return std::nullopt;
+    }
+    if (aggregate.column.empty()) {
+      count += file->numRows.value();
+      continue;
+    }
+    if (file->partitionKeys.contains(aggregate.column)) {
+      return std::nullopt;
+    }
+    auto it = file->columnStats.find(aggregate.column);
+    if (it == file->columnStats.end()) {
+      // The column was added after 'file' was written.
+      continue;
+    }
+    const auto& stats = it->second;
+    if (!stats.numValues.has_value()) {
+      return std::nullopt;
+    }
+    if (isCount || stats.numValues.value() == 0) {
+      count += stats.numValues.value();
+      continue;
+    }
+    const auto& value = isMin ? stats.min : stats.max;
+    if (!value.has_value() || value->kind() != type->kind()) {
+      return std::nullopt;
+    }
+    if (!bound.has_value() ||
+        (isMin ? value.value() < bound.value()
+               : bound.value() < value.value())) {
+      bound = value;
+    }
+  }
+  if (isCount) {
+    return velox::Variant(count);
+  }
+  return bound.value_or(velox::Variant::null(type->kind()));
+}
+
+} // namespace
+
+std::optional<std::vector<velox::Variant>>
+LocalHiveConnectorMetadata::aggregateFromMetadata(
+    const TableLayout& layout,
+    const std::vector<MetadataAggregate>& aggregates) {
+  auto* localLayout = dynamic_cast<const LocalHiveTableLayout*>(&layout);
+  if (localLayout == nullptr) {
+    return std::nullopt;
+  }
+
+  std::vector<velox::Variant> result;
+  result.reserve(aggregates.size());
+  for (const auto& aggregate : aggregates) {
+    velox::TypePtr type = velox::BIGINT();
+    if (!aggregate.column.empty()) {
+      const auto* column = layout.findColumn(aggregate.column);
+      if (column == nullptr) {
+        return std::nullopt;
+      }
+      type = column->type();
+    }
+    auto value = aggregateFiles(localLayout->files(), aggregate, type);
+    if (!value.has_value()) {
+      return std::nullopt;
+    }
+    result.push_back(std::move(value.value()));
+  }
+  return result;
+}
+
 TablePtr LocalHiveConnectorMetadata::findTable(std::string_view name) {
   ensureInitialized();
   std::lock_guard<std::mutex> l(mutex_);
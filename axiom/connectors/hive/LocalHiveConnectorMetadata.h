@@ -26,11 +26,44 @@
 
 namespace facebook::axiom::connector::hive {
 
+/// Describes a stripe or row group of a file.
+struct StripeInfo {
+  /// Byte offset of the stripe in the file.
+  uint64_t offset;
+
+  uint64_t numRows;
+};
+
+/// Statistics of a column in a file footer.
+struct FileColumnStats {
+  /// Number of non-null values.
+  std::optional<uint64_t> numValues;
+
+  /// Exact minimum and maximum of the non-null values. Only set for numeric
+  /// columns since string bounds may be truncated.
+  std::optional<velox::Variant> min;
+  std::optional<velox::Variant> max;
+};
+
 /// Describes a file in a table. Input to split enumeration.
 struct FileInfo {
   std::string path;
   folly::F14FastMap<std::string, std::optional<std::string>> partitionKeys;
   std::optional<int32_t> bucketNumber;
+
+  /// Size of the file in bytes. Set when the table is loaded.
+  std::optional<uint64_t> size;
+
+  /// Stripes or row groups in file order. Empty if the file format does not
+  /// expose them. If set, splits start and end on stripe boundaries.
+  std::vector<StripeInfo> stripes;
+
+  /// Number of rows from the file footer. Set when the table is loaded.
+  std::optional<uint64_t> numRows;
+
+  /// Footer statistics by column name. A column that is not in the file is
+  /// all null.
+  folly::F14FastMap<std::string, FileColumnStats> columnStats;
 };
 
 class LocalHiveSplitSource : public SplitSource {
@@ -49,13 +82,26 @@ class LocalHiveSplitSource : public SplitSource {
       uint64_t targetBytes) override;
 
  private:
+  // Fills 'fileSplits_' and 'fileSplitRows_' with the splits of 'file'.
+  void makeFileSplits(const FileInfo& file);
+
+  // Returns the number of splits to make for a file of 'fileSize' bytes.
+  int64_t numSplitsForFile(uint64_t fileSize) const;
+
   const SplitOptions options_;
   const velox::dwio::common::FileFormat format_;
   const std::string connectorId_;
   std::vector<const FileInfo*> files_;
   std::vector<std::shared_ptr<velox::connector::ConnectorSplit>> fileSplits_;
+
+  // Number of rows in each of 'fileSplits_'. 0 if not known.
+  std::vector<uint64_t> fileSplitRows_;
   int32_t currentFile_{-1};
   int32_t currentSplit_{0};
+
+  // Number of rows in the splits returned so far. Compared to
+  // 'options_.maxRows'.
+  uint64_t numRows_{0};
 };
 
 class LocalHiveConnectorMetadata;
@@ -249,6 +295,12 @@ class LocalHiveConnectorMetadata : public HiveConnectorMetadata {
       const ConnectorWriteHandlePtr& handle,
       const ConnectorSessionPtr& session) override;
 
+  /// Combines the row counts and column statistics of the files of
+  /// 'layout'.
+  std::optional<std::vector<velox::Variant>> aggregateFromMetadata(
+      const TableLayout& layout,
+      const std::vector<MetadataAggregate>& aggregates) override;
+
   std::string tablePath(std::string_view table) const override {
     return fmt::format("{}/{}", hiveConfig_->hiveLocalDataPath(), table);
   }
@@ -258,6 +258,74 @@ TEST_F(LocalHiveConnectorMetadataTest, basic) {
   EXPECT_EQ(250'000, pair.second);
 }
 
+TEST_F(LocalHiveConnectorMetadataTest, stripeAlignedSplits) {
+  auto table = metadata_->findTable("T");
+  ASSERT_TRUE(table != nullptr);
+  const auto* layout = getLayout(table);
+
+  folly::F14FastMap<std::string, const FileInfo*> files;
+  for (const auto& file : layout->files()) {
+    ASSERT_TRUE(file->size.has_value());
+    ASSERT_FALSE(file->stripes.empty());
+    uint64_t numRows = 0;
+    for (const auto& stripe : file->stripes) {
+      numRows += stripe.numRows;
+    }
+    EXPECT_EQ(kNumVectors * kRowsPerVector, numRows);
+    files[file->path] = file.get();
+  }
+
+  auto columnHandle = metadata_->createColumnHandle(*layout, "c0");
+  std::vector<core::TypedExprPtr> rejectedFilters;
+  auto tableHandle = metadata_->createTableHandle(
+      *layout,
+      {columnHandle},
+      *metadata_->connectorQueryCtx()->expressionEvaluator(),
+      {},
+      rejectedFilters);
+
+  // Ask for more splits than there are stripes. Each split must start at the
+  // beginning of the file or of a stripe and the splits of a file must cover
+  // it without gaps.
+  auto* splitManager = metadata_->splitManager();
+  auto source = splitManager->getSplitSource(
+      tableHandle,
+      splitManager->listPartitions(tableHandle),
+      SplitOptions{.targetSplitCount = 1'000, .fileBytesPerSplit = 1});
+  folly::F14FastMap<std::string, uint64_t> coveredBytes;
+  for (;;) {
+    auto splits = source->getSplits(std::numeric_limits<uint64_t>::max());
+    if (splits.back().split == nullptr) {
+      splits.pop_back();
+    }
+    if (splits.empty()) {
+      break;
+    }
+    for (const auto& split : splits) {
+      auto* hiveSplit =
+          dynamic_cast<const velox::connector::hive::HiveConnectorSplit*>(
+              split.split.get());
+      ASSERT_TRUE(hiveSplit != nullptr);
+      const auto* file = files.at(hiveSplit->filePath);
+      EXPECT_EQ(coveredBytes[hiveSplit->filePath], hiveSplit->start);
+      if (hiveSplit->start > 0) {
+        EXPECT_TRUE(std::any_of(
+            file->stripes.begin(),
+            file->stripes.end(),
+            [&](const auto& stripe) {
+              return stripe.offset == hiveSplit->start;
+            }));
+      }
+      coveredBytes[hiveSplit->filePath] += hiveSplit->length;
+    }
+  }
+
+  EXPECT_EQ(kNumFiles, coveredBytes.size());
+  for (const auto& [path, bytes] : coveredBytes) {
+    EXPECT_EQ(files.at(path)->size.value(), bytes);
+  }
+}
+
 TEST_F(LocalHiveConnectorMetadataTest, createTable) {
   auto tableType = ROW(
       {{"key1", BIGINT()},
@@ -48,6 +48,29 @@ TestTable::TestTable(
   pool_ = velox::memory::memoryManager()->addLeafPool(name_ + "_table");
 }
 
+void TestTable::addLookupLayout(
+    const std::string& name,
+    const std::vector<std::string>& lookupKeys,
+    bool unique) {
+  std::vector<const Column*> keys;
+  keys.reserve(lookupKeys.size());
+  for (const auto& key : lookupKeys) {
+    auto it = columns_.find(key);
+    VELOX_CHECK(
+        it != columns_.end(), "no lookup key {} in table {}", key, name_);
+    keys.push_back(it->second);
+  }
+  auto layout = std::make_unique<TestTableLayout>(
+      name,
+      this,
+      connector_,
+      layouts_[0]->columns(),
+      std::move(keys),
+      unique);
+  layouts_.push_back(layout.get());
+  exportedLayouts_.push_back(std::move(layout));
+}
+
 std::vector<SplitSource::SplitAndGroup> TestSplitSource::getSplits(uint64_t) {
   std::vector<SplitAndGroup> result;
   if (currentPartition_ >= partitions_.size()) {
@@ -105,9 +128,10 @@ TestConnectorMetadata::createTableHandle(
     std::vector<velox::core::TypedExprPtr> filters,
     std::vector<velox::core::TypedExprPtr>& rejectedFilters,
     velox::RowTypePtr /* dataColumns */,
-    std::optional<LookupKeys>) {
+    std::optional<LookupKeys> lookupKeys) {
   rejectedFilters = std::move(filters);
-  return std::make_shared<TestTableHandle>(layout, std::move(columnHandles));
+  return std::make_shared<TestTableHandle>(
+      layout, std::move(columnHandles), {}, std::move(lookupKeys));
 }
 
 std::shared_ptr<TestTable> TestConnectorMetadata::addTable(
@@ -190,6 +214,139 @@ void TestDataSource::addDynamicFilter(
   VELOX_NYI("TestDataSource does not support dynamic filters");
 }
 
+namespace {
+
+// Returns the rows of a lookup result in batches of the requested size.
+class TestLookupResultIterator
+    : public velox::connector::IndexSource::LookupResultIterator {
+ public:
+  TestLookupResultIterator(
+      velox::BufferPtr inputHits,
+      velox::RowVectorPtr output,
+      velox::memory::MemoryPool* pool)
+      : inputHits_(std::move(inputHits)),
+        output_(std::move(output)),
+        pool_(pool) {}
+
+  std::optional<
+      std::unique_ptr<velox::connector::IndexSource::LookupResult>>
+  next(velox::vector_size_t size, velox::ContinueFuture&) override {
+    if (offset_ >= output_->size()) {
+      return nullptr;
+    }
+    const auto numRows = std::min(size, output_->size() - offset_);
+    auto inputHits = velox::allocateIndices(numRows, pool_);
+    std::memcpy(
+        inputHits->asMutable<velox::vector_size_t>(),
+        inputHits_->as<velox::vector_size_t>() + offset_,
+        numRows * sizeof(velox::vector_size_t));
+    auto output = std::static_pointer_cast<velox::RowVector>(
+        output_->slice(offset_, numRows));
+    offset_ += numRows;
+    return std::make_unique<velox::connector::IndexSource::LookupResult>(
+        std::move(inputHits), std::move(output));
+  }
+
+ private:
+  const velox::BufferPtr inputHits_;
+  const velox::RowVectorPtr output_;
+  velox::memory::MemoryPool* pool_;
+  velox::vector_size_t offset_{0};
+};
+
+} // namespace
+
+TestIndexSource::TestIndexSource(
+    const velox::RowTypePtr& outputType,
+    const std::vector<std::string>& keys,
+    const velox::connector::ColumnHandleMap& handles,
+    TablePtr table,
+    velox::memory::MemoryPool* pool)
+    : outputType_(outputType), pool_(pool) {
+  auto maybeTable = std::dynamic_pointer_cast<const TestTable>(table);
+  VELOX_CHECK(maybeTable, "table {} not a TestTable", table->name());
+  data_ = maybeTable->data();
+
+  auto tableType = table->type();
+  for (const auto& key : keys) {
+    const auto idx = tableType->getChildIdxIfExists(key);
+    VELOX_CHECK(
+        idx.has_value(),
+        "lookup key '{}' not found in table '{}'.",
+        key,
+        table->name());
+    keyMappings_.emplace_back(idx.value());
+  }
+
+  outputMappings_.reserve(outputType_->size());
+  for (const auto& name : outputType->names()) {
+    VELOX_CHECK(
+        handles.contains(name),
+        "no handle for output column {} for table {}",
+        name,
+        table->name());
+    auto handle = handles.find(name)->second;
+
+    const auto idx = tableType->getChildIdxIfExists(handle->name());
+    VELOX_CHECK(
+        idx.has_value(),
+        "column '{}' not found in table '{}'.",
+        handle->name(),
+        table->name());
+    outputMappings_.emplace_back(idx.value());
+  }
+}
+
+std::shared_ptr<velox::connector::IndexSource::LookupResultIterator>
+TestIndexSource::lookup(const LookupRequest& request) {
+  const auto& input = request.input;
+  VELOX_CHECK_GE(input->childrenSize(), keyMappings_.size());
+
+  // Each hit is an input row, a batch of the table and a row of the batch. The
+  // hits are in the order of the input rows.
+  std::vector<std::tuple<velox::vector_size_t, size_t, velox::vector_size_t>>
+      hits;
+  for (velox::vector_size_t row = 0; row < input->size(); ++row) {
+    for (size_t batch = 0; batch < data_.size(); ++batch) {
+      const auto& data = data_[batch];
+      for (velox::vector_size_t dataRow = 0; dataRow < data->size();
+           ++dataRow) {
+        bool match = true;
+        for (auto i = 0; i < keyMappings_.size() && match; ++i) {
+          const auto& key = input->childAt(i);
+          match = !key->isNullAt(row) &&
+              key->equalValueAt(
+                  data->childAt(keyMappings_[i]).get(), row, dataRow);
+        }
+        if (match) {
+          hits.emplace_back(row, batch, dataRow);
+        }
+      }
+    }
+  }
+
+  const auto numHits = static_cast<velox::vector_size_t>(hits.size());
+  auto inputHits = velox::allocateIndices(numHits, pool_);
+  auto* rawInputHits = inputHits->asMutable<velox::vector_size_t>();
+  std::vector<velox::VectorPtr> children;
+  children.reserve(outputMappings_.size());
+  for (const auto& type : outputType_->children()) {
+    children.push_back(velox::BaseVector::create(type, numHits, pool_));
+  }
+  for (velox::vector_size_t i = 0; i < numHits; ++i) {
+    const auto [row, batch, dataRow] = hits[i];
+    rawInputHits[i] = row;
+    for (auto j = 0; j < outputMappings_.size(); ++j) {
+      children[j]->copy(
+          data_[batch]->childAt(outputMappings_[j]).get(), i, dataRow, 1);
+    }
+  }
+  auto output = std::make_shared<velox::RowVector>(
+      pool_, outputType_, nullptr, numHits, std::move(children));
+  return std::make_shared<TestLookupResultIterator>(
+      std::move(inputHits), std::move(output), pool_);
+}
+
 std::unique_ptr<velox::connector::DataSource> TestConnector::createDataSource(
     const velox::RowTypePtr& outputType,
     const velox::connector::ConnectorTableHandlePtr& tableHandle,
@@ -204,6 +361,34 @@ std::unique_ptr<velox::connector::DataSource> TestConnector::createDataSource(
       outputType, columnHandles, table, connectorQueryCtx->memoryPool());
 }
 
+std::shared_ptr<velox::connector::IndexSource>
+TestConnector::createIndexSource(
+    const velox::RowTypePtr& /* inputType */,
+    size_t numJoinKeys,
+    const std::vector<velox::core::IndexLookupConditionPtr>& joinConditions,
+    const velox::RowTypePtr& outputType,
+    const velox::connector::ConnectorTableHandlePtr& tableHandle,
+    const velox::connector::ColumnHandleMap& columnHandles,
+    velox::connector::ConnectorQueryCtx* connectorQueryCtx) {
+  if (!joinConditions.empty()) {
+    VELOX_NYI("TestConnector supports only equality lookups");
+  }
+  auto handle = std::dynamic_pointer_cast<const TestTableHandle>(tableHandle);
+  VELOX_CHECK(
+      handle != nullptr && handle->lookupKeys().has_value(),
+      "no lookup keys for table {}",
+      tableHandle->name());
+  const auto& keys = handle->lookupKeys()->equalityColumns;
+  VELOX_CHECK_EQ(numJoinKeys, keys.size());
+  auto table = metadata_->findTable(tableHandle->name());
+  VELOX_CHECK(
+      table,
+      "cannot create index source for nonexistent table {}",
+      tableHandle->name());
+  return std::make_shared<TestIndexSource>(
+      outputType, keys, columnHandles, table, connectorQueryCtx->memoryPool());
+}
+
 std::unique_ptr<velox::connector::DataSink> TestConnector::createDataSink(
     velox::RowTypePtr,
     velox::connector::ConnectorInsertTableHandlePtr tableHandle,
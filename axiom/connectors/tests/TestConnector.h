@@ -25,14 +25,18 @@ class TestConnector;
 
 /// The Table and Connector objects to which this layout correspond
 /// are specified explicitly at init time. The sample API is
-/// overridden to provide placeholder counts.
+/// overridden to provide placeholder counts. A layout with
+/// 'lookupKeys' serves index lookups on these keys, which are unique if
+/// 'lookupKeysUnique' is true.
 class TestTableLayout : public TableLayout {
  public:
   TestTableLayout(
       const std::string& name,
       Table* table,
       velox::connector::Connector* connector,
-      std::vector<const Column*> columns)
+      std::vector<const Column*> columns,
+      std::vector<const Column*> lookupKeys = {},
+      bool lookupKeysUnique = false)
       : TableLayout(
             name,
             table,
@@ -41,8 +45,13 @@ class TestTableLayout : public TableLayout {
             /*partitionColumns=*/{},
             /*orderColumns=*/{},
             /*sortOrder=*/{},
-            /*lookupKeys=*/{},
-            /*supportsScan=*/true) {}
+            std::move(lookupKeys),
+            /*supportsScan=*/true),
+        lookupKeysUnique_(lookupKeysUnique) {}
+
+  bool lookupKeysUnique() const override {
+    return lookupKeysUnique_;
+  }
 
   std::pair<int64_t, int64_t> sample(
       const velox::connector::ConnectorTableHandlePtr&,
@@ -54,6 +63,9 @@ class TestTableLayout : public TableLayout {
       std::vector<ColumnStatistics>*) const override {
     return std::make_pair(1'000, 1'000);
   }
+
+ private:
+  const bool lookupKeysUnique_;
 };
 
 /// RowVectors are appended using the addData() interface and the vector
@@ -89,6 +101,14 @@ class TestTable : public Table {
     return data_;
   }
 
+  /// Adds a layout with all columns of the table that serves index lookups
+  /// on 'lookupKeys'. If 'unique' is true, the data must have at most one row
+  /// per key. Must be called before the table is used in a query.
+  void addLookupLayout(
+      const std::string& name,
+      const std::vector<std::string>& lookupKeys,
+      bool unique = false);
+
   /// Copy the specified RowVector into the internal data of the
   /// table. The underlying types of the columns must match the
   /// schema specified during initial table creation.
@@ -179,11 +199,13 @@ class TestTableHandle : public velox::connector::ConnectorTableHandle {
   TestTableHandle(
       const TableLayout& layout,
       std::vector<velox::connector::ColumnHandlePtr> columnHandles,
-      std::vector<velox::core::TypedExprPtr> filters = {})
+      std::vector<velox::core::TypedExprPtr> filters = {},
+      std::optional<LookupKeys> lookupKeys = std::nullopt)
       : ConnectorTableHandle(layout.connector()->connectorId()),
         layout_(layout),
         columnHandles_(std::move(columnHandles)),
-        filters_(std::move(filters)) {}
+        filters_(std::move(filters)),
+        lookupKeys_(std::move(lookupKeys)) {}
 
   const std::string& name() const override {
     return layout_.table().name();
@@ -205,10 +227,20 @@ class TestTableHandle : public velox::connector::ConnectorTableHandle {
     return columnHandles_;
   }
 
+  /// The keys for an index lookup. Not set for scans.
+  const std::optional<LookupKeys>& lookupKeys() const {
+    return lookupKeys_;
+  }
+
+  bool supportsIndexLookup() const override {
+    return lookupKeys_.has_value();
+  }
+
  private:
   const TableLayout& layout_;
   const std::vector<velox::connector::ColumnHandlePtr> columnHandles_;
   const std::vector<velox::core::TypedExprPtr> filters_;
+  const std::optional<LookupKeys> lookupKeys_;
 };
 
 /// The TestInsertTableHandle should be populated using the table
@@ -332,6 +364,34 @@ class TestDataSource : public velox::connector::DataSource {
   uint64_t idx_{0};
 };
 
+/// Looks up the rows of a TestTable that are equal to the input on a prefix of
+/// the lookup keys of its layout. Each input row is compared with every row of
+/// the table, so this is for small tables.
+class TestIndexSource : public velox::connector::IndexSource {
+ public:
+  TestIndexSource(
+      const velox::RowTypePtr& outputType,
+      const std::vector<std::string>& keys,
+      const velox::connector::ColumnHandleMap& handles,
+      TablePtr table,
+      velox::memory::MemoryPool* pool);
+
+  std::shared_ptr<LookupResultIterator> lookup(
+      const LookupRequest& request) override;
+
+  std::unordered_map<std::string, velox::RuntimeMetric> runtimeStats()
+      override {
+    return {};
+  }
+
+ private:
+  const velox::RowTypePtr outputType_;
+  velox::memory::MemoryPool* pool_;
+  std::vector<velox::RowVectorPtr> data_;
+  std::vector<velox::column_index_t> keyMappings_;
+  std::vector<velox::column_index_t> outputMappings_;
+};
+
 /// Contains an embedded TestConnectorMetadata to which TestTables are
 /// added at runtime using the addTable API. Data is appended to a
 /// TestTable via the appendData method. createDataSource creates a
@@ -360,12 +420,27 @@ class TestConnector : public velox::connector::Connector {
     return false;
   }
 
+  bool supportsIndexLookup() const override {
+    return true;
+  }
+
   std::unique_ptr<velox::connector::DataSource> createDataSource(
       const velox::RowTypePtr& outputType,
       const velox::connector::ConnectorTableHandlePtr& tableHandle,
       const velox::connector::ColumnHandleMap& columnHandles,
       velox::connector::ConnectorQueryCtx* connectorQueryCtx) override;
 
+  /// Supports equality lookups on a prefix of the lookup keys of a
+  /// TestTableLayout. 'joinConditions' must be empty.
+  std::shared_ptr<velox::connector::IndexSource> createIndexSource(
+      const velox::RowTypePtr& inputType,
+      size_t numJoinKeys,
+      const std::vector<velox::core::IndexLookupConditionPtr>& joinConditions,
+      const velox::RowTypePtr& outputType,
+      const velox::connector::ConnectorTableHandlePtr& tableHandle,
+      const velox::connector::ColumnHandleMap& columnHandles,
+      velox::connector::ConnectorQueryCtx* connectorQueryCtx) override;
+
   std::unique_ptr<velox::connector::DataSink> createDataSink(
       velox::RowTypePtr inputType,
       velox::connector::ConnectorInsertTableHandlePtr
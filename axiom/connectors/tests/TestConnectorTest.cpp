@@ -208,6 +208,83 @@ TEST_F(TestConnectorTest, dataSource) {
   EXPECT_EQ(result.value(), nullptr);
 }
 
+TEST_F(TestConnectorTest, indexSource) {
+  auto schema = ROW({"a", "b"}, {INTEGER(), VARCHAR()});
+  auto table = connector_->addTable("table", schema);
+  table->addLookupLayout("table_a", {"a"});
+  ASSERT_EQ(2, table->layouts().size());
+  auto& layout = *table->layouts()[1];
+  ASSERT_EQ(1, layout.lookupKeys().size());
+  EXPECT_EQ("a", layout.lookupKeys()[0]->name());
+
+  connector_->appendData(
+      "table",
+      makeRowVector(
+          {makeFlatVector<int>({0, 1, 1}),
+           makeFlatVector<StringView>({"a", "b", "c"})}));
+  connector_->appendData(
+      "table",
+      makeRowVector(
+          {makeFlatVector<int>({3}), makeFlatVector<StringView>({"d"})}));
+
+  std::vector<velox::connector::ColumnHandlePtr> columns;
+  columns.push_back(metadata_->createColumnHandle(layout, "a"));
+  columns.push_back(metadata_->createColumnHandle(layout, "b"));
+  auto evaluator =
+      std::make_unique<exec::SimpleExpressionEvaluator>(nullptr, nullptr);
+  std::vector<core::TypedExprPtr> empty;
+  auto tableHandle = metadata_->createTableHandle(
+      layout,
+      std::move(columns),
+      *evaluator,
+      empty,
+      empty,
+      nullptr,
+      LookupKeys{.equalityColumns = {"a"}});
+  EXPECT_TRUE(tableHandle->supportsIndexLookup());
+  const auto& lookupKeys =
+      std::dynamic_pointer_cast<const TestTableHandle>(tableHandle)
+          ->lookupKeys();
+  ASSERT_TRUE(lookupKeys.has_value());
+  EXPECT_EQ(std::vector<std::string>{"a"}, lookupKeys->equalityColumns);
+
+  velox::connector::ColumnHandleMap handleMap;
+  handleMap.emplace("b", metadata_->createColumnHandle(layout, "b"));
+  auto indexSource = std::make_shared<TestIndexSource>(
+      ROW({"b"}, {VARCHAR()}),
+      lookupKeys->equalityColumns,
+      handleMap,
+      table,
+      pool());
+
+  // Input rows 0 and 2 have no match. The hits are in the order of the input.
+  auto iterator =
+      indexSource->lookup(velox::connector::IndexSource::LookupRequest(
+          makeRowVector({makeFlatVector<int>({2, 1, 5, 3})})));
+  velox::ContinueFuture future;
+  auto result = iterator->next(2, future);
+  ASSERT_TRUE(result.has_value());
+  ASSERT_NE(nullptr, result.value());
+  auto* inputHits = result.value()->inputHits->as<vector_size_t>();
+  EXPECT_EQ(1, inputHits[0]);
+  EXPECT_EQ(1, inputHits[1]);
+  test::assertEqualVectors(
+      makeRowVector({"b"}, {makeFlatVector<StringView>({"b", "c"})}),
+      result.value()->output);
+
+  result = iterator->next(2, future);
+  ASSERT_TRUE(result.has_value());
+  ASSERT_NE(nullptr, result.value());
+  EXPECT_EQ(3, result.value()->inputHits->as<vector_size_t>()[0]);
+  test::assertEqualVectors(
+      makeRowVector({"b"}, {makeFlatVector<StringView>({"d"})}),
+      result.value()->output);
+
+  result = iterator->next(2, future);
+  ASSERT_TRUE(result.has_value());
+  EXPECT_EQ(nullptr, result.value());
+}
+
 TEST_F(TestConnectorTest, testColumnHandleCreation) {
   auto columnHandle = std::make_shared<TestColumnHandle>("col", INTEGER());
   EXPECT_EQ(columnHandle->name(), "col");
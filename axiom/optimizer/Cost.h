@@ -28,6 +28,33 @@ struct NodePrediction {
   float peakMemory{0};
 };
 
+/// Result of sampling a join of two tables.
+struct JoinSample {
+  /// Number of hits on the left for one row on the right.
+  float rlFanout{0};
+
+  /// Number of hits on the right for one row on the left.
+  float lrFanout{0};
+
+  /// Fraction of the left rows that have the most frequent key if this key is
+  /// a heavy hitter, else 0. A partitioned join sends all rows with this key
+  /// to the same worker.
+  float leftSkew{0};
+
+  /// Fraction of the right rows that have the most frequent key if this key
+  /// is a heavy hitter, else 0.
+  float rightSkew{0};
+
+  /// Returns 'this' with left and right swapped.
+  JoinSample reverse() const {
+    return {
+        .rlFanout = lrFanout,
+        .lrFanout = rlFanout,
+        .leftSkew = rightSkew,
+        .rightSkew = leftSkew};
+  }
+};
+
 /// Interface to historical query cost and cardinality
 /// information. There is one long lived instance per
 /// process. Public functions are thread safe since multiple
@@ -58,7 +85,7 @@ class History {
 
   virtual void recordJoinSample(std::string_view key, float lr, float rl) = 0;
 
-  virtual std::pair<float, float> sampleJoin(JoinEdge* edge) = 0;
+  virtual JoinSample sampleJoin(JoinEdge* edge) = 0;
 
   virtual void recordLeafSelectivity(
       std::string_view handle,
@@ -103,6 +130,23 @@ struct Costs {
                                : kLargeHashCost;
   }
 
+  /// Returns the cost of the work held up by a partitioned hash join over
+  /// 'numWorkers' whose probe side has 'probeRows' rows and a most frequent
+  /// key with 'skew' of the rows. The worker that gets this key processes at
+  /// least 'skew' of the rows while the others wait. An even share of
+  /// 1 / 'numWorkers' holds up nothing. 'probeRowCost' is the cost of
+  /// shuffling and probing one row.
+  static float skewCost(
+      float probeRows,
+      float probeRowCost,
+      float skew,
+      int32_t numWorkers) {
+    const float excess =
+        std::max(0.F, skew - 1.F / static_cast<float>(numWorkers));
+    return probeRows * probeRowCost * excess *
+        static_cast<float>(numWorkers - 1);
+  }
+
   static constexpr float kKeyCompareCost =
       6; // ~30 instructions to find, decode and an compare
   static constexpr float kArrayProbeCost = 2; // ~10 instructions.
@@ -137,14 +181,36 @@ float selfCost(ExprCP expr);
 /// 'notCounting', which represents already computed subtrees of 'expr'.
 float costWithChildren(ExprCP expr, const PlanObjectSet& notCounting);
 
+/// Returns the fraction of the 'numRows' rows of a table that have the most
+/// frequent key of a join sample if this is over 1%, else 0. 'counts' maps
+/// the hash of each sampled key to its number of rows. The sample has all
+/// rows of the keys whose hash is in the sampled range, so a sampled heavy
+/// hitter has its full count. A heavy hitter outside the range is missed: a
+/// sample of 1/n of the hash range finds a given hot key with probability
+/// 1/n.
+float sampleSkew(
+    const folly::F14FastMap<uint32_t, uint32_t>& counts,
+    uint64_t numRows);
+
 /// Samples the join of 'left' and 'right' on 'leftKeys' and
 /// 'rightKeys'. Returns the number of hits on the right for one row
-/// of left and the number of hits on the left for one row on the
-/// right.
-std::pair<float, float> sampleJoin(
+/// of left, the number of hits on the left for one row on the
+/// right and the skew of the keys on either side.
+JoinSample sampleJoin(
     SchemaTableCP left,
     const ExprVector& leftKeys,
     SchemaTableCP right,
     const ExprVector& rightKeys);
 
+/// Samples the values of 'column' of 'table' and returns up to 'numSplitters'
+/// non-null values that divide the sample into ranges of about equal size
+/// when sorted by 'orderType'. The values are distinct and sorted by
+/// 'orderType'. Returns nullptr if the sample has too few distinct values.
+velox::VectorPtr sampleSplitters(
+    SchemaTableCP table,
+    ColumnCP column,
+    OrderType orderType,
+    int32_t numSplitters,
+    velox::memory::MemoryPool& pool);
+
 } // namespace facebook::axiom::optimizer
@@ -430,8 +430,8 @@ JoinEdgeP importedJoin(
   return newJoin;
 }
 
-// Returns a copy of 'expr', replacing instances of columns in 'outer' with
-// the corresponding expression from 'inner'
+} // namespace
+
 ExprCP
 importExpr(ExprCP expr, const ColumnVector& outer, const ExprVector& inner) {
   if (!expr) {
@@ -501,8 +501,6 @@ importExpr(ExprCP expr, const ColumnVector& outer, const ExprVector& inner) {
   }
 }
 
-} // namespace
-
 void DerivedTable::importJoinsIntoFirstDt(const DerivedTable* firstDt) {
   if (tables.size() == 1 && tables[0]->is(PlanType::kDerivedTableNode)) {
     flattenDt(tables[0]->as<DerivedTable>());
@@ -240,4 +240,9 @@ struct DerivedTable : public PlanObject {
 using DerivedTableP = DerivedTable*;
 using DerivedTableCP = const DerivedTable*;
 
+/// Returns a copy of 'expr', replacing instances of columns in 'outer' with
+/// the corresponding expression from 'inner'.
+ExprCP
+importExpr(ExprCP expr, const ColumnVector& outer, const ExprVector& inner);
+
 } // namespace facebook::axiom::optimizer
@@ -88,6 +88,11 @@ bool FunctionRegistry::registerReversibleFunction(std::string_view name) {
   return reversibleFunctions_.emplace(name, name).second;
 }
 
+bool FunctionRegistry::registerNullPropagatingFunction(std::string_view name) {
+  VELOX_USER_CHECK(!name.empty());
+  return nullPropagatingFunctions_.emplace(name).second;
+}
+
 // static
 FunctionRegistry* FunctionRegistry::instance() {
   static std::unique_ptr<FunctionRegistry> registry{new FunctionRegistry{}};
@@ -212,6 +217,23 @@ void FunctionRegistry::registerPrestoFunctions(std::string_view prefix) {
   registry->registerReversibleFunction(fullName("plus"));
   registry->registerReversibleFunction(fullName("multiply"));
 
+  for (const auto* name :
+       {"eq",
+        "neq",
+        "lt",
+        "gt",
+        "lte",
+        "gte",
+        "between",
+        "plus",
+        "minus",
+        "multiply",
+        "divide",
+        "mod",
+        "negate"}) {
+    registry->registerNullPropagatingFunction(fullName(name));
+  }
+
   // Presto special form functions created without prefix, so we register them
   // without prefix too.
   registry->registerSpecialForm(lp::SpecialForm::kAnd, velox::expression::kAnd);
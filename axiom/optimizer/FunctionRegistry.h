@@ -15,6 +15,7 @@
  */
 #pragma once
 
+#include <folly/container/F14Set.h>
 #include "axiom/logical_plan/Expr.h"
 #include "axiom/optimizer/QueryGraphContext.h"
 
@@ -218,6 +219,11 @@ class FunctionRegistry {
     return reversibleFunctions_;
   }
 
+  /// @return the functions that return null if any argument is null.
+  const folly::F14FastSet<std::string>& nullPropagatingFunctions() const {
+    return nullPropagatingFunctions_;
+  }
+
   /// Registers function 'name' with specified 'metadata' if 'name' is not
   /// already registered.
   /// @return true if registered 'name' successfully, false otherwise.
@@ -269,11 +275,18 @@ class FunctionRegistry {
       std::string_view name,
       std::string_view reverseName);
 
+  /// Registers a function that returns null if any of its arguments is null.
+  /// For example, eq and plus but not coalesce or is_null.
+  /// @return true if registered 'name' successfully, false if 'name' is
+  /// already registered.
+  bool registerNullPropagatingFunction(std::string_view name);
+
   static FunctionRegistry* instance();
 
   /// Registers Presto functions transform, transform_values, zip, and
   /// row_constructor along with metadata. Registers reversible Presto functions
-  /// eq, lt, gt, lte, gte, plus, multiply, and, or.
+  /// eq, lt, gt, lte, gte, plus, multiply, and, or. Registers comparisons and
+  /// arithmetic as null-propagating.
   static void registerPrestoFunctions(std::string_view prefix = "");
 
  private:
@@ -283,6 +296,7 @@ class FunctionRegistry {
   std::optional<std::string> subscript_;
   std::optional<std::string> cardinality_;
   folly::F14FastMap<std::string, std::string> reversibleFunctions_;
+  folly::F14FastSet<std::string> nullPropagatingFunctions_;
   folly::F14FastMap<logical_plan::SpecialForm, std::string> specialForms_;
 };
 
@@ -99,11 +99,15 @@ std::shared_ptr<velox::core::QueryCtx> sampleQueryCtx(
       fmt::format("sample:{}", ++kQueryCounter));
 }
 
+// Returns a runner that produces the hash of 'keys' for the rows of 'table'
+// where (hash % mod) < lim. If 'withKeys' is true, the keys follow the hash in
+// the output. The keys must then be columns.
 std::shared_ptr<runner::Runner> prepareSampleRunner(
     SchemaTableCP table,
     const ExprVector& keys,
     int64_t mod,
-    int64_t lim) {
+    int64_t lim,
+    bool withKeys = false) {
   static folly::once_flag kInitialized;
   static const char* kHash = "$internal$hash";
   static const char* kHashMix = "$internal$hash_mix";
@@ -150,17 +154,29 @@ std::shared_ptr<runner::Runner> prepareSampleRunner(
       make<Call>(toName(kHashMix), bigintValue(), hashes, FunctionSet{});
 
   ColumnCP hashColumn = make<Column>(toName("hash"), nullptr, hash->value());
+  ExprVector exprs{hash};
+  ColumnVector outputColumns{hashColumn};
+  if (withKeys) {
+    for (const auto& key : keys) {
+      VELOX_CHECK(key->is(PlanType::kColumnExpr));
+      exprs.push_back(key);
+      outputColumns.push_back(key->as<Column>());
+    }
+  }
   RelationOpPtr project = make<Project>(
-      scan, ExprVector{hash}, ColumnVector{hashColumn}, /*redundant=*/false);
+      scan, std::move(exprs), std::move(outputColumns), /*redundant=*/false);
 
   // (hash % mod) < lim
   ExprCP filterExpr = makeCall(
       kSample, velox::BOOLEAN(), hashColumn, bigintLit(mod), bigintLit(lim));
   RelationOpPtr filter = make<Filter>(project, ExprVector{filterExpr});
 
-  auto plan = queryCtx()->optimization()->toVeloxPlan(filter);
+  // A separate ToVelox, so that sampling can run while a plan is translated.
+  auto* optimization = queryCtx()->optimization();
+  ToVelox toVelox(optimization->runnerOptions(), optimization->options());
+  auto plan = toVelox.toVeloxPlan(filter, optimization->runnerOptions());
   return std::make_shared<runner::LocalRunner>(
-      plan.plan, sampleQueryCtx(*queryCtx()->optimization()->veloxQueryCtx()));
+      plan.plan, sampleQueryCtx(*optimization->veloxQueryCtx()));
 }
 
 // Maps hash value to number of times it appears in a table.
@@ -205,6 +221,14 @@ float freqs(const KeyFreq& left, const KeyFreq& right) {
   return hits / static_cast<float>(left.size());
 }
 
+velox::CompareFlags compareFlags(OrderType orderType) {
+  return {
+      .nullsFirst = orderType == OrderType::kAscNullsFirst ||
+          orderType == OrderType::kDescNullsFirst,
+      .ascending = orderType == OrderType::kAscNullsFirst ||
+          orderType == OrderType::kAscNullsLast};
+}
+
 float keyCardinality(const ExprVector& keys) {
   float cardinality = 1;
   for (auto& key : keys) {
@@ -214,7 +238,29 @@ float keyCardinality(const ExprVector& keys) {
 }
 } // namespace
 
-std::pair<float, float> sampleJoin(
+float sampleSkew(
+    const folly::F14FastMap<uint32_t, uint32_t>& counts,
+    uint64_t numRows) {
+  constexpr float kMinSkew = 0.01;
+
+  // The sample is a fraction of the table. Its size bounds 'numRows' from
+  // below in case the table stats are stale.
+  uint64_t numSampled = 0;
+  uint32_t maxCount = 0;
+  for (const auto& [_, count] : counts) {
+    numSampled += count;
+    maxCount = std::max(maxCount, count);
+  }
+  numRows = std::max(numRows, numSampled);
+  if (numRows == 0) {
+    return 0;
+  }
+  const auto fraction =
+      static_cast<float>(maxCount) / static_cast<float>(numRows);
+  return fraction > kMinSkew ? fraction : 0;
+}
+
+JoinSample sampleJoin(
     SchemaTableCP left,
     const ExprVector& leftKeys,
     SchemaTableCP right,
@@ -237,7 +283,7 @@ std::pair<float, float> sampleJoin(
     fraction =
         static_cast<int32_t>(std::max(2.F, (float)kMaxCardinality / ratio));
   } else {
-    return std::make_pair(0, 0);
+    return {};
   }
 
   auto leftRunner =
@@ -257,8 +303,80 @@ std::pair<float, float> sampleJoin(
 
   auto leftFreq = leftRun->move();
   auto rightFreq = rightRun->move();
-  return std::make_pair(
-      freqs(*rightFreq, *leftFreq), freqs(*leftFreq, *rightFreq));
+  return {
+      .rlFanout = freqs(*rightFreq, *leftFreq),
+      .lrFanout = freqs(*leftFreq, *rightFreq),
+      .leftSkew = sampleSkew(*leftFreq, leftRows),
+      .rightSkew = sampleSkew(*rightFreq, rightRows)};
+}
+
+velox::VectorPtr sampleSplitters(
+    SchemaTableCP table,
+    ColumnCP column,
+    OrderType orderType,
+    int32_t numSplitters,
+    velox::memory::MemoryPool& pool) {
+  static const int64_t kMaxSampleRows = 10'000;
+
+  VELOX_CHECK_GT(numSplitters, 0);
+  const auto numRows = static_cast<int64_t>(table->numRows());
+  const int64_t fraction = numRows <= kMaxSampleRows
+      ? kMaxSampleRows
+      : std::max<int64_t>(1, kMaxSampleRows * kMaxSampleRows / numRows);
+
+  auto runner = prepareSampleRunner(
+      table, {column}, kMaxSampleRows, fraction, /*withKeys=*/true);
+
+  // The sample selects keys by hash and has all rows of each selected key.
+  // Stop at a multiple of the expected size in case of heavy hitters.
+  auto values = velox::BaseVector::create(
+      toTypePtr(column->value().type), 0, &pool);
+  while (auto rows = runner->next()) {
+    const auto& batch = rows->childAt(1);
+    const auto offset = values->size();
+    values->resize(offset + batch->size());
+    values->copy(batch.get(), offset, 0, batch->size());
+    if (values->size() > 10 * kMaxSampleRows) {
+      runner->abort();
+      break;
+    }
+  }
+  runner->waitForCompletion(1'000'000);
+
+  std::vector<velox::vector_size_t> rows;
+  for (auto i = 0; i < values->size(); ++i) {
+    if (!values->isNullAt(i)) {
+      rows.push_back(i);
+    }
+  }
+  if (rows.size() <= numSplitters) {
+    return nullptr;
+  }
+
+  const auto flags = compareFlags(orderType);
+  auto compare = [&](velox::vector_size_t left, velox::vector_size_t right) {
+    return values->compare(values.get(), left, right, flags).value();
+  };
+  std::ranges::sort(
+      rows, [&](auto left, auto right) { return compare(left, right) < 0; });
+
+  std::vector<velox::vector_size_t> splitterRows;
+  for (auto i = 1; i <= numSplitters; ++i) {
+    const auto row = rows[i * rows.size() / (numSplitters + 1)];
+    if (splitterRows.empty() || compare(splitterRows.back(), row) != 0) {
+      splitterRows.push_back(row);
+    }
+  }
+  if (splitterRows.empty()) {
+    return nullptr;
+  }
+
+  auto splitters =
+      velox::BaseVector::create(values->type(), splitterRows.size(), &pool);
+  for (auto i = 0; i < splitterRows.size(); ++i) {
+    splitters->copy(values.get(), i, splitterRows[i], 1);
+  }
+  return splitters;
 }
 
 } // namespace facebook::axiom::optimizer
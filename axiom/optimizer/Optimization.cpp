@@ -21,6 +21,7 @@
 #include "axiom/optimizer/PrecomputeProjection.h"
 #include "axiom/optimizer/VeloxHistory.h"
 #include "velox/expression/Expr.h"
+#include "velox/expression/ScopedVarSetter.h"
 
 namespace facebook::axiom::optimizer {
 
@@ -294,6 +295,12 @@ void forJoinedTables(const PlanState& state, Func func) {
             break;
           }
         }
+        // A filter of a semi or anti join may depend on more left tables.
+        for (auto i = 0; usable && i < join->filter().size(); ++i) {
+          auto tables = join->filter()[i]->allTables();
+          tables.erase(join->rightTable());
+          usable = tables.isSubset(state.placed);
+        }
         if (usable) {
           func(join, join->rightTable(), join->lrFanout());
         }
@@ -514,6 +521,12 @@ RelationOpPtr repartitionForIndex(
 
   const auto& distribution = info.index->distribution;
 
+  // An unpartitioned lookup source serves any key to any worker.
+  if (distribution.partition.empty() && info.index->layout != nullptr &&
+      !info.index->layout->lookupKeys().empty()) {
+    return plan;
+  }
+
   ExprVector keyExprs;
   auto& partition = distribution.partition;
   for (auto key : partition) {
@@ -669,8 +682,499 @@ bool isRedundantProject(
   return true;
 }
 
+// Returns true if the probe side of 'join' should be filtered at run time by
+// the keys of its build side. The join must drop probe rows without a match
+// and keep few of them. The build side must be small since the probe-side
+// scans wait for all of it.
+bool useDynamicFilter(const Join& join, const OptimizerOptions& options) {
+  if (options.dynamicFilterMaxSelectivity <= 0) {
+    return false;
+  }
+  switch (join.joinType) {
+    case velox::core::JoinType::kInner:
+    case velox::core::JoinType::kLeftSemiFilter:
+    case velox::core::JoinType::kRight:
+    case velox::core::JoinType::kRightSemiFilter:
+    case velox::core::JoinType::kRightSemiProject:
+      break;
+    default:
+      return false;
+  }
+  return join.cost().fanout <= options.dynamicFilterMaxSelectivity &&
+      join.right->cost().inputCardinality <= options.dynamicFilterMaxBuildRows;
+}
+
+// Fraction of the probe keys without a match that pass a Bloom filter.
+constexpr float kBloomFalsePositiveRate = 0.03;
+
+// Adds the cost and transfer bytes of the shuffles in 'op' that carry one of
+// 'keys' to 'cost'. Scans producing the keys below such a shuffle are in
+// another fragment than the join, so a filter on the keys applies to them
+// before the shuffle.
+void addShuffleCost(const RelationOp& op, const ExprVector& keys, Cost& cost) {
+  if (op.is(RelType::kRepartition)) {
+    for (const auto* key : keys) {
+      if (std::ranges::find(op.columns(), key) != op.columns().end()) {
+        cost.unitCost += op.cost().inputCardinality * op.cost().unitCost;
+        cost.transferBytes += op.cost().transferBytes;
+        break;
+      }
+    }
+  }
+  if (op.is(RelType::kJoin)) {
+    addShuffleCost(*op.as<Join>()->right, keys, cost);
+  }
+  if (op.input() != nullptr) {
+    addShuffleCost(*op.input(), keys, cost);
+  }
+}
+
+// Returns the cost of the work of 'op' and of its inputs down to the nearest
+// shuffles. This work runs in the same fragment as 'op'.
+float fragmentCost(const RelationOp& op) {
+  if (op.is(RelType::kRepartition)) {
+    return 0;
+  }
+  float cost = op.cost().inputCardinality * op.cost().unitCost;
+  if (op.is(RelType::kJoin)) {
+    cost += fragmentCost(*op.as<Join>()->right);
+  }
+  if (op.input() != nullptr) {
+    cost += fragmentCost(*op.input());
+  }
+  return cost;
+}
+
+// Returns true if a Bloom filter of the build keys should filter the scans on
+// the probe side 'probeInput' of a hash join. The filter pays off if the
+// shuffles of the probe rows it drops cost more than sending the result of the
+// build side 'buildPlan' to the filter as well, inserting its keys and testing
+// the probe keys.
+// If so, replaces the cost of the dropped rows in 'state' with the cost of the
+// filter.
+bool addBloomFilter(
+    velox::core::JoinType joinType,
+    const ExprVector& probeKeys,
+    float joinFanout,
+    const Plan& buildPlan,
+    const RelationOp& probeInput,
+    PlanState& state,
+    const OptimizerOptions& options) {
+  const float buildRows = buildPlan.cost.fanout;
+  if (options.bloomFilterMaxBuildRows <= 0 ||
+      buildRows > options.bloomFilterMaxBuildRows) {
+    return false;
+  }
+  if (joinType != velox::core::JoinType::kInner &&
+      joinType != velox::core::JoinType::kLeftSemiFilter) {
+    return false;
+  }
+  for (const auto* key : probeKeys) {
+    if (!key->is(PlanType::kColumnExpr)) {
+      return false;
+    }
+  }
+
+  Cost shuffles;
+  addShuffleCost(probeInput, probeKeys, shuffles);
+  const float keep = std::min<float>(1, joinFanout + kBloomFalsePositiveRate);
+  const float saving = shuffles.unitCost * (1 - keep);
+  const float probeRows = probeInput.resultCardinality();
+  const float filterCost =
+      buildRows * byteSize(buildPlan.op->columns()) * Costs::byteShuffleCost() +
+      buildRows * Costs::kLargeHashCost +
+      probeRows * Costs::hashProbeCost(buildRows);
+  if (saving <= filterCost) {
+    return false;
+  }
+
+  state.cost.unitCost += filterCost - saving;
+  state.cost.transferBytes -= shuffles.transferBytes * (1 - keep);
+  return true;
+}
+
+// True if all rows of each group of 'keys' are adjacent in one partition of
+// 'plan'. Such input is aggregated in one step without a shuffle.
+bool isGroupedForAggregation(const RelationOp& plan, const ExprVector& keys) {
+  const auto& distribution = plan.distribution();
+  if (!distribution.isGroupedOn(keys)) {
+    return false;
+  }
+  if (isSingleWorker() || distribution.distributionType.isGather) {
+    return true;
+  }
+  return !distribution.partition.empty() &&
+      std::ranges::all_of(distribution.partition, [&](auto part) {
+           return std::ranges::any_of(
+               keys, [&](auto key) { return key->sameOrEqual(*part); });
+         });
+}
+
+// True if 'keys' has an expression equal to 'expr'.
+bool containsKey(const ExprVector& keys, ExprCP expr) {
+  return std::ranges::any_of(
+      keys, [&](auto key) { return key->sameOrEqual(*expr); });
+}
+
+// True if the leading unique keys of 'distribution' are all in 'keys'.
+bool hasUniqueOrderKeys(
+    const Distribution& distribution,
+    const ExprVector& keys) {
+  const auto numUnique = distribution.numKeysUnique;
+  return numUnique > 0 && numUnique <= distribution.orderKeys.size() &&
+      std::all_of(
+             distribution.orderKeys.begin(),
+             distribution.orderKeys.begin() + numUnique,
+             [&](auto key) { return containsKey(keys, key); });
+}
+
+// True if no two rows of 'op' have equal values of 'keys'. Uniqueness comes
+// from the unique keys of a table scan, a table or an aggregation and is
+// kept by operators that add no rows. The unique keys of a distribution are
+// only used for scans and operators that pass rows through, since joins and
+// unnests keep the distribution of their input while adding rows.
+bool isUniqueOn(const RelationOp& op, const ExprVector& keys) {
+  const auto& distribution = op.distribution();
+  switch (op.relType()) {
+    case RelType::kTableScan: {
+      // A TableScan with an input is an index lookup join.
+      const auto* scan = op.as<TableScan>();
+      if (scan->input() != nullptr) {
+        return false;
+      }
+      if (hasUniqueOrderKeys(distribution, keys)) {
+        return true;
+      }
+      ColumnVector columns;
+      for (const auto* key : keys) {
+        if (key->is(PlanType::kColumnExpr) &&
+            key->as<Column>()->relation() == scan->baseTable) {
+          columns.push_back(key->as<Column>());
+        }
+      }
+      return !columns.empty() &&
+          scan->baseTable->schemaTable->isUnique(columns);
+    }
+    case RelType::kAggregation: {
+      const auto* aggregation = op.as<Aggregation>();
+      if (aggregation->step == velox::core::AggregationNode::Step::kPartial) {
+        return false;
+      }
+      return std::ranges::all_of(aggregation->groupingKeys, [&](auto key) {
+        return containsKey(keys, key);
+      });
+    }
+    case RelType::kProject: {
+      if (hasUniqueOrderKeys(distribution, keys)) {
+        return true;
+      }
+      const auto* project = op.as<Project>();
+      ExprVector inputKeys;
+      for (const auto* key : keys) {
+        auto it = std::ranges::find(project->columns(), key);
+        if (it == project->columns().end()) {
+          return false;
+        }
+        inputKeys.push_back(
+            project->exprs()[it - project->columns().begin()]);
+      }
+      return isUniqueOn(*op.input(), inputKeys);
+    }
+    case RelType::kJoin: {
+      const auto* join = op.as<Join>();
+      switch (join->joinType) {
+        case velox::core::JoinType::kLeftSemiFilter:
+        case velox::core::JoinType::kLeftSemiProject:
+        case velox::core::JoinType::kAnti:
+          return isUniqueOn(*op.input(), keys);
+        case velox::core::JoinType::kInner:
+        case velox::core::JoinType::kLeft:
+          // Each row of the input matches at most one row of 'right'.
+          return isUniqueOn(*op.input(), keys) &&
+              isUniqueOn(*join->right, join->rightKeys);
+        default:
+          return false;
+      }
+    }
+    case RelType::kFilter:
+    case RelType::kLimit:
+    case RelType::kOrderBy:
+    case RelType::kRepartition:
+    case RelType::kHashBuild:
+      return !distribution.isBroadcast &&
+          (hasUniqueOrderKeys(distribution, keys) ||
+           isUniqueOn(*op.input(), keys));
+    default:
+      return false;
+  }
+}
+
+// Returns the value of 'aggregate' over a group of one row or nullptr if this
+// is not known. The arguments of 'aggregate' are columns of the input.
+ExprCP singleRowAggregate(AggregateCP aggregate) {
+  if (aggregate->condition() != nullptr) {
+    return nullptr;
+  }
+  std::string_view name = aggregate->name();
+  name = name.substr(name.rfind('.') + 1);
+  const auto& args = aggregate->args();
+  if (name == "count" && args.empty()) {
+    return make<Literal>(
+        Value(toType(velox::BIGINT()), 1),
+        queryCtx()->registerVariant(
+            std::make_unique<velox::Variant>(static_cast<int64_t>(1))));
+  }
+  if (args.size() != 1 ||
+      *args[0]->value().type != *aggregate->value().type) {
+    return nullptr;
+  }
+  if (name == "min" || name == "max" || name == "sum" ||
+      name == "arbitrary" || name == "any_value") {
+    return args[0];
+  }
+  return nullptr;
+}
+
+// Returns the aggregates of 'aggPlan' with arguments and conditions replaced
+// by columns computed in 'precompute'.
+AggregateVector precomputeAggregates(
+    const AggregationPlan& aggPlan,
+    PrecomputeProjection& precompute) {
+  AggregateVector aggregates;
+  aggregates.reserve(aggPlan.aggregates().size());
+
+  for (const auto& agg : aggPlan.aggregates()) {
+    ExprCP condition = nullptr;
+    if (agg->condition()) {
+      condition = precompute.toColumn(agg->condition());
+    }
+    auto args = precompute.toColumns(
+        agg->args(), /*aliases=*/nullptr, /*preserveLiterals=*/true);
+    aggregates.emplace_back(make<Aggregate>(
+        agg->name(),
+        agg->value(),
+        std::move(args),
+        agg->functions(),
+        agg->isDistinct(),
+        condition,
+        agg->intermediateType()));
+  }
+  return aggregates;
+}
+
+// A partial TopN or limit to add below the top of a plan.
+struct LimitPushdown {
+  // Keys of the TopN. Columns of the op the TopN is added over. Empty for a
+  // limit.
+  ExprVector orderKeys;
+  OrderTypeVector orderTypes;
+
+  // Number of rows each driver keeps.
+  int64_t count;
+
+  // Number of rows all drivers together keep.
+  float keptRows;
+};
+
+// Returns the predicted work of 'op' over all its input. Projections and
+// union alls have no cost of their own. The cost of a projection is that of
+// its expressions. A union all copies its rows through a local exchange.
+float totalCost(const RelationOp& op) {
+  auto unitCost = op.cost().unitCost;
+  if (op.is(RelType::kUnionAll)) {
+    unitCost += Costs::kColumnRowCost * static_cast<float>(op.columns().size());
+  } else if (op.is(RelType::kProject)) {
+    PlanObjectSet inputColumns;
+    inputColumns.unionObjects(op.input()->columns());
+    for (const auto* expr : op.as<Project>()->exprs()) {
+      unitCost += costWithChildren(expr, inputColumns);
+    }
+  }
+  return unitCost * op.cost().inputCardinality;
+}
+
+// Returns 'op' with partial TopNs or limits of 'pushdown' added as far below
+// it as the ops in between keep every row of their input. These are
+// projections, left joins, repartitions and union alls. A partial TopN or
+// limit is added where the work it saves in the ops above is more than it
+// costs. 'aboveCost' is the work of the ops between the final TopN or limit
+// and 'op'. Returns nullptr if nothing is added.
+RelationOpPtr addPartialLimits(
+    const RelationOpPtr& op,
+    const LimitPushdown& pushdown,
+    float aboveCost) {
+  auto hasKeys = [&](const RelationOp& input) {
+    return std::ranges::all_of(pushdown.orderKeys, [&](auto key) {
+      return std::ranges::find(input.columns(), key) != input.columns().end();
+    });
+  };
+  const auto inputCost = aboveCost + totalCost(*op);
+
+  switch (op->relType()) {
+    case RelType::kProject: {
+      const auto* project = op->as<Project>();
+      // The keys must be output columns of the projection that are input
+      // columns renamed. Otherwise the limit stays above the projection.
+      auto inputPushdown = pushdown;
+      bool keysAreColumns = true;
+      for (auto& key : inputPushdown.orderKeys) {
+        const auto it = std::ranges::find(project->columns(), key);
+        if (it == project->columns().end()) {
+          keysAreColumns = false;
+          break;
+        }
+        const auto* expr =
+            project->exprs()[std::distance(project->columns().begin(), it)];
+        if (expr->isNot(PlanType::kColumnExpr)) {
+          keysAreColumns = false;
+          break;
+        }
+        key = expr;
+      }
+      if (keysAreColumns) {
+        if (auto input =
+                addPartialLimits(op->input(), inputPushdown, inputCost)) {
+          return make<Project>(
+              input,
+              project->exprs(),
+              project->columns(),
+              project->isRedundant());
+        }
+      }
+      break;
+    }
+    case RelType::kRepartition:
+      // A merging repartition keeps the order of its input.
+      if (op->distribution().orderKeys.empty()) {
+        if (auto input = addPartialLimits(op->input(), pushdown, inputCost)) {
+          return make<Repartition>(input, op->distribution(), op->columns());
+        }
+      }
+      break;
+    case RelType::kJoin: {
+      // The probe side of a left join keeps all its rows. A merge join needs
+      // the order of its input.
+      const auto* join = op->as<Join>();
+      if (join->method == JoinMethod::kHash &&
+          (join->joinType == velox::core::JoinType::kLeft ||
+           join->joinType == velox::core::JoinType::kLeftSemiProject) &&
+          hasKeys(*join->input())) {
+        if (auto input = addPartialLimits(join->input(), pushdown, inputCost)) {
+          auto* newJoin = make<Join>(
+              join->method,
+              join->joinType,
+              input,
+              join->right,
+              join->leftKeys,
+              join->rightKeys,
+              join->filter,
+              join->cost().fanout,
+              join->columns());
+          newJoin->buildCost = join->buildCost;
+          newJoin->dynamicFilter = join->dynamicFilter;
+          newJoin->bloomFilter = join->bloomFilter;
+          return newJoin;
+        }
+      }
+      break;
+    }
+    case RelType::kUnionAll: {
+      const auto* unionAll = op->as<UnionAll>();
+      const auto rows = std::max<float>(1, op->resultCardinality());
+      RelationOpPtrVector inputs;
+      bool added = false;
+      for (const auto& input : unionAll->inputs) {
+        // The work above is shared by the inputs by their number of rows.
+        auto newInput = addPartialLimits(
+            input, pushdown, inputCost * input->resultCardinality() / rows);
+        added |= newInput != nullptr;
+        inputs.push_back(newInput != nullptr ? newInput : input);
+      }
+      if (added) {
+        return make<UnionAll>(std::move(inputs));
+      }
+      break;
+    }
+    default:
+      break;
+  }
+
+  const auto rows = op->resultCardinality();
+  if (rows <= pushdown.keptRows) {
+    return nullptr;
+  }
+
+  RelationOpPtr partial;
+  if (pushdown.orderKeys.empty()) {
+    partial = make<Limit>(op, pushdown.count, 0, /*isPartial=*/true);
+  } else {
+    partial = make<OrderBy>(
+        op,
+        pushdown.orderKeys,
+        pushdown.orderTypes,
+        pushdown.count,
+        0,
+        /*isPartial=*/true);
+  }
+
+  const auto saved = aboveCost * (1 - pushdown.keptRows / rows);
+  if (saved <= totalCost(*partial)) {
+    return nullptr;
+  }
+  return partial;
+}
+
 } // namespace
 
+void Optimization::pushdownLimit(
+    DerivedTableCP dt,
+    RelationOpPtr& plan,
+    PlanState& state) const {
+  if (dt->limit == 0 ||
+      dt->limit >= std::numeric_limits<int64_t>::max() - dt->offset) {
+    return;
+  }
+
+  LimitPushdown pushdown;
+  pushdown.count = dt->limit + dt->offset;
+  pushdown.keptRows =
+      static_cast<float>(pushdown.count) * static_cast<float>(maxParallelism());
+
+  // The keys must be columns of the plan.
+  for (auto i = 0; i < dt->orderKeys.size(); ++i) {
+    auto key = dt->orderKeys[i];
+    auto it = state.exprToColumn.find(key);
+    if (it != state.exprToColumn.end()) {
+      key = it->second;
+    }
+    if (key->isNot(PlanType::kColumnExpr) ||
+        std::ranges::find(plan->columns(), key) == plan->columns().end()) {
+      return;
+    }
+    pushdown.orderKeys.push_back(key);
+    pushdown.orderTypes.push_back(dt->orderTypes[i]);
+  }
+
+  // The final TopN compares every row. A final limit costs next to nothing.
+  const float finalCost = pushdown.orderKeys.empty()
+      ? 0
+      : Costs::kKeyCompareCost * plan->resultCardinality();
+  if (auto newPlan = addPartialLimits(plan, pushdown, finalCost)) {
+    plan = std::move(newPlan);
+  }
+}
+
+bool Optimization::isLimitBeforeProject(
+    DerivedTableCP dt,
+    const RelationOp& plan) const {
+  // The final limit runs on one driver. Below the limit, the projection runs
+  // on 'limit' rows on one driver. Above it, the projection runs on all rows
+  // spread over all drivers. The limit goes first if it takes no longer.
+  const auto limitRows = static_cast<float>(dt->limit) + dt->offset;
+  return limitRows * static_cast<float>(maxParallelism()) <=
+      plan.resultCardinality();
+}
+
 void Optimization::addPostprocess(
     DerivedTableCP dt,
     RelationOpPtr& plan,
@@ -686,11 +1190,15 @@ void Optimization::addPostprocess(
     plan = filter;
   }
 
-  // We probably want to make this decision based on cost.
-  static constexpr int64_t kMaxLimitBeforeProject = 8'192;
+  if (dt->hasLimit() && !dt->aggregation && dt->having.empty()) {
+    pushdownLimit(dt, plan, state);
+  }
+
+  const bool limitAfterProject = !dt->hasOrderBy() && dt->hasLimit() &&
+      !isLimitBeforeProject(dt, *plan);
   if (dt->hasOrderBy()) {
     addOrderBy(dt, plan, state);
-  } else if (dt->hasLimit() && dt->limit <= kMaxLimitBeforeProject) {
+  } else if (dt->hasLimit() && !limitAfterProject) {
     auto limit = make<Limit>(plan, dt->limit, dt->offset);
     state.addCost(*limit);
     plan = limit;
@@ -702,7 +1210,7 @@ void Optimization::addPostprocess(
         plan, exprs, dt->columns, isRedundantProject(plan, exprs, dt->columns));
   }
 
-  if (!dt->hasOrderBy() && dt->limit > kMaxLimitBeforeProject) {
+  if (limitAfterProject) {
     auto limit = make<Limit>(plan, dt->limit, dt->offset);
     state.addCost(*limit);
     plan = limit;
@@ -719,29 +1227,55 @@ void Optimization::addAggregation(
   auto groupingKeys =
       precompute.toColumns(aggPlan->groupingKeys(), &aggPlan->columns());
 
-  AggregateVector aggregates;
-  aggregates.reserve(aggPlan->aggregates().size());
-
-  for (const auto& agg : aggPlan->aggregates()) {
-    ExprCP condition = nullptr;
-    if (agg->condition()) {
-      condition = precompute.toColumn(agg->condition());
+  if (state.eagerAggregation) {
+    // The partial aggregation is below the joins. Its intermediate results
+    // are merged by the final aggregation.
+    const auto& intermediateColumns = aggPlan->intermediateColumns();
+    for (auto i = groupingKeys.size(); i < intermediateColumns.size(); ++i) {
+      precompute.toColumn(intermediateColumns[i]);
     }
-    auto args = precompute.toColumns(
-        agg->args(), /*aliases=*/nullptr, /*preserveLiterals=*/true);
-    aggregates.emplace_back(make<Aggregate>(
-        agg->name(),
-        agg->value(),
-        std::move(args),
-        agg->functions(),
-        agg->isDistinct(),
-        condition,
-        agg->intermediateType()));
+    plan = std::move(precompute).maybeProject();
+
+    state.placed.add(aggPlan);
+    plan = repartitionForAgg(plan, state);
+
+    auto* finalAgg = make<Aggregation>(
+        plan,
+        std::move(groupingKeys),
+        aggPlan->aggregates(),
+        velox::core::AggregationNode::Step::kFinal,
+        aggPlan->columns());
+
+    state.addCost(*finalAgg);
+    plan = finalAgg;
+    return;
   }
 
+  auto aggregates = precomputeAggregates(*aggPlan, precompute);
+
   plan = std::move(precompute).maybeProject();
 
-  if (isSingleWorker_ && runnerOptions_.numDrivers == 1) {
+  // If every group has one row, the aggregation is a projection of the
+  // grouping keys and the aggregates over the row. A global aggregation
+  // produces a row even for no input, so it is never a projection.
+  if (!groupingKeys.empty() && isUniqueOn(*plan, groupingKeys)) {
+    ExprVector exprs = groupingKeys;
+    for (const auto* aggregate : aggregates) {
+      exprs.push_back(singleRowAggregate(aggregate));
+    }
+    if (std::ranges::all_of(exprs, [](auto expr) { return expr != nullptr; })) {
+      state.placed.add(aggPlan);
+      plan = make<Project>(
+          plan,
+          exprs,
+          aggPlan->columns(),
+          isRedundantProject(plan, exprs, aggPlan->columns()));
+      return;
+    }
+  }
+
+  if ((isSingleWorker_ && runnerOptions_.numDrivers == 1) ||
+      isGroupedForAggregation(*plan, groupingKeys)) {
     auto* singleAgg = make<Aggregation>(
         plan,
         std::move(groupingKeys),
@@ -814,6 +1348,69 @@ void Optimization::addOrderBy(
   plan = orderBy;
 }
 
+namespace {
+void collectOrderBys(
+    const RelationOp& op,
+    std::vector<const OrderBy*>& orderBys) {
+  if (op.is(RelType::kOrderBy)) {
+    orderBys.push_back(op.as<OrderBy>());
+  }
+  if (op.input() != nullptr) {
+    collectOrderBys(*op.input(), orderBys);
+  }
+  if (op.is(RelType::kJoin)) {
+    collectOrderBys(*op.as<Join>()->right, orderBys);
+  } else if (op.is(RelType::kUnionAll)) {
+    for (const auto& input : op.as<UnionAll>()->inputs) {
+      collectOrderBys(*input, orderBys);
+    }
+  }
+}
+} // namespace
+
+RangeSplittersMap Optimization::sampleRangeSplitters(const RelationOp& plan) {
+  RangeSplittersMap result;
+  const auto minBytes = options_.rangeSortMinBytes;
+  if (minBytes <= 0 || runnerOptions_.numWorkers <= 1) {
+    return result;
+  }
+
+  std::vector<const OrderBy*> orderBys;
+  collectOrderBys(plan, orderBys);
+  for (const auto* orderBy : orderBys) {
+    if (orderBy->limit > 0 || orderBy->cost().totalBytes < minBytes) {
+      continue;
+    }
+
+    // The ranges are sampled from the table the leading key comes from.
+    const auto* key = orderBy->orderKeys[0];
+    if (key->isNot(PlanType::kColumnExpr)) {
+      continue;
+    }
+    const auto* column = key->as<Column>();
+    if (column->relation() == nullptr ||
+        column->relation()->isNot(PlanType::kTableNode) ||
+        column->topColumn() != nullptr || result.contains(column)) {
+      continue;
+    }
+
+    auto pool = velox::memory::memoryManager()->addLeafPool();
+    auto splitters = sampleSplitters(
+        column->relation()->as<BaseTable>()->schemaTable,
+        column,
+        orderBy->orderTypes[0],
+        runnerOptions_.numWorkers - 1,
+        *pool);
+    if (splitters != nullptr) {
+      result[column] = {
+          .orderType = orderBy->orderTypes[0],
+          .pool = std::move(pool),
+          .splitters = std::move(splitters)};
+    }
+  }
+  return result;
+}
+
 void Optimization::joinByIndex(
     const RelationOpPtr& plan,
     const JoinCandidate& candidate,
@@ -882,6 +1479,55 @@ void Optimization::joinByIndex(
   }
 }
 
+bool Optimization::eliminateJoin(
+    const RelationOpPtr& plan,
+    const JoinCandidate& candidate,
+    PlanState& state,
+    std::vector<NextJoin>& toTry) {
+  if (candidate.tables.size() != 1 || !candidate.existences.empty()) {
+    return false;
+  }
+  auto* table = candidate.tables[0];
+  const auto right = candidate.joinSides().first;
+  if (!right.isUnique) {
+    return false;
+  }
+
+  switch (right.leftJoinType()) {
+    case velox::core::JoinType::kLeft:
+      break;
+    case velox::core::JoinType::kInner: {
+      // A filter on the table or on the join may drop rows.
+      if (!options_.assumeReferentialIntegrity ||
+          !candidate.join->filter().empty() ||
+          table->isNot(PlanType::kTableNode) ||
+          !table->as<BaseTable>()->columnFilters.empty() ||
+          !table->as<BaseTable>()->filter.empty()) {
+        return false;
+      }
+      break;
+    }
+    default:
+      return false;
+  }
+
+  PlanStateSaver save(state, candidate);
+  state.placed.add(table);
+  bool isUsed = false;
+  state.downstreamColumns().forEach<Column>(
+      [&](auto column) { isUsed |= column->relation() == table; });
+  if (isUsed) {
+    return false;
+  }
+
+  if (options_.traceFlags & OptimizerOptions::kEliminatedJoin) {
+    std::cout << "Eliminated join: " << state.dt->id() << ": "
+              << candidate.toString() << std::endl;
+  }
+  state.addNextJoin(&candidate, plan, {}, toTry);
+  return true;
+}
+
 void Optimization::joinByHash(
     const RelationOpPtr& plan,
     const JoinCandidate& candidate,
@@ -944,8 +1590,22 @@ void Optimization::joinByHash(
   PlanState buildState(state.optimization, state.dt, buildPlan);
   RelationOpPtr buildInput = buildPlan->op;
   RelationOpPtr probeInput = plan;
+  const auto joinType = build.leftJoinType();
+  bool bloomFilter = false;
 
   if (!isSingleWorker_) {
+    // A heavy hitter in the probe keys makes partitioning the probe side
+    // cost more. Broadcasting the build instead costs a copy of the build
+    // on each worker other than the first.
+    const float buildRows = buildPlan->cost.fanout;
+    const float buildRowCost =
+        shuffleCost(buildInput->columns()) + Costs::hashProbeCost(buildRows);
+    const float probeSkewCost = Costs::skewCost(
+        state.cost.inputCardinality * state.cost.fanout,
+        shuffleCost(plan->columns()) + Costs::hashProbeCost(buildRows),
+        probe.skew,
+        runnerOptions_.numWorkers);
+
     if (!partKeys.empty()) {
       if (needsShuffle) {
         if (copartition.empty()) {
@@ -962,7 +1622,12 @@ void Optimization::joinByHash(
       }
     } else if (
         candidate.join->isBroadcastableType() &&
-        isBroadcastableSize(buildPlan, state)) {
+        (isBroadcastableSize(buildPlan, state) ||
+         (probeSkewCost > 0 &&
+          buildRows <= options_.skewBroadcastMaxBuildRows &&
+          buildRows * buildRowCost *
+                  static_cast<float>(runnerOptions_.numWorkers - 1) <
+              probeSkewCost))) {
       auto* broadcast = make<Repartition>(
           buildInput,
           Distribution::broadcast(plan->distribution().distributionType),
@@ -974,7 +1639,19 @@ void Optimization::joinByHash(
       // partitioned on its keys, shuffle the build too.
       alignJoinSides(
           buildInput, build.keys, buildState, probeInput, probe.keys, state);
+      state.cost.unitCost += probeSkewCost;
     }
+
+    // A selective join with a small build may drop most probe rows before
+    // they are shuffled instead of after.
+    bloomFilter = addBloomFilter(
+        joinType,
+        probe.keys,
+        candidate.fanout,
+        *buildPlan,
+        *probeInput,
+        state,
+        options_);
   }
 
   PrecomputeProjection precomputeBuild(buildInput, state.dt);
@@ -985,7 +1662,6 @@ void Optimization::joinByHash(
       make<HashBuild>(buildInput, ++buildCounter_, build.keys, buildPlan);
   buildState.addCost(*buildOp);
 
-  const auto joinType = build.leftJoinType();
   const bool probeOnly = joinType == velox::core::JoinType::kLeftSemiFilter ||
       joinType == velox::core::JoinType::kLeftSemiProject ||
       joinType == velox::core::JoinType::kAnti;
@@ -1042,9 +1718,145 @@ void Optimization::joinByHash(
   state.cost.totalBytes += buildState.cost.totalBytes;
   state.cost.transferBytes += buildState.cost.transferBytes;
   join->buildCost = buildState.cost;
+  join->dynamicFilter = useDynamicFilter(*join, options_);
+  join->bloomFilter = bloomFilter;
   state.addNextJoin(&candidate, join, {buildOp}, toTry);
 }
 
+void Optimization::joinByMerge(
+    const RelationOpPtr& plan,
+    const JoinCandidate& candidate,
+    PlanState& state,
+    std::vector<NextJoin>& toTry) {
+  if (candidate.tables.size() != 1 || !candidate.existences.empty()) {
+    return;
+  }
+  auto* rightTable = candidate.tables[0];
+  if (rightTable->is(PlanType::kDerivedTableNode)) {
+    if (rightTable->as<DerivedTable>()->setOp.has_value()) {
+      return;
+    }
+  } else if (rightTable->isNot(PlanType::kTableNode)) {
+    return;
+  }
+
+  auto [right, left] = candidate.joinSides();
+  const auto joinType = right.leftJoinType();
+  if (joinType != velox::core::JoinType::kInner &&
+      joinType != velox::core::JoinType::kLeft) {
+    return;
+  }
+
+  // 'plan' must be ordered on all the join keys, ascending with nulls first.
+  // The keys of both sides are taken in this order.
+  const auto& leftOrder = plan->distribution();
+  const auto numKeys = left.keys.size();
+  if (leftOrder.orderKeys.size() < numKeys) {
+    return;
+  }
+  ExprVector leftKeys;
+  ExprVector rightKeys;
+  for (auto i = 0; i < numKeys; ++i) {
+    if (leftOrder.orderTypes[i] != OrderType::kAscNullsFirst) {
+      return;
+    }
+    const auto nth = position(left.keys, *leftOrder.orderKeys[i]);
+    if (nth == kNotFound || left.keys[nth]->isNot(PlanType::kColumnExpr) ||
+        right.keys[nth]->isNot(PlanType::kColumnExpr)) {
+      return;
+    }
+    leftKeys.push_back(left.keys[nth]);
+    rightKeys.push_back(right.keys[nth]);
+  }
+
+  // Without a shuffle, both sides must be gathered or copartitioned.
+  Distribution forRight;
+  if (isSingleWorker_ || leftOrder.distributionType.isGather) {
+    forRight = Distribution::gather();
+  } else {
+    const auto partKeys = joinKeyPartition(plan, left.keys);
+    if (partKeys.empty()) {
+      return;
+    }
+    ExprVector copartition;
+    for (auto i : partKeys) {
+      copartition.push_back(right.keys[i]);
+    }
+    forRight = {leftOrder.distributionType, std::move(copartition)};
+  }
+  forRight.orderKeys = rightKeys;
+  forRight.orderTypes.resize(numKeys, OrderType::kAscNullsFirst);
+
+  PlanStateSaver save(state, candidate);
+
+  PlanObjectSet rightColumns = availableColumns(rightTable);
+  PlanObjectSet rightFilterColumns;
+  rightFilterColumns.unionColumns(candidate.join->filter());
+  rightFilterColumns.intersect(rightColumns);
+
+  rightColumns.intersect(state.downstreamColumns());
+  rightColumns.unionColumns(right.keys);
+  rightColumns.unionSet(rightFilterColumns);
+  state.columns.unionSet(rightColumns);
+
+  PlanObjectSet rightTables;
+  rightTables.add(rightTable);
+  MemoKey memoKey{rightTable, rightColumns, rightTables, candidate.existences};
+
+  auto* rightPlan = memoPlans(memoKey, candidate.existsFanout, state)
+                        .bestOrdered(forRight);
+  if (rightPlan == nullptr) {
+    return;
+  }
+
+  state.placed.add(rightTable);
+  if (rightTable->is(PlanType::kDerivedTableNode)) {
+    state.placed.unionSet(rightPlan->fullyImported);
+  }
+
+  PlanState rightState(state.optimization, state.dt, rightPlan);
+
+  PlanObjectSet leftColumns;
+  leftColumns.unionObjects(plan->columns());
+
+  ColumnVector columns;
+  PlanObjectSet columnSet;
+  state.downstreamColumns().forEach<Column>([&](auto column) {
+    if (!rightColumns.contains(column) && !leftColumns.contains(column)) {
+      return;
+    }
+    columnSet.add(column);
+    columns.push_back(column);
+  });
+  state.columns = columnSet;
+
+  auto* join = make<Join>(
+      JoinMethod::kMerge,
+      joinType,
+      plan,
+      rightPlan->op,
+      std::move(leftKeys),
+      std::move(rightKeys),
+      candidate.join->filter(),
+      fanoutJoinTypeLimit(joinType, candidate.fanout),
+      std::move(columns));
+
+  state.addCost(*join);
+  state.cost.setupCost += rightState.cost.unitCost + rightState.cost.setupCost;
+  state.cost.totalBytes += rightState.cost.totalBytes;
+  state.cost.transferBytes += rightState.cost.transferBytes;
+  join->buildCost = rightState.cost;
+
+  // The fragment of a merge join runs one driver per task so that the ordered
+  // streams are not split, see ToVelox::makeJoin. The work of the join and of
+  // its inputs in the fragment then holds up the other drivers.
+  if (runnerOptions_.numDrivers > 1) {
+    state.cost.unitCost += fragmentCost(*join) *
+        static_cast<float>(runnerOptions_.numDrivers - 1);
+  }
+  state.addNextJoin(&candidate, join, {}, toTry);
+}
+
 void Optimization::joinByHashRight(
     const RelationOpPtr& plan,
     const JoinCandidate& candidate,
@@ -1166,6 +1978,7 @@ void Optimization::joinByHashRight(
       candidate.join->filter(),
       fanout,
       std::move(columns));
+  join->dynamicFilter = useDynamicFilter(*join, options_);
   state.addCost(*join);
 
   state.addNextJoin(&candidate, join, {buildOp}, toTry);
@@ -1242,6 +2055,11 @@ void Optimization::addJoin(
 
   std::vector<NextJoin> toTry;
 
+  if (eliminateJoin(plan, candidate, state, toTry)) {
+    result.insert(result.end(), toTry.begin(), toTry.end());
+    return;
+  }
+
   joinByIndex(plan, candidate, state, toTry);
 
   const auto sizeAfterIndex = toTry.size();
@@ -1253,12 +2071,24 @@ void Optimization::addJoin(
     joinByHashRight(plan, candidate, state, toTry);
   }
 
-  // If one is much better do not try the other.
-  if (toTry.size() == 2 && candidate.tables.size() == 1) {
-    if (toTry[0].isWorse(toTry[1])) {
-      toTry.erase(toTry.begin());
-    } else if (toTry[1].isWorse(toTry[0])) {
-      toTry.erase(toTry.begin() + 1);
+  joinByMerge(plan, candidate, state, toTry);
+
+  // If one is much better do not try the others. A candidate is dropped only
+  // if it is worse than one still kept, so at least one remains.
+  if (toTry.size() > 1 && candidate.tables.size() == 1) {
+    for (size_t i = 0; i < toTry.size();) {
+      bool worse = false;
+      for (size_t j = 0; j < toTry.size(); ++j) {
+        if (j != i && toTry[i].isWorse(toTry[j])) {
+          worse = true;
+          break;
+        }
+      }
+      if (worse) {
+        toTry.erase(toTry.begin() + i);
+      } else {
+        ++i;
+      }
     }
   }
   result.insert(result.end(), toTry.begin(), toTry.end());
@@ -1552,6 +2382,236 @@ std::vector<int32_t> sortByStartingScore(const PlanObjectVector& tables) {
 }
 } // namespace
 
+void Optimization::makeEagerAggregationJoins(
+    const RelationOpPtr& scan,
+    BaseTableCP table,
+    PlanState& state) {
+  const auto* dt = state.dt;
+  const auto* aggPlan = dt->aggregation;
+  if (options_.eagerAggregationMaxFanout <= 0 || aggPlan == nullptr ||
+      aggPlan->aggregates().empty() || dt->joins.empty()) {
+    return;
+  }
+
+  // A join duplicates or drops all rows of a group together since these have
+  // the same join keys. Merging the partial results is then the same as
+  // aggregating the joined rows. Null-padded rows of outer joins would not be
+  // counted.
+  for (auto* join : dt->joins) {
+    if (!join->isInner() || join->directed()) {
+      return;
+    }
+  }
+
+  auto isOfTable = [&](const PlanObjectSet& columns) {
+    bool result = true;
+    columns.forEach<Column>(
+        [&](auto* column) { result &= column->relation() == table; });
+    return result;
+  };
+  for (auto* aggregate : aggPlan->aggregates()) {
+    if (aggregate->isDistinct() || !isOfTable(aggregate->columns())) {
+      return;
+    }
+  }
+
+  // Group on the columns of 'table' that are needed after the aggregation.
+  PlanObjectSet needed;
+  for (auto* join : dt->joins) {
+    needed.unionColumns(join->leftKeys());
+    needed.unionColumns(join->rightKeys());
+    needed.unionColumns(join->filter());
+  }
+  needed.unionColumns(dt->conjuncts);
+  needed.unionColumns(aggPlan->groupingKeys());
+
+  ExprVector groupingKeys;
+  bool allAvailable = true;
+  needed.forEach<Column>([&](auto* column) {
+    if (column->relation() == table) {
+      groupingKeys.push_back(column);
+      allAvailable &= state.columns.contains(column);
+    }
+  });
+  if (groupingKeys.empty() || !allAvailable) {
+    return;
+  }
+
+  PrecomputeProjection precompute(scan, dt, /*projectAllInputs=*/false);
+  groupingKeys = precompute.toColumns(groupingKeys);
+  auto aggregates = precomputeAggregates(*aggPlan, precompute);
+
+  const auto numKeys = aggPlan->groupingKeys().size();
+  const auto& intermediateColumns = aggPlan->intermediateColumns();
+  ColumnVector columns;
+  for (auto* key : groupingKeys) {
+    columns.push_back(key->as<Column>());
+  }
+  columns.insert(
+      columns.end(),
+      intermediateColumns.begin() + numKeys,
+      intermediateColumns.end());
+
+  auto* partialAgg = make<Aggregation>(
+      std::move(precompute).maybeProject(),
+      std::move(groupingKeys),
+      std::move(aggregates),
+      velox::core::AggregationNode::Step::kPartial,
+      columns);
+  // The fanout of the partial aggregation comes from the number of distinct
+  // values of the grouping keys in the column statistics. The join sampler
+  // is not used since it measures the matches between the keys of two
+  // tables, not the number of distinct keys of one.
+  if (partialAgg->cost().fanout > options_.eagerAggregationMaxFanout) {
+    return;
+  }
+
+  // The joins see the intermediate results in place of the aggregates.
+  PlanStateSaver save(state);
+  state.addCost(*partialAgg);
+  state.columns = PlanObjectSet();
+  state.columns.unionObjects(columns);
+  for (auto i = 0; i < aggPlan->aggregates().size(); ++i) {
+    state.exprToColumn[aggPlan->aggregates()[i]] =
+        intermediateColumns[numKeys + i];
+  }
+  state.eagerAggregation = true;
+  state.clearDownstreamColumns();
+
+  makeJoins(partialAgg, state);
+
+  for (auto* aggregate : aggPlan->aggregates()) {
+    state.exprToColumn.erase(aggregate);
+  }
+  state.eagerAggregation = false;
+  state.clearDownstreamColumns();
+}
+
+bool Optimization::makeLateMaterializationJoins(
+    BaseTableCP table,
+    ColumnGroupCP index,
+    const ColumnVector& columns,
+    PlanState& state) {
+  const auto* dt = state.dt;
+  if (options_.lateMaterializationMinBytes <= 0 || dt->joins.empty()) {
+    return false;
+  }
+
+  // The rows are looked up by the keys of an index that are unique in the
+  // table.
+  std::optional<LateMaterialization> late;
+  for (const auto* lookupIndex : table->schemaTable->columnGroups) {
+    const auto* layout = lookupIndex->layout;
+    if (layout == nullptr || layout->lookupKeys().empty()) {
+      continue;
+    }
+    const auto& orderKeys = lookupIndex->distribution.orderKeys;
+    ColumnVector keyColumns;
+    for (const auto* key : orderKeys) {
+      auto it = std::ranges::find_if(table->columns, [&](auto* column) {
+        return column->name() == key->as<Column>()->name();
+      });
+      if (it == table->columns.end()) {
+        break;
+      }
+      keyColumns.push_back(*it);
+    }
+    if (keyColumns.size() != orderKeys.size() ||
+        !table->schemaTable->isUnique(keyColumns)) {
+      continue;
+    }
+    auto info = table->schemaTable->indexInfo(lookupIndex, keyColumns);
+    if (info.lookupKeys.size() != keyColumns.size()) {
+      continue;
+    }
+    late = LateMaterialization{.table = table, .info = std::move(info)};
+    for (auto* key : keyColumns) {
+      late->keys.push_back(key);
+    }
+    break;
+  }
+  if (!late.has_value()) {
+    return false;
+  }
+
+  // Columns needed by the joins and filters are read first.
+  PlanObjectSet needed;
+  for (auto* join : dt->joins) {
+    needed.unionColumns(join->leftKeys());
+    needed.unionColumns(join->rightKeys());
+    needed.unionColumns(join->filter());
+  }
+  needed.unionColumns(dt->conjuncts);
+  needed.unionColumns(late->keys);
+
+  const auto lookupColumns = availableColumns(table, late->info.index);
+  ColumnVector scanColumns;
+  for (auto* column : columns) {
+    if (needed.contains(column) || column->topColumn() != nullptr ||
+        column->path() != nullptr || !lookupColumns.contains(column)) {
+      scanColumns.push_back(column);
+    } else {
+      late->columns.push_back(column);
+    }
+  }
+  if (late->columns.empty() ||
+      byteSize(late->columns) < options_.lateMaterializationMinBytes) {
+    return false;
+  }
+  for (auto* key : late->keys) {
+    if (std::ranges::find(scanColumns, key) == scanColumns.end()) {
+      scanColumns.push_back(key->as<Column>());
+    }
+  }
+
+  PlanStateSaver save(state);
+  state.placed.add(table);
+  state.columns.unionObjects(scanColumns);
+
+  auto distribution = TableScan::outputDistribution(table, index, scanColumns);
+  auto* scan = make<TableScan>(
+      nullptr,
+      std::move(distribution),
+      table,
+      index,
+      index->table->cardinality * table->filterSelectivity,
+      std::move(scanColumns));
+  state.addCost(*scan);
+
+  velox::ScopedVarSetter lateMaterialization(
+      &state.lateMaterialization,
+      static_cast<const LateMaterialization*>(&late.value()));
+  makeJoins(scan, state);
+  return true;
+}
+
+RelationOpPtr Optimization::addLateMaterialization(
+    const RelationOpPtr& plan,
+    PlanState& state) {
+  const auto& late = *state.lateMaterialization;
+  auto input = repartitionForIndex(late.info, late.keys, plan, state);
+  if (input == nullptr) {
+    return nullptr;
+  }
+
+  state.columns.unionObjects(late.columns);
+  auto columns = state.downstreamColumns();
+  columns.intersect(state.columns);
+
+  // Each row finds itself.
+  auto* lookup = make<TableScan>(
+      input,
+      input->distribution(),
+      late.table,
+      late.info.index,
+      1,
+      columns.toObjects<Column>(),
+      late.keys,
+      velox::core::JoinType::kInner);
+  state.addCost(*lookup);
+  return lookup;
+}
+
 void Optimization::makeJoins(PlanState& state) {
   auto firstTables = state.dt->startTables.toObjects();
 
@@ -1563,6 +2623,9 @@ void Optimization::makeJoins(PlanState& state) {
 
   auto sortedIndices = sortByStartingScore(firstTables);
 
+  // Plans with late materialization enumerate the joins once more. They
+  // start only with the first table and index they apply to.
+  bool lateMaterialized = false;
   for (auto index : sortedIndices) {
     auto from = firstTables.at(index);
     if (from->is(PlanType::kTableNode)) {
@@ -1572,6 +2635,10 @@ void Optimization::makeJoins(PlanState& state) {
       const auto downstream = state.downstreamColumns();
       for (auto index : indices) {
         auto columns = indexColumns(downstream, table, index);
+        if (!lateMaterialized) {
+          lateMaterialized =
+              makeLateMaterializationJoins(table, index, columns, state);
+        }
 
         PlanStateSaver save(state);
         state.placed.add(table);
@@ -1588,6 +2655,7 @@ void Optimization::makeJoins(PlanState& state) {
             std::move(columns));
         state.addCost(*scan);
         makeJoins(scan, state);
+        makeEagerAggregationJoins(scan, table, state);
       }
     } else if (from->is(PlanType::kValuesTableNode)) {
       const auto* valuesTable = from->as<ValuesTable>();
@@ -1635,6 +2703,13 @@ void Optimization::makeJoins(RelationOpPtr plan, PlanState& state) {
       return;
     }
 
+    if (state.lateMaterialization != nullptr) {
+      plan = addLateMaterialization(plan, state);
+      if (plan == nullptr) {
+        return;
+      }
+    }
+
     addPostprocess(dt, plan, state);
     auto kept = state.plans.addPlan(plan, state);
     trace(
@@ -1752,6 +2827,13 @@ PlanP Optimization::makeDtPlan(
     float existsFanout,
     PlanState& state,
     bool& needsShuffle) {
+  return memoPlans(key, existsFanout, state).best(distribution, needsShuffle);
+}
+
+PlanSet& Optimization::memoPlans(
+    const MemoKey& key,
+    float existsFanout,
+    PlanState& state) {
   auto it = memo_.find(key);
   PlanSet* plans{};
   if (it == memo_.end()) {
@@ -1773,7 +2855,7 @@ PlanP Optimization::makeDtPlan(
   } else {
     plans = &it->second;
   }
-  return plans->best(distribution, needsShuffle);
+  return *plans;
 }
 
 ExprCP Optimization::combineLeftDeep(Name func, const ExprVector& exprs) {
@@ -57,7 +57,9 @@ class Optimization {
   /// given, these can be used to record history data about the execution of
   /// each relevant node for costing future queries.
   PlanAndStats toVeloxPlan(RelationOpPtr plan) {
-    return toVelox_.toVeloxPlan(std::move(plan), runnerOptions_);
+    auto rangeSplitters = sampleRangeSplitters(*plan);
+    return toVelox_.toVeloxPlan(
+        std::move(plan), runnerOptions_, std::move(rangeSplitters));
   }
 
   std::pair<
@@ -204,6 +206,9 @@ class Optimization {
       PlanState& state,
       bool& needsShuffle);
 
+  // Returns the plans for 'key', making them if not already in 'memo_'.
+  PlanSet& memoPlans(const MemoKey& key, float existsFanout, PlanState& state);
+
   // Returns a sorted list of candidates to add to the plan in 'state'. The
   // joinable tables depend on the tables already present in 'plan'. A candidate
   // will be a single table for all the single tables that can be joined.
@@ -226,10 +231,56 @@ class Optimization {
   void addOrderBy(DerivedTableCP dt, RelationOpPtr& plan, PlanState& state)
       const;
 
+  // Samples the leading key of each sort in the chosen 'plan' that is
+  // predicted to sort at least OptimizerOptions::rangeSortMinBytes, so that
+  // the plan is translated without running queries.
+  RangeSplittersMap sampleRangeSplitters(const RelationOp& plan);
+
+  // Adds partial TopN or limit nodes for the limit of 'dt' below the
+  // projections, left joins, repartitions and union alls at the top of 'plan'
+  // where they are predicted to save more work than they cost.
+  void pushdownLimit(DerivedTableCP dt, RelationOpPtr& plan, PlanState& state)
+      const;
+
+  // True if the final limit of 'dt' goes below its projection over 'plan'.
+  bool isLimitBeforeProject(DerivedTableCP dt, const RelationOp& plan) const;
+
+  // Returns the number of drivers that run a fragment with all workers.
+  int32_t maxParallelism() const {
+    return runnerOptions_.numWorkers * runnerOptions_.numDrivers;
+  }
+
   // Places a derived table as first table in a plan. Imports possibly reducing
   // joins into the plan if can.
   void placeDerivedTable(DerivedTableCP from, PlanState& state);
 
+  // Makes plans that start with a partial aggregation of 'scan' of 'table'
+  // grouped on the columns of 'table' that the joins and grouping keys of
+  // 'state.dt' need. The aggregation of 'state.dt' is finished after the
+  // joins. Applies if all aggregates are over columns of 'table', the joins
+  // are inner and the partial aggregation is predicted to reduce the rows.
+  void makeEagerAggregationJoins(
+      const RelationOpPtr& scan,
+      BaseTableCP table,
+      PlanState& state);
+
+  // Makes plans that start with a scan of 'index' of 'table' without those of
+  // 'columns' that are used only after the joins of 'state.dt'. These are
+  // read after the joins by a lookup on a unique key of 'table'. Applies if
+  // 'table' has a layout with unique lookup keys and the columns left out
+  // take at least lateMaterializationMinBytes per row. Returns true if it
+  // made plans.
+  bool makeLateMaterializationJoins(
+      BaseTableCP table,
+      ColumnGroupCP index,
+      const ColumnVector& columns,
+      PlanState& state);
+
+  // Adds a lookup of the columns in 'state.lateMaterialization' to 'plan'.
+  RelationOpPtr addLateMaterialization(
+      const RelationOpPtr& plan,
+      PlanState& state);
+
   // Adds the items from 'dt.conjuncts' that are not placed in 'state'
   // and whose prerequisite columns are placed. If conjuncts can be
   // placed, adds them to 'state.placed' and calls makeJoins()
@@ -264,6 +315,18 @@ class Optimization {
       PlanState& state,
       std::vector<NextJoin>& result);
 
+  // Places the table of 'candidate' without a join if the join can neither
+  // add nor remove rows of 'plan' and the table has no columns used
+  // downstream. This is so for left joins on unique keys of the table and,
+  // with OptimizerOptions::assumeReferentialIntegrity, for inner joins
+  // without a join filter on unique keys of an unfiltered table. Adds 'plan'
+  // to 'toTry' and returns true if the join is eliminated.
+  bool eliminateJoin(
+      const RelationOpPtr& plan,
+      const JoinCandidate& candidate,
+      PlanState& state,
+      std::vector<NextJoin>& toTry);
+
   // If 'candidate' can be added on top 'plan' as a merge/index lookup, adds the
   // plan to 'toTry'. Adds any necessary repartitioning.
   void joinByIndex(
@@ -283,6 +346,15 @@ class Optimization {
       PlanState& state,
       std::vector<NextJoin>& toTry);
 
+  // Adds 'candidate' on top of 'plan' as a merge join if 'plan' is ordered on
+  // the join keys and there is a plan for 'candidate' ordered the same way
+  // without a shuffle. No hash table is built.
+  void joinByMerge(
+      const RelationOpPtr& plan,
+      const JoinCandidate& candidate,
+      PlanState& state,
+      std::vector<NextJoin>& toTry);
+
   // Tries a right hash join variant of left outer or left semijoin.
   void joinByHashRight(
       const RelationOpPtr& plan,
@@ -17,9 +17,14 @@
 
 #include <algorithm>
 #include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
+namespace facebook::axiom::logical_plan {
+class ValuesNode;
+} // namespace facebook::axiom::logical_plan
+
 namespace facebook::axiom::optimizer {
 
 struct OptimizerOptions {
@@ -28,6 +33,7 @@ struct OptimizerOptions {
   static constexpr uint32_t kExceededBest = 2;
   static constexpr uint32_t kSample = 4;
   static constexpr uint32_t kPreprocess = 8;
+  static constexpr uint32_t kEliminatedJoin = 16;
 
   /// Parallelizes independent projections over this many threads. 1 means no
   /// parallel projection.
@@ -59,6 +65,109 @@ struct OptimizerOptions {
   /// Produce trace of plan candidates.
   uint32_t traceFlags{0};
 
+  /// Predicted cost (see Cost) of the work to give to one driver of a
+  /// fragment. Fragments with little predicted work run on fewer workers and
+  /// drivers, never more than the numWorkers and numDrivers of
+  /// MultiFragmentPlan::Options. 0 means every fragment uses all workers and
+  /// drivers.
+  float costPerDriver{0};
+
+  /// Hash joins predicted to keep at most this fraction of the probe rows
+  /// filter the probe-side scans with the min, max and, for small builds, the
+  /// distinct values of the build keys, computed at run time while the rest of
+  /// the query runs. The probe-side scans start when the filters are ready. 0
+  /// disables dynamic filters.
+  float dynamicFilterMaxSelectivity{0};
+
+  /// Maximum predicted build-side cardinality for a dynamic filter. The
+  /// filter reads all of the build side before the probe-side scans start.
+  float dynamicFilterMaxBuildRows{1'000'000};
+
+  /// Maximum predicted build-side cardinality for a dynamic filter with the
+  /// distinct build keys. Larger builds filter on the range of the keys only.
+  float dynamicFilterMaxValues{10'000};
+
+  /// Maximum predicted build-side cardinality of a hash join whose build keys
+  /// make a Bloom filter for the probe-side scans, applied before the probe
+  /// side is shuffled to the join. The filter is planned only where the
+  /// shuffle it saves is predicted to cost more than computing and testing
+  /// the filter. 0 disables Bloom filters.
+  float bloomFilterMaxBuildRows{0};
+
+  /// If true, an inner join on the unique keys of a table is assumed to match
+  /// every row of the other side, as if the other side had a foreign key to
+  /// the table with no null values. Such joins to unfiltered tables whose
+  /// columns are not used are then removed from plans.
+  bool assumeReferentialIntegrity{false};
+
+  /// Maximum predicted build-side cardinality for broadcasting the build of a
+  /// hash join whose probe keys have a heavy hitter. Partitioning such a probe
+  /// sends the rows of the heavy hitter to one worker. The build is broadcast
+  /// only if this is predicted to cost less than waiting for that worker.
+  float skewBroadcastMaxBuildRows{1'000'000};
+
+  /// Aggregations over the columns of one table of an inner join are also
+  /// planned with a partial aggregation of that table below the joins if the
+  /// partial aggregation is predicted to keep at most this fraction of the
+  /// rows. The cheaper plan is chosen. 0 disables eager aggregation.
+  float eagerAggregationMaxFanout{0};
+
+  /// Sorts without a limit that are predicted to sort at least this many bytes
+  /// repartition their input by ranges of the leading sort key, sort the
+  /// ranges in parallel and concatenate them in the final stage. The ranges
+  /// are chosen by sampling the key. 0 disables range-partitioned sorts.
+  float rangeSortMinBytes{0};
+
+  /// Maximum predicted size in bytes of the result of a subplan that occurs
+  /// more than once in a plan, e.g. a view referenced twice, for computing it
+  /// once and sending its result to each consumer. The result is buffered
+  /// until the slowest consumer has read it. The subplan is recomputed for
+  /// each consumer if that is predicted to cost less than sending its result.
+  /// 0 disables sharing of subplans.
+  float shareSubplanMaxBytes{0};
+
+  /// Maximum predicted size in bytes of the result of a scan that replaces
+  /// several scans of one table, e.g. both sides of a self join. The scan
+  /// reads the columns of all of them with the OR of their filters and sends
+  /// its result to each, where their own filters are applied. Scans are
+  /// merged only if this is predicted to cost less than reading the table
+  /// once per scan. 0 disables merging of scans.
+  float shareScanMaxBytes{0};
+
+  /// Plans that start with a table whose columns used only after the joins
+  /// take at least this many bytes per row are also planned reading these
+  /// columns after the joins, by a lookup on a unique key of the table. The
+  /// joins and shuffles then carry the key in place of the columns. The
+  /// cheaper plan is chosen. 0 disables late materialization.
+  ///
+  /// Applies only to tables with a layout that supports index lookups on
+  /// keys known to be unique. Hive tables have no such layout: Velox cannot
+  /// read the rows of a file by '$path' and row number, so Hive scans are
+  /// never late materialized.
+  float lateMaterializationMinBytes{0};
+
+  /// If true, count, min and max over all rows of a table are answered from
+  /// the row counts and column statistics the connector keeps, e.g. in file
+  /// footers, without scanning the table. The answer reflects the table as of
+  /// planning.
+  bool aggregateFromMetadata{false};
+
+  /// Maximum limit pushed into the scan below it, if there are only
+  /// projections in between. The scan then gets one split at a time per task
+  /// and the runner stops adding splits once the limit is reached. The runner
+  /// checks the progress of the tasks every few milliseconds, so this is meant
+  /// for small limits, e.g. a look at the first rows of a table. 0 disables
+  /// the pushdown.
+  int64_t scanLimitMaxRows{10'000};
+
+  /// Results of subplans of the query computed before planning, by the id of
+  /// the root node of the subplan. The plan reads these in place of the
+  /// subplans. See QueryCheckpoints.
+  folly::F14FastMap<
+      std::string,
+      std::shared_ptr<const logical_plan::ValuesNode>>
+      checkpoints;
+
   bool isMapAsStruct(const char* table, const char* column) const {
     if (allMapsAsStruct) {
       return true;
@@ -353,6 +353,39 @@ PlanP PlanSet::best(const Distribution& distribution, bool& needsShuffle) {
   return best;
 }
 
+PlanP PlanSet::bestOrdered(const Distribution& distribution) {
+  PlanP best = nullptr;
+  float bestCost = -1;
+
+  const bool single = isSingleWorker();
+
+  for (const auto& plan : plans) {
+    const auto& planDistribution = plan->op->distribution();
+    if (!planDistribution.isOrderedOn(
+            distribution.orderKeys, distribution.orderTypes)) {
+      continue;
+    }
+
+    if (!single) {
+      if (distribution.distributionType.isGather) {
+        if (!planDistribution.distributionType.isGather) {
+          continue;
+        }
+      } else if (!planDistribution.isSamePartition(distribution)) {
+        continue;
+      }
+    }
+
+    const float cost =
+        plan->cost.fanout * plan->cost.unitCost + plan->cost.setupCost;
+    if (!best || cost < bestCost) {
+      best = plan.get();
+      bestCost = cost;
+    }
+  }
+  return best;
+}
+
 const JoinEdgeVector& joinedBy(PlanObjectCP table) {
   if (table->is(PlanType::kTableNode)) {
     return table->as<BaseTable>()->joinedBy;
@@ -89,6 +89,11 @@ struct PlanSet {
   /// some other distribution, sets 'needsShuffle ' to true.
   PlanP best(const Distribution& distribution, bool& needsShuffle);
 
+  /// Returns the best plan that is ordered on the 'orderKeys' of
+  /// 'distribution' and has the same partitioning, without a shuffle. Returns
+  /// nullptr if there is no such plan.
+  PlanP bestOrdered(const Distribution& distribution);
+
   /// Retruns the best plan when we're ok with any distribution.
   PlanP best() {
     bool ignore = false;
@@ -185,6 +190,21 @@ struct NextJoin {
 
 class Optimization;
 
+/// Columns of a table that are read after the joins by looking up the rows of
+/// the table by a unique key. See Optimization::makeLateMaterializationJoins.
+struct LateMaterialization {
+  BaseTableCP table;
+
+  /// Index for looking up rows of 'table' by 'keys'.
+  IndexInfo info;
+
+  /// Columns of 'table' read before the joins. Unique in 'table'.
+  ExprVector keys;
+
+  /// Columns of 'table' read after the joins.
+  ColumnVector columns;
+};
+
 /// Tracks the set of tables / columns that have been placed or are still needed
 /// when constructing a partial plan.
 struct PlanState {
@@ -217,6 +237,15 @@ struct PlanState {
   /// lookup keys for an index based derived table.
   PlanObjectSet input;
 
+  /// True if the aggregation of 'dt' started with a partial aggregation below
+  /// the joins. 'exprToColumn' maps the aggregates to the intermediate
+  /// results.
+  bool eagerAggregation{false};
+
+  /// Columns to read after the joins of 'dt' if the first table is read
+  /// without them.
+  const LateMaterialization* lateMaterialization{nullptr};
+
   /// The total cost for the PlanObjects placed thus far.
   Cost cost;
 
@@ -250,6 +279,12 @@ struct PlanState {
   /// targetColumns. Gets smaller as more tables are placed.
   const PlanObjectSet& downstreamColumns() const;
 
+  /// Drops the cached results of downstreamColumns(). Must be called after
+  /// changing 'exprToColumn' for expressions that are not placed.
+  void clearDownstreamColumns() {
+    downstreamColumnsCache.clear();
+  }
+
   /// Replace expressions with pre-computed columns using 'exprToColumn'
   /// mapping.
   ExprVector exprsToColumns(const ExprVector& exprs) const;
@@ -279,7 +314,8 @@ struct PlanState {
 
  private:
   /// Caches results of downstreamColumns(). This is a pure function of
-  /// 'placed', 'targetExprs' and 'dt'.
+  /// 'placed', 'targetExprs' and 'dt' as long as 'exprToColumn' only maps
+  /// placed expressions.
   mutable folly::F14FastMap<PlanObjectSet, PlanObjectSet>
       downstreamColumnsCache;
 };
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "axiom/optimizer/QueryCheckpoints.h"
+#include "axiom/optimizer/VeloxHistory.h"
+
+namespace facebook::axiom::optimizer {
+namespace {
+
+namespace lp = facebook::axiom::logical_plan;
+
+bool hasSubquery(const lp::ExprPtr& expr) {
+  if (expr->isSubquery()) {
+    return true;
+  }
+  return std::ranges::any_of(expr->inputs(), hasSubquery);
+}
+
+// True if 'node' is a scan of one table with at least one filter and only
+// filters and projections over it.
+bool isFilteredScan(const lp::LogicalPlanNode& node) {
+  bool hasFilter = false;
+  for (const auto* current = &node;; current = current->onlyInput().get()) {
+    switch (current->kind()) {
+      case lp::NodeKind::kTableScan:
+        return hasFilter;
+      case lp::NodeKind::kFilter:
+        if (hasSubquery(
+                current->asUnchecked<lp::FilterNode>()->predicate())) {
+          return false;
+        }
+        hasFilter = true;
+        break;
+      case lp::NodeKind::kProject:
+        if (std::ranges::any_of(
+                current->asUnchecked<lp::ProjectNode>()->expressions(),
+                hasSubquery)) {
+          return false;
+        }
+        break;
+      default:
+        return false;
+    }
+  }
+}
+
+void findCheckpoints(
+    const lp::LogicalPlanNode& node,
+    std::vector<lp::LogicalPlanNodePtr>& checkpoints) {
+  for (const auto& input : node.inputs()) {
+    if (node.kind() == lp::NodeKind::kJoin && isFilteredScan(*input)) {
+      checkpoints.push_back(input);
+      continue;
+    }
+    findCheckpoints(*input, checkpoints);
+  }
+}
+} // namespace
+
+// static
+std::vector<logical_plan::LogicalPlanNodePtr> QueryCheckpoints::find(
+    const logical_plan::LogicalPlanNode& plan) {
+  std::vector<logical_plan::LogicalPlanNodePtr> checkpoints;
+  findCheckpoints(plan, checkpoints);
+  return checkpoints;
+}
+
+std::optional<std::vector<velox::exec::TaskStats>> QueryCheckpoints::add(
+    const logical_plan::LogicalPlanNodePtr& node,
+    const PlanAndStats& plan,
+    const std::shared_ptr<runner::Runner>& runner,
+    int64_t maxRows,
+    float threshold) {
+  constexpr int32_t kWaitMicros = 1'000'000;
+
+  const auto& type = node->outputType();
+  std::vector<velox::RowVectorPtr> values;
+  int64_t numRows = 0;
+  while (auto batch = runner->next()) {
+    numRows += batch->size();
+    if (numRows > maxRows) {
+      runner->abort();
+      runner->waitForCompletion(kWaitMicros);
+      return std::nullopt;
+    }
+
+    // The plan of 'node' may name its output columns differently.
+    VELOX_CHECK_EQ(batch->childrenSize(), type->size());
+    values.push_back(std::make_shared<velox::RowVector>(
+        batch->pool(),
+        type,
+        batch->nulls(),
+        batch->size(),
+        batch->children()));
+  }
+
+  // Completion drops the tasks and their stats.
+  auto stats = runner->stats();
+  runner->waitForCompletion(kWaitMicros);
+
+  if (VeloxHistory::findMisestimates(plan, stats, threshold).empty()) {
+    return stats;
+  }
+
+  results_[node->id()] = values.empty()
+      ? std::make_shared<logical_plan::ValuesNode>(
+            node->id(), type, logical_plan::ValuesNode::Rows{})
+      : std::make_shared<logical_plan::ValuesNode>(
+            node->id(), std::move(values));
+  runners_.push_back(runner);
+  return stats;
+}
+
+} // namespace facebook::axiom::optimizer
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <folly/container/F14Map.h>
+#include "axiom/logical_plan/LogicalPlanNode.h"
+#include "axiom/optimizer/ToVelox.h"
+#include "axiom/runner/Runner.h"
+
+namespace facebook::axiom::optimizer {
+
+/// Results of subplans of a query, run before the rest of the query is
+/// planned. The inputs of joins that read one table with a filter are the
+/// checkpoints, since filter selectivities are the estimates most likely to
+/// be off. A checkpoint whose actual cardinalities diverge from the estimates
+/// is kept. The rest of the query is then planned again with its actual
+/// cardinality and reads its result instead of running it again. See
+/// OptimizerOptions::checkpoints.
+class QueryCheckpoints {
+ public:
+  /// Returns the subplans of 'plan' to run as checkpoints.
+  static std::vector<logical_plan::LogicalPlanNodePtr> find(
+      const logical_plan::LogicalPlanNode& plan);
+
+  /// Reads the result of 'node' from 'runner', which runs 'plan', a plan of
+  /// 'node'. Keeps the result if it has at most 'maxRows' rows and the
+  /// cardinality of a node of 'plan' is more than 'threshold' times off its
+  /// prediction. A checkpoint that matches its estimates is not kept, so that
+  /// the query is planned as it would be without it. Returns the stats of
+  /// the tasks of 'runner' for recording in the history, or std::nullopt if
+  /// the result has more than 'maxRows' rows, in which case 'runner' is
+  /// aborted.
+  std::optional<std::vector<velox::exec::TaskStats>> add(
+      const logical_plan::LogicalPlanNodePtr& node,
+      const PlanAndStats& plan,
+      const std::shared_ptr<runner::Runner>& runner,
+      int64_t maxRows,
+      float threshold);
+
+  /// Returns the kept results by the id of their subplan.
+  const folly::F14FastMap<std::string, logical_plan::ValuesNodePtr>& results()
+      const {
+    return results_;
+  }
+
+ private:
+  folly::F14FastMap<std::string, logical_plan::ValuesNodePtr> results_;
+
+  // Runners of 'results_'. The results are allocated from their pools.
+  std::vector<std::shared_ptr<runner::Runner>> runners_;
+};
+
+} // namespace facebook::axiom::optimizer
@@ -223,7 +223,8 @@ JoinSide JoinEdge::sideOf(PlanObjectCP side, bool other) const {
         rightExists_,
         rightNotExists_,
         markColumn_,
-        rightUnique_};
+        rightUnique_,
+        rightSkew_};
   }
 
   return {
@@ -235,7 +236,8 @@ JoinSide JoinEdge::sideOf(PlanObjectCP side, bool other) const {
       false,
       false,
       nullptr,
-      leftUnique_};
+      leftUnique_,
+      leftSkew_};
 }
 
 bool JoinEdge::isBroadcastableType() const {
@@ -459,17 +461,19 @@ void JoinEdge::guessFanout() {
   }
 
   auto* opt = queryCtx()->optimization();
-  auto samplePair = opt->history().sampleJoin(this);
+  auto sample = opt->history().sampleJoin(this);
   auto left = joinCardinality(leftTable_, toRangeCast<Column>(leftKeys_));
   auto right = joinCardinality(rightTable_, toRangeCast<Column>(rightKeys_));
   leftUnique_ = left.unique;
   rightUnique_ = right.unique;
-  if (samplePair.first == 0 && samplePair.second == 0) {
+  leftSkew_ = sample.leftSkew;
+  rightSkew_ = sample.rightSkew;
+  if (sample.rlFanout == 0 && sample.lrFanout == 0) {
     lrFanout_ = right.joinCardinality * baseSelectivity(rightTable_);
     rlFanout_ = left.joinCardinality * baseSelectivity(leftTable_);
   } else {
-    lrFanout_ = samplePair.second * baseSelectivity(rightTable_);
-    rlFanout_ = samplePair.first * baseSelectivity(leftTable_);
+    lrFanout_ = sample.lrFanout * baseSelectivity(rightTable_);
+    rlFanout_ = sample.rlFanout * baseSelectivity(leftTable_);
   }
   // If one side is unique, the other side is a pk to fk join, with fanout =
   // fk-table-card / pk-table-card.
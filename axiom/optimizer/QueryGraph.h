@@ -442,6 +442,10 @@ struct JoinSide {
   ColumnCP markColumn;
   const bool isUnique;
 
+  /// Fraction of the rows of 'table' that have the most frequent value of
+  /// 'keys'. 0 if no key is a heavy hitter or if not known.
+  const float skew;
+
   /// Returns the join type to use if 'this' is the right side.
   velox::core::JoinType leftJoinType() const {
     if (isNotExists) {
@@ -554,6 +558,18 @@ class JoinEdge {
     return rlFanout_;
   }
 
+  /// Fraction of the 'leftTable' rows that have the most frequent value of
+  /// 'leftKeys' if this is a heavy hitter in the join sample, else 0.
+  float leftSkew() const {
+    return leftSkew_;
+  }
+
+  /// Fraction of the 'rightTable' rows that have the most frequent value of
+  /// 'rightKeys' if this is a heavy hitter in the join sample, else 0.
+  float rightSkew() const {
+    return rightSkew_;
+  }
+
   bool leftOptional() const {
     return leftOptional_;
   }
@@ -674,6 +690,10 @@ class JoinEdge {
   // True if 'lrFanout_' and 'rlFanout_' are set by setFanouts.
   bool fanoutsFixed_{false};
 
+  // See leftSkew() and rightSkew().
+  float leftSkew_{0};
+  float rightSkew_{0};
+
   // 'rightKeys' select max 1 'leftTable' row.
   bool leftUnique_{false};
 
@@ -353,6 +353,18 @@ Join::Join(
   cost_.inputCardinality = inputCardinality();
   cost_.fanout = fanout;
 
+  if (method == JoinMethod::kMerge) {
+    // Both sides are read once in key order. Each row of either side is
+    // compared to the current row of the other side. Nothing is resident.
+    const float rightRows = right->resultCardinality();
+    const auto numKeys = static_cast<float>(leftKeys.size());
+    const auto numRightColumns = static_cast<float>(right->columns().size());
+    cost_.unitCost = numKeys * Costs::kKeyCompareCost *
+            (1 + rightRows / std::max<float>(1, cost_.inputCardinality)) +
+        cost_.fanout * numRightColumns * Costs::kHashExtractColumnCost;
+    return;
+  }
+
   const float buildSize = right->cost().inputCardinality;
   const auto numRightColumns =
       static_cast<float>(right->input()->columns().size());
@@ -360,6 +372,9 @@ Join::Join(
   const auto numLeftKeys = static_cast<float>(leftKeys.size());
   cost_.unitCost = Costs::hashProbeCost(buildSize) + cost_.fanout * rowCost +
       numLeftKeys * Costs::kHashColumnCost;
+
+  // The build side is resident for the duration of the probe.
+  cost_.peakResidentBytes = right->cost().peakResidentBytes;
 }
 
 namespace {
@@ -430,6 +445,9 @@ std::string Join::toString(bool recursive, bool detail) const {
   }
   out << "*" << (method == JoinMethod::kHash ? "H" : "M") << " "
       << joinTypeLabel(joinType);
+  if (bloomFilter) {
+    out << " bloom";
+  }
   printCost(detail, out);
   if (detail) {
     out << "columns: " << itemsToString(columns().data(), columns().size())
@@ -503,16 +521,40 @@ Unnest::Unnest(
       unnestExprs{std::move(unnestExprs)},
       unnestedColumns{std::move(unnestedColumns)} {}
 
+namespace {
+
+// Returns the distribution of an aggregation of 'input'. The output is in the
+// order of the input only if the input is grouped on the keys.
+Distribution aggregationDistribution(
+    const RelationOp& input,
+    const ExprVector& groupingKeys) {
+  auto distribution = input.distribution();
+  if (groupingKeys.empty() || !distribution.isGroupedOn(groupingKeys)) {
+    distribution.orderKeys.clear();
+    distribution.orderTypes.clear();
+  }
+  return distribution;
+}
+
+} // namespace
+
 Aggregation::Aggregation(
     RelationOpPtr input,
     ExprVector groupingKeysVector,
     AggregateVector aggregatesVector,
     velox::core::AggregationNode::Step step,
     ColumnVector columns)
-    : RelationOp{RelType::kAggregation, std::move(input), std::move(columns)},
+    : RelationOp{
+          RelType::kAggregation,
+          input,
+          aggregationDistribution(*input, groupingKeysVector),
+          std::move(columns)},
       groupingKeys{std::move(groupingKeysVector)},
       aggregates{std::move(aggregatesVector)},
-      step{step} {
+      step{step},
+      preGrouped{
+          !groupingKeys.empty() &&
+          input_->distribution().isGroupedOn(groupingKeys)} {
   cost_.inputCardinality = inputCardinality();
 
   float cardinality = 1;
@@ -532,10 +574,19 @@ Aggregation::Aggregation(
 
   cost_.fanout = nOut / cost_.inputCardinality;
   const auto numGrouppingKeys = static_cast<float>(groupingKeys.size());
-  cost_.unitCost = numGrouppingKeys * Costs::hashProbeCost(nOut);
-
   float rowBytes = byteSize(groupingKeys) + byteSize(aggregates);
   cost_.totalBytes = nOut * rowBytes;
+
+  if (preGrouped) {
+    // Each row is compared to the previous one instead of probing a hash
+    // table. Only the current group is held.
+    cost_.unitCost = numGrouppingKeys * Costs::kKeyCompareCost;
+    cost_.peakResidentBytes = rowBytes;
+    return;
+  }
+
+  cost_.unitCost = numGrouppingKeys * Costs::hashProbeCost(nOut);
+  cost_.peakResidentBytes = cost_.totalBytes;
 }
 
 std::string Unnest::toString(bool recursive, bool detail) const {
@@ -619,6 +670,7 @@ HashBuild::HashBuild(
       Costs::hashProbeCost(cost_.inputCardinality) +
       numColumns * Costs::kHashExtractColumnCost * 2;
   cost_.totalBytes = cost_.inputCardinality * byteSize(columns());
+  cost_.peakResidentBytes = cost_.totalBytes;
 }
 
 std::string HashBuild::toString(bool recursive, bool detail) const {
@@ -734,9 +786,17 @@ namespace {
 Distribution makeOrderByDistribution(
     const RelationOpPtr& input,
     ExprVector orderKeys,
-    OrderTypeVector orderTypes) {
+    OrderTypeVector orderTypes,
+    bool isPartial) {
   Distribution distribution = input->distribution();
 
+  if (isPartial) {
+    // Each driver produces its own TopN.
+    distribution.orderKeys.clear();
+    distribution.orderTypes.clear();
+    return distribution;
+  }
+
   distribution.distributionType = DistributionType::gather();
   distribution.partition.clear();
   distribution.orderKeys = std::move(orderKeys);
@@ -753,14 +813,33 @@ OrderBy::OrderBy(
     ExprVector orderKeys,
     OrderTypeVector orderTypes,
     int64_t limit,
-    int64_t offset)
-    : RelationOp{RelType::kOrderBy, input, makeOrderByDistribution(input, std::move(orderKeys), std::move(orderTypes))},
+    int64_t offset,
+    bool isPartial)
+    : RelationOp{RelType::kOrderBy, input, makeOrderByDistribution(input, orderKeys, orderTypes, isPartial)},
+      orderKeys{std::move(orderKeys)},
+      orderTypes{std::move(orderTypes)},
       limit{limit},
-      offset{offset} {
+      offset{offset},
+      isPartial{isPartial} {
+  VELOX_CHECK(!isPartial || (limit > 0 && offset == 0));
   cost_.inputCardinality = inputCardinality();
   cost_.fanout = 1;
 
-  // TODO Fill in cost_.unitCost and others.
+  const float rowBytes = byteSize(columns());
+  cost_.totalBytes = cost_.inputCardinality * rowBytes;
+
+  if (isPartial) {
+    // Most rows are compared with the top of a heap of 'limit' rows once.
+    cost_.unitCost = Costs::kKeyCompareCost;
+    if (cost_.inputCardinality > static_cast<float>(limit)) {
+      cost_.fanout = static_cast<float>(limit) / cost_.inputCardinality;
+    }
+  }
+
+  // A TopN keeps only 'limit + offset' rows.
+  cost_.peakResidentBytes = limit > 0
+      ? std::min<float>(cost_.inputCardinality, limit + offset) * rowBytes
+      : cost_.totalBytes;
 }
 
 std::string OrderBy::toString(bool recursive, bool detail) const {
@@ -770,17 +849,25 @@ std::string OrderBy::toString(bool recursive, bool detail) const {
   }
 
   if (detail) {
-    out << "OrderBy (" << distribution_.toString() << ")\n";
+    out << (isPartial ? "PartialOrderBy (" : "OrderBy (")
+        << distribution_.toString() << ")\n";
   } else {
-    out << "order by " << distribution_.orderKeys.size() << " columns ";
+    out << (isPartial ? "partial " : "") << "order by " << orderKeys.size()
+        << " columns ";
   }
   return out.str();
 }
 
-Limit::Limit(RelationOpPtr input, int64_t limit, int64_t offset)
-    : RelationOp{RelType::kLimit, std::move(input), Distribution::gather()},
+Limit::Limit(
+    RelationOpPtr input,
+    int64_t limit,
+    int64_t offset,
+    bool isPartial)
+    : RelationOp{RelType::kLimit, input, isPartial ? input->distribution() : Distribution::gather()},
       limit{limit},
-      offset{offset} {
+      offset{offset},
+      isPartial{isPartial} {
+  VELOX_CHECK(!isPartial || offset == 0);
   cost_.inputCardinality = inputCardinality();
   cost_.unitCost = 0.01;
   const auto cardinality = static_cast<float>(limit);
@@ -802,9 +889,11 @@ std::string Limit::toString(bool recursive, bool detail) const {
   }
 
   if (detail) {
-    out << "Limit (" << offset << ", " << limit << ")\n";
+    out << (isPartial ? "PartialLimit (" : "Limit (") << offset << ", "
+        << limit << ")\n";
   } else {
-    out << "offset " << offset << " limit " << limit << " ";
+    out << (isPartial ? "partial " : "") << "offset " << offset << " limit "
+        << limit << " ";
   }
   return out.str();
 }
@@ -860,4 +949,263 @@ std::string UnionAll::toString(bool recursive, bool detail) const {
   return out.str();
 }
 
+namespace {
+
+using PlanObjectMap = folly::F14FastMap<PlanObjectCP, PlanObjectCP>;
+
+bool sameExpr(ExprCP left, ExprCP right, const PlanObjectMap& mapping);
+
+bool sameExprs(
+    const ExprVector& left,
+    const ExprVector& right,
+    const PlanObjectMap& mapping) {
+  if (left.size() != right.size()) {
+    return false;
+  }
+  for (auto i = 0; i < left.size(); ++i) {
+    if (!sameExpr(left[i], right[i], mapping)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Same as sameExprs() for conjuncts, which may come in any order.
+bool sameConjuncts(
+    const ExprVector& left,
+    const ExprVector& right,
+    const PlanObjectMap& mapping) {
+  if (left.size() != right.size()) {
+    return false;
+  }
+  return std::ranges::all_of(right, [&](ExprCP conjunct) {
+    return std::ranges::any_of(left, [&](ExprCP other) {
+      return sameExpr(other, conjunct, mapping);
+    });
+  });
+}
+
+bool sameExpr(ExprCP left, ExprCP right, const PlanObjectMap& mapping) {
+  if (left == nullptr || right == nullptr) {
+    return left == right;
+  }
+  if (auto it = mapping.find(right); it != mapping.end()) {
+    return it->second == left;
+  }
+  if (left == right) {
+    return true;
+  }
+  if (left->type() != right->type() ||
+      left->value().type != right->value().type) {
+    return false;
+  }
+
+  switch (right->type()) {
+    case PlanType::kColumnExpr: {
+      // Columns of corresponding scans of the same table.
+      const auto* leftColumn = left->as<Column>();
+      const auto* rightColumn = right->as<Column>();
+      auto it = mapping.find(rightColumn->relation());
+      return it != mapping.end() && it->second == leftColumn->relation() &&
+          leftColumn->schemaColumn() != nullptr &&
+          leftColumn->schemaColumn() == rightColumn->schemaColumn() &&
+          leftColumn->path() == rightColumn->path();
+    }
+    case PlanType::kLiteralExpr:
+      return left->as<Literal>()->literal() == right->as<Literal>()->literal();
+    case PlanType::kFieldExpr: {
+      const auto* leftField = left->as<Field>();
+      const auto* rightField = right->as<Field>();
+      return leftField->field() == rightField->field() &&
+          leftField->index() == rightField->index() &&
+          sameExpr(leftField->base(), rightField->base(), mapping);
+    }
+    case PlanType::kAggregateExpr: {
+      const auto* leftAggregate = left->as<Aggregate>();
+      const auto* rightAggregate = right->as<Aggregate>();
+      if (leftAggregate->isDistinct() != rightAggregate->isDistinct() ||
+          !sameExpr(
+              leftAggregate->condition(),
+              rightAggregate->condition(),
+              mapping)) {
+        return false;
+      }
+      [[fallthrough]];
+    }
+    case PlanType::kCallExpr: {
+      const auto* leftCall = left->as<Call>();
+      const auto* rightCall = right->as<Call>();
+      return leftCall->name() == rightCall->name() &&
+          sameExprs(leftCall->args(), rightCall->args(), mapping);
+    }
+    default:
+      return false;
+  }
+}
+
+// Adds the correspondence of 'right' to 'left' to 'mapping'. Returns false if
+// 'right' already corresponds to something else.
+bool mapObject(PlanObjectCP left, PlanObjectCP right, PlanObjectMap& mapping) {
+  auto [it, inserted] = mapping.try_emplace(right, left);
+  return inserted || it->second == left;
+}
+
+bool mapColumns(
+    const ColumnVector& left,
+    const ColumnVector& right,
+    PlanObjectMap& mapping) {
+  if (left.size() != right.size()) {
+    return false;
+  }
+  for (auto i = 0; i < left.size(); ++i) {
+    if (left[i]->value().type != right[i]->value().type ||
+        !mapObject(left[i], right[i], mapping)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool sameInput(
+    const RelationOpPtr& left,
+    const RelationOpPtr& right,
+    PlanObjectMap& mapping) {
+  if (left == nullptr || right == nullptr) {
+    return left == right;
+  }
+  return sameResult(*left, *right, mapping);
+}
+
+bool sameTableScan(
+    const TableScan& left,
+    const TableScan& right,
+    PlanObjectMap& mapping) {
+  if (left.baseTable->schemaTable != right.baseTable->schemaTable ||
+      left.index != right.index || !left.keys.empty() ||
+      !right.keys.empty() ||
+      !mapObject(left.baseTable, right.baseTable, mapping)) {
+    return false;
+  }
+  for (auto i = 0; i < right.columns().size(); ++i) {
+    if (i >= left.columns().size() ||
+        !sameExpr(left.columns()[i], right.columns()[i], mapping)) {
+      return false;
+    }
+  }
+  return sameConjuncts(
+             left.baseTable->columnFilters,
+             right.baseTable->columnFilters,
+             mapping) &&
+      sameConjuncts(left.baseTable->filter, right.baseTable->filter, mapping);
+}
+
+bool sameOp(
+    const RelationOp& left,
+    const RelationOp& right,
+    PlanObjectMap& mapping) {
+  switch (right.relType()) {
+    case RelType::kTableScan:
+      return sameTableScan(
+          *left.as<TableScan>(), *right.as<TableScan>(), mapping);
+    case RelType::kValues:
+      return &left.as<Values>()->valuesTable ==
+          &right.as<Values>()->valuesTable;
+    case RelType::kRepartition: {
+      const auto& leftDistribution = left.distribution();
+      const auto& rightDistribution = right.distribution();
+      return leftDistribution.isBroadcast == rightDistribution.isBroadcast &&
+          leftDistribution.distributionType.isGather ==
+          rightDistribution.distributionType.isGather &&
+          sameExprs(
+              leftDistribution.partition, rightDistribution.partition, mapping);
+    }
+    case RelType::kFilter:
+      return sameConjuncts(
+          left.as<Filter>()->exprs(), right.as<Filter>()->exprs(), mapping);
+    case RelType::kProject:
+      return sameExprs(
+          left.as<Project>()->exprs(), right.as<Project>()->exprs(), mapping);
+    case RelType::kJoin: {
+      const auto* leftJoin = left.as<Join>();
+      const auto* rightJoin = right.as<Join>();
+      return leftJoin->method == rightJoin->method &&
+          leftJoin->joinType == rightJoin->joinType &&
+          sameInput(leftJoin->right, rightJoin->right, mapping) &&
+          sameExprs(leftJoin->leftKeys, rightJoin->leftKeys, mapping) &&
+          sameExprs(leftJoin->rightKeys, rightJoin->rightKeys, mapping) &&
+          sameConjuncts(leftJoin->filter, rightJoin->filter, mapping);
+    }
+    case RelType::kHashBuild:
+      return sameExprs(
+          left.as<HashBuild>()->keys, right.as<HashBuild>()->keys, mapping);
+    case RelType::kAggregation: {
+      const auto* leftAggregation = left.as<Aggregation>();
+      const auto* rightAggregation = right.as<Aggregation>();
+      if (leftAggregation->step != rightAggregation->step ||
+          leftAggregation->aggregates.size() !=
+              rightAggregation->aggregates.size() ||
+          !sameExprs(
+              leftAggregation->groupingKeys,
+              rightAggregation->groupingKeys,
+              mapping)) {
+        return false;
+      }
+      for (auto i = 0; i < leftAggregation->aggregates.size(); ++i) {
+        if (!sameExpr(
+                leftAggregation->aggregates[i],
+                rightAggregation->aggregates[i],
+                mapping)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case RelType::kOrderBy: {
+      const auto* leftOrderBy = left.as<OrderBy>();
+      const auto* rightOrderBy = right.as<OrderBy>();
+      return leftOrderBy->orderTypes == rightOrderBy->orderTypes &&
+          leftOrderBy->limit == rightOrderBy->limit &&
+          leftOrderBy->offset == rightOrderBy->offset &&
+          leftOrderBy->isPartial == rightOrderBy->isPartial &&
+          sameExprs(leftOrderBy->orderKeys, rightOrderBy->orderKeys, mapping);
+    }
+    case RelType::kLimit: {
+      const auto* leftLimit = left.as<Limit>();
+      const auto* rightLimit = right.as<Limit>();
+      return leftLimit->limit == rightLimit->limit &&
+          leftLimit->offset == rightLimit->offset &&
+          leftLimit->isPartial == rightLimit->isPartial;
+    }
+    case RelType::kUnionAll: {
+      const auto& leftInputs = left.as<UnionAll>()->inputs;
+      const auto& rightInputs = right.as<UnionAll>()->inputs;
+      if (leftInputs.size() != rightInputs.size()) {
+        return false;
+      }
+      for (auto i = 0; i < leftInputs.size(); ++i) {
+        if (!sameResult(*leftInputs[i], *rightInputs[i], mapping)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+} // namespace
+
+bool sameResult(
+    const RelationOp& left,
+    const RelationOp& right,
+    PlanObjectMap& mapping) {
+  if (left.relType() != right.relType() ||
+      !sameInput(left.input(), right.input(), mapping) ||
+      !sameOp(left, right, mapping)) {
+    return false;
+  }
+  return mapColumns(left.columns(), right.columns(), mapping);
+}
+
 } // namespace facebook::axiom::optimizer
@@ -416,6 +416,15 @@ struct Join : public RelationOp {
   // Total cost of build side plan. For documentation.
   Cost buildCost;
 
+  // True if the probe-side scans are filtered by the build keys at run time.
+  // See OptimizerOptions::dynamicFilterMaxSelectivity.
+  bool dynamicFilter{false};
+
+  // True if the probe-side scans are filtered by a Bloom filter of the build
+  // keys before the probe side is shuffled. Replaces 'dynamicFilter'. See
+  // OptimizerOptions::bloomFilterMaxBuildRows.
+  bool bloomFilter{false};
+
   const QGString& historyKey() const override;
 
   std::string toString(bool recursive, bool detail) const override;
@@ -472,6 +481,11 @@ struct Aggregation : public RelationOp {
   const AggregateVector aggregates;
   const velox::core::AggregationNode::Step step;
 
+  /// True if the input is grouped on 'groupingKeys'. Each group is then
+  /// aggregated and produced before the next one starts, using memory for
+  /// one group only.
+  const bool preGrouped;
+
   const QGString& historyKey() const override;
 
   std::string toString(bool recursive, bool detail) const override;
@@ -484,11 +498,22 @@ struct OrderBy : public RelationOp {
       ExprVector orderKeys,
       OrderTypeVector orderTypes,
       int64_t limit = -1,
-      int64_t offset = 0);
+      int64_t offset = 0,
+      bool isPartial = false);
+
+  /// The sort keys and their order. Also the order of the distribution unless
+  /// 'isPartial' is true.
+  const ExprVector orderKeys;
+  const OrderTypeVector orderTypes;
 
   const int64_t limit;
   const int64_t offset;
 
+  /// True if this is a TopN that keeps the first 'limit' rows of each driver
+  /// of the input and does not repartition. The final order and limit are
+  /// applied further up the plan. The output is in no particular order.
+  const bool isPartial;
+
   std::string toString(bool recursive, bool detail) const override;
 };
 
@@ -508,11 +533,20 @@ struct UnionAll : public RelationOp {
 using UnionAllCP = const UnionAll*;
 
 struct Limit : public RelationOp {
-  Limit(RelationOpPtr input, int64_t limit, int64_t offset);
+  Limit(
+      RelationOpPtr input,
+      int64_t limit,
+      int64_t offset,
+      bool isPartial = false);
 
   const int64_t limit;
   const int64_t offset;
 
+  /// True if this keeps the first 'limit' rows of each driver of the input
+  /// and does not repartition. The final limit is applied further up the
+  /// plan.
+  const bool isPartial;
+
   bool isNoLimit() const {
     static const auto kMax = std::numeric_limits<int64_t>::max();
     return limit >= (kMax - offset);
@@ -523,4 +557,13 @@ struct Limit : public RelationOp {
 
 using LimitCP = const Limit*;
 
+/// True if 'right' produces the same rows as 'left' with its columns in the
+/// same order, e.g. if both are plans of one subquery that occurs twice in a
+/// query. Adds the columns and tables of 'left' that correspond to the
+/// columns and tables of 'right' to 'mapping', keyed on those of 'right'.
+bool sameResult(
+    const RelationOp& left,
+    const RelationOp& right,
+    folly::F14FastMap<PlanObjectCP, PlanObjectCP>& mapping);
+
 } // namespace facebook::axiom::optimizer
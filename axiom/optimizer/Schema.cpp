@@ -137,6 +137,34 @@ SchemaTableCP Schema::findTable(
       {},
       std::move(columns),
       connectorTable->layouts()[0]);
+
+  // Layouts with lookup keys are indices ordered on the keys if the connector
+  // serves index lookups. Full scans use the first ColumnGroup, so these are
+  // only used for lookups and for knowing that the keys are unique.
+  for (const auto* layout : connectorTable->layouts()) {
+    if (layout->lookupKeys().empty() ||
+        !layout->connector()->supportsIndexLookup()) {
+      continue;
+    }
+    auto schemaColumns = [&](const auto& layoutColumns) {
+      ColumnVector result;
+      for (const auto* column : layoutColumns) {
+        result.push_back(schemaTable->columns.at(toName(column->name())));
+      }
+      return result;
+    };
+    auto keys = schemaColumns(layout->lookupKeys());
+    const auto numKeys = static_cast<int32_t>(keys.size());
+    schemaTable->addIndex(
+        toName(layout->name()),
+        layout->lookupKeysUnique() ? numKeys : 0,
+        numKeys,
+        keys,
+        defaultDistributionType,
+        {},
+        schemaColumns(layout->columns()),
+        layout);
+  }
   table = {schemaTable, std::move(connectorTable)};
   return table.schemaTable;
 }
@@ -390,6 +418,50 @@ bool Distribution::isSameOrder(const Distribution& other) const {
   return true;
 }
 
+bool Distribution::isOrderedOn(
+    const ExprVector& keys,
+    const OrderTypeVector& types) const {
+  VELOX_DCHECK_EQ(keys.size(), types.size());
+  if (orderTypes.size() < keys.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < keys.size(); ++i) {
+    if (!orderKeys[i]->sameOrEqual(*keys[i]) || orderTypes[i] != types[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool Distribution::isGroupedOn(const ExprVector& keys) const {
+  if (keys.empty()) {
+    return false;
+  }
+  // A prefix of the order keys must have all of 'keys' and nothing else. An
+  // order key may repeat, so count the distinct keys covered.
+  std::vector<bool> covered(keys.size(), false);
+  size_t numCovered = 0;
+  for (auto orderKey : orderKeys) {
+    bool found = false;
+    for (size_t i = 0; i < keys.size(); ++i) {
+      if (keys[i]->sameOrEqual(*orderKey)) {
+        found = true;
+        if (!covered[i]) {
+          covered[i] = true;
+          ++numCovered;
+        }
+      }
+    }
+    if (!found) {
+      return false;
+    }
+    if (numCovered == keys.size()) {
+      return true;
+    }
+  }
+  return false;
+}
+
 Distribution Distribution::rename(
     const ExprVector& exprs,
     const ColumnVector& names) const {
@@ -192,6 +192,14 @@ struct Distribution {
   /// True if 'other' has the same ordering columns and order type.
   bool isSameOrder(const Distribution& other) const;
 
+  /// True if the leading ordering columns are 'keys' with order 'types'.
+  bool isOrderedOn(const ExprVector& keys, const OrderTypeVector& types) const;
+
+  /// True if rows with equal 'keys' are adjacent within each partition, i.e.
+  /// the leading ordering columns are 'keys' in any order and direction. An
+  /// ordering column may repeat.
+  bool isGroupedOn(const ExprVector& keys) const;
+
   Distribution rename(const ExprVector& exprs, const ColumnVector& names) const;
 
   std::string toString() const;
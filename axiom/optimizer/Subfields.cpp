@@ -273,9 +273,42 @@ void ToGraph::markSubfields(
         return;
       }
     }
+
+    // A correlated subquery refers to the fields of the enclosing queries.
+    for (auto it = outerContexts_.rbegin(); it != outerContexts_.rend(); ++it) {
+      for (auto i = 0; i < it->sources.size(); ++i) {
+        if (auto maybeIdx = it->rowTypes[i]->getChildIdxIfExists(name)) {
+          markFieldAccessed(
+              it->sources[i],
+              static_cast<int32_t>(maybeIdx.value()),
+              steps,
+              isControl,
+              *it);
+          return;
+        }
+      }
+    }
     VELOX_FAIL("Field not found {}", name);
   }
 
+  if (expr->isSubquery()) {
+    const auto& subquery = *expr->asUnchecked<lp::SubqueryExpr>()->subquery();
+    outerContexts_.push_back(context);
+    markAllSubfields(subquery);
+    outerContexts_.pop_back();
+    return;
+  }
+
+  if (isSpecialForm(expr, lp::SpecialForm::kExists)) {
+    // Only the rows of an EXISTS subquery matter, not its columns.
+    const auto& subquery =
+        *expr->inputAt(0)->asUnchecked<lp::SubqueryExpr>()->subquery();
+    outerContexts_.push_back(context);
+    markControl(subquery);
+    outerContexts_.pop_back();
+    return;
+  }
+
   if (isSpecialForm(expr, lp::SpecialForm::kDereference)) {
     VELOX_CHECK(expr->inputAt(1)->isConstant());
     const auto* field = expr->inputAt(1)->asUnchecked<lp::ConstantExpr>();
@@ -25,6 +25,7 @@
 #include "velox/expression/ConstantExpr.h"
 #include "velox/expression/Expr.h"
 #include "velox/expression/FunctionSignature.h"
+#include "velox/expression/ScopedVarSetter.h"
 #include "velox/functions/FunctionRegistry.h"
 
 namespace facebook::axiom::optimizer {
@@ -85,6 +86,10 @@ ToGraph::ToGraph(
   reversibleFunctions_[SpecialFormCallNames::kAnd] = SpecialFormCallNames::kAnd;
   reversibleFunctions_[SpecialFormCallNames::kOr] = SpecialFormCallNames::kOr;
 
+  for (const auto& name : registry->nullPropagatingFunctions()) {
+    nullPropagatingFunctions_.insert(toName(name));
+  }
+
   if (auto elementAt = registry->elementAt()) {
     elementAt_ = toName(elementAt.value());
   }
@@ -155,6 +160,8 @@ void ToGraph::translateConjuncts(const lp::ExprPtr& input, ExprVector& flat) {
     for (auto& child : input->inputs()) {
       translateConjuncts(child, flat);
     }
+  } else if (allowSubqueries_ && translateSemijoin(input)) {
+    // The conjunct is a join edge in 'currentDt_'.
   } else {
     auto translatedExpr = translateExpr(input);
     if (!isConstantTrue(translatedExpr)) {
@@ -675,6 +682,10 @@ ExprCP ToGraph::translateExpr(const lp::ExprPtr& expr) {
     return makeConstant(*expr->asUnchecked<lp::ConstantExpr>());
   }
 
+  if (expr->isSubquery()) {
+    return translateScalarSubquery(*expr->asUnchecked<lp::SubqueryExpr>());
+  }
+
   if (auto path = translateSubfield(expr)) {
     return path.value();
   }
@@ -995,6 +1006,40 @@ AggregationPlanCP ToGraph::translateAggregation(const lp::AggregateNode& agg) {
     }
   }
 
+  // A correlated subquery is grouped on the columns its correlated
+  // equalities compare to the enclosing query.
+  if (correlation_ != nullptr && correlation_->dt == currentDt_) {
+    correlation_->globalAggregation = agg.groupingKeys().empty();
+    for (const auto* conjunct : correlation_->conjuncts) {
+      ExprCP key = nullptr;
+      if (isCallExpr(conjunct, equality_)) {
+        const auto* call = conjunct->as<Call>();
+        for (auto i = 0; i < 2; ++i) {
+          const auto* arg = call->argAt(i);
+          const auto* other = call->argAt(1 - i);
+          if (arg->is(PlanType::kColumnExpr) &&
+              !correlation_->outerTables.contains(
+                  arg->as<Column>()->relation()) &&
+              other->allTables().isSubset(correlation_->outerTables)) {
+            key = arg;
+          }
+        }
+      }
+      VELOX_CHECK_NOT_NULL(
+          key,
+          "Correlated subqueries with aggregation support only equalities "
+          "between a column of the subquery and the enclosing query: {}",
+          conjunct->toString());
+
+      auto it = uniqueGroupingKeys.try_emplace(key).first;
+      if (!it->second) {
+        columns.push_back(key->as<Column>());
+        deduppedGroupingKeys.emplace_back(key);
+        it->second = columns.back();
+      }
+    }
+  }
+
   AggregateVector deduppedAggregates;
   folly::F14FastMap<AggregateDedupKey, ColumnCP, AggregateDedupHasher>
       uniqueAggregates;
@@ -1139,6 +1184,28 @@ void extractNonInnerJoinEqualities(
   }
 }
 
+// True if 'expr' is a call to Presto's 'not'.
+bool isNegation(const lp::ExprPtr& expr) {
+  if (!expr->isCall()) {
+    return false;
+  }
+  std::string_view name = expr->asUnchecked<lp::CallExpr>()->name();
+  return name == "not" || name.ends_with(".not");
+}
+
+// True if the aggregates in 'aggregation' return null for an empty input.
+// A missing group of a correlated scalar subquery then has the same effect
+// on the enclosing query as a null result.
+bool isNullOnEmpty(const AggregationPlan& aggregation) {
+  return std::ranges::none_of(
+      aggregation.aggregates(), [](const auto* aggregate) {
+        std::string_view name = aggregate->name();
+        name = name.substr(name.rfind('.') + 1);
+        return name == "count" || name == "count_if" ||
+            name == "approx_distinct";
+      });
+}
+
 } // namespace
 
 void ToGraph::translateJoin(const lp::JoinNode& join) {
@@ -1173,6 +1240,7 @@ void ToGraph::translateJoin(const lp::JoinNode& join) {
   translateConjuncts(join.condition(), conjuncts);
 
   if (isInner) {
+    simplifyOuterJoins(conjuncts);
     currentDt_->conjuncts.insert(
         currentDt_->conjuncts.end(), conjuncts.begin(), conjuncts.end());
   } else {
@@ -1207,6 +1275,309 @@ void ToGraph::translateJoin(const lp::JoinNode& join) {
   }
 }
 
+bool ToGraph::isNullRejecting(ExprCP expr, PlanObjectCP table) const {
+  if (expr->is(PlanType::kCallExpr)) {
+    const auto* call = expr->as<Call>();
+    auto rejects = [&](ExprCP arg) { return isNullRejecting(arg, table); };
+    if (call->name() == SpecialFormCallNames::kAnd) {
+      return std::ranges::any_of(call->args(), rejects);
+    }
+    if (call->name() == SpecialFormCallNames::kOr) {
+      return std::ranges::all_of(call->args(), rejects);
+    }
+  }
+  return isNullIfNull(expr, table);
+}
+
+bool ToGraph::isNullIfNull(ExprCP expr, PlanObjectCP table) const {
+  if (expr->is(PlanType::kColumnExpr)) {
+    return expr->as<Column>()->relation() == table;
+  }
+
+  if (!expr->is(PlanType::kCallExpr)) {
+    return false;
+  }
+
+  const auto* call = expr->as<Call>();
+  const auto name = call->name();
+  const auto& args = call->args();
+
+  // 'x IN (...)' and 'cast(x)' are null if 'x' is null.
+  if (name == SpecialFormCallNames::kIn ||
+      name == SpecialFormCallNames::kCast) {
+    return isNullIfNull(args[0], table);
+  }
+
+  // Only functions known to return null for a null argument qualify. Others,
+  // e.g. coalesce or is_null, may turn a null into a value.
+  if (nullPropagatingFunctions_.contains(name)) {
+    return std::ranges::any_of(
+        args, [&](ExprCP arg) { return isNullIfNull(arg, table); });
+  }
+
+  return false;
+}
+
+void ToGraph::simplifyOuterJoins(const ExprVector& conjuncts) {
+  auto rejectsNulls = [&](PlanObjectCP table) {
+    return table != nullptr &&
+        std::ranges::any_of(conjuncts, [&](ExprCP conjunct) {
+             return isNullRejecting(conjunct, table);
+           });
+  };
+
+  auto& joins = currentDt_->joins;
+  for (auto i = 0; i < joins.size(); ++i) {
+    auto* edge = joins[i];
+    if (edge->isSemi() || edge->isAnti() ||
+        (!edge->leftOptional() && !edge->rightOptional())) {
+      continue;
+    }
+
+    const bool leftOptional =
+        edge->leftOptional() && !rejectsNulls(edge->leftTable());
+    const bool rightOptional =
+        edge->rightOptional() && !rejectsNulls(edge->rightTable());
+    if (leftOptional == edge->leftOptional() &&
+        rightOptional == edge->rightOptional()) {
+      continue;
+    }
+
+    if (!leftOptional && !rightOptional) {
+      // An inner join is represented by its conjuncts. The equalities become
+      // join edges in distributeConjuncts() and the tables can be reordered
+      // freely. The join condition may in turn reject nulls of an outer join
+      // below, e.g. a left join to a dimension reached through another one.
+      ExprVector condition = edge->filter();
+      for (auto j = 0; j < edge->numKeys(); ++j) {
+        condition.push_back(deduppedCall(
+            equality_,
+            Value(toType(velox::BOOLEAN()), 2),
+            ExprVector{edge->leftKeys()[j], edge->rightKeys()[j]},
+            FunctionSet()));
+      }
+      joins.erase(joins.begin() + i);
+      simplifyOuterJoins(condition);
+      currentDt_->conjuncts.insert(
+          currentDt_->conjuncts.end(), condition.begin(), condition.end());
+      i = -1;
+      continue;
+    }
+
+    // A full outer join becomes a left or right join.
+    auto* simplified = make<JoinEdge>(
+        edge->leftTable(),
+        edge->rightTable(),
+        JoinEdge::Spec{
+            .filter = edge->filter(),
+            .leftOptional = leftOptional,
+            .rightOptional = rightOptional});
+    for (auto j = 0; j < edge->numKeys(); ++j) {
+      simplified->addEquality(edge->leftKeys()[j], edge->rightKeys()[j]);
+    }
+    joins[i] = simplified;
+  }
+}
+
+DerivedTableP ToGraph::translateSubquery(
+    const lp::LogicalPlanNode& subquery,
+    bool exportOutput,
+    Correlation& correlation) {
+  auto* outerDt = currentDt_;
+  const auto* outerExprSource = exprSource_;
+
+  correlation.parent = correlation_;
+  correlation.dt = newDt();
+  correlation.outerTables = outerDt->tableSet;
+
+  correlation_ = &correlation;
+  currentDt_ = correlation.dt;
+  {
+    velox::ScopedVarSetter noSubqueries(&allowSubqueries_, false);
+    makeQueryGraph(subquery, kAllAllowedInDt);
+  }
+  auto* dt = currentDt_;
+
+  correlation_ = correlation.parent;
+  currentDt_ = outerDt;
+  exprSource_ = outerExprSource;
+
+  VELOX_CHECK(
+      correlation.conjuncts.empty() || dt == correlation.dt,
+      "Correlated conjuncts must be in the outermost derived table of a "
+      "subquery");
+
+  if (exportOutput) {
+    setDtUsedOutput(dt, subquery);
+  }
+
+  // The correlated conjuncts are evaluated in the enclosing query. They refer
+  // to the columns of the subquery through the columns of 'dt'.
+  ColumnVector innerColumns;
+  ExprVector dtColumns;
+  for (const auto* conjunct : correlation.conjuncts) {
+    conjunct->columns().forEach<Column>([&](const Column* column) {
+      if (correlation.outerTables.contains(column->relation()) ||
+          std::ranges::find(innerColumns, column) != innerColumns.end()) {
+        return;
+      }
+      innerColumns.push_back(column);
+      auto it = std::ranges::find(dt->exprs, column);
+      if (it != dt->exprs.end()) {
+        dtColumns.push_back(dt->columns[it - dt->exprs.begin()]);
+        return;
+      }
+      dt->exprs.push_back(column);
+      dt->columns.push_back(
+          make<Column>(column->name(), dt, column->value(), column->name()));
+      dtColumns.push_back(dt->columns.back());
+    });
+  }
+  for (auto& conjunct : correlation.conjuncts) {
+    conjunct = importExpr(conjunct, innerColumns, dtColumns);
+  }
+
+  outerDt->tables.push_back(dt);
+  outerDt->tableSet.add(dt);
+  dt->makeInitialPlan();
+  return dt;
+}
+
+bool ToGraph::translateSemijoin(const lp::ExprPtr& conjunct) {
+  const bool anti = isNegation(conjunct);
+  const auto& expr = anti ? conjunct->inputAt(0) : conjunct;
+
+  const lp::SubqueryExpr* subquery = nullptr;
+  ExprCP probe = nullptr;
+  if (isSpecialForm(expr, lp::SpecialForm::kExists)) {
+    subquery = expr->inputAt(0)->asUnchecked<lp::SubqueryExpr>();
+  } else if (
+      isSpecialForm(expr, lp::SpecialForm::kIn) && expr->inputs().size() == 2 &&
+      expr->inputAt(1)->isSubquery()) {
+    // NOT IN is true only if the subquery has no nulls, which an anti join
+    // does not check.
+    if (anti) {
+      VELOX_NYI("NOT IN with a subquery is not supported");
+    }
+    subquery = expr->inputAt(1)->asUnchecked<lp::SubqueryExpr>();
+    probe = translateExpr(expr->inputAt(0));
+  } else {
+    return false;
+  }
+
+  Correlation correlation;
+  const auto& node = *subquery->subquery();
+  auto* dt = translateSubquery(node, probe != nullptr, correlation);
+
+  // A global aggregation has a row for every row of the enclosing query,
+  // also where the semi join on its groups finds none.
+  if (probe == nullptr && correlation.globalAggregation) {
+    VELOX_NYI(
+        "EXISTS over a correlated aggregation without grouping keys is not "
+        "supported");
+  }
+
+  auto& conjuncts = correlation.conjuncts;
+  if (probe != nullptr) {
+    conjuncts.push_back(deduppedCall(
+        equality_,
+        Value(toType(velox::BOOLEAN()), 2),
+        ExprVector{probe, translateColumn(node.outputType()->nameOf(0))},
+        FunctionSet()));
+  }
+
+  ExprVector leftKeys;
+  ExprVector rightKeys;
+  PlanObjectSet leftTables;
+  extractNonInnerJoinEqualities(
+      equality_, conjuncts, dt, leftKeys, rightKeys, leftTables);
+  if (leftKeys.empty()) {
+    VELOX_NYI(
+        "EXISTS and IN subqueries need an equality to the enclosing query");
+  }
+
+  for (const auto* filter : conjuncts) {
+    auto tables = filter->allTables();
+    tables.erase(dt);
+    leftTables.unionSet(tables);
+  }
+  auto leftTableVector = leftTables.toObjects();
+
+  auto* edge = make<JoinEdge>(
+      leftTableVector.size() == 1 ? leftTableVector[0] : nullptr,
+      dt,
+      JoinEdge::Spec{
+          .filter = std::move(conjuncts),
+          .rightExists = !anti,
+          .rightNotExists = anti});
+  currentDt_->joins.push_back(edge);
+  for (auto i = 0; i < leftKeys.size(); ++i) {
+    edge->addEquality(leftKeys[i], rightKeys[i]);
+  }
+  return true;
+}
+
+ExprCP ToGraph::translateScalarSubquery(const lp::SubqueryExpr& subquery) {
+  VELOX_CHECK(allowSubqueries_, "Subqueries are supported only in filters");
+  const auto& node = *subquery.subquery();
+  VELOX_CHECK_EQ(
+      1, node.outputType()->size(), "Scalar subquery must return one column");
+
+  Correlation correlation;
+  auto* dt = translateSubquery(node, true, correlation);
+
+  // A scalar subquery returns one row per row of the enclosing query. For a
+  // correlated one this is a join to its groups on the correlation keys.
+  if (!correlation.globalAggregation) {
+    VELOX_NYI(
+        "Scalar subqueries are supported only over an aggregation without "
+        "grouping keys");
+  }
+  if (!correlation.conjuncts.empty()) {
+    if (!isNullOnEmpty(*dt->aggregation)) {
+      VELOX_NYI("Correlated scalar subqueries with count are not supported");
+    }
+    currentDt_->conjuncts.insert(
+        currentDt_->conjuncts.end(),
+        correlation.conjuncts.begin(),
+        correlation.conjuncts.end());
+    correlatedScalarSubqueries_.push_back(dt);
+  }
+
+  return translateColumn(node.outputType()->nameOf(0));
+}
+
+void ToGraph::extractCorrelatedConjuncts(ExprVector& conjuncts) {
+  for (auto i = 0; i < conjuncts.size(); ++i) {
+    const auto tables = conjuncts[i]->allTables();
+    for (auto* outer = correlation_->parent; outer != nullptr;
+         outer = outer->parent) {
+      auto outerTables = tables;
+      outerTables.intersect(outer->outerTables);
+      if (!outerTables.empty()) {
+        VELOX_NYI(
+            "Subqueries may refer only to the immediately enclosing query: {}",
+            conjuncts[i]->toString());
+      }
+    }
+
+    auto outerTables = tables;
+    outerTables.intersect(correlation_->outerTables);
+    if (outerTables.empty()) {
+      continue;
+    }
+    if (currentDt_ != correlation_->dt || currentDt_->hasAggregation()) {
+      VELOX_NYI(
+          "Correlated conjuncts must be below the aggregation of a "
+          "subquery: {}",
+          conjuncts[i]->toString());
+    }
+    correlation_->conjuncts.push_back(conjuncts[i]);
+    conjuncts.erase(conjuncts.begin() + i);
+    --i;
+  }
+}
+
 DerivedTableP ToGraph::newDt() {
   auto* dt = make<DerivedTable>();
   dt->cname = newCName("dt");
@@ -1341,6 +1712,103 @@ PlanObjectP ToGraph::makeValuesTable(const lp::ValuesNode& values) {
   return valuesTable;
 }
 
+const lp::ValuesNode* ToGraph::aggregateFromMetadata(
+    const lp::AggregateNode& agg) {
+  if (!options_.aggregateFromMetadata || !agg.groupingKeys().empty() ||
+      agg.onlyInput()->kind() != lp::NodeKind::kTableScan) {
+    return nullptr;
+  }
+  const auto& scan = *agg.onlyInput()->asUnchecked<lp::TableScanNode>();
+
+  std::vector<connector::MetadataAggregate> aggregates;
+  aggregates.reserve(agg.aggregates().size());
+  for (const auto& aggregate : agg.aggregates()) {
+    if (aggregate->isDistinct() || aggregate->filter() != nullptr ||
+        !aggregate->ordering().empty() || aggregate->inputs().size() > 1) {
+      return nullptr;
+    }
+
+    std::string_view name = aggregate->name();
+    name = name.substr(name.rfind('.') + 1);
+    connector::MetadataAggregate metadataAggregate;
+    if (name == "count") {
+      metadataAggregate.kind = connector::MetadataAggregateKind::kCount;
+    } else if (name == "min" || name == "max") {
+      metadataAggregate.kind = name == "min"
+          ? connector::MetadataAggregateKind::kMin
+          : connector::MetadataAggregateKind::kMax;
+      if (aggregate->inputs().empty() ||
+          *aggregate->inputAt(0)->type() != *aggregate->type()) {
+        return nullptr;
+      }
+    } else {
+      return nullptr;
+    }
+
+    if (!aggregate->inputs().empty()) {
+      const auto& input = aggregate->inputAt(0);
+      if (metadataAggregate.kind == connector::MetadataAggregateKind::kCount &&
+          input->isConstant() &&
+          !input->asUnchecked<lp::ConstantExpr>()->isNull()) {
+        // count(1) is count(*).
+        aggregates.push_back(std::move(metadataAggregate));
+        continue;
+      }
+      if (!input->isInputReference()) {
+        return nullptr;
+      }
+      const auto& field = input->asUnchecked<lp::InputReferenceExpr>()->name();
+      metadataAggregate.column =
+          scan.columnNames()[scan.outputType()->getChildIdx(field)];
+    }
+    aggregates.push_back(std::move(metadataAggregate));
+  }
+
+  const auto* schemaTable =
+      schema_.findTable(scan.connectorId(), scan.tableName());
+  if (schemaTable == nullptr || schemaTable->connectorTable == nullptr) {
+    return nullptr;
+  }
+  const auto& layout = *schemaTable->connectorTable->layouts()[0];
+  auto* metadata = connector::ConnectorMetadata::metadata(layout.connector());
+  auto row = metadata->aggregateFromMetadata(layout, aggregates);
+  if (!row.has_value()) {
+    return nullptr;
+  }
+
+  auto values = std::make_shared<lp::ValuesNode>(
+      agg.id(),
+      agg.outputType(),
+      std::vector<velox::Variant>{velox::Variant::row(std::move(*row))});
+
+  // The values have the columns of 'agg' and are accessed the same way.
+  controlSubfields_.nodeFields[values.get()] =
+      controlSubfields_.nodeFields[&agg];
+  payloadSubfields_.nodeFields[values.get()] =
+      payloadSubfields_.nodeFields[&agg];
+  metadataValues_.push_back(values);
+  return values.get();
+}
+
+const lp::ValuesNode* ToGraph::checkpoint(const lp::LogicalPlanNode& node) {
+  auto it = options_.checkpoints.find(node.id());
+  if (it == options_.checkpoints.end()) {
+    return nullptr;
+  }
+  const auto* values = it->second.get();
+  VELOX_CHECK(
+      values->outputType()->equivalent(*node.outputType()),
+      "Checkpoint of node {} has type {}, expected {}",
+      node.id(),
+      values->outputType()->toString(),
+      node.outputType()->toString());
+
+  // The values have the columns of 'node' and are accessed the same way.
+  controlSubfields_.nodeFields[values] = controlSubfields_.nodeFields[&node];
+  payloadSubfields_.nodeFields[values] = payloadSubfields_.nodeFields[&node];
+  return values;
+}
+
 namespace {
 const velox::Type* pathType(const velox::Type* type, PathCP path) {
   for (auto& step : path->steps()) {
@@ -1420,16 +1888,50 @@ PlanObjectP ToGraph::addProjection(const lp::ProjectNode* project) {
   return currentDt_;
 }
 
+namespace {
+
+bool containsSubquery(const lp::ExprPtr& expr) {
+  return expr->isSubquery() ||
+      std::ranges::any_of(expr->inputs(), containsSubquery);
+}
+
+} // namespace
+
 PlanObjectP ToGraph::addFilter(const lp::FilterNode* filter) {
+  if (currentDt_->hasAggregation() && containsSubquery(filter->predicate())) {
+    // A subquery is joined to the result of the aggregation, not its input.
+    finalizeDt(*filter->onlyInput());
+  }
+
   exprSource_ = filter->onlyInput().get();
 
   ExprVector flat;
-  translateConjuncts(filter->predicate(), flat);
+  {
+    velox::ScopedVarSetter allowSubqueries(&allowSubqueries_, true);
+    translateConjuncts(filter->predicate(), flat);
+  }
+
+  // The inner join to a correlated scalar subquery drops the rows without a
+  // group, for which the subquery is null. The filter must drop them too.
+  for (auto* dt : std::exchange(correlatedScalarSubqueries_, {})) {
+    if (std::ranges::none_of(flat, [&](ExprCP conjunct) {
+          return isNullRejecting(conjunct, dt);
+        })) {
+      VELOX_NYI(
+          "Correlated scalar subqueries are supported only in conjuncts "
+          "that are null or false when the subquery is null");
+    }
+  }
+
+  if (correlation_ != nullptr) {
+    extractCorrelatedConjuncts(flat);
+  }
 
   if (currentDt_->hasAggregation()) {
     currentDt_->having.insert(
         currentDt_->having.end(), flat.begin(), flat.end());
   } else {
+    simplifyOuterJoins(flat);
     currentDt_->conjuncts.insert(
         currentDt_->conjuncts.end(), flat.begin(), flat.end());
   }
@@ -1665,6 +2167,10 @@ PlanObjectP ToGraph::makeQueryGraph(
     uint64_t allowedInDt) {
   ToGraphContext ctx{&node};
   velox::ExceptionContextSetter exceptionContext{makeExceptionContext(&ctx)};
+  if (const auto* values = checkpoint(node)) {
+    return makeValuesTable(*values);
+  }
+
   switch (node.kind()) {
     case lp::NodeKind::kValues:
       return makeValuesTable(*node.asUnchecked<lp::ValuesNode>());
@@ -1709,6 +2215,11 @@ PlanObjectP ToGraph::makeQueryGraph(
       return addProjection(node.asUnchecked<lp::ProjectNode>());
 
     case lp::NodeKind::kAggregate:
+      if (const auto* values =
+              aggregateFromMetadata(*node.asUnchecked<lp::AggregateNode>())) {
+        return makeValuesTable(*values);
+      }
+
       if (!contains(allowedInDt, PlanType::kAggregationNode)) {
         return wrapInDt(node);
       }
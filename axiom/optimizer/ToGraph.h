@@ -273,6 +273,57 @@ class ToGraph {
   // Adds a JoinEdge corresponding to 'join' to the enclosing DerivedTable.
   void translateJoin(const logical_plan::JoinNode& join);
 
+  // Conjuncts of a subquery that refer to the enclosing query.
+  struct Correlation {
+    // Correlation of the enclosing subquery, if any.
+    Correlation* parent{nullptr};
+
+    // DerivedTable the subquery is translated into.
+    DerivedTableP dt{nullptr};
+
+    // Tables of the enclosing query.
+    PlanObjectSet outerTables;
+
+    // Conjuncts of the subquery that refer to 'outerTables'. After
+    // translateSubquery() these refer to the columns of 'dt' instead of the
+    // tables inside the subquery.
+    ExprVector conjuncts;
+
+    // True if the subquery is an aggregation without grouping keys, i.e.
+    // produces one row for each row of the enclosing query.
+    bool globalAggregation{false};
+  };
+
+  // Translates 'subquery' into a DerivedTable that is added to the tables of
+  // 'currentDt_'. Exports the output of 'subquery' if 'exportOutput' is true
+  // and the columns referenced by correlated conjuncts.
+  DerivedTableP translateSubquery(
+      const logical_plan::LogicalPlanNode& subquery,
+      bool exportOutput,
+      Correlation& correlation);
+
+  // Adds a semi or anti join edge to 'currentDt_' if 'conjunct' is [NOT]
+  // EXISTS or IN with a subquery. Returns false for any other 'conjunct'.
+  bool translateSemijoin(const logical_plan::ExprPtr& conjunct);
+
+  // Joins a scalar subquery to 'currentDt_' and returns its result column.
+  ExprCP translateScalarSubquery(const logical_plan::SubqueryExpr& subquery);
+
+  // Moves conjuncts that refer to the query enclosing the subquery being
+  // translated from 'conjuncts' to 'correlation_'.
+  void extractCorrelatedConjuncts(ExprVector& conjuncts);
+
+  // True if 'expr' is null or false whenever all columns of 'table' are null.
+  bool isNullRejecting(ExprCP expr, PlanObjectCP table) const;
+
+  // True if 'expr' is null whenever all columns of 'table' are null.
+  bool isNullIfNull(ExprCP expr, PlanObjectCP table) const;
+
+  // Converts outer joins in the current DerivedTable to inner, left or right
+  // joins if 'conjuncts' evaluated above the join reject the null-extended
+  // rows of an optional side.
+  void simplifyOuterJoins(const ExprVector& conjuncts);
+
   DerivedTableP translateSetJoin(
       const logical_plan::SetNode& set,
       DerivedTableP setDt);
@@ -390,6 +441,17 @@ class ToGraph {
 
   PlanObjectP makeValuesTable(const logical_plan::ValuesNode& values);
 
+  // Returns the result of 'node' from OptimizerOptions::checkpoints or
+  // nullptr if 'node' is not a checkpoint.
+  const logical_plan::ValuesNode* checkpoint(
+      const logical_plan::LogicalPlanNode& node);
+
+  // Returns a single row ValuesNode with the result of 'agg' if 'agg' is a
+  // global count, min or max over a TableScan whose connector knows the
+  // result from metadata. Returns nullptr otherwise.
+  const logical_plan::ValuesNode* aggregateFromMetadata(
+      const logical_plan::AggregateNode& agg);
+
   // Decomposes complex type columns into parts projected out as top
   // level if subfield pushdown is on.
   void makeSubfieldColumns(
@@ -429,6 +491,20 @@ class ToGraph {
   // True if wrapping a nondeterministic filter inside a DT in ToGraph.
   bool isNondeterministicWrap_{false};
 
+  // Set while translating a subquery.
+  Correlation* correlation_{nullptr};
+
+  // True while translating a filter. Subqueries are supported only there.
+  bool allowSubqueries_{false};
+
+  // Correlated scalar subqueries of the filter being translated. Each is
+  // joined to the enclosing query by an inner join on the correlated
+  // equalities, which the filter must then reject nulls of.
+  std::vector<DerivedTableP> correlatedScalarSubqueries_;
+
+  // Contexts of the queries enclosing a subquery in markSubfields().
+  std::vector<MarkFieldsAccessedContext> outerContexts_;
+
   // Source PlanNode when inside addProjection() or 'addFilter().
   const logical_plan::LogicalPlanNode* exprSource_{nullptr};
 
@@ -488,12 +564,19 @@ class ToGraph {
   folly::F14FastMap<const logical_plan::LogicalPlanNode*, PlanObjectCP>
       planLeaves_;
 
+  // ValuesNodes made by aggregateFromMetadata(). These are referenced from
+  // 'planLeaves_' and ValuesTables.
+  std::vector<logical_plan::ValuesNodePtr> metadataValues_;
+
   Name equality_;
   Name elementAt_{nullptr};
   Name subscript_{nullptr};
   Name cardinality_{nullptr};
 
   folly::F14FastMap<Name, Name> reversibleFunctions_;
+
+  // Functions that return null if any argument is null.
+  folly::F14FastSet<Name> nullPropagatingFunctions_;
 };
 
 } // namespace facebook::axiom::optimizer
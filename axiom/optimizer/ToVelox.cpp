@@ -17,6 +17,7 @@
 #include "axiom/optimizer/ToVelox.h"
 #include "axiom/optimizer/FunctionRegistry.h"
 #include "axiom/optimizer/Optimization.h"
+#include "velox/common/encode/Base64.h"
 #include "velox/core/PlanConsistencyChecker.h"
 #include "velox/core/PlanNode.h"
 #include "velox/exec/HashPartitionFunction.h"
@@ -24,6 +25,7 @@
 #include "velox/expression/ExprToSubfieldFilter.h"
 #include "velox/expression/ScopedVarSetter.h"
 #include "velox/vector/VariantToVector.h"
+#include "velox/vector/VectorSaver.h"
 
 namespace facebook::axiom::optimizer {
 
@@ -145,8 +147,27 @@ void ToVelox::filterUpdated(BaseTableCP table, bool updateSelectivity) {
   auto scanType = subfieldPushdownScanType(
       table, leafColumns, topColumns, columnAlteredTypes_);
 
-  auto* optimization = queryCtx()->optimization();
-  auto* evaluator = optimization->evaluator();
+  std::vector<velox::core::TypedExprPtr> rejectedFilters;
+  auto handle = makeTableHandle(
+      table,
+      *table->schemaTable->columnGroups[0]->layout,
+      std::nullopt,
+      rejectedFilters);
+  columnAlteredTypes_.clear();
+
+  setLeafHandle(table->id(), handle, std::move(rejectedFilters));
+  if (updateSelectivity) {
+    queryCtx()->optimization()->setLeafSelectivity(
+        *const_cast<BaseTable*>(table), scanType);
+  }
+}
+
+velox::connector::ConnectorTableHandlePtr ToVelox::makeTableHandle(
+    BaseTableCP table,
+    const connector::TableLayout& layout,
+    std::optional<connector::LookupKeys> lookupKeys,
+    std::vector<velox::core::TypedExprPtr>& rejectedFilters) {
+  auto* evaluator = queryCtx()->optimization()->evaluator();
 
   std::vector<velox::core::TypedExprPtr> remainingConjuncts;
   std::vector<velox::core::TypedExprPtr> pushdownConjuncts;
@@ -178,13 +199,8 @@ void ToVelox::filterUpdated(BaseTableCP table, bool updateSelectivity) {
         std::move(remainingConjuncts));
   }
 
-  columnAlteredTypes_.clear();
-
   auto& dataColumns = table->schemaTable->connectorTable->type();
-  auto* layout = table->schemaTable->columnGroups[0]->layout;
-
-  auto connector = layout->connector();
-  auto* metadata = connector::ConnectorMetadata::metadata(connector);
+  auto* metadata = connector::ConnectorMetadata::metadata(layout.connector());
 
   std::vector<velox::connector::ColumnHandlePtr> columns;
   for (int32_t i = 0; i < dataColumns->size(); ++i) {
@@ -195,45 +211,55 @@ void ToVelox::filterUpdated(BaseTableCP table, bool updateSelectivity) {
     auto subfields = columnSubfields(table, id.value());
 
     columns.push_back(metadata->createColumnHandle(
-        *layout, dataColumns->nameOf(i), std::move(subfields)));
+        layout, dataColumns->nameOf(i), std::move(subfields)));
   }
   auto allFilters = std::move(pushdownConjuncts);
   if (remainingFilter) {
     allFilters.push_back(remainingFilter);
   }
-  std::vector<velox::core::TypedExprPtr> rejectedFilters;
-  auto handle = metadata->createTableHandle(
-      *layout, columns, *evaluator, std::move(allFilters), rejectedFilters);
-
-  setLeafHandle(table->id(), handle, std::move(rejectedFilters));
-  if (updateSelectivity) {
-    optimization->setLeafSelectivity(*const_cast<BaseTable*>(table), scanType);
-  }
+  return metadata->createTableHandle(
+      layout,
+      columns,
+      *evaluator,
+      std::move(allFilters),
+      rejectedFilters,
+      nullptr,
+      std::move(lookupKeys));
 }
 
 PlanAndStats ToVelox::toVeloxPlan(
     RelationOpPtr plan,
-    const runner::MultiFragmentPlan::Options& options) {
+    const runner::MultiFragmentPlan::Options& options,
+    RangeSplittersMap rangeSplitters) {
   options_ = options;
+  rangeSplitters_ = std::move(rangeSplitters);
 
   prediction_.clear();
   nodeHistory_.clear();
+  fragmentMemory_.clear();
+  dynamicFilters_.clear();
+  sharedSources_.clear();
 
   if (options_.numWorkers > 1) {
     plan = addGather(plan);
   }
+  planSharedScans(*plan);
 
   runner::ExecutableFragment top;
+  setParallelism(*plan, top, false);
   std::vector<runner::ExecutableFragment> stages;
   top.fragment.planNode = makeFragment(plan, top, stages);
   stages.push_back(std::move(top));
 
+  setFragmentMemory(stages);
+
   for (const auto& stage : stages) {
     velox::core::PlanConsistencyChecker::check(stage.fragment.planNode);
   }
 
   return PlanAndStats{
-      std::make_shared<runner::MultiFragmentPlan>(std::move(stages), options),
+      std::make_shared<runner::MultiFragmentPlan>(
+          std::move(stages), options, std::move(dynamicFilters_)),
       std::move(nodeHistory_),
       std::move(prediction_)};
 }
@@ -518,10 +544,123 @@ velox::core::TypedExprPtr ToVelox::toTypedExpr(ExprCP expr) {
   }
 }
 
-runner::ExecutableFragment ToVelox::newFragment() {
+namespace {
+// Returns the predicted cost of 'op' and its inputs up to the next
+// repartitions, i.e. the work done in the fragment that runs 'op'. The input
+// of a repartition runs in another fragment.
+float fragmentCost(const RelationOp& op) {
+  const auto& cost = op.cost();
+  float total = cost.inputCardinality * cost.unitCost + cost.setupCost;
+  if (op.is(RelType::kRepartition)) {
+    return total;
+  }
+
+  auto addInput = [&](const RelationOpPtr& input) {
+    if (input != nullptr && !input->is(RelType::kRepartition)) {
+      total += fragmentCost(*input);
+    }
+  };
+
+  addInput(op.input());
+  if (op.is(RelType::kJoin)) {
+    addInput(op.as<Join>()->right);
+  } else if (op.is(RelType::kUnionAll)) {
+    for (const auto& input : op.as<UnionAll>()->inputs) {
+      addInput(input);
+    }
+  }
+  return total;
+}
+
+// Returns the predicted cost of 'op' and all its inputs.
+float planCost(const RelationOp& op) {
+  const auto& cost = op.cost();
+  float total = cost.inputCardinality * cost.unitCost + cost.setupCost;
+  if (op.input() != nullptr) {
+    total += planCost(*op.input());
+  }
+  if (op.is(RelType::kJoin)) {
+    total += planCost(*op.as<Join>()->right);
+  } else if (op.is(RelType::kUnionAll)) {
+    for (const auto& input : op.as<UnionAll>()->inputs) {
+      total += planCost(*input);
+    }
+  }
+  return total;
+}
+} // namespace
+
+void ToVelox::setParallelism(
+    const RelationOp& root,
+    runner::ExecutableFragment& fragment,
+    bool setWidth) const {
+  const auto costPerDriver = optimizerOptions_.costPerDriver;
+  if (costPerDriver <= 0) {
+    return;
+  }
+
+  const int32_t maxDrivers = options_.numWorkers * options_.numDrivers;
+  const auto totalDrivers = static_cast<int32_t>(std::clamp<double>(
+      std::ceil(fragmentCost(root) / costPerDriver), 1, maxDrivers));
+
+  int32_t width = std::max(1, fragment.width);
+  if (setWidth) {
+    width = std::clamp(
+        (totalDrivers + options_.numDrivers - 1) / options_.numDrivers,
+        1,
+        options_.numWorkers);
+    fragment.width = width;
+  }
+  fragment.numDrivers =
+      std::clamp((totalDrivers + width - 1) / width, 1, options_.numDrivers);
+}
+
+void ToVelox::addFragmentMemory(
+    const runner::ExecutableFragment& fragment,
+    const RelationOp& op) {
+  fragmentMemory_[fragment.taskPrefix] += op.cost().peakResidentBytes;
+}
+
+void ToVelox::setFragmentMemory(
+    std::vector<runner::ExecutableFragment>& stages) const {
+  int64_t total = 0;
+  for (auto& stage : stages) {
+    auto it = fragmentMemory_.find(stage.taskPrefix);
+    if (it != fragmentMemory_.end()) {
+      stage.predictedMemory = static_cast<int64_t>(it->second);
+      total += stage.predictedMemory;
+    }
+  }
+
+  const auto budget = options_.queryMemoryBudget;
+  if (budget <= 0) {
+    return;
+  }
+
+  std::vector<runner::ExecutableFragment*> largestFirst;
+  for (auto& stage : stages) {
+    largestFirst.push_back(&stage);
+  }
+  std::ranges::sort(largestFirst, [](const auto* left, const auto* right) {
+    return left->predictedMemory > right->predictedMemory;
+  });
+
+  // Enable spilling in the fragments with the largest predicted memory until
+  // the fragments that do not spill fit in the budget.
+  for (auto* stage : largestFirst) {
+    if (total <= budget || stage->predictedMemory == 0) {
+      break;
+    }
+    stage->canSpill = true;
+    total -= stage->predictedMemory;
+  }
+}
+
+runner::ExecutableFragment ToVelox::newFragment(const RelationOp& root) {
   runner::ExecutableFragment fragment;
   fragment.width = options_.numWorkers;
   fragment.taskPrefix = fmt::format("stage{}", ++stageCounter_);
+  setParallelism(root, fragment, true);
 
   return fragment;
 }
@@ -540,6 +679,26 @@ velox::core::PlanNodePtr addPartialLimit(
       input);
 }
 
+// Records in 'fragment' that the scan below 'input' needs no more than
+// 'numRows' rows if there are only projections in between and 'numRows' is at
+// most 'maxRows'.
+void setScanLimit(
+    const velox::core::PlanNodePtr& input,
+    int64_t numRows,
+    int64_t maxRows,
+    runner::ExecutableFragment& fragment) {
+  if (numRows > maxRows) {
+    return;
+  }
+  const auto* node = input.get();
+  while (dynamic_cast<const velox::core::ProjectNode*>(node) != nullptr) {
+    node = node->sources()[0].get();
+  }
+  if (dynamic_cast<const velox::core::TableScanNode*>(node) != nullptr) {
+    fragment.scanLimits[node->id()] = numRows;
+  }
+}
+
 velox::core::PlanNodePtr addFinalLimit(
     const velox::core::PlanNodeId& id,
     int64_t offset,
@@ -605,8 +764,130 @@ velox::core::SortOrder toSortOrder(const OrderType& order) {
       : order == OrderType::kDescNullsFirst ? velox::core::kDescNullsFirst
                                             : velox::core::kDescNullsLast;
 }
+
+// Assigns rows to partitions by the range of the key between consecutive
+// splitters. The ranges are spread evenly over the partitions if there are
+// more ranges than partitions. Nulls are in the first or last range depending
+// on 'flags'.
+class RangePartitionFunction : public velox::core::PartitionFunction {
+ public:
+  RangePartitionFunction(
+      int numPartitions,
+      velox::column_index_t key,
+      const velox::BaseVector* splitters,
+      velox::CompareFlags flags)
+      : numPartitions_{numPartitions},
+        key_{key},
+        splitters_{splitters},
+        flags_{flags} {}
+
+  std::optional<uint32_t> partition(
+      const velox::RowVector& input,
+      std::vector<uint32_t>& partitions) override {
+    const auto* key = input.childAt(key_)->loadedVector();
+    const int32_t numRanges = splitters_->size() + 1;
+    partitions.resize(input.size());
+    for (auto row = 0; row < input.size(); ++row) {
+      int32_t range;
+      if (key->isNullAt(row)) {
+        range = flags_.nullsFirst ? 0 : numRanges - 1;
+      } else {
+        // The range is the number of splitters at or before the key.
+        int32_t low = 0;
+        int32_t high = numRanges - 1;
+        while (low < high) {
+          const auto mid = (low + high) / 2;
+          if (splitters_->compare(key, mid, row, flags_).value() <= 0) {
+            low = mid + 1;
+          } else {
+            high = mid;
+          }
+        }
+        range = low;
+      }
+      partitions[row] = range * numPartitions_ / numRanges;
+    }
+    return std::nullopt;
+  }
+
+ private:
+  const int numPartitions_;
+  const velox::column_index_t key_;
+  const velox::BaseVector* const splitters_;
+  const velox::CompareFlags flags_;
+};
+
+class RangePartitionFunctionSpec : public velox::core::PartitionFunctionSpec {
+ public:
+  RangePartitionFunctionSpec(
+      velox::column_index_t key,
+      std::shared_ptr<velox::memory::MemoryPool> pool,
+      velox::VectorPtr splitters,
+      velox::CompareFlags flags)
+      : key_{key},
+        pool_{std::move(pool)},
+        splitters_{std::move(splitters)},
+        flags_{flags} {}
+
+  std::unique_ptr<velox::core::PartitionFunction> create(
+      int numPartitions,
+      bool /*localExchange*/) const override {
+    return std::make_unique<RangePartitionFunction>(
+        numPartitions, key_, splitters_.get(), flags_);
+  }
+
+  folly::dynamic serialize() const override {
+    std::ostringstream out;
+    velox::saveVector(*splitters_, out);
+    const auto splitters = out.str();
+
+    folly::dynamic obj = folly::dynamic::object;
+    obj["name"] = "RangePartitionFunctionSpec";
+    obj["key"] = key_;
+    obj["nullsFirst"] = flags_.nullsFirst;
+    obj["ascending"] = flags_.ascending;
+    obj["splitters"] =
+        velox::encoding::Base64::encode(splitters.data(), splitters.size());
+    return obj;
+  }
+
+  // 'context' is the memory pool of the splitters.
+  static velox::core::PartitionFunctionSpecPtr deserialize(
+      const folly::dynamic& obj,
+      void* context) {
+    auto* pool = static_cast<velox::memory::MemoryPool*>(context);
+    VELOX_CHECK_NOT_NULL(pool);
+    std::istringstream in(
+        velox::encoding::Base64::decode(obj["splitters"].asString()));
+    auto splitters = velox::restoreVector(in, pool);
+    return std::make_shared<RangePartitionFunctionSpec>(
+        obj["key"].asInt(),
+        pool->shared_from_this(),
+        std::move(splitters),
+        velox::CompareFlags{
+            .nullsFirst = obj["nullsFirst"].asBool(),
+            .ascending = obj["ascending"].asBool()});
+  }
+
+  std::string toString() const override {
+    return fmt::format("range({} splitters)", splitters_->size());
+  }
+
+ private:
+  const velox::column_index_t key_;
+
+  // Pool of 'splitters_'. Declared first to be destroyed last.
+  const std::shared_ptr<velox::memory::MemoryPool> pool_;
+  const velox::VectorPtr splitters_;
+  const velox::CompareFlags flags_;
+};
 } // namespace
 
+void registerRangePartitionFunctionSerDe() {
+  velox::DeserializationWithContextRegistryForSharedPtr().Register(
+      "RangePartitionFunctionSpec", RangePartitionFunctionSpec::deserialize);
+}
+
 velox::core::FieldAccessTypedExprPtr ToVelox::toFieldRef(ExprCP expr) {
   VELOX_CHECK(
       expr->is(PlanType::kColumnExpr),
@@ -635,15 +916,21 @@ velox::core::PlanNodePtr ToVelox::makeOrderBy(
     runner::ExecutableFragment& fragment,
     std::vector<runner::ExecutableFragment>& stages) {
   std::vector<velox::core::SortOrder> sortOrder;
-  sortOrder.reserve(op.distribution().orderTypes.size());
-  for (auto order : op.distribution().orderTypes) {
+  sortOrder.reserve(op.orderTypes.size());
+  for (auto order : op.orderTypes) {
     sortOrder.push_back(toSortOrder(order));
   }
 
-  auto keys = toFieldRefs(op.distribution().orderKeys);
+  auto keys = toFieldRefs(op.orderKeys);
+
+  if (op.isPartial) {
+    auto input = makeFragment(op.input(), fragment, stages);
+    return addPartialTopN(nextId(), keys, sortOrder, op.limit, input);
+  }
 
   if (isSingle_) {
     auto input = makeFragment(op.input(), fragment, stages);
+    addFragmentMemory(fragment, op);
 
     if (options_.numDrivers == 1) {
       if (op.limit <= 0) {
@@ -679,8 +966,15 @@ velox::core::PlanNodePtr ToVelox::makeOrderBy(
     return node;
   }
 
-  auto source = newFragment();
+  if (op.limit <= 0) {
+    if (auto node = makeRangeOrderBy(op, keys, sortOrder, fragment, stages)) {
+      return node;
+    }
+  }
+
+  auto source = newFragment(*op.input());
   auto input = makeFragment(op.input(), source, stages);
+  addFragmentMemory(source, op);
 
   velox::core::PlanNodePtr node;
   if (op.limit <= 0) {
@@ -709,6 +1003,72 @@ velox::core::PlanNodePtr ToVelox::makeOrderBy(
   return merge;
 }
 
+velox::core::PlanNodePtr ToVelox::makeRangeOrderBy(
+    const OrderBy& op,
+    const std::vector<velox::core::FieldAccessTypedExprPtr>& keys,
+    const std::vector<velox::core::SortOrder>& sortOrder,
+    runner::ExecutableFragment& fragment,
+    std::vector<runner::ExecutableFragment>& stages) {
+  // The splitters are sampled before translation for sorts large enough to
+  // range partition.
+  auto it = rangeSplitters_.find(op.orderKeys[0]);
+  if (it == rangeSplitters_.end() ||
+      it->second.orderType != op.orderTypes[0]) {
+    return nullptr;
+  }
+
+  auto sortFragment = newFragment(op);
+  if (sortFragment.width <= 1) {
+    return nullptr;
+  }
+
+  const velox::CompareFlags flags{
+      .nullsFirst = sortOrder[0].isNullsFirst(),
+      .ascending = sortOrder[0].isAscending()};
+  auto source = newFragment(*op.input());
+  auto input = makeFragment(op.input(), source, stages);
+
+  const auto keyIndex = input->outputType()->getChildIdx(keys[0]->name());
+  source.fragment.planNode =
+      std::make_shared<velox::core::PartitionedOutputNode>(
+          nextId(),
+          velox::core::PartitionedOutputNode::Kind::kPartitioned,
+          std::vector<velox::core::TypedExprPtr>{keys[0]},
+          sortFragment.width,
+          false,
+          std::make_shared<RangePartitionFunctionSpec>(
+              keyIndex, it->second.pool, it->second.splitters, flags),
+          input->outputType(),
+          exchangeSerdeKind_,
+          input);
+
+  auto exchange = std::make_shared<velox::core::ExchangeNode>(
+      nextId(), input->outputType(), exchangeSerdeKind_);
+  sortFragment.inputStages.emplace_back(exchange->id(), source.taskPrefix);
+  stages.push_back(std::move(source));
+
+  // Each task sorts one range.
+  velox::core::PlanNodePtr node = std::make_shared<velox::core::OrderByNode>(
+      nextId(), keys, sortOrder, true, exchange);
+  node = addLocalMerge(nextId(), keys, sortOrder, node);
+  addFragmentMemory(sortFragment, op);
+
+  sortFragment.fragment.planNode = velox::core::PartitionedOutputNode::single(
+      nextId(), node->outputType(), exchangeSerdeKind_, node);
+
+  // The ranges are concatenated in order by a single driver.
+  auto concat = std::make_shared<velox::core::ExchangeNode>(
+      nextId(), node->outputType(), exchangeSerdeKind_);
+  fragment.width = 1;
+  fragment.numDrivers = 1;
+  fragment.inputStages.push_back(
+      {.consumerNodeId = concat->id(),
+       .producerTaskPrefix = sortFragment.taskPrefix,
+       .ordered = true});
+  stages.push_back(std::move(sortFragment));
+  return concat;
+}
+
 velox::core::PlanNodePtr ToVelox::makeOffset(
     const Limit& op,
     runner::ExecutableFragment& fragment,
@@ -718,7 +1078,7 @@ velox::core::PlanNodePtr ToVelox::makeOffset(
     return addFinalLimit(nextId(), op.offset, op.limit, input);
   }
 
-  auto source = newFragment();
+  auto source = newFragment(*op.input());
   auto input = makeFragment(op.input(), source, stages);
 
   source.fragment.planNode = velox::core::PartitionedOutputNode::single(
@@ -744,8 +1104,20 @@ velox::core::PlanNodePtr ToVelox::makeLimit(
     return makeOffset(op, fragment, stages);
   }
 
+  if (op.isPartial) {
+    auto input = makeFragment(op.input(), fragment, stages);
+    setScanLimit(
+        input, op.limit, optimizerOptions_.scanLimitMaxRows, fragment);
+    return addPartialLimit(nextId(), 0, op.limit, input);
+  }
+
   if (isSingle_) {
     auto input = makeFragment(op.input(), fragment, stages);
+    setScanLimit(
+        input,
+        op.offset + op.limit,
+        optimizerOptions_.scanLimitMaxRows,
+        fragment);
     if (options_.numDrivers == 1) {
       return addFinalLimit(nextId(), op.offset, op.limit, input);
     }
@@ -757,8 +1129,13 @@ velox::core::PlanNodePtr ToVelox::makeLimit(
     return node;
   }
 
-  auto source = newFragment();
+  auto source = newFragment(*op.input());
   auto input = makeFragment(op.input(), source, stages);
+  setScanLimit(
+      input,
+      op.offset + op.limit,
+      optimizerOptions_.scanLimitMaxRows,
+      source);
 
   auto node = addPartialLimit(nextId(), 0, op.offset + op.limit, input);
 
@@ -1010,12 +1387,279 @@ velox::core::TypedExprPtr toAndWithAliases(
   return result->rewriteInputNames(mapping);
 }
 
+// Returns the filters of 'baseTable'.
+ExprVector tableFilters(const BaseTable& baseTable) {
+  ExprVector filters = baseTable.columnFilters;
+  filters.insert(
+      filters.end(), baseTable.filter.begin(), baseTable.filter.end());
+  return filters;
+}
+
+// Returns the columns of 'scan' followed by the other columns its filters
+// use.
+ColumnVector scanColumns(const TableScan& scan) {
+  ColumnVector columns = scan.columns();
+  PlanObjectSet columnSet;
+  columnSet.unionObjects(columns);
+  for (const auto* filter : tableFilters(*scan.baseTable)) {
+    filter->columns().forEach<Column>([&](auto* column) {
+      if (!columnSet.contains(column)) {
+        columnSet.add(column);
+        columns.push_back(column);
+      }
+    });
+  }
+  return columns;
+}
+
+// Adds the TableScans in 'op' to 'scans' with the number of the fragment
+// they are in. 'op' is in fragment 'fragment'. The input of a Repartition is
+// in a new fragment numbered from 'numFragments'.
+void collectTableScans(
+    const RelationOp& op,
+    int32_t fragment,
+    int32_t& numFragments,
+    std::vector<std::pair<const TableScan*, int32_t>>& scans) {
+  if (op.is(RelType::kTableScan)) {
+    scans.emplace_back(op.as<TableScan>(), fragment);
+  }
+  if (op.input() != nullptr) {
+    collectTableScans(
+        *op.input(),
+        op.is(RelType::kRepartition) ? numFragments++ : fragment,
+        numFragments,
+        scans);
+  }
+  if (op.is(RelType::kJoin)) {
+    collectTableScans(*op.as<Join>()->right, fragment, numFragments, scans);
+  } else if (op.is(RelType::kUnionAll)) {
+    for (const auto& input : op.as<UnionAll>()->inputs) {
+      collectTableScans(*input, fragment, numFragments, scans);
+    }
+  }
+}
+
+// Returns the predicted cost of reading 'columns' of all rows of 'table'.
+float readCost(const SchemaTable& table, const ColumnVector& columns) {
+  const auto size = byteSize(columns);
+  const auto numColumns = static_cast<float>(columns.size());
+  const auto rowCost = numColumns * Costs::kColumnRowCost +
+      std::max<float>(0, size - 8 * numColumns) * Costs::kColumnByteCost;
+  return table.cardinality * rowCost;
+}
+
 } // namespace
 
+void ToVelox::planSharedScans(const RelationOp& plan) {
+  sharedScans_.clear();
+  sharedScanIndex_.clear();
+
+  const auto maxBytes = optimizerOptions_.shareScanMaxBytes;
+  if (maxBytes <= 0) {
+    return;
+  }
+
+  std::vector<std::pair<const TableScan*, int32_t>> scans;
+  int32_t numFragments = 1;
+  collectTableScans(plan, 0, numFragments, scans);
+
+  // Full scans of the same table and layout whose columns are read as is.
+  // The rows of a shared scan have no placement, so scans whose rows are
+  // partitioned for a join or aggregation above them read the table
+  // themselves. So does a scan in a fragment that has another scan of the
+  // same table, since a fragment does not read one shared scan twice.
+  folly::F14FastMap<ColumnGroupCP, std::vector<const TableScan*>> candidates;
+  folly::F14FastSet<std::pair<ColumnGroupCP, int32_t>> fragments;
+  for (const auto& [scan, fragment] : scans) {
+    if (!scan->keys.empty() || hasSubfieldPushdown(*scan) ||
+        !scan->distribution().partition.empty()) {
+      continue;
+    }
+    const auto columns = scanColumns(*scan);
+    if (std::ranges::any_of(columns, [&](ColumnCP column) {
+          return column->topColumn() != nullptr ||
+              isMapAsStruct(scan->baseTable->schemaTable->name, column->name());
+        })) {
+      continue;
+    }
+    if (!fragments.emplace(scan->index, fragment).second) {
+      continue;
+    }
+    candidates[scan->index].push_back(scan);
+  }
+
+  for (auto& [index, group] : candidates) {
+    if (group.size() < 2) {
+      continue;
+    }
+
+    const auto& table = *index->table;
+    SharedScan shared;
+    float separateCost = 0;
+    float selectivity = 0;
+    folly::F14FastSet<Name> names;
+    for (const auto* scan : group) {
+      const auto columns = scanColumns(*scan);
+      separateCost += readCost(table, columns);
+      selectivity += scan->baseTable->filterSelectivity;
+      for (auto* column : columns) {
+        if (names.insert(column->name()).second) {
+          shared.columns.push_back(column);
+        }
+      }
+    }
+
+    // Each scan reads the rows that pass any of the filters through a
+    // shuffle.
+    const auto numRows = table.cardinality * std::min<float>(1, selectivity);
+    const auto numBytes = numRows * byteSize(shared.columns);
+    const auto sharedCost = readCost(table, shared.columns) +
+        group.size() * numRows * shuffleCost(shared.columns);
+    if (numBytes > maxBytes || sharedCost >= separateCost) {
+      continue;
+    }
+
+    for (const auto* scan : group) {
+      sharedScanIndex_[scan] = static_cast<int32_t>(sharedScans_.size());
+    }
+    shared.scans = std::move(group);
+    sharedScans_.push_back(std::move(shared));
+  }
+}
+
+velox::core::PlanNodePtr ToVelox::makeSharedScan(
+    const TableScan& scan,
+    int32_t sharedIndex,
+    runner::ExecutableFragment& fragment,
+    std::vector<runner::ExecutableFragment>& stages) {
+  auto& shared = sharedScans_[sharedIndex];
+  if (std::ranges::find(shared.consumerTaskPrefixes, fragment.taskPrefix) !=
+      shared.consumerTaskPrefixes.end()) {
+    return nullptr;
+  }
+  shared.consumerTaskPrefixes.push_back(fragment.taskPrefix);
+
+  if (shared.taskPrefix.empty()) {
+    const auto& layout = *scan.index->layout;
+    auto* metadata = connector::ConnectorMetadata::metadata(layout.connector());
+
+    // Reads the rows that pass the filters of any of the scans.
+    std::vector<velox::core::TypedExprPtr> filters;
+    {
+      velox::ScopedVarSetter noAlias(&makeVeloxExprWithNoAlias_, true);
+      std::vector<velox::core::TypedExprPtr> disjuncts;
+      for (const auto* other : shared.scans) {
+        auto conjuncts = tableFilters(*other->baseTable);
+        if (conjuncts.empty()) {
+          disjuncts.clear();
+          break;
+        }
+        disjuncts.push_back(toAnd(conjuncts));
+      }
+      if (disjuncts.size() == 1) {
+        filters.push_back(std::move(disjuncts[0]));
+      } else if (!disjuncts.empty()) {
+        filters.push_back(std::make_shared<velox::core::CallTypedExpr>(
+            velox::BOOLEAN(),
+            std::move(disjuncts),
+            specialForm(logical_plan::SpecialForm::kOr)));
+      }
+    }
+
+    std::vector<std::string> names;
+    std::vector<velox::TypePtr> types;
+    std::vector<velox::connector::ColumnHandlePtr> columnHandles;
+    velox::connector::ColumnHandleMap assignments;
+    for (const auto* column : shared.columns) {
+      auto handle = metadata->createColumnHandle(layout, column->name());
+      names.emplace_back(column->name());
+      types.push_back(toTypePtr(column->value().type));
+      assignments[names.back()] = handle;
+      columnHandles.push_back(std::move(handle));
+    }
+    shared.outputType = ROW(std::move(names), std::move(types));
+
+    std::vector<velox::core::TypedExprPtr> rejectedFilters;
+    auto tableHandle = metadata->createTableHandle(
+        layout,
+        columnHandles,
+        *queryCtx()->optimization()->evaluator(),
+        std::move(filters),
+        rejectedFilters,
+        nullptr,
+        std::nullopt);
+
+    velox::core::PlanNodePtr node =
+        std::make_shared<velox::core::TableScanNode>(
+            nextId(), shared.outputType, tableHandle, assignments);
+    if (!rejectedFilters.empty()) {
+      node = std::make_shared<velox::core::FilterNode>(
+          nextId(),
+          rejectedFilters.size() == 1
+              ? rejectedFilters[0]
+              : std::make_shared<velox::core::CallTypedExpr>(
+                    velox::BOOLEAN(),
+                    std::move(rejectedFilters),
+                    specialForm(logical_plan::SpecialForm::kAnd)),
+          node);
+    }
+
+    // The rows have no placement. Each consumer gets them in round robin.
+    auto source = newFragment(scan);
+    source.fragment.planNode =
+        std::make_shared<velox::core::PartitionedOutputNode>(
+            nextId(),
+            velox::core::PartitionedOutputNode::Kind::kPartitioned,
+            std::vector<velox::core::TypedExprPtr>{},
+            fragment.width,
+            false,
+            std::make_shared<velox::exec::RoundRobinPartitionFunctionSpec>(),
+            shared.outputType,
+            exchangeSerdeKind_,
+            node);
+    shared.taskPrefix = source.taskPrefix;
+    stages.push_back(std::move(source));
+  }
+
+  auto exchange = std::make_shared<velox::core::ExchangeNode>(
+      nextId(), shared.outputType, exchangeSerdeKind_);
+  fragment.inputStages.emplace_back(exchange->id(), shared.taskPrefix);
+
+  // Renames the columns after the columns of 'scan' and applies its filters.
+  std::vector<std::string> names;
+  std::vector<velox::core::TypedExprPtr> exprs;
+  for (const auto* column : scanColumns(scan)) {
+    names.push_back(column->outputName());
+    exprs.push_back(std::make_shared<velox::core::FieldAccessTypedExpr>(
+        toTypePtr(column->value().type), std::string(column->name())));
+  }
+  velox::core::PlanNodePtr result = std::make_shared<velox::core::ProjectNode>(
+      nextId(), std::move(names), std::move(exprs), exchange);
+
+  const auto filters = tableFilters(*scan.baseTable);
+  if (!filters.empty()) {
+    result = std::make_shared<velox::core::FilterNode>(
+        nextId(), toAnd(filters), result);
+  }
+
+  makePredictionAndHistory(result->id(), &scan);
+  return addDynamicFilters(scan, fragment, std::move(result));
+}
+
 velox::core::PlanNodePtr ToVelox::makeScan(
     const TableScan& scan,
     runner::ExecutableFragment& fragment,
     std::vector<runner::ExecutableFragment>& stages) {
+  if (!scan.keys.empty()) {
+    return makeIndexLookup(scan, fragment, stages);
+  }
+
+  if (auto it = sharedScanIndex_.find(&scan); it != sharedScanIndex_.end()) {
+    if (auto node = makeSharedScan(scan, it->second, fragment, stages)) {
+      return node;
+    }
+  }
+
   columnAlteredTypes_.clear();
 
   const bool isSubfieldPushdown = hasSubfieldPushdown(scan);
@@ -1064,22 +1708,175 @@ velox::core::PlanNodePtr ToVelox::makeScan(
   velox::core::PlanNodePtr result =
       std::make_shared<velox::core::TableScanNode>(
           nextId(), outputType, tableHandle, assignments);
+  auto predictionId = result->id();
+
+  // Dynamic filters directly over the scan are also added to the scan. The
+  // scan output is named after the columns unless subfields are pushed down.
+  if (!isSubfieldPushdown) {
+    result = addDynamicFilters(scan, fragment, std::move(result));
+  }
 
   if (filter != nullptr) {
     result =
         std::make_shared<velox::core::FilterNode>(nextId(), filter, result);
+    predictionId = result->id();
   }
 
   if (isSubfieldPushdown) {
     result = makeSubfieldProjections(scan, result);
+    predictionId = result->id();
   }
 
-  makePredictionAndHistory(result->id(), &scan);
+  makePredictionAndHistory(predictionId, &scan);
 
   columnAlteredTypes_.clear();
+  if (isSubfieldPushdown) {
+    return addDynamicFilters(scan, fragment, std::move(result));
+  }
   return result;
 }
 
+velox::core::PlanNodePtr ToVelox::makeIndexLookup(
+    const TableScan& scan,
+    runner::ExecutableFragment& fragment,
+    std::vector<runner::ExecutableFragment>& stages) {
+  auto left = makeFragment(scan.input(), fragment, stages);
+
+  const auto* table = scan.baseTable;
+  const auto& layout = *scan.index->layout;
+  const auto& orderKeys = scan.index->distribution.orderKeys;
+
+  // A lookup of rows of 'table' by keys read from 'table', as for late
+  // materialization, reads only the columns the probe side does not have.
+  // The probe side has passed the filters of 'table'.
+  const bool isSelfLookup = std::ranges::any_of(scan.keys, [&](ExprCP key) {
+    return key->is(PlanType::kColumnExpr) &&
+        key->as<Column>()->relation() == table;
+  });
+  const auto& leftType = left->outputType();
+
+  // 'scan.keys' are probe side values for a prefix of the index keys.
+  connector::LookupKeys lookupKeys;
+  ExprVector rightKeys;
+  ColumnVector rightColumns;
+  for (auto i = 0; i < scan.keys.size(); ++i) {
+    const auto name = orderKeys[i]->as<Column>()->name();
+    auto it = std::ranges::find_if(
+        table->columns, [&](auto* column) { return column->name() == name; });
+    VELOX_CHECK(
+        it != table->columns.end(),
+        "No lookup key {} in {}",
+        name,
+        table->cname);
+    lookupKeys.equalityColumns.push_back(name);
+    rightKeys.push_back(*it);
+    rightColumns.push_back(*it);
+  }
+  for (auto* column : scan.columns()) {
+    if (column->relation() == table &&
+        std::ranges::find(rightColumns, column) == rightColumns.end() &&
+        !(isSelfLookup && leftType->containsChild(column->outputName()))) {
+      rightColumns.push_back(column);
+    }
+  }
+
+  std::vector<velox::core::TypedExprPtr> rejectedFilters;
+  auto tableHandle =
+      makeTableHandle(table, layout, std::move(lookupKeys), rejectedFilters);
+
+  // Filters the lookup source does not apply are evaluated by the join. Both
+  // inner and left joins produce the same result as filtering the lookup.
+  velox::core::TypedExprPtr filter = toAnd(scan.joinFilter);
+  if (!rejectedFilters.empty() && !isSelfLookup) {
+    auto tableFilter =
+        toAndWithAliases(std::move(rejectedFilters), table, rightColumns);
+    filter = filter == nullptr
+        ? tableFilter
+        : std::make_shared<velox::core::CallTypedExpr>(
+              velox::BOOLEAN(),
+              specialForm(logical_plan::SpecialForm::kAnd),
+              std::vector<velox::core::TypedExprPtr>{filter, tableFilter});
+  }
+
+  // Keys of a self lookup are renamed on the right side.
+  auto rightType = makeOutputType(rightColumns);
+  if (isSelfLookup) {
+    auto names = rightType->names();
+    for (auto& name : names) {
+      if (leftType->containsChild(name)) {
+        name = fmt::format("{}_lookup", name);
+      }
+    }
+    rightType = ROW(std::move(names), rightType->children());
+  }
+
+  auto* connectorMetadata =
+      connector::ConnectorMetadata::metadata(layout.connector());
+  velox::connector::ColumnHandleMap assignments;
+  for (auto i = 0; i < rightColumns.size(); ++i) {
+    auto* column = rightColumns[i];
+    assignments[rightType->nameOf(i)] = connectorMetadata->createColumnHandle(
+        layout, column->name(), columnSubfields(table, column->id()));
+  }
+  auto right = std::make_shared<velox::core::TableScanNode>(
+      nextId(), rightType, tableHandle, assignments);
+
+  std::vector<velox::core::FieldAccessTypedExprPtr> rightKeyFields;
+  for (auto i = 0; i < rightKeys.size(); ++i) {
+    rightKeyFields.push_back(
+        std::make_shared<velox::core::FieldAccessTypedExpr>(
+            rightType->childAt(i), rightType->nameOf(i)));
+  }
+
+  auto joinNode = std::make_shared<velox::core::IndexLookupJoinNode>(
+      nextId(),
+      scan.joinType,
+      toFieldRefs(scan.keys),
+      std::move(rightKeyFields),
+      std::vector<velox::core::IndexLookupConditionPtr>{},
+      std::move(filter),
+      /*hasMarker=*/false,
+      std::move(left),
+      std::move(right),
+      makeOutputType(scan.columns()));
+  makePredictionAndHistory(joinNode->id(), &scan);
+  return joinNode;
+}
+
+velox::core::PlanNodePtr ToVelox::addDynamicFilters(
+    const TableScan& scan,
+    const runner::ExecutableFragment& fragment,
+    velox::core::PlanNodePtr scanNode) {
+  if (pendingDynamicFilters_.empty()) {
+    return scanNode;
+  }
+
+  // A join in the same fragment filters its probe rows before any exchange,
+  // so only scans in other fragments are filtered.
+  const auto& outputType = scanNode->outputType();
+  std::vector<std::pair<velox::column_index_t, runner::DynamicFilterPtr>>
+      filters;
+  for (auto* column : scan.columns()) {
+    auto it = pendingDynamicFilters_.find(column);
+    if (it == pendingDynamicFilters_.end() ||
+        it->second.taskPrefix == fragment.taskPrefix) {
+      continue;
+    }
+    auto channel = outputType->getChildIdxIfExists(column->outputName());
+    if (!channel.has_value()) {
+      continue;
+    }
+    filters.emplace_back(channel.value(), it->second.filter);
+    it->second.used = true;
+  }
+
+  if (filters.empty()) {
+    return scanNode;
+  }
+  return std::make_shared<runner::DynamicFilterNode>(
+      nextId(), std::move(filters), std::move(scanNode));
+}
+
 velox::core::PlanNodePtr ToVelox::makeFilter(
     const Filter& filter,
     runner::ExecutableFragment& fragment,
@@ -1124,12 +1921,190 @@ velox::core::PlanNodePtr ToVelox::makeProject(
       nextId(), std::move(names), std::move(exprs), std::move(input));
 }
 
+namespace {
+
+bool isIntegerKind(velox::TypeKind kind) {
+  return kind == velox::TypeKind::TINYINT ||
+      kind == velox::TypeKind::SMALLINT || kind == velox::TypeKind::INTEGER ||
+      kind == velox::TypeKind::BIGINT;
+}
+
+// True if a dynamic filter can test keys of 'type'. See
+// runner::makeDynamicFilter().
+bool isDynamicFilterType(const velox::Type& type) {
+  switch (type.kind()) {
+    case velox::TypeKind::REAL:
+    case velox::TypeKind::DOUBLE:
+    case velox::TypeKind::VARCHAR:
+    case velox::TypeKind::VARBINARY:
+      return true;
+    default:
+      return isIntegerKind(type.kind());
+  }
+}
+
+// Returns a process-wide unique id that names a dynamic filter in plan text.
+std::string nextDynamicFilterId(const std::string& queryId) {
+  static std::atomic<int64_t> counter{0};
+  return fmt::format("{}.{}", queryId, ++counter);
+}
+
+} // namespace
+
+runner::DynamicFilterSource ToVelox::makeDynamicFilterSource(
+    const Join& join,
+    const std::vector<std::pair<int32_t, runner::DynamicFilterPtr>>& keys,
+    const runner::ExecutableFragment& fragment,
+    const velox::core::PlanNode& build) {
+  // The filter needs all the build keys in one place. It reads the fragment
+  // that sends the build side to the join, which then sends it to both.
+  auto input = std::ranges::find_if(
+      fragment.inputStages,
+      [&](const auto& stage) { return stage.consumerNodeId == build.id(); });
+  VELOX_CHECK(
+      input != fragment.inputStages.end(),
+      "Build side of a join with dynamic filters is not an exchange: {}",
+      build.id());
+
+  runner::DynamicFilterSource source;
+  auto& top = source.fragment;
+  top.taskPrefix = fmt::format("filter{}", ++stageCounter_);
+  top.width = 1;
+  top.numDrivers = 1;
+  velox::core::PlanNodePtr node = std::make_shared<velox::core::ExchangeNode>(
+      nextId(), build.outputType(), exchangeSerdeKind_);
+  top.inputStages.emplace_back(node->id(), input->producerTaskPrefix);
+
+  if (join.bloomFilter) {
+    // The runner inserts the distinct build keys into a Bloom filter per
+    // key. The distinct bounds the rows the runner holds to the keys.
+    std::vector<std::string> names;
+    std::vector<velox::core::TypedExprPtr> exprs;
+    std::vector<velox::core::FieldAccessTypedExprPtr> groupingKeys;
+    for (const auto& [index, filter] : keys) {
+      names.push_back(fmt::format("key_{}", names.size()));
+      exprs.push_back(toFieldRef(join.rightKeys[index]));
+      groupingKeys.push_back(
+          std::make_shared<velox::core::FieldAccessTypedExpr>(
+              exprs.back()->type(), names.back()));
+      source.keys.push_back({.filter = filter});
+    }
+    source.bloom = true;
+    auto project = std::make_shared<velox::core::ProjectNode>(
+        nextId(), std::move(names), std::move(exprs), std::move(node));
+    top.fragment.planNode = std::make_shared<velox::core::AggregationNode>(
+        nextId(),
+        velox::core::AggregationNode::Step::kSingle,
+        std::move(groupingKeys),
+        std::vector<velox::core::FieldAccessTypedExprPtr>{},
+        std::vector<std::string>{},
+        std::vector<velox::core::AggregationNode::Aggregate>{},
+        false,
+        std::move(project));
+    return source;
+  }
+
+  // Small builds also produce the distinct keys for an IN filter.
+  const bool smallBuild = join.right->cost().inputCardinality <=
+      optimizerOptions_.dynamicFilterMaxValues;
+
+  std::vector<std::string> names;
+  std::vector<velox::core::AggregationNode::Aggregate> aggregates;
+  for (const auto& [index, filter] : keys) {
+    auto key = toFieldRef(join.rightKeys[index]);
+    const auto& type = key->type();
+    auto addAggregate = [&](const std::string& name,
+                            const velox::TypePtr& resultType) {
+      names.push_back(fmt::format("{}_{}", name, names.size()));
+      aggregates.push_back(
+          {.call = std::make_shared<velox::core::CallTypedExpr>(
+               resultType, std::vector<velox::core::TypedExprPtr>{key}, name),
+           .rawInputTypes = {type}});
+    };
+
+    const bool hasValues = smallBuild &&
+        (isIntegerKind(type->kind()) ||
+         type->kind() == velox::TypeKind::VARCHAR ||
+         type->kind() == velox::TypeKind::VARBINARY);
+    addAggregate("min", type);
+    addAggregate("max", type);
+    if (hasValues) {
+      addAggregate("set_agg", velox::ARRAY(type));
+    }
+    source.keys.push_back({.filter = filter, .hasValues = hasValues});
+  }
+
+  top.fragment.planNode = std::make_shared<velox::core::AggregationNode>(
+      nextId(),
+      velox::core::AggregationNode::Step::kSingle,
+      std::vector<velox::core::FieldAccessTypedExprPtr>{},
+      std::vector<velox::core::FieldAccessTypedExprPtr>{},
+      names,
+      aggregates,
+      false,
+      node);
+  return source;
+}
+
 velox::core::PlanNodePtr ToVelox::makeJoin(
     const Join& join,
     runner::ExecutableFragment& fragment,
     std::vector<runner::ExecutableFragment>& stages) {
+  // Probe keys that scans in the probe side may filter on. An enclosing join
+  // on the same key is shadowed while making the probe side.
+  struct FilterKey {
+    int32_t index;
+    ColumnCP column;
+    std::optional<PendingDynamicFilter> shadowed;
+  };
+  std::vector<FilterKey> filterKeys;
+  // The filters are computed from the build side as it is sent to the join.
+  // The probe side then waits for the whole build side, which only a hash
+  // join reads before its probe side.
+  const bool buildIsExchange = !isSingle_ &&
+      join.method == JoinMethod::kHash &&
+      join.right->relType() == RelType::kRepartition;
+  if ((join.dynamicFilter || join.bloomFilter) && buildIsExchange) {
+    for (auto i = 0; i < join.leftKeys.size(); ++i) {
+      const auto* key = join.leftKeys[i];
+      if (!key->is(PlanType::kColumnExpr) ||
+          !isDynamicFilterType(*toTypePtr(key->value().type))) {
+        continue;
+      }
+      auto* column = key->as<Column>();
+      std::optional<PendingDynamicFilter> shadowed;
+      if (auto it = pendingDynamicFilters_.find(column);
+          it != pendingDynamicFilters_.end()) {
+        shadowed = std::move(it->second);
+      }
+      pendingDynamicFilters_[column] = PendingDynamicFilter{
+          .filter = std::make_shared<runner::DynamicFilter>(
+              nextDynamicFilterId(options_.queryId)),
+          .taskPrefix = fragment.taskPrefix};
+      filterKeys.push_back({i, column, std::move(shadowed)});
+    }
+  }
+
   auto left = makeFragment(join.input(), fragment, stages);
+
+  std::vector<std::pair<int32_t, runner::DynamicFilterPtr>> usedKeys;
+  for (auto& key : filterKeys) {
+    auto it = pendingDynamicFilters_.find(key.column);
+    if (it->second.used) {
+      usedKeys.emplace_back(key.index, it->second.filter);
+    }
+    if (key.shadowed.has_value()) {
+      it->second = std::move(key.shadowed.value());
+    } else {
+      pendingDynamicFilters_.erase(it);
+    }
+  }
+
   auto right = makeFragment(join.right, fragment, stages);
+  if (!usedKeys.empty()) {
+    dynamicFilters_.push_back(
+        makeDynamicFilterSource(join, usedKeys, fragment, *right));
+  }
   if (join.method == JoinMethod::kCross) {
     auto joinNode = std::make_shared<velox::core::NestedLoopJoinNode>(
         nextId(),
@@ -1149,6 +2124,24 @@ velox::core::PlanNodePtr ToVelox::makeJoin(
   auto leftKeys = toFieldRefs(join.leftKeys);
   auto rightKeys = toFieldRefs(join.rightKeys);
 
+  if (join.method == JoinMethod::kMerge) {
+    // Each side is one stream ordered on the keys. The fragment runs a single
+    // driver per task so that the streams are not split. The cost of this is
+    // charged in Optimization::joinByMerge.
+    fragment.numDrivers = 1;
+    auto joinNode = std::make_shared<velox::core::MergeJoinNode>(
+        nextId(),
+        join.joinType,
+        leftKeys,
+        rightKeys,
+        toAnd(join.filter),
+        left,
+        right,
+        makeOutputType(join.columns()));
+    makePredictionAndHistory(joinNode->id(), &join);
+    return joinNode;
+  }
+
   auto joinNode = std::make_shared<velox::core::HashJoinNode>(
       nextId(),
       join.joinType,
@@ -1160,6 +2153,7 @@ velox::core::PlanNodePtr ToVelox::makeJoin(
       right,
       makeOutputType(join.columns()));
 
+  addFragmentMemory(fragment, join);
   makePredictionAndHistory(joinNode->id(), &join);
   return joinNode;
 }
@@ -1234,7 +2228,13 @@ velox::core::PlanNodePtr ToVelox::makeAggregation(
     }
   }
 
-  if (options_.numDrivers > 1 &&
+  // Pre-grouped input is aggregated by a streaming aggregation. The input
+  // comes in order from a merge, so it must not be repartitioned.
+  std::vector<velox::core::FieldAccessTypedExprPtr> preGroupedKeys;
+  if (op.preGrouped) {
+    preGroupedKeys = keys;
+  } else if (
+      options_.numDrivers > 1 &&
       (op.step == velox::core::AggregationNode::Step::kFinal ||
        op.step == velox::core::AggregationNode::Step::kSingle)) {
     std::vector<velox::core::PlanNodePtr> inputs = {input};
@@ -1256,32 +2256,81 @@ velox::core::PlanNodePtr ToVelox::makeAggregation(
     }
   }
 
+  if (op.step != velox::core::AggregationNode::Step::kPartial) {
+    addFragmentMemory(fragment, op);
+  }
+
   return std::make_shared<velox::core::AggregationNode>(
       nextId(),
       op.step,
       keys,
-      std::vector<velox::core::FieldAccessTypedExprPtr>{},
+      preGroupedKeys,
       aggregateNames,
       aggregates,
       false,
       input);
 }
 
+ToVelox::SharedSource* ToVelox::findSharedSource(
+    const Repartition& repartition,
+    const runner::ExecutableFragment& consumer) {
+  const auto maxBytes = optimizerOptions_.shareSubplanMaxBytes;
+  if (maxBytes <= 0 || sharedSources_.empty()) {
+    return nullptr;
+  }
+
+  // Sending the result of a shared subplan to one more consumer costs one
+  // more shuffle of the result. Recompute if that is cheaper.
+  const auto& cost = repartition.cost();
+  const float bytes = cost.transferBytes / Costs::byteShuffleCost();
+  const float sendCost = cost.inputCardinality * cost.unitCost;
+  if (bytes > maxBytes || planCost(*repartition.input()) <= sendCost) {
+    return nullptr;
+  }
+
+  for (auto& shared : sharedSources_) {
+    folly::F14FastMap<PlanObjectCP, PlanObjectCP> mapping;
+    if (std::ranges::find(shared.consumerTaskPrefixes, consumer.taskPrefix) ==
+            shared.consumerTaskPrefixes.end() &&
+        sameResult(*shared.repartition, repartition, mapping)) {
+      return &shared;
+    }
+  }
+  return nullptr;
+}
+
 velox::core::PlanNodePtr ToVelox::makeRepartition(
     const Repartition& repartition,
     runner::ExecutableFragment& fragment,
     std::vector<runner::ExecutableFragment>& stages,
     std::shared_ptr<velox::core::ExchangeNode>& exchange) {
-  auto source = newFragment();
-  auto sourcePlan = makeFragment(repartition.input(), source, stages);
-
-  auto keys = toTypedExprs(repartition.distribution().partition);
-
   const auto& distribution = repartition.distribution();
   if (distribution.distributionType.isGather) {
     fragment.width = 1;
   }
 
+  // Reads the result of an identical subplan made earlier. Its fragment
+  // partitions the result for each consumer.
+  if (auto* shared = findSharedSource(repartition, fragment)) {
+    if (exchange == nullptr) {
+      exchange = std::make_shared<velox::core::ExchangeNode>(
+          nextId(), makeOutputType(repartition.columns()), exchangeSerdeKind_);
+    }
+    fragment.inputStages.emplace_back(exchange->id(), shared->taskPrefix);
+    shared->consumerTaskPrefixes.push_back(fragment.taskPrefix);
+    return exchange;
+  }
+
+  // A subplan whose scans have dynamic filters of joins above it cannot be
+  // shared with consumers that do not have the joins.
+  const bool shareable = optimizerOptions_.shareSubplanMaxBytes > 0 &&
+      pendingDynamicFilters_.empty();
+
+  auto source = newFragment(*repartition.input());
+  auto sourcePlan = makeFragment(repartition.input(), source, stages);
+
+  auto keys = toTypedExprs(repartition.distribution().partition);
+
   auto partitionFunctionFactory = createPartitionFunctionSpec(
       sourcePlan->outputType(), keys, distribution.isBroadcast);
 
@@ -1304,6 +2353,10 @@ velox::core::PlanNodePtr ToVelox::makeRepartition(
         nextId(), sourcePlan->outputType(), exchangeSerdeKind_);
   }
   fragment.inputStages.emplace_back(exchange->id(), source.taskPrefix);
+  if (shareable) {
+    sharedSources_.push_back(
+        {&repartition, source.taskPrefix, {fragment.taskPrefix}});
+  }
   stages.push_back(std::move(source));
   return exchange;
 }
@@ -1409,7 +2462,8 @@ void ToVelox::makePredictionAndHistory(
     const RelationOp* op) {
   nodeHistory_[id] = op->historyKey();
   prediction_[id] = NodePrediction{
-      .cardinality = op->cost().inputCardinality * op->cost().fanout};
+      .cardinality = op->cost().inputCardinality * op->cost().fanout,
+      .peakMemory = op->cost().peakResidentBytes};
 }
 
 velox::core::PlanNodePtr ToVelox::makeFragment(
@@ -44,6 +44,23 @@ struct PlanAndStats {
   std::string toString() const;
 };
 
+/// Values of the leading key of a sort that divide its rows into ranges of
+/// about equal size for a range-partitioned sort. 'splitters' is allocated
+/// from 'pool'.
+struct RangeSplitters {
+  OrderType orderType;
+  std::shared_ptr<velox::memory::MemoryPool> pool;
+  velox::VectorPtr splitters;
+};
+
+/// Sampled splitters by the leading key of the sort.
+using RangeSplittersMap = folly::F14FastMap<ColumnCP, RangeSplitters>;
+
+/// Registers the deserializer of the partition function of range-partitioned
+/// sorts. The memory pool passed as context to deserialization gets the
+/// splitters.
+void registerRangePartitionFunctionSerDe();
+
 class ToVelox {
  public:
   ToVelox(
@@ -51,10 +68,12 @@ class ToVelox {
       const OptimizerOptions& optimizerOptions);
 
   /// Converts physical plan (a tree of RelationOp) to an executable
-  /// multi-fragment Velox plan.
+  /// multi-fragment Velox plan. Sorts whose leading key is in
+  /// 'rangeSplitters' are range partitioned.
   PlanAndStats toVeloxPlan(
       RelationOpPtr plan,
-      const runner::MultiFragmentPlan::Options& options);
+      const runner::MultiFragmentPlan::Options& options,
+      RangeSplittersMap rangeSplitters = {});
 
   std::pair<
       velox::connector::ConnectorTableHandlePtr,
@@ -98,6 +117,15 @@ class ToVelox {
     leafHandles_[id] = {std::move(handle), std::move(extraFilters)};
   }
 
+  // Makes a handle for reading 'table' from 'layout' with the filters of
+  // 'table' pushed down. Filters the connector does not apply are returned in
+  // 'rejectedFilters'. 'lookupKeys' is set for index lookups.
+  velox::connector::ConnectorTableHandlePtr makeTableHandle(
+      BaseTableCP table,
+      const connector::TableLayout& layout,
+      std::optional<connector::LookupKeys> lookupKeys,
+      std::vector<velox::core::TypedExprPtr>& rejectedFilters);
+
   /// True if a scan should expose 'column' of 'table' as a struct only
   /// containing the accessed keys. 'column' must be a top level map column.
   bool isMapAsStruct(Name table, Name column) {
@@ -144,6 +172,17 @@ class ToVelox {
       runner::ExecutableFragment& fragment,
       std::vector<runner::ExecutableFragment>& stages);
 
+  // Sorts the input of 'op' in parallel by repartitioning it on ranges of the
+  // leading key and concatenates the sorted ranges in 'fragment'. Returns
+  // nullptr if there are no splitters for the leading key in
+  // 'rangeSplitters_'.
+  velox::core::PlanNodePtr makeRangeOrderBy(
+      const OrderBy& op,
+      const std::vector<velox::core::FieldAccessTypedExprPtr>& keys,
+      const std::vector<velox::core::SortOrder>& sortOrder,
+      runner::ExecutableFragment& fragment,
+      std::vector<runner::ExecutableFragment>& stages);
+
   // Makes partial + final limit fragments.
   velox::core::PlanNodePtr makeLimit(
       const Limit& op,
@@ -161,6 +200,13 @@ class ToVelox {
       runner::ExecutableFragment& fragment,
       std::vector<runner::ExecutableFragment>& stages);
 
+  // Makes an IndexLookupJoinNode for a 'scan' with lookup keys. The input of
+  // 'scan' is the probe side.
+  velox::core::PlanNodePtr makeIndexLookup(
+      const TableScan& scan,
+      runner::ExecutableFragment& fragment,
+      std::vector<runner::ExecutableFragment>& stages);
+
   velox::core::PlanNodePtr makeFilter(
       const Filter& filter,
       runner::ExecutableFragment& fragment,
@@ -182,6 +228,21 @@ class ToVelox {
       std::vector<runner::ExecutableFragment>& stages,
       std::shared_ptr<velox::core::ExchangeNode>& exchange);
 
+  // Finds full scans of the same table in 'plan' to replace by one scan of
+  // the union of their columns if this is predicted to cost less than
+  // reading the table once per scan. Fills 'sharedScans_'.
+  void planSharedScans(const RelationOp& plan);
+
+  // Makes an exchange reading the result of the scan shared by 'scan' and
+  // other scans of the same table, followed by the filters of 'scan'. Makes
+  // the fragment of the shared scan if not made yet. Returns nullptr if
+  // 'fragment' already reads the shared scan.
+  velox::core::PlanNodePtr makeSharedScan(
+      const TableScan& scan,
+      int32_t sharedIndex,
+      runner::ExecutableFragment& fragment,
+      std::vector<runner::ExecutableFragment>& stages);
+
   // Makes a union all with a mix of remote and local inputs. Combines all
   // remote inputs into one ExchangeNode.
   velox::core::PlanNodePtr makeUnionAll(
@@ -228,7 +289,45 @@ class ToVelox {
       const TableScan& scan,
       const velox::core::PlanNodePtr& scanNode);
 
-  runner::ExecutableFragment newFragment();
+  // Makes the fragment that computes the dynamic filters of 'join'. 'keys'
+  // are the indices of the filtered keys in the join keys and their filters.
+  // 'build' is the exchange that reads the build side into 'fragment', the
+  // fragment of the join.
+  runner::DynamicFilterSource makeDynamicFilterSource(
+      const Join& join,
+      const std::vector<std::pair<int32_t, runner::DynamicFilterPtr>>& keys,
+      const runner::ExecutableFragment& fragment,
+      const velox::core::PlanNode& build);
+
+  // Adds a runner::DynamicFilterNode over 'scanNode' that tests the pending
+  // dynamic filters on the columns of 'scan' that come from joins in
+  // fragments other than 'fragment'. Returns 'scanNode' if there are none.
+  velox::core::PlanNodePtr addDynamicFilters(
+      const TableScan& scan,
+      const runner::ExecutableFragment& fragment,
+      velox::core::PlanNodePtr scanNode);
+
+  // Returns a new fragment that runs the part of 'root' up to the next
+  // repartitions. Sizes the fragment from the predicted cost of that part.
+  runner::ExecutableFragment newFragment(const RelationOp& root);
+
+  // Sets the width and number of drivers of 'fragment' from the predicted
+  // cost of 'root'. Leaves the width unchanged if 'setWidth' is false.
+  void setParallelism(
+      const RelationOp& root,
+      runner::ExecutableFragment& fragment,
+      bool setWidth) const;
+
+  // Adds the predicted peak memory of 'op' to the fragment that runs it.
+  void addFragmentMemory(
+      const runner::ExecutableFragment& fragment,
+      const RelationOp& op);
+
+  // Sets the predicted memory of 'stages'. Enables spilling in the fragments
+  // with the most predicted memory until the rest fit in 'queryMemoryBudget'
+  // of 'options_'.
+  void setFragmentMemory(
+      std::vector<runner::ExecutableFragment>& stages) const;
 
   // TODO Move this into MultiFragmentPlan::Options.
   const velox::VectorSerde::Kind exchangeSerdeKind_{
@@ -248,6 +347,78 @@ class ToVelox {
   // Predicted cardinality and memory for nodes to record in history.
   NodePredictionMap prediction_;
 
+  // Predicted peak memory of hash tables and sort buffers per fragment. Keyed
+  // on task prefix.
+  folly::F14FastMap<std::string, float> fragmentMemory_;
+
+  struct PendingDynamicFilter {
+    runner::DynamicFilterPtr filter;
+
+    // Task prefix of the fragment of the join.
+    std::string taskPrefix;
+
+    // True if a scan is filtered by 'this'.
+    bool used{false};
+  };
+
+  // Dynamic filters of the joins whose probe side is being made. Keyed on the
+  // probe key.
+  folly::F14FastMap<ColumnCP, PendingDynamicFilter> pendingDynamicFilters_;
+
+  struct SharedSource {
+    const Repartition* repartition;
+
+    // Task prefix of the fragment with the input of 'repartition'.
+    std::string taskPrefix;
+
+    // Task prefixes of the fragments that read the fragment at 'taskPrefix'.
+    // A fragment reads it at most once since its exchanges are not read
+    // independently of each other.
+    std::vector<std::string> consumerTaskPrefixes;
+  };
+
+  // Repartitions whose input fragments may be read by other consumers with
+  // an identical Repartition.
+  std::vector<SharedSource> sharedSources_;
+
+  // Returns the earlier Repartition that produces the same result as
+  // 'repartition' if reading it from 'consumer' is predicted to cost less than
+  // making another fragment. Returns nullptr otherwise, also if 'consumer'
+  // already reads the earlier Repartition.
+  SharedSource* findSharedSource(
+      const Repartition& repartition,
+      const runner::ExecutableFragment& consumer);
+
+  // Splitters for range-partitioned sorts. See toVeloxPlan().
+  RangeSplittersMap rangeSplitters_;
+
+  // A scan of the union of the columns of several TableScans of one table
+  // with the OR of their filters. Its fragment sends the result to the
+  // fragment of each of the TableScans.
+  struct SharedScan {
+    std::vector<const TableScan*> scans;
+
+    // Columns read by any of 'scans'. These are named after the columns of
+    // the table in the result.
+    ColumnVector columns;
+
+    // Task prefix of the fragment of the scan. Empty until it is made.
+    std::string taskPrefix;
+
+    // Task prefixes of the fragments that read the fragment of the scan.
+    std::vector<std::string> consumerTaskPrefixes;
+
+    velox::RowTypePtr outputType;
+  };
+
+  std::vector<SharedScan> sharedScans_;
+
+  // Index into 'sharedScans_' for each of the TableScans it replaces.
+  folly::F14FastMap<const TableScan*, int32_t> sharedScanIndex_;
+
+  // Fragments computing the dynamic filters used in the plan being made.
+  std::vector<runner::DynamicFilterSource> dynamicFilters_;
+
   // On when producing a remaining filter for table scan, where columns must
   // correspond 1:1 to the schema.
   bool makeVeloxExprWithNoAlias_{false};
@@ -29,23 +29,23 @@ namespace facebook::axiom::optimizer {
 
 void VeloxHistory::recordJoinSample(std::string_view key, float lr, float rl) {}
 
-std::pair<float, float> VeloxHistory::sampleJoin(JoinEdge* edge) {
+JoinSample VeloxHistory::sampleJoin(JoinEdge* edge) {
   const auto& options = queryCtx()->optimization()->options();
   if (!options.sampleJoins) {
-    return {0, 0};
+    return {};
   }
 
   auto keyPair = edge->sampleKey();
 
   if (keyPair.first.empty()) {
-    return std::make_pair(0, 0);
+    return {};
   }
   {
     std::lock_guard<std::mutex> l(mutex_);
     auto it = joinSamples_.find(keyPair.first);
     if (it != joinSamples_.end()) {
       if (keyPair.second) {
-        return std::make_pair(it->second.second, it->second.first);
+        return it->second.reverse();
       }
       return it->second;
     }
@@ -54,32 +54,33 @@ std::pair<float, float> VeloxHistory::sampleJoin(JoinEdge* edge) {
   auto rightTable = edge->rightTable()->as<BaseTable>()->schemaTable;
   auto leftTable = edge->leftTable()->as<BaseTable>()->schemaTable;
 
-  std::pair<float, float> pair;
+  JoinSample sample;
   uint64_t start = velox::getCurrentTimeMicro();
   if (keyPair.second) {
-    pair = optimizer::sampleJoin(
+    sample = optimizer::sampleJoin(
         rightTable, edge->rightKeys(), leftTable, edge->leftKeys());
   } else {
-    pair = optimizer::sampleJoin(
+    sample = optimizer::sampleJoin(
         leftTable, edge->leftKeys(), rightTable, edge->rightKeys());
   }
 
   {
     std::lock_guard<std::mutex> l(mutex_);
-    joinSamples_[keyPair.first] = pair;
+    joinSamples_[keyPair.first] = sample;
   }
 
   const bool trace = (options.traceFlags & OptimizerOptions::kSample) != 0;
   if (trace) {
-    std::cout << "Sample join " << keyPair.first << ": " << pair.first << " :"
-              << pair.second << " time="
+    std::cout << "Sample join " << keyPair.first << ": " << sample.rlFanout
+              << " :" << sample.lrFanout << " skew=" << sample.leftSkew
+              << " :" << sample.rightSkew << " time="
               << velox::succinctMicros(velox::getCurrentTimeMicro() - start)
               << std::endl;
   }
   if (keyPair.second) {
-    return std::make_pair(pair.second, pair.first);
+    return sample.reverse();
   }
-  return pair;
+  return sample;
 }
 
 bool VeloxHistory::setLeafSelectivity(
@@ -216,28 +217,32 @@ void VeloxHistory::recordVeloxExecution(
           // the previous node.
           continue;
         }
+        const uint64_t actualRows = op.outputPositions;
+
+        // The scan is recorded even if the prediction is for a filter or
+        // projection above it. Later plans take their leaf selectivities
+        // from here.
+        if (op.operatorType == "TableScan") {
+          if (const auto* scan = findScan(op.planNodeId, plan.plan)) {
+            std::string handle = scan->tableHandle()->toString();
+            recordLeafSelectivity(
+                handle,
+                static_cast<float>(actualRows) /
+                    std::max(1.F, static_cast<float>(op.rawInputPositions)),
+                true);
+          }
+        }
+
         auto it = plan.prediction.find(op.planNodeId);
         auto keyIt = plan.history.find(op.planNodeId);
         if (keyIt == plan.history.end()) {
           continue;
         }
-        uint64_t actualRows{};
         {
           std::lock_guard<std::mutex> l(mutex_);
-          actualRows = op.outputPositions;
           planHistory_[keyIt->second] =
               NodePrediction{.cardinality = static_cast<float>(actualRows)};
         }
-        if (op.operatorType == "TableScanOperator") {
-          if (const auto* scan = findScan(op.planNodeId, plan.plan)) {
-            std::string handle = scan->tableHandle()->toString();
-            recordLeafSelectivity(
-                handle,
-                static_cast<float>(actualRows) /
-                    std::max(1.F, static_cast<float>(op.rawInputPositions)),
-                true);
-          }
-        }
         if (it != plan.prediction.end()) {
           auto predictedRows = it->second.cardinality;
           predictionWarnings(
@@ -251,6 +256,37 @@ void VeloxHistory::recordVeloxExecution(
   }
 }
 
+// static
+std::vector<velox::core::PlanNodeId> VeloxHistory::findMisestimates(
+    const PlanAndStats& plan,
+    const std::vector<velox::exec::TaskStats>& stats,
+    float threshold) {
+  VELOX_CHECK_GT(threshold, 1);
+  std::vector<velox::core::PlanNodeId> result;
+  for (auto& task : stats) {
+    for (auto& pipeline : task.pipelineStats) {
+      for (auto& op : pipeline.operatorStats) {
+        if (op.operatorType == "HashBuild") {
+          continue;
+        }
+        auto it = plan.prediction.find(op.planNodeId);
+        if (it == plan.prediction.end() ||
+            std::isnan(it->second.cardinality)) {
+          continue;
+        }
+        const auto ratio =
+            std::max(1.F, static_cast<float>(op.outputPositions)) /
+            std::max(1.F, it->second.cardinality);
+        if ((ratio > threshold || ratio < 1 / threshold) &&
+            std::ranges::find(result, op.planNodeId) == result.end()) {
+          result.push_back(op.planNodeId);
+        }
+      }
+    }
+  }
+  return result;
+}
+
 folly::dynamic VeloxHistory::serialize() {
   folly::dynamic obj = folly::dynamic::object();
   auto leafArray = folly::dynamic::array();
@@ -265,8 +301,10 @@ folly::dynamic VeloxHistory::serialize() {
   for (auto& pair : joinSamples_) {
     folly::dynamic join = folly::dynamic::object();
     join["key"] = pair.first;
-    join["lr"] = pair.second.first;
-    join["rl"] = pair.second.second;
+    join["lr"] = pair.second.rlFanout;
+    join["rl"] = pair.second.lrFanout;
+    join["lskew"] = pair.second.leftSkew;
+    join["rskew"] = pair.second.rightSkew;
     joinArray.push_back(join);
   }
   obj["joins"] = joinArray;
@@ -290,8 +328,16 @@ void VeloxHistory::update(folly::dynamic& serialized) {
     leafSelectivities_[pair["key"].asString()] = toFloat(pair["value"]);
   }
   for (auto& pair : serialized["joins"]) {
-    joinSamples_[pair["key"].asString()] =
-        std::make_pair<float, float>(toFloat(pair["lr"]), toFloat(pair["rl"]));
+    // Histories written before skew was sampled have no skew.
+    auto optionalFloat = [&](const char* name) {
+      auto* value = pair.get_ptr(name);
+      return value == nullptr ? 0 : toFloat(*value);
+    };
+    joinSamples_[pair["key"].asString()] = {
+        .rlFanout = toFloat(pair["lr"]),
+        .lrFanout = toFloat(pair["rl"]),
+        .leftSkew = optionalFloat("lskew"),
+        .rightSkew = optionalFloat("rskew")};
   }
   for (auto& pair : serialized["plans"]) {
     planHistory_[pair["key"].asString()] =
@@ -28,7 +28,7 @@ class VeloxHistory : public History {
  public:
   void recordJoinSample(std::string_view key, float lr, float rl) override;
 
-  std::pair<float, float> sampleJoin(JoinEdge* edge) override;
+  JoinSample sampleJoin(JoinEdge* edge) override;
 
   std::optional<Cost> findCost(RelationOp& op) override {
     return std::nullopt;
@@ -48,12 +48,20 @@ class VeloxHistory : public History {
       const PlanAndStats& plan,
       const std::vector<velox::exec::TaskStats>& stats);
 
+  /// Returns the ids of the nodes in 'stats' whose output cardinality is more
+  /// than 'threshold' times above or below the prediction in 'plan'.
+  /// Cardinalities below 1 count as 1.
+  static std::vector<velox::core::PlanNodeId> findMisestimates(
+      const PlanAndStats& plan,
+      const std::vector<velox::exec::TaskStats>& stats,
+      float threshold);
+
   folly::dynamic serialize() override;
 
   void update(folly::dynamic& serialized) override;
 
  private:
-  folly::F14FastMap<std::string, std::pair<float, float>> joinSamples_;
+  folly::F14FastMap<std::string, JoinSample> joinSamples_;
   folly::F14FastMap<std::string, NodePrediction> planHistory_;
 };
 
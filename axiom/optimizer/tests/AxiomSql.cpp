@@ -26,10 +26,12 @@
 #include "axiom/logical_plan/PlanPrinter.h"
 #include "axiom/optimizer/Optimization.h"
 #include "axiom/optimizer/Plan.h"
+#include "axiom/optimizer/QueryCheckpoints.h"
 #include "axiom/optimizer/VeloxHistory.h"
 #include "axiom/optimizer/tests/PrestoParser.h"
 #include "axiom/runner/LocalRunner.h"
 #include "velox/benchmarks/QueryBenchmarkBase.h"
+#include "velox/common/base/SuccinctPrinter.h"
 #include "velox/common/caching/SsdCache.h"
 #include "velox/common/file/FileSystems.h"
 #include "velox/connectors/hive/HiveConnector.h"
@@ -83,8 +85,83 @@ DEFINE_int32(num_workers, 4, "Number of in-process workers");
 // Defined in velox/benchmarks/QueryBenchmarkBase.cpp
 DECLARE_int32(num_drivers);
 
+DEFINE_double(
+    cost_per_driver,
+    0,
+    "Predicted cost of the work for one driver. Stages with less work run on "
+    "fewer workers and drivers. 0 means all stages use num_workers and "
+    "num_drivers");
+
+DEFINE_double(
+    dynamic_filter_selectivity,
+    0,
+    "Hash joins predicted to keep at most this fraction of probe rows filter "
+    "probe-side scans with the build keys at run time. 0 disables dynamic "
+    "filters");
+
+DEFINE_double(
+    bloom_filter_max_build_rows,
+    0,
+    "Maximum predicted build rows of a hash join whose build keys make a Bloom "
+    "filter for the probe side before it is shuffled. 0 disables Bloom "
+    "filters");
+
+DEFINE_bool(
+    assume_referential_integrity,
+    false,
+    "Assume that inner joins on the unique keys of a table match every row of "
+    "the other side. Such joins whose table has no filter and no used columns "
+    "are removed");
+
+DEFINE_double(
+    eager_aggregation_fanout,
+    0,
+    "Aggregations over one table of a join are also planned with a partial "
+    "aggregation below the joins if it keeps at most this fraction of rows. 0 "
+    "disables eager aggregation");
+
+DEFINE_double(
+    range_sort_min_bytes,
+    0,
+    "Sorts predicted to sort at least this many bytes sort ranges of the "
+    "leading key in parallel. 0 disables range-partitioned sorts");
+
 DEFINE_int64(split_target_bytes, 16 << 20, "Approx bytes covered by one split");
 
+DEFINE_string(
+    spill_dir,
+    "",
+    "Directory for spill files. If empty, queries do not spill");
+
+DEFINE_int64(
+    query_memory_budget_mb,
+    0,
+    "Memory a query is expected to fit in. Stages with the largest predicted "
+    "hash tables and sorts spill until the rest fit. 0 means no spilling");
+
+DEFINE_int32(
+    concurrency,
+    0,
+    "If > 0, runs each query from this many concurrent clients and reports "
+    "throughput and p50/p99 latency instead of printing results");
+
+DEFINE_int32(
+    queries_per_client,
+    10,
+    "Number of times each client runs the query when concurrency > 0");
+
+DEFINE_int32(
+    scheduler_max_drivers,
+    0,
+    "Maximum number of drivers of concurrently running queries. Queries over "
+    "the limit wait for admission. 0 means no limit");
+
+DEFINE_int64(
+    scheduler_max_memory_mb,
+    0,
+    "Maximum predicted memory of concurrently running queries. Queries over "
+    "the limit wait for admission. 0 means no limit");
+
 DEFINE_string(
     query,
     "",
@@ -102,6 +179,25 @@ DEFINE_string(
     "Name of SQL file with a single query. Runs and "
     "compares with <name>.ref, previously recorded with --record");
 
+DEFINE_bool(
+    adaptive,
+    false,
+    "Run the filtered scans that are inputs of joins first and plan the rest "
+    "of the query again with the results that are off the estimates");
+
+DEFINE_int64(
+    adaptive_max_rows,
+    100'000,
+    "Maximum rows of a filtered scan kept by --adaptive. Larger scans are "
+    "run again as part of the query");
+
+DEFINE_double(
+    adaptive_threshold,
+    2,
+    "The rest of the query is planned again with the result of a filtered "
+    "scan run by --adaptive if its cardinality is more than this many times "
+    "off the estimate");
+
 DEFINE_bool(
     check_test_flag_combinations,
     true,
@@ -133,7 +229,11 @@ const char* helpText =
     "\n"
     "print_stats - Prints the Velox stats of after execution. Annotates operators with predicted and acttual output cardinality.\n"
     "\n"
-    "include_custom_stats - Prints per operator runtime stats.\n";
+    "include_custom_stats - Prints per operator runtime stats.\n"
+    "\n"
+    "concurrency - Runs each query from this many concurrent clients and prints throughput and p50/p99 latency.\n"
+    "\n"
+    "adaptive - Runs the filtered scans that are inputs of joins first. If one is off the estimate, the rest of the query is planned again with its actual cardinality and reads its result.\n";
 
 static const std::string kHiveConnectorId = "hive";
 
@@ -184,6 +284,13 @@ class VeloxRunner : public velox::QueryBenchmarkBase {
             std::thread::hardware_concurrency() * 2,
             FLAGS_num_workers * FLAGS_num_drivers * 2 + 2));
     spillExecutor_ = std::make_shared<folly::IOThreadPoolExecutor>(4);
+
+    if (FLAGS_scheduler_max_drivers > 0 || FLAGS_scheduler_max_memory_mb > 0) {
+      scheduler_ = facebook::axiom::runner::QueryScheduler::create({
+          .maxMemoryBytes = FLAGS_scheduler_max_memory_mb << 20,
+          .maxDrivers = FLAGS_scheduler_max_drivers,
+      });
+    }
   }
 
   void initializeMemoryManager() {
@@ -332,6 +439,11 @@ class VeloxRunner : public velox::QueryBenchmarkBase {
     const auto logicalPlan =
         sqlStatement->asUnchecked<optimizer::test::SelectStatement>()->plan();
 
+    if (FLAGS_concurrency > 0) {
+      runConcurrent(logicalPlan);
+      return;
+    }
+
     if (record_ || check_) {
       std::string error;
       std::string plan;
@@ -411,16 +523,23 @@ class VeloxRunner : public velox::QueryBenchmarkBase {
   }
 
   std::shared_ptr<core::QueryCtx> newQuery() {
-    ++queryCounter_;
+    const auto queryNumber = ++queryCounter_;
+
+    auto config = config_;
+    if (!FLAGS_spill_dir.empty()) {
+      // Velox spills only in tasks with a spill directory. These are set by
+      // the runner for the stages the optimizer marks as spillable.
+      config.try_emplace(core::QueryConfig::kSpillEnabled, "true");
+    }
 
     return core::QueryCtx::create(
         executor_.get(),
-        core::QueryConfig(config_),
+        core::QueryConfig(std::move(config)),
         {},
         cache::AsyncDataCache::getInstance(),
         rootPool_->shared_from_this(),
         spillExecutor_.get(),
-        fmt::format("query_{}", queryCounter_));
+        fmt::format("query_{}", queryNumber));
   }
 
   void runExplain(const optimizer::test::SelectStatement& statement) {
@@ -451,7 +570,8 @@ class VeloxRunner : public velox::QueryBenchmarkBase {
       const logical_plan::LogicalPlanNodePtr& logicalPlan,
       const std::shared_ptr<core::QueryCtx>& queryCtx,
       const std::function<void(const optimizer::Plan&)>& peakAtBestPlan =
-          nullptr) {
+          nullptr,
+      const optimizer::QueryCheckpoints* checkpoints = nullptr) {
     if (FLAGS_print_logical_plan) {
       std::cout << "Logical plan: " << std::endl
                 << logical_plan::PlanPrinter::toText(*logicalPlan) << std::endl;
@@ -460,6 +580,8 @@ class VeloxRunner : public velox::QueryBenchmarkBase {
     facebook::axiom::runner::MultiFragmentPlan::Options opts;
     opts.numWorkers = FLAGS_num_workers;
     opts.numDrivers = FLAGS_num_drivers;
+    opts.queryMemoryBudget = FLAGS_query_memory_budget_mb << 20;
+    opts.spillDirectory = FLAGS_spill_dir;
     auto allocator =
         std::make_unique<HashStringAllocator>(optimizerPool_.get());
     auto context = std::make_unique<optimizer::QueryGraphContext>(*allocator);
@@ -476,13 +598,28 @@ class VeloxRunner : public velox::QueryBenchmarkBase {
     exec::SimpleExpressionEvaluator evaluator(
         queryCtx.get(), optimizerPool_.get());
 
+    optimizer::OptimizerOptions options{
+        .traceFlags = FLAGS_optimizer_trace,
+        .costPerDriver = static_cast<float>(FLAGS_cost_per_driver),
+        .dynamicFilterMaxSelectivity =
+            static_cast<float>(FLAGS_dynamic_filter_selectivity),
+        .bloomFilterMaxBuildRows =
+            static_cast<float>(FLAGS_bloom_filter_max_build_rows),
+        .assumeReferentialIntegrity = FLAGS_assume_referential_integrity,
+        .eagerAggregationMaxFanout =
+            static_cast<float>(FLAGS_eager_aggregation_fanout),
+        .rangeSortMinBytes = static_cast<float>(FLAGS_range_sort_min_bytes)};
+    if (checkpoints) {
+      options.checkpoints = checkpoints->results();
+    }
+
     optimizer::Optimization optimization(
         *logicalPlan,
         veraxSchema,
         *history_,
         queryCtx,
         evaluator,
-        {.traceFlags = FLAGS_optimizer_trace},
+        std::move(options),
         opts);
 
     auto best = optimization.bestPlan();
@@ -519,20 +656,97 @@ class VeloxRunner : public velox::QueryBenchmarkBase {
     });
   }
 
-  static std::shared_ptr<facebook::axiom::runner::LocalRunner> makeRunner(
+  std::shared_ptr<facebook::axiom::runner::LocalRunner> makeRunner(
       const optimizer::PlanAndStats& planAndStats,
-      const std::shared_ptr<core::QueryCtx>& queryCtx) {
+      const std::shared_ptr<core::QueryCtx>& queryCtx,
+      std::string schedulerGroup = "") {
     connector::SplitOptions splitOptions{
         .targetSplitCount =
             static_cast<int32_t>(FLAGS_num_workers * FLAGS_num_drivers * 2),
         .fileBytesPerSplit = static_cast<uint64_t>(FLAGS_split_target_bytes),
     };
 
-    return std::make_shared<facebook::axiom::runner::LocalRunner>(
+    auto runner = std::make_shared<facebook::axiom::runner::LocalRunner>(
         planAndStats.plan,
         queryCtx,
         std::make_shared<facebook::axiom::runner::ConnectorSplitSourceFactory>(
             splitOptions));
+    if (scheduler_) {
+      runner->setScheduler(scheduler_, 0, std::move(schedulerGroup));
+    }
+    return runner;
+  }
+
+  /// Runs 'logicalPlan' 'queries_per_client' times from each of
+  /// 'concurrency' client threads. Prints the throughput and the p50 and p99
+  /// latency. The latency includes the time waiting for admission.
+  void runConcurrent(const logical_plan::LogicalPlanNodePtr& logicalPlan) {
+    optimizer::PlanAndStats planAndStats;
+    try {
+      planAndStats = optimize(logicalPlan, newQuery());
+    } catch (const std::exception& e) {
+      std::cerr << "Failed to optimize: " << e.what() << std::endl;
+      return;
+    }
+
+    std::mutex mutex;
+    std::vector<uint64_t> latencies;
+    std::atomic<int32_t> numErrors{0};
+    uint64_t totalMicros = 0;
+    {
+      MicrosecondTimer timer(&totalMicros);
+      std::vector<std::thread> clients;
+      for (auto client = 0; client < FLAGS_concurrency; ++client) {
+        clients.emplace_back([&, client]() {
+          for (auto i = 0; i < FLAGS_queries_per_client; ++i) {
+            uint64_t micros = 0;
+            std::shared_ptr<facebook::axiom::runner::LocalRunner> runner;
+            try {
+              MicrosecondTimer queryTimer(&micros);
+              runner = makeRunner(
+                  planAndStats, newQuery(), fmt::format("client{}", client));
+              while (runner->next()) {
+              }
+            } catch (const std::exception& e) {
+              LOG(ERROR) << "Query failed: " << e.what();
+              ++numErrors;
+            }
+            waitForCompletion(runner);
+
+            std::lock_guard<std::mutex> l(mutex);
+            latencies.push_back(micros);
+          }
+        });
+      }
+      for (auto& client : clients) {
+        client.join();
+      }
+    }
+
+    if (latencies.empty()) {
+      return;
+    }
+
+    std::ranges::sort(latencies);
+    auto percentile = [&](double fraction) {
+      const auto index = static_cast<size_t>(
+          std::ceil(fraction * static_cast<double>(latencies.size())));
+      return latencies[std::clamp<size_t>(index, 1, latencies.size()) - 1];
+    };
+
+    const double queriesPerSecond = static_cast<double>(latencies.size()) *
+        1'000'000 / static_cast<double>(std::max<uint64_t>(totalMicros, 1));
+    std::cout << fmt::format(
+                     "{} queries from {} clients in {}: {:.2f} queries/s, "
+                     "p50 {}, p99 {}, {} errors",
+                     latencies.size(),
+                     FLAGS_concurrency,
+                     succinctMicros(totalMicros),
+                     queriesPerSecond,
+                     succinctMicros(percentile(0.5)),
+                     succinctMicros(percentile(0.99)),
+                     numErrors.load())
+              << std::endl;
   }
 
   /// Runs a query and returns the result as a single vector in *resultVector,
@@ -545,14 +759,23 @@ class VeloxRunner : public velox::QueryBenchmarkBase {
       std::string* errorString = nullptr,
       std::vector<exec::TaskStats>* statsReturn = nullptr,
       RunStats* runStatsReturn = nullptr) {
+    // Declared first since the plan reads the results of the checkpoints.
+    std::unique_ptr<optimizer::QueryCheckpoints> checkpoints;
     auto queryCtx = newQuery();
     optimizer::PlanAndStats planAndStats;
     try {
-      planAndStats = optimize(logicalPlan, queryCtx, [&](const auto& best) {
-        if (planString) {
-          *planString = best.op->toString(true, false);
-        }
-      });
+      if (FLAGS_adaptive) {
+        checkpoints = runCheckpoints(*logicalPlan);
+      }
+      planAndStats = optimize(
+          logicalPlan,
+          queryCtx,
+          [&](const auto& best) {
+            if (planString) {
+              *planString = best.op->toString(true, false);
+            }
+          },
+          checkpoints.get());
     } catch (const std::exception& e) {
       std::cerr << "Failed to optimize: " << e.what() << std::endl;
       if (errorString) {
@@ -624,6 +847,29 @@ class VeloxRunner : public velox::QueryBenchmarkBase {
     }
   }
 
+  /// Runs the checkpoints of 'logicalPlan' and records their execution in
+  /// the history. Keeps the results of the checkpoints that are more than
+  /// --adaptive_threshold times off the estimate.
+  std::unique_ptr<optimizer::QueryCheckpoints> runCheckpoints(
+      const logical_plan::LogicalPlanNode& logicalPlan) {
+    auto checkpoints = std::make_unique<optimizer::QueryCheckpoints>();
+    for (const auto& node : optimizer::QueryCheckpoints::find(logicalPlan)) {
+      auto queryCtx = newQuery();
+      auto planAndStats = optimize(node, queryCtx);
+      auto runner = makeRunner(planAndStats, queryCtx);
+      auto stats = checkpoints->add(
+          node,
+          planAndStats,
+          runner,
+          FLAGS_adaptive_max_rows,
+          FLAGS_adaptive_threshold);
+      if (stats) {
+        history_->recordVeloxExecution(planAndStats, *stats);
+      }
+    }
+    return checkpoints;
+  }
+
   void runMain(std::ostream& out, RunStats& runStats) override {
     std::vector<RowVectorPtr> result;
     auto runner =
@@ -840,6 +1086,7 @@ class VeloxRunner : public velox::QueryBenchmarkBase {
   std::unique_ptr<folly::IOThreadPoolExecutor> cacheExecutor_;
   std::shared_ptr<folly::CPUThreadPoolExecutor> executor_;
   std::shared_ptr<folly::IOThreadPoolExecutor> spillExecutor_;
+  std::shared_ptr<facebook::axiom::runner::QueryScheduler> scheduler_;
   std::shared_ptr<velox::connector::Connector> connector_;
   std::shared_ptr<connector::SchemaResolver> schema_;
   std::unique_ptr<optimizer::VeloxHistory> history_;
@@ -850,7 +1097,7 @@ class VeloxRunner : public velox::QueryBenchmarkBase {
   int32_t numFailed_{0};
   int32_t numPlanMismatch_{0};
   int32_t numResultMismatch_{0};
-  int32_t queryCounter_{0};
+  std::atomic<int32_t> queryCounter_{0};
   logical_plan::LogicalPlanNodePtr logicalPlan_;
   bool hasReferenceResult_{false};
   // Keeps live 'referenceResult_'.
@@ -290,5 +290,99 @@ TEST_F(HiveLimitQueriesTest, orderByOffsetLimit) {
   checkResults(plan, reference);
 }
 
+// Limits over a table of several files, of which a scan under a small limit
+// reads only the first.
+class ScanLimitTest : public test::QueryTestBase {
+ protected:
+  static void SetUpTestCase() {
+    test::QueryTestBase::SetUpTestCase();
+    localDataPath_.clear();
+    localFileFormat_ = dwio::common::FileFormat::DWRF;
+    testTables_ = {runner::test::TableSpec{
+        .name = "numbers",
+        .columns = ROW({"n"}, {BIGINT()}),
+        .rowsPerVector = 1'000,
+        .numVectorsPerFile = 1,
+        .numFiles = 10}};
+  }
+
+  static void TearDownTestCase() {
+    testTables_.clear();
+    localDataPath_.clear();
+    test::QueryTestBase::TearDownTestCase();
+  }
+};
+
+// LIMIT 10 over a table of 10'000 rows in 10 files.
+TEST_F(ScanLimitTest, scanLimit) {
+  lp::PlanBuilder::Context context(exec::test::kHiveConnectorId);
+
+  auto logicalPlan =
+      lp::PlanBuilder(context).tableScan("numbers").limit(10).build();
+
+  auto countRows = [](const test::TestResult& result) {
+    int64_t numRows = 0;
+    for (const auto& rows : result.results) {
+      numRows += rows->size();
+    }
+    return numRows;
+  };
+
+  auto countScannedRows = [](const test::TestResult& result) {
+    int64_t numRows = 0;
+    for (const auto& stats : result.stats) {
+      for (const auto& pipeline : stats.pipelineStats) {
+        for (const auto& op : pipeline.operatorStats) {
+          if (op.operatorType == "TableScan") {
+            numRows += op.rawInputPositions;
+          }
+        }
+      }
+    }
+    return numRows;
+  };
+
+  // Single driver. The scan stops adding splits once it has 10 rows.
+  {
+    SCOPED_TRACE("numWorkers: 1, numDrivers: 1");
+    auto plan = planVelox(logicalPlan, {.numWorkers = 1, .numDrivers = 1});
+    const auto& fragments = plan.plan->fragments();
+    ASSERT_EQ(1, fragments.size());
+    ASSERT_EQ(1, fragments.at(0).scanLimits.size());
+    EXPECT_EQ(10, fragments.at(0).scanLimits.begin()->second);
+
+    auto result = runFragmentedPlan(plan);
+    EXPECT_EQ(10, countRows(result));
+    EXPECT_LT(countScannedRows(result), 10'000);
+  }
+
+  // Distributed. The scan is limited in the leaf fragment.
+  {
+    SCOPED_TRACE("numWorkers: 4, numDrivers: 4");
+    auto plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+    const auto& fragments = plan.plan->fragments();
+    ASSERT_EQ(2, fragments.size());
+    ASSERT_EQ(1, fragments.at(0).scanLimits.size());
+    EXPECT_EQ(10, fragments.at(0).scanLimits.begin()->second);
+    EXPECT_TRUE(fragments.at(1).scanLimits.empty());
+
+    auto result = runFragmentedPlan(plan);
+    EXPECT_EQ(10, countRows(result));
+  }
+
+  // Limits above scanLimitMaxRows are not pushed into the scan.
+  {
+    SCOPED_TRACE("scanLimitMaxRows: 5");
+    optimizerOptions_.scanLimitMaxRows = 5;
+    auto plan = planVelox(logicalPlan, {.numWorkers = 1, .numDrivers = 1});
+    const auto& fragments = plan.plan->fragments();
+    ASSERT_EQ(1, fragments.size());
+    EXPECT_TRUE(fragments.at(0).scanLimits.empty());
+
+    auto result = runFragmentedPlan(plan);
+    EXPECT_EQ(10, countRows(result));
+  }
+}
+
 } // namespace
 } // namespace facebook::axiom::optimizer
@@ -15,10 +15,13 @@
  */
 
 #include <folly/init/Init.h>
+#include <folly/json.h>
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include "axiom/connectors/tests/TestConnector.h"
 #include "axiom/logical_plan/PlanBuilder.h"
+#include "axiom/optimizer/Cost.h"
+#include "axiom/optimizer/QueryCheckpoints.h"
 #include "axiom/optimizer/tests/ParquetTpchTest.h"
 #include "axiom/optimizer/tests/PlanMatcher.h"
 #include "axiom/optimizer/tests/QueryTestBase.h"
@@ -471,6 +474,67 @@ TEST_F(PlanTest, multipleConnectors) {
   ASSERT_TRUE(matcher->match(plan));
 }
 
+TEST_F(PlanTest, indexLookupJoin) {
+  testConnector_->addTable("probe", ROW({"p_key", "p_value"}, BIGINT()));
+  testConnector_->appendData(
+      "probe",
+      makeRowVector(
+          {"p_key", "p_value"},
+          {makeFlatVector<int64_t>(
+               10, [](auto row) { return row == 9 ? 1'000'000 : row * 3; }),
+           makeFlatVector<int64_t>(10, [](auto row) { return row; })}));
+  auto dim =
+      testConnector_->addTable("dim", ROW({"d_key", "d_value"}, BIGINT()));
+  dim->addLookupLayout("dim_by_key", {"d_key"});
+  testConnector_->appendData(
+      "dim",
+      makeRowVector(
+          {"d_key", "d_value"},
+          {makeFlatVector<int64_t>(100'000, [](auto row) { return row; }),
+           makeFlatVector<int64_t>(
+               100'000, [](auto row) { return row * 2; })}));
+
+  // A few probe rows look up their matches in a large table instead of
+  // building a hash table of it.
+  lp::PlanBuilder::Context context(kTestConnectorId);
+  auto logicalPlan = lp::PlanBuilder(context)
+                         .tableScan("probe")
+                         .join(
+                             lp::PlanBuilder(context).tableScan("dim"),
+                             "p_key = d_key",
+                             lp::JoinType::kInner)
+                         .project({"p_value", "d_value"})
+                         .build();
+
+  auto plan = planVelox(logicalPlan, {.numWorkers = 1, .numDrivers = 1});
+  ASSERT_EQ(1, plan.plan->fragments().size());
+  const auto* join = dynamic_cast<const core::IndexLookupJoinNode*>(
+      core::PlanNode::findFirstNode(
+          plan.plan->fragments()[0].fragment.planNode.get(),
+          [](const auto* node) {
+            return dynamic_cast<const core::IndexLookupJoinNode*>(node) !=
+                nullptr;
+          }));
+  ASSERT_NE(nullptr, join);
+  auto handle = std::dynamic_pointer_cast<const connector::TestTableHandle>(
+      join->lookupSource()->tableHandle());
+  ASSERT_NE(nullptr, handle);
+  EXPECT_EQ("dim_by_key", handle->layout().name());
+  ASSERT_TRUE(handle->lookupKeys().has_value());
+  EXPECT_EQ(
+      std::vector<std::string>{"d_key"}, handle->lookupKeys()->equalityColumns);
+
+  // The last probe row has no match.
+  auto referencePlan =
+      exec::test::PlanBuilder()
+          .values({makeRowVector(
+              {makeFlatVector<int64_t>(9, [](auto row) { return row; }),
+               makeFlatVector<int64_t>(9, [](auto row) { return row * 6; })})})
+          .planNode();
+
+  checkSame(plan, referencePlan);
+}
+
 TEST_F(PlanTest, filterToJoinEdge) {
   auto nationType = ROW({"n_regionkey"}, {BIGINT()});
   auto regionType = ROW({"r_regionkey"}, {BIGINT()});
@@ -1233,6 +1297,14 @@ TEST_F(PlanTest, values) {
 
 TEST_F(PlanTest, limitBeforeProject) {
   testConnector_->addTable("t", ROW({"a", "b"}, {INTEGER(), INTEGER()}));
+  testConnector_->appendData(
+      "t",
+      makeRowVector(
+          {"a", "b"},
+          {makeFlatVector<int32_t>(1'000, [](auto row) { return row; }),
+           makeFlatVector<int32_t>(1'000, [](auto row) { return row; })}));
+
+  // The limit goes below the projection if it keeps few of the 1000 rows.
   {
     auto logicalPlan = lp::PlanBuilder{}
                            .tableScan(kTestConnectorId, "t", {"a", "b"})
@@ -1263,6 +1335,1429 @@ TEST_F(PlanTest, limitBeforeProject) {
   }
 }
 
+TEST_F(PlanTest, joinSkew) {
+  // The skew of a join sample is the fraction of the rows of the table that
+  // have the most frequent key, if this is over 1%.
+  EXPECT_EQ(0, sampleSkew({}, 0));
+  EXPECT_FLOAT_EQ(0.5, sampleSkew({{1, 50}, {2, 25}, {3, 25}}, 100));
+  folly::F14FastMap<uint32_t, uint32_t> uniform;
+  for (auto i = 0; i < 200; ++i) {
+    uniform[i] = 1;
+  }
+  EXPECT_EQ(0, sampleSkew(uniform, 200));
+
+  // A sample of a fraction of the table has the full count of its keys. The
+  // skew is relative to the table, not to the sample.
+  EXPECT_FLOAT_EQ(0.05, sampleSkew({{1, 50}, {2, 25}, {3, 25}}, 1'000));
+  EXPECT_EQ(0, sampleSkew({{1, 50}, {2, 25}, {3, 25}}, 10'000));
+
+  // Stale table stats do not make the skew exceed the sample.
+  EXPECT_FLOAT_EQ(0.5, sampleSkew({{1, 50}, {2, 25}, {3, 25}}, 10));
+
+  // A key with no more than an even share of the rows holds up no worker.
+  EXPECT_EQ(0, Costs::skewCost(1'000, 2, 0, 4));
+  EXPECT_EQ(0, Costs::skewCost(1'000, 2, 0.25, 4));
+  EXPECT_FLOAT_EQ(1'000 * 2 * 0.25 * 3, Costs::skewCost(1'000, 2, 0.5, 4));
+
+  // Skew survives a round trip through a saved history. Histories saved
+  // without skew load with none.
+  {
+    auto saved = folly::parseJson(
+        R"({"leaves": [], "plans": [], "joins": [
+              {"key": "a", "lr": 1, "rl": 2, "lskew": 0.5, "rskew": 0.25},
+              {"key": "b", "lr": 1, "rl": 1}]})");
+    VeloxHistory loaded;
+    loaded.update(saved);
+    auto resaved = loaded.serialize();
+    VeloxHistory reloaded;
+    reloaded.update(resaved);
+    auto joins = reloaded.serialize()["joins"];
+    ASSERT_EQ(2, joins.size());
+    for (const auto& join : joins) {
+      if (join["key"].asString() == "a") {
+        EXPECT_FLOAT_EQ(0.5, join["lskew"].asDouble());
+        EXPECT_FLOAT_EQ(0.25, join["rskew"].asDouble());
+      } else {
+        EXPECT_EQ(0, join["lskew"].asDouble());
+        EXPECT_EQ(0, join["rskew"].asDouble());
+      }
+    }
+  }
+
+  // A build too large to broadcast for its size is broadcast if partitioning
+  // the probe sends most of the probe rows to one worker.
+  testConnector_->addTable("fact", ROW({"f_key"}, {BIGINT()}));
+  testConnector_->appendData(
+      "fact",
+      makeRowVector(
+          {"f_key"},
+          {makeFlatVector<int64_t>(
+              1'000'000, [](auto row) { return row % 150'000; })}));
+  testConnector_->addTable("dim", ROW({"d_key"}, {BIGINT()}));
+  testConnector_->appendData(
+      "dim",
+      makeRowVector(
+          {"d_key"},
+          {makeFlatVector<int64_t>(150'000, [](auto row) { return row; })}));
+
+  lp::PlanBuilder::Context context(kTestConnectorId);
+  auto logicalPlan = lp::PlanBuilder(context)
+                         .tableScan("fact")
+                         .join(
+                             lp::PlanBuilder(context).tableScan("dim"),
+                             "f_key = d_key",
+                             lp::JoinType::kInner)
+                         .aggregate({}, {"count(1)"})
+                         .build();
+
+  auto isBroadcast = [](const PlanAndStats& plan) {
+    for (const auto& fragment : plan.plan->fragments()) {
+      auto* output = dynamic_cast<const core::PartitionedOutputNode*>(
+          fragment.fragment.planNode.get());
+      if (output != nullptr &&
+          output->kind() == core::PartitionedOutputNode::Kind::kBroadcast) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  auto plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  EXPECT_FALSE(isBroadcast(plan));
+
+  // Marks the sampled join as having a heavy hitter on both sides.
+  auto saved = history().serialize();
+  ASSERT_EQ(1, saved["joins"].size());
+  auto& join = saved["joins"][0];
+  join["lr"] = 1;
+  join["rl"] = 1;
+  join["lskew"] = 0.9;
+  join["rskew"] = 0.9;
+  history().update(saved);
+
+  plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  ASSERT_TRUE(isBroadcast(plan));
+
+  auto result = runFragmentedPlan(plan);
+  ASSERT_EQ(1, result.results.size());
+  EXPECT_EQ(
+      1'000'000,
+      result.results[0]->childAt(0)->as<SimpleVector<int64_t>>()->valueAt(0));
+}
+
+TEST_F(PlanTest, adaptiveParallelism) {
+  const auto connectorId = exec::test::kHiveConnectorId;
+
+  auto logicalPlan =
+      lp::PlanBuilder()
+          .tableScan(connectorId, "nation", {"n_regionkey", "n_nationkey"})
+          .aggregate({"n_regionkey"}, {"count(1)"})
+          .build();
+
+  // Without a cost per driver every stage runs on all workers and drivers.
+  auto plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  for (const auto& fragment : plan.plan->fragments()) {
+    EXPECT_EQ(0, fragment.numDrivers);
+  }
+  EXPECT_EQ(4, plan.plan->fragments().front().width);
+
+  // 'nation' is tiny. With a cost per driver, the stages shrink to one worker
+  // with one driver.
+  optimizerOptions_.costPerDriver = 1'000'000;
+  plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  const auto& fragments = plan.plan->fragments();
+  ASSERT_LT(1, fragments.size());
+  for (auto i = 0; i < fragments.size() - 1; ++i) {
+    EXPECT_EQ(1, fragments[i].width);
+    EXPECT_EQ(1, fragments[i].numDrivers);
+  }
+  EXPECT_EQ(1, fragments.back().numDrivers);
+
+  checkSame(logicalPlan, toSingleNodePlan(logicalPlan));
+}
+
+TEST_F(PlanTest, spillableFragments) {
+  const auto connectorId = exec::test::kHiveConnectorId;
+
+  auto logicalPlan =
+      lp::PlanBuilder()
+          .tableScan(connectorId, "nation", {"n_regionkey", "n_nationkey"})
+          .aggregate({"n_regionkey"}, {"count(1)"})
+          .build();
+
+  auto countSpillable = [](const PlanAndStats& plan) {
+    return std::ranges::count_if(
+        plan.plan->fragments(),
+        [](const auto& fragment) { return fragment.canSpill; });
+  };
+
+  // Without a budget no fragment spills.
+  auto plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  EXPECT_EQ(0, countSpillable(plan));
+
+  // The final aggregation has a predicted hash table size. A budget below it
+  // makes its fragment spill.
+  plan = planVelox(
+      logicalPlan,
+      {.numWorkers = 4, .numDrivers = 4, .queryMemoryBudget = 1});
+  EXPECT_EQ(1, countSpillable(plan));
+  EXPECT_TRUE(std::ranges::any_of(plan.prediction, [](const auto& pair) {
+    return pair.second.peakMemory > 0;
+  }));
+
+  // A budget above the prediction makes no fragment spill.
+  plan = planVelox(
+      logicalPlan,
+      {.numWorkers = 4, .numDrivers = 4, .queryMemoryBudget = 1LL << 40});
+  EXPECT_EQ(0, countSpillable(plan));
+}
+
+TEST_F(PlanTest, dynamicFilters) {
+  const auto connectorId = exec::test::kHiveConnectorId;
+
+  lp::PlanBuilder::Context context;
+  auto logicalPlan =
+      lp::PlanBuilder(context)
+          .tableScan(connectorId, "nation", {"n_nationkey", "n_regionkey"})
+          .join(
+              lp::PlanBuilder(context)
+                  .tableScan(connectorId, "region", {"r_regionkey", "r_name"})
+                  .filter("r_name = 'ASIA'"),
+              "n_regionkey = r_regionkey",
+              lp::JoinType::kInner)
+          .aggregate({}, {"count(1)"})
+          .build();
+
+  // Dynamic filters are off by default.
+  auto plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  EXPECT_TRUE(plan.plan->dynamicFilters().empty());
+
+  // Each filter is computed by a global aggregation over the build side as it
+  // is sent to the join and tested over a scan of the main plan.
+  optimizerOptions_.dynamicFilterMaxSelectivity = 1;
+  plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  std::string fragmentsText;
+  folly::F14FastSet<std::string> taskPrefixes;
+  for (const auto& fragment : plan.plan->fragments()) {
+    fragmentsText += fragment.fragment.planNode->toString(true, true);
+    taskPrefixes.insert(fragment.taskPrefix);
+  }
+  for (const auto& source : plan.plan->dynamicFilters()) {
+    const auto& top = source.fragment;
+    EXPECT_NE(
+        nullptr,
+        dynamic_cast<const core::AggregationNode*>(
+            top.fragment.planNode.get()));
+    ASSERT_EQ(1, top.inputStages.size());
+    EXPECT_TRUE(taskPrefixes.contains(top.inputStages[0].producerTaskPrefix));
+    for (const auto& key : source.keys) {
+      EXPECT_NE(std::string::npos, fragmentsText.find(key.filter->id()));
+    }
+  }
+
+  auto idGenerator = std::make_shared<core::PlanNodeIdGenerator>();
+  auto referencePlan =
+      exec::test::PlanBuilder(idGenerator)
+          .tableScan(
+              "nation",
+              ROW({"n_nationkey", "n_regionkey"}, {BIGINT(), BIGINT()}))
+          .hashJoin(
+              {"n_regionkey"},
+              {"r_regionkey"},
+              exec::test::PlanBuilder(idGenerator)
+                  .tableScan(
+                      "region",
+                      ROW({"r_regionkey", "r_name"}, {BIGINT(), VARCHAR()}))
+                  .filter("r_name = 'ASIA'")
+                  .planNode(),
+              "",
+              {"n_nationkey"})
+          .singleAggregation({}, {"count(1)"})
+          .planNode();
+
+  checkSame(logicalPlan, referencePlan);
+}
+
+TEST_F(PlanTest, bloomFilter) {
+  // A wide probe side whose keys rarely match a build side too large to
+  // broadcast. Dropping the probe rows without a match before the shuffle
+  // saves more than computing and testing the filter.
+  const std::vector<std::string> probeColumns = {
+      "p_key", "p_a", "p_b", "p_c", "p_d", "p_e"};
+  testConnector_->addTable("probe", ROW(probeColumns, BIGINT()));
+  testConnector_->appendData(
+      "probe",
+      makeRowVector(
+          probeColumns,
+          std::vector<VectorPtr>(
+              probeColumns.size(),
+              makeFlatVector<int64_t>(
+                  1'000'000, [](auto row) { return row; }))));
+  testConnector_->addTable("build", ROW({"b_key"}, {BIGINT()}));
+  testConnector_->appendData(
+      "build",
+      makeRowVector(
+          {"b_key"},
+          {makeFlatVector<int64_t>(
+              150'000, [](auto row) { return row * 1'000; })}));
+
+  lp::PlanBuilder::Context context(kTestConnectorId);
+  auto logicalPlan =
+      lp::PlanBuilder(context)
+          .tableScan("probe")
+          .join(
+              lp::PlanBuilder(context).tableScan("build"),
+              "p_key = b_key",
+              lp::JoinType::kInner)
+          .aggregate(
+              {},
+              {"count(1)",
+               "sum(p_a)",
+               "sum(p_b)",
+               "sum(p_c)",
+               "sum(p_d)",
+               "sum(p_e)"})
+          .build();
+
+  auto hasBloomFilter = [](const PlanAndStats& plan) {
+    return std::ranges::any_of(
+        plan.plan->dynamicFilters(),
+        [](const auto& source) { return source.bloom; });
+  };
+
+  // Bloom filters are off by default.
+  auto plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  EXPECT_FALSE(hasBloomFilter(plan));
+
+  // One in 1000 probe keys has a match.
+  auto saved = history().serialize();
+  ASSERT_EQ(1, saved["joins"].size());
+  auto& join = saved["joins"][0];
+  join["lr"] = 0.001;
+  join["rl"] = 0.001;
+  history().update(saved);
+
+  optimizerOptions_.bloomFilterMaxBuildRows = 1'000'000;
+  plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  ASSERT_TRUE(hasBloomFilter(plan));
+
+  // The filter is computed from the distinct build keys. These are read from
+  // the fragment that sends them to the join, so the build side runs once.
+  folly::F14FastMap<std::string, int32_t> numConsumers;
+  for (const auto& fragment : plan.plan->fragments()) {
+    for (const auto& input : fragment.inputStages) {
+      ++numConsumers[input.producerTaskPrefix];
+    }
+  }
+  for (const auto& source : plan.plan->dynamicFilters()) {
+    if (source.bloom) {
+      const auto* aggregation = dynamic_cast<const core::AggregationNode*>(
+          source.fragment.fragment.planNode.get());
+      ASSERT_NE(nullptr, aggregation);
+      EXPECT_EQ(source.keys.size(), aggregation->groupingKeys().size());
+      ASSERT_EQ(1, source.fragment.inputStages.size());
+      EXPECT_EQ(
+          1, numConsumers[source.fragment.inputStages[0].producerTaskPrefix]);
+    }
+  }
+
+  // The probe scan is filtered by a DynamicFilterNode directly over it.
+  bool filtersScan = false;
+  std::function<void(const core::PlanNodePtr&)> findFilter =
+      [&](const core::PlanNodePtr& node) {
+        if (dynamic_cast<const runner::DynamicFilterNode*>(node.get()) &&
+            dynamic_cast<const core::TableScanNode*>(
+                node->sources()[0].get())) {
+          filtersScan = true;
+        }
+        for (const auto& source : node->sources()) {
+          findFilter(source);
+        }
+      };
+  for (const auto& fragment : plan.plan->fragments()) {
+    findFilter(fragment.fragment.planNode);
+  }
+  EXPECT_TRUE(filtersScan);
+
+  // The probe keys that are multiples of 1000 match.
+  std::vector<VectorPtr> expected(
+      probeColumns.size(), makeFlatVector<int64_t>({499'500'000}));
+  expected[0] = makeFlatVector<int64_t>({1'000});
+  auto referencePlan = exec::test::PlanBuilder()
+                           .values({makeRowVector(std::move(expected))})
+                           .planNode();
+
+  checkSame(plan, referencePlan);
+}
+
+TEST_F(PlanTest, findMisestimates) {
+  PlanAndStats plan;
+  plan.prediction["scan"] = {.cardinality = 1'000};
+  plan.prediction["filter"] = {.cardinality = 10};
+  plan.prediction["empty"] = {.cardinality = 1'000};
+  plan.prediction["build"] = {.cardinality = 1};
+
+  auto makeStats = [](std::vector<std::tuple<std::string, std::string, int>>
+                          operators) {
+    exec::TaskStats stats;
+    stats.pipelineStats.emplace_back(true, true);
+    for (const auto& [nodeId, type, rows] : operators) {
+      exec::OperatorStats op(0, 0, nodeId, type);
+      op.outputPositions = rows;
+      stats.pipelineStats.back().operatorStats.push_back(std::move(op));
+    }
+    return stats;
+  };
+
+  // Nodes within 2x of the prediction, hash builds and nodes without a
+  // prediction are not reported. A node is reported once for all tasks.
+  std::vector<exec::TaskStats> stats{
+      makeStats(
+          {{"scan", "TableScan", 1'500},
+           {"filter", "FilterProject", 100},
+           {"build", "HashBuild", 1'000},
+           {"other", "FilterProject", 1}}),
+      makeStats({{"filter", "FilterProject", 100}, {"empty", "Values", 0}})};
+  EXPECT_THAT(
+      VeloxHistory::findMisestimates(plan, stats, 2),
+      testing::ElementsAre("filter", "empty"));
+  EXPECT_THAT(
+      VeloxHistory::findMisestimates(plan, stats, 1'000),
+      testing::IsEmpty());
+}
+
+TEST_F(PlanTest, checkpoints) {
+  const auto connectorId = exec::test::kHiveConnectorId;
+
+  lp::PlanBuilder::Context context;
+  auto logicalPlan =
+      lp::PlanBuilder(context)
+          .tableScan(connectorId, "nation", {"n_nationkey", "n_regionkey"})
+          .join(
+              lp::PlanBuilder(context)
+                  .tableScan(connectorId, "region", {"r_regionkey", "r_name"})
+                  .filter("r_name = 'ASIA'"),
+              "n_regionkey = r_regionkey",
+              lp::JoinType::kInner)
+          .aggregate({}, {"count(1)"})
+          .build();
+
+  // The filtered scan of region is the only checkpoint.
+  auto nodes = QueryCheckpoints::find(*logicalPlan);
+  ASSERT_EQ(1, nodes.size());
+  const auto& region = nodes[0];
+  EXPECT_EQ(lp::NodeKind::kFilter, region->kind());
+
+  // 'predictedRows' replaces the predictions of the plan of region if set.
+  auto runCheckpoint = [&](QueryCheckpoints& checkpoints,
+                           int64_t maxRows,
+                           float threshold,
+                           std::optional<float> predictedRows = std::nullopt) {
+    auto plan = planVelox(region);
+    if (predictedRows.has_value()) {
+      for (auto& [id, prediction] : plan.prediction) {
+        prediction.cardinality = predictedRows.value();
+      }
+    }
+    return checkpoints.add(
+        region,
+        plan,
+        std::make_shared<runner::LocalRunner>(plan.plan, getQueryCtx()),
+        maxRows,
+        threshold);
+  };
+
+  // A result over the limit is not kept.
+  QueryCheckpoints checkpoints;
+  EXPECT_FALSE(runCheckpoint(checkpoints, 0, 2).has_value());
+  EXPECT_TRUE(checkpoints.results().empty());
+
+  // Region has 5 rows, so no estimate is 1000x off. A result that matches the
+  // estimates is not kept. The stats of the finished checkpoint are
+  // returned.
+  auto stats = runCheckpoint(checkpoints, 100, 1'000);
+  ASSERT_TRUE(stats.has_value());
+  EXPECT_FALSE(stats->empty());
+  EXPECT_TRUE(checkpoints.results().empty());
+
+  ASSERT_TRUE(runCheckpoint(checkpoints, 100, 2, 1'000).has_value());
+  EXPECT_EQ(1, checkpoints.results().at(region->id())->cardinality());
+
+  // The query reads the kept result instead of scanning region.
+  optimizerOptions_.checkpoints = checkpoints.results();
+  auto plan = planVelox(logicalPlan);
+  int32_t numScans = 0;
+  int32_t numValues = 0;
+  for (const auto& fragment : plan.plan->fragments()) {
+    core::PlanNode::findFirstNode(
+        fragment.fragment.planNode.get(), [&](const auto* node) {
+          numScans += dynamic_cast<const core::TableScanNode*>(node) != nullptr;
+          numValues += dynamic_cast<const core::ValuesNode*>(node) != nullptr;
+          return false;
+        });
+  }
+  EXPECT_EQ(1, numScans);
+  EXPECT_EQ(1, numValues);
+
+  auto idGenerator = std::make_shared<core::PlanNodeIdGenerator>();
+  auto referencePlan =
+      exec::test::PlanBuilder(idGenerator)
+          .tableScan(
+              "nation",
+              ROW({"n_nationkey", "n_regionkey"}, {BIGINT(), BIGINT()}))
+          .hashJoin(
+              {"n_regionkey"},
+              {"r_regionkey"},
+              exec::test::PlanBuilder(idGenerator)
+                  .tableScan(
+                      "region",
+                      ROW({"r_regionkey", "r_name"}, {BIGINT(), VARCHAR()}))
+                  .filter("r_name = 'ASIA'")
+                  .planNode(),
+              "",
+              {"n_nationkey"})
+          .singleAggregation({}, {"count(1)"})
+          .planNode();
+
+  checkSame(logicalPlan, referencePlan);
+}
+
+TEST_F(PlanTest, joinElimination) {
+  const auto connectorId = exec::test::kHiveConnectorId;
+
+  // The aggregation is unique on the join key and none of its columns are
+  // used, so the left join to it is removed.
+  lp::PlanBuilder::Context context;
+  auto logicalPlan =
+      lp::PlanBuilder(context)
+          .tableScan(connectorId, "orders", {"o_orderkey", "o_custkey"})
+          .join(
+              lp::PlanBuilder(context)
+                  .tableScan(connectorId, "lineitem", {"l_orderkey", "l_tax"})
+                  .aggregate({"l_orderkey"}, {"sum(l_tax) as tax"}),
+              "o_orderkey = l_orderkey",
+              lp::JoinType::kLeft)
+          .project({"o_orderkey", "o_custkey"})
+          .build();
+
+  auto plan = toSingleNodePlan(logicalPlan);
+  EXPECT_EQ(
+      nullptr,
+      core::PlanNode::findFirstNode(plan.get(), [](const auto* node) {
+        return dynamic_cast<const core::HashJoinNode*>(node) != nullptr ||
+            dynamic_cast<const core::AggregationNode*>(node) != nullptr;
+      }));
+
+  auto referencePlan =
+      exec::test::PlanBuilder()
+          .tableScan(
+              "orders", ROW({"o_orderkey", "o_custkey"}, {BIGINT(), BIGINT()}))
+          .planNode();
+
+  checkSame(logicalPlan, referencePlan);
+}
+
+TEST_F(PlanTest, innerJoinElimination) {
+  testConnector_->addTable("fact", ROW({"f_key", "f_value"}, BIGINT()));
+  testConnector_->appendData(
+      "fact",
+      makeRowVector(
+          {"f_key", "f_value"},
+          {makeFlatVector<int64_t>(1'000, [](auto row) { return row % 100; }),
+           makeFlatVector<int64_t>(1'000, [](auto row) { return row; })}));
+  auto dim = testConnector_->addTable("dim", ROW({"d_key"}, BIGINT()));
+  dim->addLookupLayout("dim_pk", {"d_key"}, /*unique=*/true);
+  testConnector_->appendData(
+      "dim",
+      makeRowVector(
+          {"d_key"},
+          {makeFlatVector<int64_t>(100, [](auto row) { return row; })}));
+
+  auto hasJoin = [](const PlanAndStats& plan) {
+    return std::ranges::any_of(
+        plan.plan->fragments(), [](const auto& fragment) {
+          return core::PlanNode::findFirstNode(
+                     fragment.fragment.planNode.get(),
+                     [](const auto* node) {
+                       return dynamic_cast<const core::HashJoinNode*>(node) !=
+                           nullptr ||
+                           dynamic_cast<const core::IndexLookupJoinNode*>(
+                               node) != nullptr;
+                     }) != nullptr;
+        });
+  };
+
+  // Every fact row has a match, but the catalog does not say so.
+  lp::PlanBuilder::Context context(kTestConnectorId);
+  auto logicalPlan = lp::PlanBuilder(context)
+                         .tableScan("fact")
+                         .join(
+                             lp::PlanBuilder(context).tableScan("dim"),
+                             "f_key = d_key",
+                             lp::JoinType::kInner)
+                         .aggregate({}, {"count(1)", "sum(f_value)"})
+                         .build();
+  EXPECT_TRUE(hasJoin(planVelox(logicalPlan)));
+
+  optimizerOptions_.assumeReferentialIntegrity = true;
+  auto plan = planVelox(logicalPlan);
+  EXPECT_FALSE(hasJoin(plan));
+
+  auto referencePlan =
+      exec::test::PlanBuilder()
+          .values({makeRowVector(
+              {makeFlatVector<int64_t>({1'000}),
+               makeFlatVector<int64_t>({499'500})})})
+          .planNode();
+  checkSame(plan, referencePlan);
+
+  // A condition on both tables drops the fact rows whose value is not greater
+  // than their key, so the join stays.
+  logicalPlan = lp::PlanBuilder(context)
+                    .tableScan("fact")
+                    .join(
+                        lp::PlanBuilder(context).tableScan("dim"),
+                        "f_key = d_key and f_value > d_key",
+                        lp::JoinType::kInner)
+                    .aggregate({}, {"count(1)", "sum(f_value)"})
+                    .build();
+  plan = planVelox(logicalPlan);
+  EXPECT_TRUE(hasJoin(plan));
+
+  referencePlan = exec::test::PlanBuilder()
+                      .values({makeRowVector(
+                          {makeFlatVector<int64_t>({900}),
+                           makeFlatVector<int64_t>({499'500 - 4'950})})})
+                      .planNode();
+  checkSame(plan, referencePlan);
+}
+
+TEST_F(PlanTest, outerJoinSimplification) {
+  const auto connectorId = exec::test::kHiveConnectorId;
+
+  auto countJoins = [](const core::PlanNode* root, core::JoinType joinType) {
+    int32_t count = 0;
+    core::PlanNode::findFirstNode(root, [&](const auto* node) {
+      const auto* join = dynamic_cast<const core::HashJoinNode*>(node);
+      if (join != nullptr && join->joinType() == joinType) {
+        ++count;
+      }
+      return false;
+    });
+    return count;
+  };
+
+  // A BI tool left joins the fact table to its dimensions and filters on a
+  // dimension. The filter rejects the null-extended customer rows and the
+  // join to customer then rejects the null-extended orders rows, so both
+  // left joins are inner joins.
+  auto makeLogicalPlan = [&](const std::string& filter) {
+    lp::PlanBuilder::Context context;
+    return lp::PlanBuilder(context)
+        .tableScan(connectorId, "lineitem", {"l_orderkey", "l_quantity"})
+        .join(
+            lp::PlanBuilder(context).tableScan(
+                connectorId, "orders", {"o_orderkey", "o_custkey"}),
+            "l_orderkey = o_orderkey",
+            lp::JoinType::kLeft)
+        .join(
+            lp::PlanBuilder(context).tableScan(
+                connectorId, "customer", {"c_custkey", "c_mktsegment"}),
+            "o_custkey = c_custkey",
+            lp::JoinType::kLeft)
+        .filter(filter)
+        .project({"l_orderkey", "l_quantity", "c_mktsegment"})
+        .build();
+  };
+
+  auto logicalPlan = makeLogicalPlan("c_mktsegment = 'BUILDING'");
+  auto plan = toSingleNodePlan(logicalPlan);
+  EXPECT_EQ(0, countJoins(plan.get(), core::JoinType::kLeft));
+  EXPECT_EQ(0, countJoins(plan.get(), core::JoinType::kRight));
+  EXPECT_EQ(2, countJoins(plan.get(), core::JoinType::kInner));
+
+  auto idGenerator = std::make_shared<core::PlanNodeIdGenerator>();
+  auto referencePlan =
+      exec::test::PlanBuilder(idGenerator)
+          .tableScan(
+              "lineitem",
+              ROW({"l_orderkey", "l_quantity"}, {BIGINT(), DOUBLE()}))
+          .hashJoin(
+              {"l_orderkey"},
+              {"o_orderkey"},
+              exec::test::PlanBuilder(idGenerator)
+                  .tableScan(
+                      "orders",
+                      ROW({"o_orderkey", "o_custkey"}, {BIGINT(), BIGINT()}))
+                  .planNode(),
+              "",
+              {"l_orderkey", "l_quantity", "o_custkey"})
+          .hashJoin(
+              {"o_custkey"},
+              {"c_custkey"},
+              exec::test::PlanBuilder(idGenerator)
+                  .tableScan(
+                      "customer",
+                      ROW({"c_custkey", "c_mktsegment"}, {BIGINT(), VARCHAR()}))
+                  .filter("c_mktsegment = 'BUILDING'")
+                  .planNode(),
+              "",
+              {"l_orderkey", "l_quantity", "c_mktsegment"})
+          .planNode();
+
+  checkSame(logicalPlan, referencePlan);
+
+  // coalesce() keeps the null-extended rows, so the joins stay outer.
+  logicalPlan = makeLogicalPlan("coalesce(c_mktsegment, 'NONE') <> 'NONE'");
+  plan = toSingleNodePlan(logicalPlan);
+  EXPECT_EQ(
+      2,
+      countJoins(plan.get(), core::JoinType::kLeft) +
+          countJoins(plan.get(), core::JoinType::kRight));
+
+  // The AND is false, not null, for the null-extended rows since its second
+  // argument is always false. The comparison is then true and keeps them.
+  logicalPlan = makeLogicalPlan(
+      "(c_mktsegment = 'BUILDING' and l_quantity < 0) = false");
+  plan = toSingleNodePlan(logicalPlan);
+  EXPECT_EQ(
+      2,
+      countJoins(plan.get(), core::JoinType::kLeft) +
+          countJoins(plan.get(), core::JoinType::kRight));
+}
+
+TEST_F(PlanTest, uniqueGroupBy) {
+  const auto connectorId = exec::test::kHiveConnectorId;
+
+  // The second aggregation groups on the keys of the first. Each of its
+  // groups has one row, so it becomes a projection.
+  lp::PlanBuilder::Context context;
+  auto logicalPlan =
+      lp::PlanBuilder(context)
+          .tableScan(connectorId, "orders", {"o_custkey", "o_totalprice"})
+          .aggregate({"o_custkey"}, {"sum(o_totalprice) as total"})
+          .aggregate({"o_custkey"}, {"max(total) as m", "sum(total) as s"})
+          .build();
+
+  auto plan = toSingleNodePlan(logicalPlan);
+  int32_t numFinalAggregations = 0;
+  core::PlanNode::findFirstNode(plan.get(), [&](const auto* node) {
+    const auto* agg = dynamic_cast<const core::AggregationNode*>(node);
+    if (agg != nullptr &&
+        agg->step() != core::AggregationNode::Step::kPartial) {
+      ++numFinalAggregations;
+    }
+    return false;
+  });
+  EXPECT_EQ(1, numFinalAggregations);
+
+  auto referencePlan =
+      exec::test::PlanBuilder()
+          .tableScan(
+              "orders",
+              ROW({"o_custkey", "o_totalprice"}, {BIGINT(), DOUBLE()}))
+          .singleAggregation({"o_custkey"}, {"sum(o_totalprice)"})
+          .project({"o_custkey", "a0", "a0"})
+          .planNode();
+
+  checkSame(logicalPlan, referencePlan);
+
+  // A global aggregation has one row for no input. The filter removes the
+  // row of the first aggregation and the second still produces a row.
+  logicalPlan = lp::PlanBuilder(context)
+                    .tableScan(connectorId, "orders", {"o_totalprice"})
+                    .aggregate({}, {"count(1) as c"})
+                    .filter("c < 0")
+                    .aggregate({}, {"max(c)"})
+                    .build();
+
+  referencePlan =
+      exec::test::PlanBuilder()
+          .values({makeRowVector(
+              {makeNullableFlatVector<int64_t>({std::nullopt})})})
+          .planNode();
+
+  checkSame(logicalPlan, referencePlan);
+
+  // A join keeps the distribution of its left side but not its uniqueness.
+  // Each order has several line items, so the counts are not 1.
+  logicalPlan =
+      lp::PlanBuilder(context)
+          .tableScan(connectorId, "orders", {"o_orderkey"})
+          .aggregate({"o_orderkey"}, {})
+          .join(
+              lp::PlanBuilder(context).tableScan(
+                  connectorId, "lineitem", {"l_orderkey"}),
+              "o_orderkey = l_orderkey",
+              lp::JoinType::kInner)
+          .aggregate({"o_orderkey"}, {"count(1) as c"})
+          .build();
+
+  auto idGenerator = std::make_shared<core::PlanNodeIdGenerator>();
+  referencePlan =
+      exec::test::PlanBuilder(idGenerator)
+          .tableScan("orders", ROW({"o_orderkey"}, {BIGINT()}))
+          .hashJoin(
+              {"o_orderkey"},
+              {"l_orderkey"},
+              exec::test::PlanBuilder(idGenerator)
+                  .tableScan("lineitem", ROW({"l_orderkey"}, {BIGINT()}))
+                  .planNode(),
+              "",
+              {"o_orderkey"})
+          .singleAggregation({"o_orderkey"}, {"count(1)"})
+          .planNode();
+
+  checkSame(logicalPlan, referencePlan);
+}
+
+TEST_F(PlanTest, eagerAggregation) {
+  const auto connectorId = exec::test::kHiveConnectorId;
+
+  // The aggregates are over orders only, so orders can be aggregated on the
+  // join key before the join with customer.
+  lp::PlanBuilder::Context context;
+  auto logicalPlan =
+      lp::PlanBuilder(context)
+          .tableScan(connectorId, "orders", {"o_custkey", "o_totalprice"})
+          .join(
+              lp::PlanBuilder(context).tableScan(
+                  connectorId, "customer", {"c_custkey", "c_mktsegment"}),
+              "o_custkey = c_custkey",
+              lp::JoinType::kInner)
+          .aggregate(
+              {"c_mktsegment"},
+              {"sum(o_totalprice) as total", "count(1) as cnt"})
+          .build();
+
+  auto partialKeys = [](const PlanAndStats& plan) {
+    std::string keys;
+    for (const auto& fragment : plan.plan->fragments()) {
+      core::PlanNode::findFirstNode(
+          fragment.fragment.planNode.get(), [&](const auto* node) {
+            const auto* agg = dynamic_cast<const core::AggregationNode*>(node);
+            if (agg != nullptr &&
+                agg->step() == core::AggregationNode::Step::kPartial) {
+              for (const auto& key : agg->groupingKeys()) {
+                keys += key->name() + " ";
+              }
+            }
+            return false;
+          });
+    }
+    return keys;
+  };
+
+  // Eager aggregation is off by default.
+  auto plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  EXPECT_EQ(std::string::npos, partialKeys(plan).find("o_custkey"));
+
+  optimizerOptions_.eagerAggregationMaxFanout = 0.5;
+  plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  EXPECT_NE(std::string::npos, partialKeys(plan).find("o_custkey"));
+
+  auto idGenerator = std::make_shared<core::PlanNodeIdGenerator>();
+  auto referencePlan =
+      exec::test::PlanBuilder(idGenerator)
+          .tableScan(
+              "orders",
+              ROW({"o_custkey", "o_totalprice"}, {BIGINT(), DOUBLE()}))
+          .hashJoin(
+              {"o_custkey"},
+              {"c_custkey"},
+              exec::test::PlanBuilder(idGenerator)
+                  .tableScan(
+                      "customer",
+                      ROW({"c_custkey", "c_mktsegment"}, {BIGINT(), VARCHAR()}))
+                  .planNode(),
+              "",
+              {"o_totalprice", "c_mktsegment"})
+          .singleAggregation(
+              {"c_mktsegment"},
+              {"sum(o_totalprice) as total", "count(1) as cnt"})
+          .planNode();
+
+  checkSame(logicalPlan, referencePlan);
+}
+
+TEST_F(PlanTest, mergeJoin) {
+  const auto connectorId = exec::test::kHiveConnectorId;
+
+  // Both sides are ordered on the join key, so no hash table is needed.
+  lp::PlanBuilder::Context context;
+  auto logicalPlan =
+      lp::PlanBuilder(context)
+          .tableScan(connectorId, "nation", {"n_regionkey", "n_name"})
+          .orderBy({"n_regionkey"})
+          .limit(100)
+          .join(
+              lp::PlanBuilder(context)
+                  .tableScan(connectorId, "region", {"r_regionkey", "r_name"})
+                  .orderBy({"r_regionkey"})
+                  .limit(100),
+              "n_regionkey = r_regionkey",
+              lp::JoinType::kInner)
+          .build();
+
+  auto plan = toSingleNodePlan(logicalPlan);
+  EXPECT_NE(
+      nullptr,
+      core::PlanNode::findFirstNode(plan.get(), [](const auto* node) {
+        return dynamic_cast<const core::MergeJoinNode*>(node) != nullptr;
+      }));
+
+  auto idGenerator = std::make_shared<core::PlanNodeIdGenerator>();
+  auto referencePlan =
+      exec::test::PlanBuilder(idGenerator)
+          .tableScan(
+              "nation", ROW({"n_regionkey", "n_name"}, {BIGINT(), VARCHAR()}))
+          .hashJoin(
+              {"n_regionkey"},
+              {"r_regionkey"},
+              exec::test::PlanBuilder(idGenerator)
+                  .tableScan(
+                      "region",
+                      ROW({"r_regionkey", "r_name"}, {BIGINT(), VARCHAR()}))
+                  .planNode(),
+              "",
+              {"n_regionkey", "n_name", "r_regionkey", "r_name"})
+          .planNode();
+
+  checkSame(logicalPlan, referencePlan);
+}
+
+TEST_F(PlanTest, isGroupedOn) {
+  auto allocator = std::make_unique<HashStringAllocator>(pool_.get());
+  auto context = std::make_unique<QueryGraphContext>(*allocator);
+  queryCtx() = context.get();
+
+  SCOPE_EXIT {
+    queryCtx() = nullptr;
+  };
+
+  Value value(toType(BIGINT()), 1'000);
+  ExprCP a = make<Column>(toName("a"), nullptr, value);
+  ExprCP b = make<Column>(toName("b"), nullptr, value);
+  auto orderedOn = [](ExprVector keys) {
+    OrderTypeVector types(keys.size(), OrderType::kAscNullsFirst);
+    return Distribution(
+        DistributionType::gather(), {}, std::move(keys), std::move(types));
+  };
+
+  EXPECT_TRUE(orderedOn({a, b}).isGroupedOn({b, a}));
+  EXPECT_TRUE(orderedOn({a, b}).isGroupedOn({a}));
+  EXPECT_FALSE(orderedOn({a, b}).isGroupedOn({b}));
+  EXPECT_FALSE(orderedOn({a}).isGroupedOn({a, b}));
+  EXPECT_FALSE(orderedOn({a, b}).isGroupedOn({}));
+
+  // A repeated order key does not group on a key that is not ordered.
+  EXPECT_FALSE(orderedOn({a, a}).isGroupedOn({a, b}));
+  EXPECT_TRUE(orderedOn({a, a, b}).isGroupedOn({b, a}));
+}
+
+TEST_F(PlanTest, streamingAggregation) {
+  const auto connectorId = exec::test::kHiveConnectorId;
+
+  // The input is ordered on the grouping key, so groups are adjacent.
+  lp::PlanBuilder::Context context;
+  auto logicalPlan =
+      lp::PlanBuilder(context)
+          .tableScan(connectorId, "nation", {"n_regionkey", "n_nationkey"})
+          .orderBy({"n_regionkey"})
+          .limit(100)
+          .aggregate(
+              {"n_regionkey"}, {"count(1) as cnt", "sum(n_nationkey) as s"})
+          .build();
+
+  auto plan = toSingleNodePlan(logicalPlan);
+  const auto* aggregation = core::PlanNode::findFirstNode(
+      plan.get(), [](const auto* node) {
+        return dynamic_cast<const core::AggregationNode*>(node) != nullptr;
+      });
+  ASSERT_NE(nullptr, aggregation);
+  const auto* streaming =
+      dynamic_cast<const core::AggregationNode*>(aggregation);
+  EXPECT_EQ(core::AggregationNode::Step::kSingle, streaming->step());
+  EXPECT_EQ(1, streaming->preGroupedKeys().size());
+
+  auto referencePlan =
+      exec::test::PlanBuilder()
+          .tableScan(
+              "nation",
+              ROW({"n_regionkey", "n_nationkey"}, {BIGINT(), BIGINT()}))
+          .singleAggregation(
+              {"n_regionkey"}, {"count(1) as cnt", "sum(n_nationkey) as s"})
+          .planNode();
+
+  checkSame(logicalPlan, referencePlan);
+}
+
+TEST_F(PlanTest, rangeOrderBy) {
+  const auto connectorId = exec::test::kHiveConnectorId;
+
+  lp::PlanBuilder::Context context;
+  auto logicalPlan =
+      lp::PlanBuilder(context)
+          .tableScan(connectorId, "orders", {"o_orderkey", "o_custkey"})
+          .orderBy({"o_custkey", "o_orderkey"})
+          .build();
+
+  auto isRangeSort = [](const PlanAndStats& plan) {
+    for (const auto& fragment : plan.plan->fragments()) {
+      for (const auto& input : fragment.inputStages) {
+        if (input.ordered) {
+          return true;
+        }
+      }
+    }
+    return false;
+  };
+
+  // Range-partitioned sorts are off by default.
+  auto plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  EXPECT_FALSE(isRangeSort(plan));
+
+  optimizerOptions_.rangeSortMinBytes = 1;
+  plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  ASSERT_TRUE(isRangeSort(plan));
+
+  // The range partition function serializes with its splitters.
+  registerRangePartitionFunctionSerDe();
+  int32_t numRangePartitions = 0;
+  for (const auto& fragment : plan.plan->fragments()) {
+    const auto* output = dynamic_cast<const core::PartitionedOutputNode*>(
+        fragment.fragment.planNode.get());
+    if (output == nullptr ||
+        output->partitionFunctionSpec().toString().find("range") != 0) {
+      continue;
+    }
+    ++numRangePartitions;
+    const auto serialized = output->partitionFunctionSpec().serialize();
+    auto copy = ISerializable::deserialize<core::PartitionFunctionSpec>(
+        serialized, pool_.get());
+    EXPECT_EQ(serialized, copy->serialize());
+  }
+  EXPECT_EQ(1, numRangePartitions);
+
+  auto result = runFragmentedPlan(plan);
+  int64_t numRows = 0;
+  std::optional<std::pair<int64_t, int64_t>> previous;
+  for (const auto& batch : result.results) {
+    auto custKeys = batch->childAt(1)->as<SimpleVector<int64_t>>();
+    auto orderKeys = batch->childAt(0)->as<SimpleVector<int64_t>>();
+    for (auto i = 0; i < batch->size(); ++i) {
+      std::pair<int64_t, int64_t> row{
+          custKeys->valueAt(i), orderKeys->valueAt(i)};
+      if (previous.has_value()) {
+        ASSERT_LE(previous.value(), row);
+      }
+      previous = row;
+    }
+    numRows += batch->size();
+  }
+
+  auto referencePlan =
+      exec::test::PlanBuilder()
+          .tableScan(
+              "orders", ROW({"o_orderkey", "o_custkey"}, {BIGINT(), BIGINT()}))
+          .planNode();
+  auto reference = runVelox(referencePlan);
+  int64_t numReferenceRows = 0;
+  for (const auto& batch : reference.results) {
+    numReferenceRows += batch->size();
+  }
+  EXPECT_EQ(numReferenceRows, numRows);
+}
+
+TEST_F(PlanTest, sharedSubplan) {
+  const auto connectorId = exec::test::kHiveConnectorId;
+
+  // Returns the largest number of consumers of a fragment.
+  auto maxConsumers = [](const PlanAndStats& plan) {
+    folly::F14FastMap<std::string, int32_t> consumers;
+    int32_t result = 0;
+    for (const auto& fragment : plan.plan->fragments()) {
+      for (const auto& input : fragment.inputStages) {
+        result = std::max(result, ++consumers[input.producerTaskPrefix]);
+      }
+    }
+    return result;
+  };
+
+  // True if a fragment reads the output of another fragment more than once.
+  auto readsTwice = [](const PlanAndStats& plan) {
+    return std::ranges::any_of(
+        plan.plan->fragments(), [](const auto& fragment) {
+          folly::F14FastSet<std::string> producers;
+          return std::ranges::any_of(
+              fragment.inputStages, [&](const auto& input) {
+                return !producers.insert(input.producerTaskPrefix).second;
+              });
+        });
+  };
+
+  // Both sides of the join aggregate 'lineitem' the same way.
+  auto makeLogicalPlan = [&](const std::string& buildKey) {
+    lp::PlanBuilder::Context context;
+    return lp::PlanBuilder(context)
+        .tableScan(connectorId, "lineitem", {"l_orderkey", "l_quantity"})
+        .aggregate({"l_orderkey"}, {"sum(l_quantity) as q1"})
+        .join(
+            lp::PlanBuilder(context)
+                .tableScan(
+                    connectorId, "lineitem", {"l_orderkey", "l_quantity"})
+                .aggregate({"l_orderkey"}, {"sum(l_quantity) as q2"})
+                .project({buildKey + " as k2", "q2"}),
+            "l_orderkey = k2",
+            lp::JoinType::kInner)
+        .project({"l_orderkey", "q1", "q2"})
+        .build();
+  };
+
+  auto makeReferencePlan = [&](const std::string& buildKey) {
+    auto idGenerator = std::make_shared<core::PlanNodeIdGenerator>();
+    auto aggregate = [&](const std::string& name) {
+      return exec::test::PlanBuilder(idGenerator)
+          .tableScan(
+              "lineitem",
+              ROW({"l_orderkey", "l_quantity"}, {BIGINT(), DOUBLE()}))
+          .singleAggregation({"l_orderkey"}, {"sum(l_quantity) as " + name});
+    };
+    return aggregate("q1")
+        .hashJoin(
+            {"l_orderkey"},
+            {"k2"},
+            aggregate("q2").project({buildKey + " as k2", "q2"}).planNode(),
+            "",
+            {"l_orderkey", "q1", "q2"})
+        .planNode();
+  };
+
+  auto logicalPlan = makeLogicalPlan("l_orderkey");
+  auto plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  EXPECT_EQ(1, maxConsumers(plan));
+
+  // If the join reads both aggregations in one fragment, that fragment does
+  // not read the shared fragment twice. The aggregation is then computed
+  // twice.
+  optimizerOptions_.shareSubplanMaxBytes = 1e12;
+  plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  EXPECT_FALSE(readsTwice(plan));
+
+  auto referencePlan = makeReferencePlan("l_orderkey");
+  checkSame(plan, referencePlan);
+
+  // The build side is repartitioned on a key computed after the aggregation.
+  // The aggregations are then in different fragments that read one shared
+  // fragment.
+  logicalPlan = makeLogicalPlan("l_orderkey + 1");
+  plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  EXPECT_EQ(2, maxConsumers(plan));
+
+  referencePlan = makeReferencePlan("l_orderkey + 1");
+  checkSame(plan, referencePlan);
+  checkSame(logicalPlan, referencePlan);
+}
+
+TEST_F(PlanTest, sharedScan) {
+  const auto connectorId = exec::test::kHiveConnectorId;
+
+  // Returns the number of scans in all fragments.
+  auto countScans = [](const PlanAndStats& plan) {
+    int32_t count = 0;
+    for (const auto& fragment : plan.plan->fragments()) {
+      core::PlanNode::findFirstNode(
+          fragment.fragment.planNode.get(), [&](const auto* node) {
+            count += dynamic_cast<const core::TableScanNode*>(node) != nullptr;
+            return false;
+          });
+    }
+    return count;
+  };
+
+  // Both sides of the join read a few rows of 'lineitem'.
+  lp::PlanBuilder::Context context;
+  auto logicalPlan =
+      lp::PlanBuilder(context)
+          .tableScan(connectorId, "lineitem", {"l_orderkey", "l_quantity"})
+          .filter("l_quantity < 2.0")
+          .join(
+              lp::PlanBuilder(context)
+                  .tableScan(
+                      connectorId, "lineitem", {"l_orderkey", "l_quantity"})
+                  .filter("l_quantity > 49.0")
+                  .project({"l_orderkey as k2", "l_quantity as q2"}),
+              "l_orderkey = k2",
+              lp::JoinType::kInner)
+          .project({"l_orderkey", "l_quantity", "q2"})
+          .build();
+
+  auto plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  EXPECT_EQ(2, countScans(plan));
+
+  // The shared scan reads about 2'400 rows of 16 bytes.
+  optimizerOptions_.shareScanMaxBytes = 1'000;
+  plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  EXPECT_EQ(2, countScans(plan));
+
+  optimizerOptions_.shareScanMaxBytes = 1'000'000;
+  plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  EXPECT_EQ(1, countScans(plan));
+
+  auto idGenerator = std::make_shared<core::PlanNodeIdGenerator>();
+  auto referencePlan =
+      exec::test::PlanBuilder(idGenerator)
+          .tableScan(
+              "lineitem",
+              ROW({"l_orderkey", "l_quantity"}, {BIGINT(), DOUBLE()}))
+          .filter("l_quantity < 2.0")
+          .hashJoin(
+              {"l_orderkey"},
+              {"k2"},
+              exec::test::PlanBuilder(idGenerator)
+                  .tableScan(
+                      "lineitem",
+                      ROW({"l_orderkey", "l_quantity"}, {BIGINT(), DOUBLE()}))
+                  .filter("l_quantity > 49.0")
+                  .project({"l_orderkey as k2", "l_quantity as q2"})
+                  .planNode(),
+              "",
+              {"l_orderkey", "l_quantity", "q2"})
+          .planNode();
+
+  checkSame(plan, referencePlan);
+  checkSame(logicalPlan, referencePlan);
+}
+
+TEST_F(PlanTest, lateMaterialization) {
+  // A wide table with a unique key, of which few rows match a table too large
+  // to broadcast.
+  const std::vector<std::string> factColumns = {
+      "f_key", "f_dim", "f_a", "f_b", "f_c", "f_d", "f_e", "f_f"};
+  auto fact = testConnector_->addTable("fact", ROW(factColumns, BIGINT()));
+  fact->addLookupLayout("fact_pk", {"f_key"}, /*unique=*/true);
+  std::vector<VectorPtr> factData;
+  for (auto i = 1; i <= factColumns.size(); ++i) {
+    factData.push_back(
+        makeFlatVector<int64_t>(100'000, [i](auto row) { return row * i; }));
+  }
+  testConnector_->appendData(
+      "fact", makeRowVector(factColumns, std::move(factData)));
+  testConnector_->addTable("dim", ROW({"d_key", "d_value"}, BIGINT()));
+  testConnector_->appendData(
+      "dim",
+      makeRowVector(
+          {"d_key", "d_value"},
+          {makeFlatVector<int64_t>(
+               150'000, [](auto row) { return row * 2'000; }),
+           makeFlatVector<int64_t>(150'000, [](auto row) { return row; })}));
+
+  lp::PlanBuilder::Context context(kTestConnectorId);
+  auto logicalPlan =
+      lp::PlanBuilder(context)
+          .tableScan("fact")
+          .join(
+              lp::PlanBuilder(context).tableScan("dim"),
+              "f_dim = d_key",
+              lp::JoinType::kInner)
+          .project(
+              {"f_key", "f_a", "f_b", "f_c", "f_d", "f_e", "f_f", "d_value"})
+          .build();
+
+  // Returns the lookup of 'fact' after the join, if any.
+  auto findLookup = [](const PlanAndStats& plan) {
+    for (const auto& fragment : plan.plan->fragments()) {
+      const auto* node = core::PlanNode::findFirstNode(
+          fragment.fragment.planNode.get(), [](const auto* node) {
+            return dynamic_cast<const core::IndexLookupJoinNode*>(node) !=
+                nullptr;
+          });
+      if (node != nullptr) {
+        return dynamic_cast<const core::IndexLookupJoinNode*>(node);
+      }
+    }
+    return static_cast<const core::IndexLookupJoinNode*>(nullptr);
+  };
+
+  auto plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  EXPECT_EQ(nullptr, findLookup(plan));
+
+  // One in 1000 fact rows has a match.
+  auto saved = history().serialize();
+  ASSERT_EQ(1, saved["joins"].size());
+  auto& join = saved["joins"][0];
+  join["lr"] = 0.001;
+  join["rl"] = 0.001;
+  history().update(saved);
+
+  // The join carries the key of 'fact' in place of its other columns, which
+  // are looked up after the join.
+  optimizerOptions_.lateMaterializationMinBytes = 32;
+  plan = planVelox(logicalPlan, {.numWorkers = 4, .numDrivers = 4});
+  const auto* lookup = findLookup(plan);
+  ASSERT_NE(nullptr, lookup);
+  auto handle = std::dynamic_pointer_cast<const connector::TestTableHandle>(
+      lookup->lookupSource()->tableHandle());
+  ASSERT_NE(nullptr, handle);
+  EXPECT_EQ("fact_pk", handle->layout().name());
+  EXPECT_TRUE(lookup->lookupSource()->outputType()->containsChild("f_a"));
+
+  // The fact rows whose f_dim = 2 * row is a multiple of 2000 match.
+  std::vector<VectorPtr> expected;
+  for (int64_t i : {1, 3, 4, 5, 6, 7, 8}) {
+    expected.push_back(makeFlatVector<int64_t>(
+        100, [i](auto row) { return row * 1'000 * i; }));
+  }
+  expected.push_back(
+      makeFlatVector<int64_t>(100, [](auto row) { return row; }));
+  auto referencePlan = exec::test::PlanBuilder()
+                           .values({makeRowVector(std::move(expected))})
+                           .planNode();
+
+  checkSame(plan, referencePlan);
+}
+
+TEST_F(PlanTest, aggregateFromMetadata) {
+  const auto connectorId = exec::test::kHiveConnectorId;
+
+  auto hasScan = [](const PlanAndStats& plan) {
+    for (const auto& fragment : plan.plan->fragments()) {
+      if (core::PlanNode::findFirstNode(
+              fragment.fragment.planNode.get(), [](const auto* node) {
+                return dynamic_cast<const core::TableScanNode*>(node) !=
+                    nullptr;
+              })) {
+        return true;
+      }
+    }
+    return false;
+  };
+
+  lp::PlanBuilder::Context context;
+  auto logicalPlan =
+      lp::PlanBuilder(context)
+          .tableScan(
+              connectorId,
+              "lineitem",
+              {"l_orderkey", "l_quantity", "l_comment"})
+          .aggregate(
+              {},
+              {"count(1)",
+               "min(l_orderkey)",
+               "max(l_quantity)",
+               "count(l_comment)"})
+          .build();
+
+  auto plan = planVelox(logicalPlan);
+  EXPECT_TRUE(hasScan(plan));
+
+  optimizerOptions_.aggregateFromMetadata = true;
+  plan = planVelox(logicalPlan);
+  EXPECT_FALSE(hasScan(plan));
+
+  auto referencePlan =
+      exec::test::PlanBuilder()
+          .tableScan(
+              "lineitem",
+              ROW({"l_orderkey", "l_quantity", "l_comment"},
+                  {BIGINT(), DOUBLE(), VARCHAR()}))
+          .singleAggregation(
+              {},
+              {"count(1)",
+               "min(l_orderkey)",
+               "max(l_quantity)",
+               "count(l_comment)"})
+          .planNode();
+
+  checkSame(plan, referencePlan);
+
+  // A string bound may be truncated in the footer and is not used.
+  logicalPlan = lp::PlanBuilder(context)
+                    .tableScan(connectorId, "lineitem", {"l_comment"})
+                    .aggregate({}, {"max(l_comment)"})
+                    .build();
+  EXPECT_TRUE(hasScan(planVelox(logicalPlan)));
+}
+
+TEST_F(PlanTest, topNPushdown) {
+  const auto connectorId = exec::test::kHiveConnectorId;
+
+  // Returns true if 'root' has a partial TopN or limit below it.
+  auto hasPartial = [](const core::PlanNode* root) {
+    return core::PlanNode::findFirstNode(root, [](const auto* node) {
+             if (const auto* topN = dynamic_cast<const core::TopNNode*>(node)) {
+               return topN->isPartial();
+             }
+             if (const auto* limit =
+                     dynamic_cast<const core::LimitNode*>(node)) {
+               return limit->isPartial();
+             }
+             return false;
+           }) != nullptr;
+  };
+
+  // The TopN goes below the left join on the preserved side.
+  lp::PlanBuilder::Context context;
+  auto logicalPlan =
+      lp::PlanBuilder(context)
+          .tableScan(connectorId, "orders", {"o_orderkey", "o_custkey"})
+          .join(
+              lp::PlanBuilder(context).tableScan(
+                  connectorId, "customer", {"c_custkey", "c_name"}),
+              "o_custkey = c_custkey",
+              lp::JoinType::kLeft)
+          .orderBy({"o_orderkey"})
+          .limit(10)
+          .build();
+
+  auto plan = toSingleNodePlan(logicalPlan);
+  const auto* join =
+      core::PlanNode::findFirstNode(plan.get(), [](const auto* node) {
+        return dynamic_cast<const core::HashJoinNode*>(node) != nullptr;
+      });
+  ASSERT_NE(nullptr, join);
+  EXPECT_TRUE(hasPartial(join->sources()[0].get()));
+
+  auto idGenerator = std::make_shared<core::PlanNodeIdGenerator>();
+  auto referencePlan =
+      exec::test::PlanBuilder(idGenerator)
+          .tableScan(
+              "orders", ROW({"o_orderkey", "o_custkey"}, {BIGINT(), BIGINT()}))
+          .hashJoin(
+              {"o_custkey"},
+              {"c_custkey"},
+              exec::test::PlanBuilder(idGenerator)
+                  .tableScan(
+                      "customer",
+                      ROW({"c_custkey", "c_name"}, {BIGINT(), VARCHAR()}))
+                  .planNode(),
+              "",
+              {"o_orderkey", "o_custkey", "c_custkey", "c_name"},
+              core::JoinType::kLeft)
+          .topN({"o_orderkey"}, 10, false)
+          .planNode();
+
+  checkSame(logicalPlan, referencePlan);
+
+  // The limit goes into every input of the union all.
+  lp::PlanBuilder::Context unionContext;
+  auto scan = [&]() {
+    return lp::PlanBuilder(unionContext)
+        .tableScan(connectorId, "orders", {"o_orderkey"});
+  };
+  logicalPlan = scan().unionAll(scan()).limit(10).build();
+
+  plan = toSingleNodePlan(logicalPlan);
+  const auto* localPartition =
+      core::PlanNode::findFirstNode(plan.get(), [](const auto* node) {
+        return dynamic_cast<const core::LocalPartitionNode*>(node) != nullptr;
+      });
+  ASSERT_NE(nullptr, localPartition);
+  for (const auto& source : localPartition->sources()) {
+    EXPECT_TRUE(hasPartial(source.get()));
+  }
+}
+
 TEST_F(PlanTest, limitAfterOrderBy) {
   testConnector_->addTable("t", ROW({"a", "b"}, INTEGER()));
 
@@ -530,6 +530,11 @@ class RelationPlanner : public sql::AstVisitor {
             toExpr(between->max()));
       }
 
+      case sql::NodeType::kExistsPredicate: {
+        auto* exists = node->as<sql::ExistsPredicate>();
+        return lp::Exists(toExpr(exists->subquery()));
+      }
+
       case sql::NodeType::kInPredicate: {
         auto* inPredicate = node->as<sql::InPredicate>();
         const auto& valueList = inPredicate->valueList();
@@ -101,6 +101,11 @@ class QueryTestBase : public runner::test::LocalRunnerTestBase {
     return *gSuiteHistory;
   }
 
+  /// Returns the history used for planning in this test.
+  VeloxHistory& history() {
+    return *history_;
+  }
+
   OptimizerOptions optimizerOptions_;
 
  private:
@@ -20,6 +20,7 @@
 #include "axiom/logical_plan/PlanBuilder.h"
 #include "axiom/optimizer/tests/HiveQueriesTestBase.h"
 #include "velox/dwio/common/tests/utils/DataFiles.h"
+#include "velox/exec/tests/utils/PlanBuilder.h"
 #include "velox/exec/tests/utils/TpchQueryBuilder.h"
 
 DEFINE_int32(num_repeats, 1, "Number of repeats for optimization timing");
@@ -163,8 +164,101 @@ TEST_F(TpchPlanTest, q01) {
 }
 
 TEST_F(TpchPlanTest, q02) {
-  // TODO Add support for subqueries.
-  parseTpchSql(2);
+  auto planNodeIdGenerator = std::make_shared<core::PlanNodeIdGenerator>();
+  auto scan = [&](const std::string& tableName) {
+    return exec::test::PlanBuilder(planNodeIdGenerator)
+        .tableScan(tableName, getSchema(tableName));
+  };
+
+  auto europeanSuppliers = [&]() {
+    return scan("supplier")
+        .hashJoin(
+            {"s_nationkey"},
+            {"n_nationkey"},
+            scan("nation")
+                .hashJoin(
+                    {"n_regionkey"},
+                    {"r_regionkey"},
+                    scan("region").filter("r_name = 'EUROPE'").planNode(),
+                    "",
+                    {"n_nationkey", "n_name"})
+                .planNode(),
+            "",
+            {"s_suppkey",
+             "s_name",
+             "s_address",
+             "s_phone",
+             "s_acctbal",
+             "s_comment",
+             "n_name"})
+        .planNode();
+  };
+
+  // The correlated subquery is the minimum cost per part, joined on the part
+  // and the cost.
+  auto minCost =
+      scan("partsupp")
+          .hashJoin(
+              {"ps_suppkey"},
+              {"s_suppkey"},
+              europeanSuppliers(),
+              "",
+              {"ps_partkey", "ps_supplycost"})
+          .singleAggregation({"ps_partkey"}, {"min(ps_supplycost)"})
+          .project({"ps_partkey as m_partkey", "a0 as m_supplycost"})
+          .planNode();
+
+  auto referencePlan =
+      scan("part")
+          .filter("p_size = 15 and p_type like '%BRASS'")
+          .hashJoin(
+              {"p_partkey"},
+              {"ps_partkey"},
+              scan("partsupp").planNode(),
+              "",
+              {"p_partkey", "p_mfgr", "ps_suppkey", "ps_supplycost"})
+          .hashJoin(
+              {"ps_suppkey"},
+              {"s_suppkey"},
+              europeanSuppliers(),
+              "",
+              {"p_partkey",
+               "p_mfgr",
+               "ps_supplycost",
+               "s_name",
+               "s_address",
+               "s_phone",
+               "s_acctbal",
+               "s_comment",
+               "n_name"})
+          .hashJoin(
+              {"p_partkey", "ps_supplycost"},
+              {"m_partkey", "m_supplycost"},
+              minCost,
+              "",
+              {"s_acctbal",
+               "s_name",
+               "n_name",
+               "p_partkey",
+               "p_mfgr",
+               "s_address",
+               "s_phone",
+               "s_comment"})
+          .orderBy({"s_acctbal desc", "n_name", "s_name", "p_partkey"}, false)
+          .limit(0, 100, false)
+          .planNode();
+
+  checkResults(parseTpchSql(2), referencePlan);
+
+  // The subquery is null for a part without suppliers and coalesce() keeps
+  // the part, which an inner join to the subquery would drop.
+  auto statement = prestoParser().parse(
+      "select p_partkey from part where p_retailprice > coalesce(("
+      "select min(ps_supplycost) from partsupp where ps_partkey = p_partkey"
+      "), 0)");
+  EXPECT_THROW(
+      planVelox(statement->asUnchecked<test::SelectStatement>()->plan()),
+      VeloxException);
 }
 
 TEST_F(TpchPlanTest, q03) {
@@ -191,9 +285,42 @@ TEST_F(TpchPlanTest, q03) {
   checkTpchSql(3);
 }
 
-TEST_F(TpchPlanTest, DISABLED_q04) {
-  // Incorrect with distributed plan at larger scales.
-  // TODO Implement.
+TEST_F(TpchPlanTest, q04) {
+  auto planNodeIdGenerator = std::make_shared<core::PlanNodeIdGenerator>();
+  auto scan = [&](const std::string& tableName) {
+    return exec::test::PlanBuilder(planNodeIdGenerator)
+        .tableScan(tableName, getSchema(tableName));
+  };
+
+  // EXISTS is a semi join on the correlated equality.
+  auto referencePlan =
+      scan("orders")
+          .filter(
+              "o_orderdate >= '1993-07-01'::date "
+              "and o_orderdate < '1993-10-01'::date")
+          .hashJoin(
+              {"o_orderkey"},
+              {"l_orderkey"},
+              scan("lineitem")
+                  .filter("l_commitdate < l_receiptdate")
+                  .planNode(),
+              "",
+              {"o_orderpriority"},
+              core::JoinType::kLeftSemiFilter)
+          .singleAggregation({"o_orderpriority"}, {"count(*) as order_count"})
+          .orderBy({"o_orderpriority"}, false)
+          .planNode();
+
+  checkResults(parseTpchSql(4), referencePlan);
+
+  // A global aggregation has a row for every order, so EXISTS is true also
+  // for orders without line items, which a semi join would drop.
+  auto statement = prestoParser().parse(
+      "select o_orderkey from orders where exists ("
+      "select max(l_quantity) from lineitem where l_orderkey = o_orderkey)");
+  EXPECT_THROW(
+      planVelox(statement->asUnchecked<test::SelectStatement>()->plan()),
+      VeloxException);
 }
 
 TEST_F(TpchPlanTest, q05) {
@@ -395,6 +522,40 @@ TEST_F(TpchPlanTest, q10) {
   checkTpchSql(10);
 }
 
+TEST_F(TpchPlanTest, eagerAggregation) {
+  // Returns the grouping keys of the partial aggregations of 'plan'.
+  auto partialKeys = [](const PlanAndStats& plan) {
+    std::vector<std::string> keys;
+    for (const auto& fragment : plan.plan->fragments()) {
+      core::PlanNode::findFirstNode(
+          fragment.fragment.planNode.get(), [&](const auto* node) {
+            const auto* agg = dynamic_cast<const core::AggregationNode*>(node);
+            if (agg != nullptr &&
+                agg->step() == core::AggregationNode::Step::kPartial) {
+              for (const auto& key : agg->groupingKeys()) {
+                keys.push_back(key->name());
+              }
+            }
+            return false;
+          });
+    }
+    return keys;
+  };
+
+  // q3 and q10 sum columns of lineitem grouped on columns of other tables.
+  // Eager aggregation groups lineitem on l_orderkey before the join with
+  // orders.
+  optimizerOptions_.eagerAggregationMaxFanout = 1;
+  for (auto query : {3, 10}) {
+    SCOPED_TRACE(fmt::format("q{}", query));
+    auto plan = planVelox(parseTpchSql(query));
+    const auto keys = partialKeys(plan);
+    EXPECT_NE(keys.end(), std::ranges::find(keys, "l_orderkey"));
+
+    checkTpchSql(query);
+  }
+}
+
 TEST_F(TpchPlanTest, q11) {
   lp::PlanBuilder::Context context{exec::test::kHiveConnectorId};
   auto logicalPlan =
@@ -420,32 +581,9 @@ TEST_F(TpchPlanTest, q11) {
           .orderBy({"value desc"})
           .build();
 
-  // TODO Make above plan with a non-correlated subquery work.
-  logicalPlan =
-      lp::PlanBuilder(context)
-          .from({"partsupp", "supplier", "nation"})
-          .filter(
-              "ps_suppkey = s_suppkey and s_nationkey = n_nationkey and n_name = 'GERMANY'")
-          .aggregate(
-              {"ps_partkey"},
-              {"sum(ps_supplycost * ps_availqty::double) as value"})
-          .crossJoin(
-              lp::PlanBuilder(context)
-                  .from({"partsupp", "supplier", "nation"})
-                  .filter(
-                      "ps_suppkey = s_suppkey and s_nationkey = n_nationkey and n_name = 'GERMANY'")
-                  .aggregate(
-                      {}, {"sum(ps_supplycost * ps_availqty::double) as total"})
-                  .project({"total * 0.0001 as threshold"}))
-          .filter("value > threshold")
-          .orderBy({"value desc"})
-          .project({"ps_partkey", "value"})
-          .build();
-
   checkTpch(11, logicalPlan);
 
-  // TODO Add subquery support to the optimizer.
-  // checkTpchSql(11);
+  checkTpchSql(11);
 }
 
 TEST_F(TpchPlanTest, q12) {
@@ -524,8 +662,7 @@ TEST_F(TpchPlanTest, DISABLED_q16) {
 }
 
 TEST_F(TpchPlanTest, q17) {
-  // TODO Implement.
-  parseTpchSql(17);
+  checkTpchSql(17);
 }
 
 TEST_F(TpchPlanTest, DISABLED_q18) {
@@ -568,16 +705,16 @@ TEST_F(TpchPlanTest, q19) {
   checkTpchSql(19);
 }
 
-TEST_F(TpchPlanTest, DISABLED_q20) {
-  // TODO Implement.
+TEST_F(TpchPlanTest, q20) {
+  checkTpchSql(20);
 }
 
-TEST_F(TpchPlanTest, DISABLED_q21) {
-  // TODO Implement.
+TEST_F(TpchPlanTest, q21) {
+  checkTpchSql(21);
 }
 
-TEST_F(TpchPlanTest, DISABLED_q22) {
-  // TODO Implement.
+TEST_F(TpchPlanTest, q22) {
+  checkTpchSql(22);
 }
 
 } // namespace
@@ -0,0 +1,40 @@
+-- TPC-H/TPC-R Potential Part Promotion Query (Q20)
+-- Functional Query Definition
+-- Approved February 1998
+select
+	s_name,
+	s_address
+from
+	supplier as s,
+	nation as n
+where
+	s_suppkey in (
+		select
+			ps_suppkey
+		from
+			partsupp as ps
+		where
+			ps_partkey in (
+				select
+					p_partkey
+				from
+					part
+				where
+					p_name like 'forest%'
+			)
+			and ps_availqty > (
+				select
+					0.5 * sum(l_quantity)
+				from
+					lineitem
+				where
+					l_partkey = ps.ps_partkey
+					and l_suppkey = ps.ps_suppkey
+					and l_shipdate >= date '1994-01-01'
+					and cast(l_shipdate as date) < date '1994-01-01' + interval '1' year
+			)
+	)
+	and s_nationkey = n_nationkey
+	and n_name = 'CANADA'
+order by
+	s_name;
@@ -0,0 +1,24 @@
+-- TPC-H/TPC-R Order Priority Checking Query (Q4)
+-- Functional Query Definition
+-- Approved February 1998
+select
+	o_orderpriority,
+	count(*) as order_count
+from
+	orders as o
+where
+	o_orderdate >= date '1993-07-01'
+	and cast(o_orderdate as date) < date '1993-07-01' + interval '3' month
+	and exists (
+		select
+			*
+		from
+			lineitem
+		where
+			l_orderkey = o.o_orderkey
+			and l_commitdate < l_receiptdate
+	)
+group by
+	o_orderpriority
+order by
+	o_orderpriority;
@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "axiom/runner/DynamicFilter.h"
+
+namespace facebook::axiom::runner {
+namespace {
+
+int64_t integerAt(const velox::BaseVector& vector, velox::vector_size_t row) {
+  switch (vector.typeKind()) {
+    case velox::TypeKind::TINYINT:
+      return vector.as<velox::SimpleVector<int8_t>>()->valueAt(row);
+    case velox::TypeKind::SMALLINT:
+      return vector.as<velox::SimpleVector<int16_t>>()->valueAt(row);
+    case velox::TypeKind::INTEGER:
+      return vector.as<velox::SimpleVector<int32_t>>()->valueAt(row);
+    case velox::TypeKind::BIGINT:
+      return vector.as<velox::SimpleVector<int64_t>>()->valueAt(row);
+    default:
+      VELOX_UNREACHABLE();
+  }
+}
+
+int64_t integerAt(
+    const velox::DecodedVector& keys,
+    velox::TypeKind kind,
+    velox::vector_size_t row) {
+  switch (kind) {
+    case velox::TypeKind::TINYINT:
+      return keys.valueAt<int8_t>(row);
+    case velox::TypeKind::SMALLINT:
+      return keys.valueAt<int16_t>(row);
+    case velox::TypeKind::INTEGER:
+      return keys.valueAt<int32_t>(row);
+    case velox::TypeKind::BIGINT:
+      return keys.valueAt<int64_t>(row);
+    default:
+      VELOX_UNREACHABLE();
+  }
+}
+
+bool isInteger(velox::TypeKind kind) {
+  return kind == velox::TypeKind::TINYINT ||
+      kind == velox::TypeKind::SMALLINT || kind == velox::TypeKind::INTEGER ||
+      kind == velox::TypeKind::BIGINT;
+}
+
+// Returns the hash of the non-null key at 'row'. Integer keys of different
+// widths hash alike.
+uint64_t hashKey(
+    const velox::DecodedVector& keys,
+    velox::TypeKind kind,
+    velox::vector_size_t row) {
+  switch (kind) {
+    case velox::TypeKind::TINYINT:
+      return folly::hasher<int64_t>()(keys.valueAt<int8_t>(row));
+    case velox::TypeKind::SMALLINT:
+      return folly::hasher<int64_t>()(keys.valueAt<int16_t>(row));
+    case velox::TypeKind::INTEGER:
+      return folly::hasher<int64_t>()(keys.valueAt<int32_t>(row));
+    case velox::TypeKind::BIGINT:
+      return folly::hasher<int64_t>()(keys.valueAt<int64_t>(row));
+    case velox::TypeKind::REAL:
+      return folly::hasher<float>()(keys.valueAt<float>(row));
+    case velox::TypeKind::DOUBLE:
+      return folly::hasher<double>()(keys.valueAt<double>(row));
+    case velox::TypeKind::VARCHAR:
+    case velox::TypeKind::VARBINARY: {
+      const auto value = keys.valueAt<velox::StringView>(row);
+      return folly::hasher<std::string_view>()(
+          std::string_view(value.data(), value.size()));
+    }
+    default:
+      VELOX_UNSUPPORTED("Bloom filter on {} keys", kind);
+  }
+}
+
+} // namespace
+
+bool testDynamicFilter(
+    const velox::common::Filter& filter,
+    const velox::DecodedVector& keys,
+    velox::TypeKind kind,
+    velox::vector_size_t row) {
+  if (keys.isNullAt(row)) {
+    return filter.testNull();
+  }
+  switch (kind) {
+    case velox::TypeKind::TINYINT:
+      return filter.testInt64(keys.valueAt<int8_t>(row));
+    case velox::TypeKind::SMALLINT:
+      return filter.testInt64(keys.valueAt<int16_t>(row));
+    case velox::TypeKind::INTEGER:
+      return filter.testInt64(keys.valueAt<int32_t>(row));
+    case velox::TypeKind::BIGINT:
+      return filter.testInt64(keys.valueAt<int64_t>(row));
+    case velox::TypeKind::REAL:
+      return filter.testFloat(keys.valueAt<float>(row));
+    case velox::TypeKind::DOUBLE:
+      return filter.testDouble(keys.valueAt<double>(row));
+    case velox::TypeKind::VARCHAR:
+    case velox::TypeKind::VARBINARY: {
+      const auto value = keys.valueAt<velox::StringView>(row);
+      return filter.testBytes(value.data(), value.size());
+    }
+    default:
+      return true;
+  }
+}
+
+KeyBloomFilter::KeyBloomFilter(int32_t capacity) {
+  bloom_.reset(std::max<int32_t>(1, capacity));
+}
+
+void KeyBloomFilter::insert(const velox::BaseVector& keys) {
+  velox::DecodedVector decoded(keys);
+  const auto kind = keys.typeKind();
+  const bool integer = isInteger(kind);
+  for (velox::vector_size_t row = 0; row < keys.size(); ++row) {
+    if (decoded.isNullAt(row)) {
+      continue;
+    }
+    bloom_.insert(hashKey(decoded, kind, row));
+    ++numKeys_;
+    if (integer) {
+      const auto key = integerAt(decoded, kind, row);
+      if (integerRange_.has_value()) {
+        integerRange_->first = std::min(integerRange_->first, key);
+        integerRange_->second = std::max(integerRange_->second, key);
+      } else {
+        integerRange_ = {key, key};
+      }
+    }
+  }
+}
+
+bool KeyBloomFilter::mayContain(
+    const velox::DecodedVector& keys,
+    velox::TypeKind kind,
+    velox::vector_size_t row) const {
+  if (keys.isNullAt(row)) {
+    return false;
+  }
+  return bloom_.mayContain(hashKey(keys, kind, row));
+}
+
+std::unique_ptr<velox::common::Filter> KeyBloomFilter::range() const {
+  if (numKeys_ == 0) {
+    return std::make_unique<velox::common::AlwaysFalse>();
+  }
+  if (!integerRange_.has_value()) {
+    return nullptr;
+  }
+  return std::make_unique<velox::common::BigintRange>(
+      integerRange_->first, integerRange_->second, false);
+}
+
+std::unique_ptr<velox::common::Filter> makeDynamicFilter(
+    const velox::BaseVector& min,
+    const velox::BaseVector& max,
+    const velox::BaseVector* values,
+    velox::vector_size_t row) {
+  if (min.isNullAt(row)) {
+    return std::make_unique<velox::common::AlwaysFalse>();
+  }
+
+  const auto kind = min.typeKind();
+  const auto* array = values != nullptr && !values->isNullAt(row)
+      ? values->wrappedVector()->as<velox::ArrayVector>()
+      : nullptr;
+  const auto arrayRow = values != nullptr ? values->wrappedIndex(row) : 0;
+
+  if (isInteger(kind)) {
+    if (array != nullptr) {
+      const auto& elements = *array->elements();
+      std::vector<int64_t> keys;
+      const auto offset = array->offsetAt(arrayRow);
+      for (auto i = 0; i < array->sizeAt(arrayRow); ++i) {
+        if (!elements.isNullAt(offset + i)) {
+          keys.push_back(integerAt(elements, offset + i));
+        }
+      }
+      if (!keys.empty()) {
+        return velox::common::createBigintValues(keys, false);
+      }
+    }
+    return std::make_unique<velox::common::BigintRange>(
+        integerAt(min, row), integerAt(max, row), false);
+  }
+
+  switch (kind) {
+    case velox::TypeKind::REAL:
+      return std::make_unique<velox::common::FloatRange>(
+          min.as<velox::SimpleVector<float>>()->valueAt(row),
+          false,
+          false,
+          max.as<velox::SimpleVector<float>>()->valueAt(row),
+          false,
+          false,
+          false);
+    case velox::TypeKind::DOUBLE:
+      return std::make_unique<velox::common::DoubleRange>(
+          min.as<velox::SimpleVector<double>>()->valueAt(row),
+          false,
+          false,
+          max.as<velox::SimpleVector<double>>()->valueAt(row),
+          false,
+          false,
+          false);
+    case velox::TypeKind::VARCHAR:
+    case velox::TypeKind::VARBINARY: {
+      if (array != nullptr) {
+        const auto* elements =
+            array->elements()->as<velox::SimpleVector<velox::StringView>>();
+        std::vector<std::string> keys;
+        const auto offset = array->offsetAt(arrayRow);
+        for (auto i = 0; i < array->sizeAt(arrayRow); ++i) {
+          if (!elements->isNullAt(offset + i)) {
+            keys.push_back(std::string(elements->valueAt(offset + i)));
+          }
+        }
+        if (!keys.empty()) {
+          return std::make_unique<velox::common::BytesValues>(keys, false);
+        }
+      }
+      return std::make_unique<velox::common::BytesRange>(
+          std::string(
+              min.as<velox::SimpleVector<velox::StringView>>()->valueAt(row)),
+          false,
+          false,
+          std::string(
+              max.as<velox::SimpleVector<velox::StringView>>()->valueAt(row)),
+          false,
+          false,
+          false);
+    }
+    default:
+      return nullptr;
+  }
+}
+
+void DynamicFilter::set(
+    std::shared_ptr<velox::common::Filter> filter,
+    std::shared_ptr<const KeyBloomFilter> bloom) {
+  std::lock_guard<std::mutex> l(mutex_);
+  filter_ = std::move(filter);
+  bloom_ = std::move(bloom);
+}
+
+void DynamicFilter::clear() {
+  set(nullptr, nullptr);
+}
+
+std::shared_ptr<velox::common::Filter> DynamicFilter::filter() const {
+  std::lock_guard<std::mutex> l(mutex_);
+  return filter_;
+}
+
+std::shared_ptr<const KeyBloomFilter> DynamicFilter::bloom() const {
+  std::lock_guard<std::mutex> l(mutex_);
+  return bloom_;
+}
+
+DynamicFilterNode::DynamicFilterNode(
+    const velox::core::PlanNodeId& id,
+    std::vector<std::pair<velox::column_index_t, DynamicFilterPtr>> filters,
+    velox::core::PlanNodePtr source)
+    : PlanNode(id), filters_{std::move(filters)}, sources_{std::move(source)} {
+  VELOX_CHECK(!filters_.empty());
+  for (const auto& [channel, filter] : filters_) {
+    VELOX_CHECK_LT(channel, outputType()->size());
+    VELOX_CHECK_NOT_NULL(filter);
+  }
+}
+
+folly::dynamic DynamicFilterNode::serialize() const {
+  // The filters are shared in memory with the runner that computes them.
+  VELOX_NYI("DynamicFilterNode runs only in LocalRunner: {}", id());
+}
+
+void DynamicFilterNode::addDetails(std::stringstream& stream) const {
+  for (auto i = 0; i < filters_.size(); ++i) {
+    const auto& [channel, filter] = filters_[i];
+    if (i > 0) {
+      stream << ", ";
+    }
+    stream << outputType()->nameOf(channel) << " IN " << filter->id();
+  }
+}
+
+} // namespace facebook::axiom::runner
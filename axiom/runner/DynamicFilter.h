@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <mutex>
+#include "velox/common/base/BloomFilter.h"
+#include "velox/core/PlanNode.h"
+#include "velox/type/Filter.h"
+#include "velox/vector/ComplexVector.h"
+#include "velox/vector/DecodedVector.h"
+
+namespace facebook::axiom::runner {
+
+/// Bloom filter over the build keys of a hash join. Passes every inserted key
+/// and a small fraction of the others. Null keys never pass.
+class KeyBloomFilter {
+ public:
+  /// Makes a filter sized for 'capacity' distinct keys.
+  explicit KeyBloomFilter(int32_t capacity);
+
+  /// Inserts the non-null keys of 'keys'.
+  void insert(const velox::BaseVector& keys);
+
+  /// Returns false if the key at 'row' of 'keys' was not inserted. 'kind' is
+  /// the type kind of the keys.
+  bool mayContain(
+      const velox::DecodedVector& keys,
+      velox::TypeKind kind,
+      velox::vector_size_t row) const;
+
+  /// Returns a filter that passes the range of the inserted integer keys and
+  /// no key if none was inserted. The range can be tested by a scan where the
+  /// Bloom filter cannot. Returns nullptr for keys of other types.
+  std::unique_ptr<velox::common::Filter> range() const;
+
+ private:
+  velox::BloomFilter<> bloom_;
+
+  int64_t numKeys_{0};
+
+  // Range of the inserted keys if these are integers.
+  std::optional<std::pair<int64_t, int64_t>> integerRange_;
+};
+
+/// Makes a filter for the build keys described by 'min', 'max' and optionally
+/// 'values' at 'row'. 'values' is an array of the distinct keys. 'min' is null
+/// if the build side has no non-null keys, in which case no key passes.
+/// Returns nullptr if the type of the keys is not supported.
+std::unique_ptr<velox::common::Filter> makeDynamicFilter(
+    const velox::BaseVector& min,
+    const velox::BaseVector& max,
+    const velox::BaseVector* values,
+    velox::vector_size_t row);
+
+/// Returns true if 'filter' passes the key at 'row' of 'keys'. 'kind' is the
+/// type kind of the keys. Keys of types 'filter' cannot test pass.
+bool testDynamicFilter(
+    const velox::common::Filter& filter,
+    const velox::DecodedVector& keys,
+    velox::TypeKind kind,
+    velox::vector_size_t row);
+
+/// Filter on a join key computed at run time from the build side of a hash
+/// join and applied to probe-side scans in other fragments. Shared by the
+/// DynamicFilterSource that computes it and the DynamicFilterNodes that test
+/// it. Passes all keys until set, so that a filter that could not be
+/// computed never changes results.
+class DynamicFilter {
+ public:
+  /// 'id' names the filter in plan text.
+  explicit DynamicFilter(std::string id) : id_{std::move(id)} {}
+
+  const std::string& id() const {
+    return id_;
+  }
+
+  /// Sets the filter to 'filter' and optionally 'bloom'. The probe keys that
+  /// pass are the keys that pass both.
+  void set(
+      std::shared_ptr<velox::common::Filter> filter,
+      std::shared_ptr<const KeyBloomFilter> bloom = nullptr);
+
+  /// Makes 'this' pass all keys again. Called before a plan runs.
+  void clear();
+
+  /// Returns the filter or nullptr if not set.
+  std::shared_ptr<velox::common::Filter> filter() const;
+
+  /// Returns the Bloom filter or nullptr if not set.
+  std::shared_ptr<const KeyBloomFilter> bloom() const;
+
+ private:
+  const std::string id_;
+
+  mutable std::mutex mutex_;
+  std::shared_ptr<velox::common::Filter> filter_;
+  std::shared_ptr<const KeyBloomFilter> bloom_;
+};
+
+using DynamicFilterPtr = std::shared_ptr<DynamicFilter>;
+
+/// Passes the rows of its source whose keys pass dynamic filters. Placed
+/// directly over a TableScanNode, whose connector then also gets the filters
+/// once they are set so that the reader skips the data that cannot pass. Run
+/// by LocalRunner, see registerDynamicFilterOperator().
+class DynamicFilterNode : public velox::core::PlanNode {
+ public:
+  /// 'filters' are the filters to test and the channels of the keys in the
+  /// output of 'source'.
+  DynamicFilterNode(
+      const velox::core::PlanNodeId& id,
+      std::vector<std::pair<velox::column_index_t, DynamicFilterPtr>> filters,
+      velox::core::PlanNodePtr source);
+
+  const velox::RowTypePtr& outputType() const override {
+    return sources_[0]->outputType();
+  }
+
+  const std::vector<velox::core::PlanNodePtr>& sources() const override {
+    return sources_;
+  }
+
+  std::string_view name() const override {
+    return "DynamicFilter";
+  }
+
+  folly::dynamic serialize() const override;
+
+  const std::vector<std::pair<velox::column_index_t, DynamicFilterPtr>>&
+  filters() const {
+    return filters_;
+  }
+
+ private:
+  void addDetails(std::stringstream& stream) const override;
+
+  const std::vector<std::pair<velox::column_index_t, DynamicFilterPtr>>
+      filters_;
+  const std::vector<velox::core::PlanNodePtr> sources_;
+};
+
+} // namespace facebook::axiom::runner
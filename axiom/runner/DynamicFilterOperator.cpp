@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "axiom/runner/DynamicFilterOperator.h"
+#include <numeric>
+#include "velox/connectors/Connector.h"
+#include "velox/exec/OperatorUtils.h"
+
+namespace facebook::axiom::runner {
+namespace {
+
+// True if the Driver can add dynamic filters to the source of 'node'.
+bool canPushdown(const DynamicFilterNode& node) {
+  auto scan = std::dynamic_pointer_cast<const velox::core::TableScanNode>(
+      node.sources()[0]);
+  if (scan == nullptr) {
+    return false;
+  }
+  return velox::connector::getConnector(scan->tableHandle()->connectorId())
+      ->canAddDynamicFilter();
+}
+
+class DynamicFilterTranslator
+    : public velox::exec::Operator::PlanNodeTranslator {
+ public:
+  std::unique_ptr<velox::exec::Operator> toOperator(
+      velox::exec::DriverCtx* ctx,
+      int32_t id,
+      const velox::core::PlanNodePtr& node) override {
+    if (auto filterNode =
+            std::dynamic_pointer_cast<const DynamicFilterNode>(node)) {
+      return std::make_unique<DynamicFilterOperator>(id, ctx, filterNode);
+    }
+    return nullptr;
+  }
+};
+
+} // namespace
+
+DynamicFilterOperator::DynamicFilterOperator(
+    int32_t operatorId,
+    velox::exec::DriverCtx* driverCtx,
+    const std::shared_ptr<const DynamicFilterNode>& node)
+    : Operator(
+          driverCtx,
+          node->outputType(),
+          operatorId,
+          node->id(),
+          "DynamicFilter"),
+      filters_{node->filters()},
+      canPushdown_{canPushdown(*node)} {
+  // The Driver follows identity projections down to the scan when it adds
+  // the filters.
+  for (auto i = 0; i < outputType_->size(); ++i) {
+    identityProjections_.emplace_back(i, i);
+  }
+}
+
+velox::RowVectorPtr DynamicFilterOperator::getOutput() {
+  if (input_ == nullptr) {
+    return nullptr;
+  }
+  auto input = std::move(input_);
+  const auto numRows = input->size();
+
+  auto indices = velox::allocateIndices(numRows, pool());
+  auto* rawIndices = indices->asMutable<velox::vector_size_t>();
+  std::iota(rawIndices, rawIndices + numRows, 0);
+  velox::vector_size_t numPassed = numRows;
+
+  for (const auto& [channel, dynamicFilter] : filters_) {
+    auto filter = pushedDown_ ? nullptr : dynamicFilter->filter();
+    auto bloom = dynamicFilter->bloom();
+    if (filter == nullptr && bloom == nullptr) {
+      continue;
+    }
+
+    const auto& keys = input->childAt(channel);
+    velox::DecodedVector decoded(*keys);
+    const auto kind = keys->typeKind();
+    velox::vector_size_t numOut = 0;
+    for (auto i = 0; i < numPassed; ++i) {
+      const auto row = rawIndices[i];
+      if ((filter == nullptr ||
+           testDynamicFilter(*filter, decoded, kind, row)) &&
+          (bloom == nullptr || bloom->mayContain(decoded, kind, row))) {
+        rawIndices[numOut++] = row;
+      }
+    }
+    numPassed = numOut;
+  }
+
+  // The splits of the scan are added once the filters are set, so the
+  // filters handed over with the first output apply to all later reads.
+  if (canPushdown_ && !pushedDown_) {
+    for (const auto& [channel, dynamicFilter] : filters_) {
+      if (auto filter = dynamicFilter->filter()) {
+        dynamicFilters_.emplace(channel, std::move(filter));
+      }
+    }
+    pushedDown_ = true;
+  }
+
+  if (numPassed == numRows) {
+    return input;
+  }
+  if (numPassed == 0) {
+    return nullptr;
+  }
+  return velox::exec::wrap(numPassed, std::move(indices), input);
+}
+
+void registerDynamicFilterOperator() {
+  static std::once_flag registered;
+  std::call_once(registered, []() {
+    velox::exec::Operator::registerOperator(
+        std::make_unique<DynamicFilterTranslator>());
+  });
+}
+
+} // namespace facebook::axiom::runner
@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "axiom/runner/DynamicFilter.h"
+#include "velox/exec/Operator.h"
+
+namespace facebook::axiom::runner {
+
+/// Runs a DynamicFilterNode. Drops the input rows whose keys do not pass the
+/// filters. If the node is directly over a TableScanNode whose connector
+/// accepts dynamic filters, the first output also hands the filters to the
+/// Driver, which adds them to the scan. The reader then skips the stripes and
+/// rows that do not pass. Bloom filters stay in the operator.
+class DynamicFilterOperator : public velox::exec::Operator {
+ public:
+  DynamicFilterOperator(
+      int32_t operatorId,
+      velox::exec::DriverCtx* driverCtx,
+      const std::shared_ptr<const DynamicFilterNode>& node);
+
+  bool needsInput() const override {
+    return input_ == nullptr;
+  }
+
+  void addInput(velox::RowVectorPtr input) override {
+    input_ = std::move(input);
+  }
+
+  velox::RowVectorPtr getOutput() override;
+
+  velox::exec::BlockingReason isBlocked(
+      velox::ContinueFuture* /*future*/) override {
+    return velox::exec::BlockingReason::kNotBlocked;
+  }
+
+  bool isFinished() override {
+    return noMoreInput_ && input_ == nullptr;
+  }
+
+ private:
+  const std::vector<std::pair<velox::column_index_t, DynamicFilterPtr>>
+      filters_;
+
+  // True if the filters can be added to the scan below.
+  const bool canPushdown_;
+
+  // True once the filters have been handed to the Driver. Only the Bloom
+  // filters are then tested here.
+  bool pushedDown_{false};
+};
+
+/// Registers DynamicFilterOperator with Velox. Safe to call more than once.
+void registerDynamicFilterOperator();
+
+} // namespace facebook::axiom::runner
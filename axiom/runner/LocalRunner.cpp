@@ -15,8 +15,14 @@
  */
 
 #include "axiom/runner/LocalRunner.h"
+#include <folly/container/F14Set.h>
+#include <folly/executors/InlineExecutor.h>
+#include <folly/futures/Future.h>
 #include "axiom/connectors/ConnectorMetadata.h"
+#include "axiom/runner/DynamicFilterOperator.h"
+#include "velox/common/base/SuccinctPrinter.h"
 #include "velox/common/time/Timer.h"
+#include "velox/connectors/hive/HiveConnectorSplit.h"
 #include "velox/exec/Exchange.h"
 #include "velox/exec/PlanNodeStats.h"
 
@@ -46,7 +52,8 @@ class SimpleSplitSource : public connector::SplitSource {
 
 std::shared_ptr<connector::SplitSource>
 SimpleSplitSourceFactory::splitSourceForScan(
-    const velox::core::TableScanNode& scan) {
+    const velox::core::TableScanNode& scan,
+    std::optional<int64_t> /*maxRows*/) {
   auto it = nodeSplitMap_.find(scan.id());
   if (it == nodeSplitMap_.end()) {
     VELOX_FAIL("Splits are not provided for scan {}", scan.id());
@@ -56,13 +63,16 @@ SimpleSplitSourceFactory::splitSourceForScan(
 
 std::shared_ptr<connector::SplitSource>
 ConnectorSplitSourceFactory::splitSourceForScan(
-    const velox::core::TableScanNode& scan) {
+    const velox::core::TableScanNode& scan,
+    std::optional<int64_t> maxRows) {
   const auto& handle = scan.tableHandle();
   auto metadata = connector::ConnectorMetadata::metadata(handle->connectorId());
   auto splitManager = metadata->splitManager();
 
   auto partitions = splitManager->listPartitions(handle);
-  return splitManager->getSplitSource(handle, partitions, options_);
+  auto options = options_;
+  options.maxRows = maxRows;
+  return splitManager->getSplitSource(handle, partitions, options);
 }
 
 namespace {
@@ -72,6 +82,43 @@ std::shared_ptr<velox::exec::RemoteConnectorSplit> remoteSplit(
   return std::make_shared<velox::exec::RemoteConnectorSplit>(taskId);
 }
 
+// Adds the split for the output of producers[index] to 'consumer' and the
+// split for the next producer when this one completes. The consumer gets the
+// output of the producers one after the other. Tasks are referenced weakly
+// since they keep the callback until they complete. The consumer fails if a
+// producer is gone before its split is added.
+void addSplitsInOrder(
+    const std::weak_ptr<velox::exec::Task>& consumer,
+    const velox::core::PlanNodeId& nodeId,
+    const std::shared_ptr<std::vector<std::weak_ptr<velox::exec::Task>>>&
+        producers,
+    size_t index) {
+  auto consumerTask = consumer.lock();
+  if (consumerTask == nullptr) {
+    return;
+  }
+  if (index == producers->size()) {
+    consumerTask->noMoreSplits(nodeId);
+    return;
+  }
+  auto producer = (*producers)[index].lock();
+  if (producer == nullptr) {
+    consumerTask->setError(fmt::format(
+        "Producer {} of ordered input {} of task {} no longer exists",
+        index,
+        nodeId,
+        consumerTask->taskId()));
+    return;
+  }
+  consumerTask->addSplit(
+      nodeId, velox::exec::Split(remoteSplit(producer->taskId())));
+  producer->taskCompletionFuture()
+      .via(&folly::InlineExecutor::instance())
+      .thenTry([consumer, nodeId, producers, index](auto&&) {
+        addSplitsInOrder(consumer, nodeId, producers, index + 1);
+      });
+}
+
 std::vector<velox::exec::Split> listAllSplits(
     const std::shared_ptr<connector::SplitSource>& source) {
   std::vector<velox::exec::Split> result;
@@ -134,8 +181,135 @@ std::vector<ExecutableFragment> topologicalSort(
   VELOX_CHECK_EQ(result.size(), fragments.size());
   return result;
 }
+
+// Bytes of results buffered before the last stage is blocked. Same as the
+// default of velox::exec::CursorParameters::bufferedBytes.
+constexpr uint64_t kMaxResultBytes = 512 << 10;
 } // namespace
 
+/// Buffers the output of the last stage until it is returned by
+/// LocalRunner::nextAsync(). Producers are the drivers of the last stage. They
+/// are blocked when more than 'maxBytes' are buffered. A consumer waiting for
+/// a batch gets a future instead of blocking a thread.
+class ResultQueue {
+ public:
+  explicit ResultQueue(uint64_t maxBytes) : maxBytes_(maxBytes) {}
+
+  /// Adds 'batch'. Returns kWaitForConsumer and sets 'future' if the queue is
+  /// full.
+  velox::exec::BlockingReason enqueue(
+      velox::RowVectorPtr batch,
+      velox::ContinueFuture* future) {
+    std::optional<folly::Promise<velox::RowVectorPtr>> consumer;
+    {
+      std::lock_guard<std::mutex> l(mutex_);
+      if (atEnd_) {
+        return velox::exec::BlockingReason::kNotBlocked;
+      }
+      if (consumer_.has_value()) {
+        VELOX_CHECK(batches_.empty());
+        consumer = std::move(consumer_);
+        consumer_.reset();
+      } else {
+        bytes_ += batch->estimateFlatSize();
+        batches_.push_back(std::move(batch));
+        if (bytes_ >= maxBytes_) {
+          auto [promise, semiFuture] =
+              velox::makeVeloxContinuePromiseContract("ResultQueue::enqueue");
+          producers_.push_back(std::move(promise));
+          *future = std::move(semiFuture);
+          return velox::exec::BlockingReason::kWaitForConsumer;
+        }
+      }
+    }
+    if (consumer.has_value()) {
+      consumer->setValue(std::move(batch));
+    }
+    return velox::exec::BlockingReason::kNotBlocked;
+  }
+
+  /// Returns the next batch, nullptr at end or the error given to finish().
+  /// The future is pending until a batch is enqueued or finish() is called.
+  folly::SemiFuture<velox::RowVectorPtr> dequeue() {
+    std::vector<velox::ContinuePromise> producers;
+    velox::RowVectorPtr batch;
+    {
+      std::lock_guard<std::mutex> l(mutex_);
+      VELOX_CHECK(!consumer_.has_value(), "Concurrent calls to nextAsync()");
+      if (batches_.empty()) {
+        if (error_) {
+          return folly::makeSemiFuture<velox::RowVectorPtr>(
+              folly::exception_wrapper(error_));
+        }
+        if (atEnd_) {
+          return folly::makeSemiFuture<velox::RowVectorPtr>(nullptr);
+        }
+        consumer_.emplace();
+        return consumer_->getSemiFuture();
+      }
+      batch = std::move(batches_.front());
+      batches_.pop_front();
+      bytes_ -= batch->estimateFlatSize();
+      if (bytes_ < maxBytes_) {
+        producers = std::move(producers_);
+        producers_.clear();
+      }
+    }
+    for (auto& promise : producers) {
+      promise.setValue();
+    }
+    return folly::makeSemiFuture(std::move(batch));
+  }
+
+  /// Marks the end of the results. Batches enqueued before remain readable
+  /// unless 'error' is set.
+  void finish(std::exception_ptr error) {
+    std::vector<velox::ContinuePromise> producers;
+    std::optional<folly::Promise<velox::RowVectorPtr>> consumer;
+    {
+      std::lock_guard<std::mutex> l(mutex_);
+      if (atEnd_ && (error_ || !error)) {
+        return;
+      }
+      atEnd_ = true;
+      if (error) {
+        error_ = error;
+        batches_.clear();
+        bytes_ = 0;
+      }
+      producers = std::move(producers_);
+      producers_.clear();
+      consumer = std::move(consumer_);
+      consumer_.reset();
+    }
+    for (auto& promise : producers) {
+      promise.setValue();
+    }
+    if (consumer.has_value()) {
+      if (error) {
+        consumer->setException(folly::exception_wrapper(error));
+      } else {
+        consumer->setValue(nullptr);
+      }
+    }
+  }
+
+ private:
+  const uint64_t maxBytes_;
+
+  std::mutex mutex_;
+  std::deque<velox::RowVectorPtr> batches_;
+  uint64_t bytes_{0};
+  bool atEnd_{false};
+  std::exception_ptr error_;
+
+  // Set while a consumer waits for a batch.
+  std::optional<folly::Promise<velox::RowVectorPtr>> consumer_;
+
+  // Producers blocked because the queue is full.
+  std::vector<velox::ContinuePromise> producers_;
+};
+
 LocalRunner::LocalRunner(
     const MultiFragmentPlanPtr& plan,
     std::shared_ptr<velox::core::QueryCtx> queryCtx,
@@ -143,50 +317,258 @@ LocalRunner::LocalRunner(
     std::shared_ptr<velox::memory::MemoryPool> outputPool)
     : plan_{plan},
       fragments_(topologicalSort(plan->fragments())),
+      queryCtx_{std::move(queryCtx)},
+      outputPool_{std::move(outputPool)},
       splitSourceFactory_(std::move(splitSourceFactory)) {
-  params_.queryCtx = std::move(queryCtx);
-  params_.outputPool = std::move(outputPool);
+  if (!outputPool_) {
+    outputPool_ = queryCtx_->pool()->addLeafChild(
+        fmt::format("{}.output", queryCtx_->queryId()));
+  }
+  if (!plan_->dynamicFilters().empty()) {
+    registerDynamicFilterOperator();
+  }
+}
+
+void LocalRunner::setScheduler(
+    std::shared_ptr<QueryScheduler> scheduler,
+    int32_t priority,
+    std::string group) {
+  VELOX_CHECK_EQ(state_, State::kInitialized);
+  scheduler_ = std::move(scheduler);
+  schedulerPriority_ = priority;
+  schedulerGroup_ = std::move(group);
 }
 
-velox::RowVectorPtr LocalRunner::next() {
-  if (!cursor_) {
+QueryScheduler::Request LocalRunner::schedulerRequest() const {
+  QueryScheduler::Request request{
+      .memoryBytes = 0,
+      .numDrivers = 0,
+      .priority = schedulerPriority_,
+      .group = schedulerGroup_};
+  for (const auto& fragment : fragments_) {
+    request.memoryBytes += fragment.predictedMemory;
+    request.numDrivers += std::max(1, fragment.width) * numDrivers(fragment);
+  }
+  return request;
+}
+
+folly::SemiFuture<velox::RowVectorPtr> LocalRunner::nextAsync() {
+  if (state_ != State::kInitialized) {
+    return nextBatch();
+  }
+
+  if (scheduler_ == nullptr) {
+    return startAndNextBatch();
+  }
+
+  // Starts when admitted. The reservation is held until completion.
+  QueryScheduler::WaiterId waiterId;
+  auto admitted = scheduler_->admit(schedulerRequest(), &waiterId);
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    waiterId_ = waiterId;
+  }
+  return std::move(admitted).deferValue(
+      [self = shared_from_this()](
+          std::unique_ptr<QueryScheduler::Admission> admission) {
+        {
+          std::lock_guard<std::mutex> l(self->mutex_);
+          self->waiterId_.reset();
+          if (self->state_ != State::kInitialized) {
+            // Aborted after admission. Dropping 'admission' releases it.
+            return folly::makeSemiFuture<velox::RowVectorPtr>(
+                folly::exception_wrapper(self->error_));
+          }
+          self->admission_ = std::move(admission);
+        }
+        return self->startAndNextBatch();
+      });
+}
+
+folly::SemiFuture<velox::RowVectorPtr> LocalRunner::startAndNextBatch() {
+  try {
     start();
+  } catch (const std::exception&) {
+    return folly::makeSemiFuture<velox::RowVectorPtr>(
+        folly::exception_wrapper(std::current_exception()));
+  }
+  return nextBatch();
+}
+
+folly::SemiFuture<velox::RowVectorPtr> LocalRunner::nextBatch() {
+  std::shared_ptr<ResultQueue> results;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    if (!results_) {
+      return folly::makeSemiFuture<velox::RowVectorPtr>(
+          folly::exception_wrapper(error_));
+    }
+    results = results_;
   }
 
-  if (!cursor_->moveNext()) {
+  return results->dequeue().deferValue(
+      [self = shared_from_this()](velox::RowVectorPtr batch) {
+        if (batch == nullptr) {
+          self->finish();
+        }
+        return batch;
+      });
+}
+
+void LocalRunner::setCompletionCallback(CompletionCallback callback) {
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    if (state_ == State::kInitialized || state_ == State::kRunning) {
+      completionCallback_ = std::move(callback);
+      return;
+    }
+  }
+  callback(state_, error_);
+}
+
+void LocalRunner::finish() {
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    // The last stage may complete before start() sets kRunning.
+    if (state_ != State::kRunning && state_ != State::kInitialized) {
+      return;
+    }
     state_ = State::kFinished;
-    return nullptr;
   }
-  return cursor_->current();
+  notifyCompletion();
+}
+
+void LocalRunner::notifyCompletion() {
+  CompletionCallback callback;
+  std::unique_ptr<QueryScheduler::Admission> admission;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    std::swap(callback, completionCallback_);
+    std::swap(admission, admission_);
+  }
+  // Releases the resources of the query to the scheduler.
+  admission.reset();
+
+  if (callback) {
+    callback(state_, error_);
+  }
+}
+
+void LocalRunner::setError(std::exception_ptr error) {
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    if (error_) {
+      return;
+    }
+    state_ = State::kError;
+    error_ = std::move(error);
+  }
+  if (results_) {
+    abort();
+  }
 }
 
 void LocalRunner::start() {
   VELOX_CHECK_EQ(state_, State::kInitialized);
 
-  params_.maxDrivers = plan_->options().numDrivers;
-  params_.planNode = fragments_.back().fragment.planNode;
-
-  auto cursor = velox::exec::TaskCursor::create(params_);
-  makeStages(cursor->task());
+  auto results = std::make_shared<ResultQueue>(kMaxResultBytes);
+  makeStages(makeLastStageTask(results));
 
   {
     std::lock_guard<std::mutex> l(mutex_);
     if (!error_) {
-      cursor_ = std::move(cursor);
-      state_ = State::kRunning;
+      results_ = std::move(results);
+      if (state_ == State::kInitialized) {
+        state_ = State::kRunning;
+      }
     }
   }
 
-  if (!cursor_) {
-    // The cursor was not set because previous fragments had an error.
+  if (!results_) {
+    // The results were not set because previous fragments had an error.
     abort();
     std::rethrow_exception(error_);
   }
 }
 
+std::shared_ptr<velox::exec::Task> LocalRunner::makeLastStageTask(
+    const std::shared_ptr<ResultQueue>& results) {
+  const auto& fragment = fragments_.back();
+
+  // Results are copied because the producing operators may reuse their
+  // output vectors.
+  auto consumer = [results, pool = outputPool_](
+                      velox::RowVectorPtr batch,
+                      bool drained,
+                      velox::ContinueFuture* future) {
+    if (batch == nullptr || drained) {
+      return velox::exec::BlockingReason::kNotBlocked;
+    }
+    auto copy = velox::BaseVector::create<velox::RowVector>(
+        batch->type(), batch->size(), pool.get());
+    copy->copy(batch.get(), 0, 0, batch->size());
+    return results->enqueue(std::move(copy), future);
+  };
+
+  auto task = velox::exec::Task::create(
+      fmt::format("local://{}/{}.0", queryCtx_->queryId(), fragment.taskPrefix),
+      fragment.fragment,
+      0,
+      queryCtx_,
+      velox::exec::Task::ExecutionMode::kParallel,
+      std::move(consumer),
+      0,
+      [self = shared_from_this()](std::exception_ptr error) {
+        self->setError(std::move(error));
+      });
+
+  if (auto directory = spillDirectory(fragment, 0); !directory.empty()) {
+    task->setSpillDirectory(directory, false);
+  }
+
+  // All output has been passed to the consumer when the task completes. The
+  // query is then finished even if the consumer does not read to the end.
+  task->taskCompletionFuture()
+      .via(&folly::InlineExecutor::instance())
+      .thenValue([results,
+                  weakTask = std::weak_ptr(task),
+                  weakSelf = weak_from_this()](auto&&) {
+        auto task = weakTask.lock();
+        auto error = task ? task->error() : nullptr;
+        results->finish(error);
+        if (auto self = weakSelf.lock(); self != nullptr && !error) {
+          self->finish();
+        }
+      });
+
+  task->start(numDrivers(fragment));
+  return task;
+}
+
+int32_t LocalRunner::numDrivers(const ExecutableFragment& fragment) const {
+  return fragment.numDrivers > 0 ? fragment.numDrivers
+                                 : plan_->options().numDrivers;
+}
+
+std::string LocalRunner::spillDirectory(
+    const ExecutableFragment& fragment,
+    int32_t worker) const {
+  const auto& directory = plan_->options().spillDirectory;
+  if (!fragment.canSpill || directory.empty()) {
+    return "";
+  }
+  return fmt::format(
+      "{}/{}/{}.{}",
+      directory,
+      queryCtx_->queryId(),
+      fragment.taskPrefix,
+      worker);
+}
+
 std::shared_ptr<connector::SplitSource> LocalRunner::splitSourceForScan(
-    const velox::core::TableScanNode& scan) {
-  return splitSourceFactory_->splitSourceForScan(scan);
+    const velox::core::TableScanNode& scan,
+    std::optional<int64_t> maxRows) {
+  return splitSourceFactory_->splitSourceForScan(scan, maxRows);
 }
 
 void LocalRunner::abort() {
@@ -200,6 +582,17 @@ void LocalRunner::abort() {
     }
   }
   VELOX_CHECK(state_ != State::kInitialized);
+
+  // A query waiting for admission leaves the queue and fails.
+  std::optional<QueryScheduler::WaiterId> waiterId;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    std::swap(waiterId, waiterId_);
+  }
+  if (waiterId.has_value()) {
+    scheduler_->cancel(waiterId.value(), error_);
+  }
+
   // Setting errors is thread safe. The stages do not change after
   // initialization.
   for (auto& stage : stages_) {
@@ -207,13 +600,21 @@ void LocalRunner::abort() {
       task->setError(error_);
     }
   }
-  if (cursor_) {
-    cursor_->setError(error_);
+  for (auto& task : fanoutTasks_) {
+    task->setError(error_);
+  }
+  for (auto& task : filterTasks_) {
+    task->setError(error_);
   }
+  if (results_) {
+    results_->finish(error_);
+  }
+  notifyCompletion();
 }
 
 void LocalRunner::waitForCompletion(int32_t maxWaitMicros) {
   VELOX_CHECK_NE(state_, State::kInitialized);
+
   std::vector<velox::ContinueFuture> futures;
   {
     std::lock_guard<std::mutex> l(mutex_);
@@ -223,6 +624,14 @@ void LocalRunner::waitForCompletion(int32_t maxWaitMicros) {
       }
       stage.clear();
     }
+    for (auto& task : fanoutTasks_) {
+      futures.push_back(task->taskDeletionFuture());
+    }
+    fanoutTasks_.clear();
+    for (auto& task : filterTasks_) {
+      futures.push_back(task->taskDeletionFuture());
+    }
+    filterTasks_.clear();
   }
 
   const auto startTime = velox::getCurrentTimeMicro();
@@ -254,6 +663,91 @@ bool isBroadcast(const velox::core::PlanFragment& fragment) {
   return false;
 }
 
+const velox::core::PartitionedOutputNode& outputNode(
+    const ExecutableFragment& fragment) {
+  const auto* output =
+      dynamic_cast<const velox::core::PartitionedOutputNode*>(
+          fragment.fragment.planNode.get());
+  VELOX_CHECK_NOT_NULL(
+      output,
+      "Fragment {} has several consumers but no PartitionedOutputNode",
+      fragment.taskPrefix);
+  return *output;
+}
+
+// Returns the number of fragments that read the output of each fragment. The
+// fragments of 'filterSources' read the build sides of their joins like the
+// joins do.
+folly::F14FastMap<std::string, int32_t> countConsumers(
+    const std::vector<ExecutableFragment>& fragments,
+    const std::vector<DynamicFilterSource>& filterSources) {
+  std::vector<const ExecutableFragment*> consumers;
+  for (const auto& fragment : fragments) {
+    consumers.push_back(&fragment);
+  }
+  for (const auto& source : filterSources) {
+    consumers.push_back(&source.fragment);
+  }
+
+  folly::F14FastMap<std::string, int32_t> numConsumers;
+  for (const auto* fragment : consumers) {
+    // The fan-out tasks of a fragment with several consumers each buffer the
+    // output for one consumer. A fragment that read two of them would block
+    // the producer on the one it reads last.
+    folly::F14FastSet<std::string> producers;
+    for (const auto& input : fragment->inputStages) {
+      VELOX_CHECK(
+          producers.insert(input.producerTaskPrefix).second,
+          "Fragment {} reads the output of {} more than once",
+          fragment->taskPrefix,
+          input.producerTaskPrefix);
+      ++numConsumers[input.producerTaskPrefix];
+    }
+  }
+  return numConsumers;
+}
+
+// Returns the plan of 'fragment' with its output broadcast to 'numConsumers'
+// fan-out tasks.
+velox::core::PlanFragment broadcastToFanout(
+    const ExecutableFragment& fragment,
+    int32_t numConsumers) {
+  const auto& output = outputNode(fragment);
+  auto result = fragment.fragment;
+  result.planNode = velox::core::PartitionedOutputNode::broadcast(
+      output.id(),
+      numConsumers,
+      output.outputType(),
+      output.serdeKind(),
+      output.sources()[0]);
+  return result;
+}
+
+// Returns the plan of a fan-out task. The task reads the output of all tasks
+// of 'producer' and partitions it for a consumer with 'width' tasks like the
+// output of 'producer' would be if the consumer were its only consumer. A
+// gather stays a gather. Output with no keys to more than one partition, e.g.
+// round robin, goes to all tasks of the consumer.
+velox::core::PlanFragment fanoutPlan(
+    const ExecutableFragment& producer,
+    int32_t width) {
+  const auto& output = outputNode(producer);
+  const bool isGather = output.keys().empty() && output.numPartitions() == 1;
+  auto exchange = std::make_shared<velox::core::ExchangeNode>(
+      "fanout.exchange", output.outputType(), output.serdeKind());
+  return velox::core::PlanFragment(
+      std::make_shared<velox::core::PartitionedOutputNode>(
+          "fanout.output",
+          output.kind(),
+          output.keys(),
+          isGather ? 1 : width,
+          output.isReplicateNullsAndAny(),
+          output.partitionFunctionSpecPtr(),
+          output.outputType(),
+          output.serdeKind(),
+          exchange));
+}
+
 void gatherScans(
     const velox::core::PlanNodePtr& plan,
     std::vector<velox::core::TableScanNodePtr>& scans) {
@@ -266,27 +760,258 @@ void gatherScans(
     gatherScans(source, scans);
   }
 }
-} // namespace
 
-void LocalRunner::makeStages(
-    const std::shared_ptr<velox::exec::Task>& lastStageTask) {
-  auto sharedRunner = shared_from_this();
-  auto onError = [self = sharedRunner, this](std::exception_ptr error) {
-    {
-      std::lock_guard<std::mutex> l(mutex_);
-      if (error_) {
-        return;
+// Dynamic filters by the id of the scan they are directly over.
+using ScanFilters = folly::F14FastMap<
+    velox::core::PlanNodeId,
+    std::vector<const DynamicFilter*>>;
+
+// Adds the filters of the DynamicFilterNodes directly over the scans in 'plan'
+// to 'filters'.
+void gatherDynamicFilterScans(
+    const velox::core::PlanNodePtr& plan,
+    ScanFilters& filters) {
+  if (auto node = std::dynamic_pointer_cast<const DynamicFilterNode>(plan)) {
+    const auto& source = node->sources()[0];
+    if (std::dynamic_pointer_cast<const velox::core::TableScanNode>(source)) {
+      auto& scanFilters = filters[source->id()];
+      for (const auto& [channel, filter] : node->filters()) {
+        scanFilters.push_back(filter.get());
       }
-      state_ = State::kError;
-      error_ = std::move(error);
     }
-    if (cursor_) {
-      abort();
+  }
+  for (const auto& source : plan->sources()) {
+    gatherDynamicFilterScans(source, filters);
+  }
+}
+
+// Maps 'key' to a bucket in [0, numBuckets). Growing 'numBuckets' moves only
+// the keys that land in the new buckets. See Lamping & Veach, "A Fast, Minimal
+// Memory, Consistent Hash Algorithm".
+int32_t jumpConsistentHash(uint64_t key, int32_t numBuckets) {
+  int64_t bucket = -1;
+  int64_t next = 0;
+  while (next < numBuckets) {
+    bucket = next;
+    key = key * 2862933555777941757ULL + 1;
+    next = static_cast<int64_t>(
+        static_cast<double>(bucket + 1) *
+        (static_cast<double>(1LL << 31) /
+         static_cast<double>((key >> 33) + 1)));
+  }
+  return static_cast<int32_t>(bucket);
+}
+
+// Returns a hash of the data read by 'split' or std::nullopt if the split has
+// no cache affinity.
+std::optional<uint64_t> affinityHash(
+    const velox::connector::ConnectorSplit& split) {
+  if (auto* hiveSplit =
+          dynamic_cast<const velox::connector::hive::HiveConnectorSplit*>(
+              &split)) {
+    return folly::hash::hash_combine(hiveSplit->filePath, hiveSplit->start);
+  }
+  return std::nullopt;
+}
+
+// Interval at which the splits of a scan under a limit are topped up. Tasks
+// report no event when a split is started, so their stats are polled.
+constexpr auto kLimitedScanInterval = std::chrono::milliseconds(10);
+
+// Splits of a TableScan of which 'maxRows' rows are needed. Each task gets one
+// split at a time. The next split is added when the task has started the
+// previous one, until the tasks have produced 'maxRows' rows.
+struct LimitedScan {
+  std::vector<std::weak_ptr<velox::exec::Task>> tasks;
+  velox::core::PlanNodeId nodeId;
+  std::shared_ptr<connector::SplitSource> source;
+  int64_t maxRows;
+
+  // Number of splits added to each of 'tasks'.
+  std::vector<int64_t> numAdded;
+
+  // Called with an error from adding splits. Fails the query.
+  std::function<void(std::exception_ptr)> onError;
+
+  // Splits from 'source' not yet added.
+  std::vector<connector::SplitSource::SplitAndGroup> splits;
+  size_t splitIdx{0};
+
+  // Returns the next split or nullptr if there are no more.
+  std::shared_ptr<velox::connector::ConnectorSplit> nextSplit() {
+    if (splitIdx >= splits.size()) {
+      splits = source->getSplits(0);
+      VELOX_CHECK(!splits.empty());
+      splitIdx = 0;
+    }
+    return std::move(splits[splitIdx++].split);
+  }
+};
+
+// Adds a split to each task of 'scan' that has started all its splits.
+// Returns false if the scan needs no more splits.
+bool topUpLimitedScan(LimitedScan& scan) {
+  std::vector<std::shared_ptr<velox::exec::Task>> tasks;
+  for (const auto& weakTask : scan.tasks) {
+    auto task = weakTask.lock();
+    if (task == nullptr) {
+      return false;
+    }
+    tasks.push_back(std::move(task));
+  }
+
+  auto noMoreSplits = [&]() {
+    for (const auto& task : tasks) {
+      if (task->isRunning()) {
+        task->noMoreSplits(scan.nodeId);
+      }
+    }
+    return false;
+  };
+
+  // A task that is no longer running has reached its limit or failed.
+  int64_t numRows = 0;
+  std::vector<int64_t> numStarted(tasks.size(), 0);
+  for (auto i = 0; i < tasks.size(); ++i) {
+    if (!tasks[i]->isRunning()) {
+      return noMoreSplits();
+    }
+    for (const auto& pipeline : tasks[i]->taskStats().pipelineStats) {
+      for (const auto& op : pipeline.operatorStats) {
+        if (op.planNodeId == scan.nodeId) {
+          numRows += op.outputPositions;
+          numStarted[i] += op.numSplits;
+        }
+      }
+    }
+  }
+  if (numRows >= scan.maxRows) {
+    return noMoreSplits();
+  }
+
+  for (auto i = 0; i < tasks.size(); ++i) {
+    if (numStarted[i] < scan.numAdded[i]) {
+      continue;
+    }
+    auto split = scan.nextSplit();
+    if (split == nullptr) {
+      return noMoreSplits();
+    }
+    tasks[i]->addSplit(scan.nodeId, velox::exec::Split(std::move(split)));
+    ++scan.numAdded[i];
+  }
+  return true;
+}
+
+void addLimitedScanSplits(
+    const std::shared_ptr<LimitedScan>& scan,
+    folly::Executor* executor) {
+  try {
+    if (!topUpLimitedScan(*scan)) {
+      return;
+    }
+  } catch (const std::exception&) {
+    scan->onError(std::current_exception());
+    return;
+  }
+
+  folly::futures::sleep(kLimitedScanInterval)
+      .via(executor)
+      .thenValue(
+          [scan, executor](auto&&) { addLimitedScanSplits(scan, executor); })
+      .thenError([scan](folly::exception_wrapper error) {
+        scan->onError(error.to_exception_ptr());
+      });
+}
+
+// Bytes read by table scans by the source of the data.
+struct ScanCacheStats {
+  int64_t ramBytes{0};
+  int64_t ssdBytes{0};
+  int64_t storageBytes{0};
+
+  void add(const velox::exec::OperatorStats& stats) {
+    auto sum = [&](const char* name) -> int64_t {
+      auto it = stats.runtimeStats.find(name);
+      return it == stats.runtimeStats.end() ? 0 : it->second.sum;
+    };
+    ramBytes += sum("ramReadBytes");
+    ssdBytes += sum("localReadBytes");
+    storageBytes += sum("storageReadBytes");
+  }
+
+  int64_t totalBytes() const {
+    return ramBytes + ssdBytes + storageBytes;
+  }
+
+  std::string toString() const {
+    const auto total = static_cast<double>(totalBytes());
+    return fmt::format(
+        "Cache hits: {:.1f}% memory, {:.1f}% SSD, {} read from storage",
+        100 * ramBytes / total,
+        100 * ssdBytes / total,
+        velox::succinctBytes(storageBytes));
+  }
+};
+
+// Returns the stats of 'tasks' added together. The tasks run the same plan.
+velox::exec::TaskStats aggregateStats(
+    const std::vector<std::shared_ptr<velox::exec::Task>>& tasks) {
+  VELOX_CHECK(!tasks.empty());
+
+  auto stats = tasks[0]->taskStats();
+  for (auto i = 1; i < tasks.size(); ++i) {
+    const auto moreStats = tasks[i]->taskStats();
+    for (auto pipeline = 0; pipeline < stats.pipelineStats.size(); ++pipeline) {
+      auto& pipelineStats = stats.pipelineStats[pipeline];
+      for (auto op = 0; op < pipelineStats.operatorStats.size(); ++op) {
+        pipelineStats.operatorStats[op].add(
+            moreStats.pipelineStats[pipeline].operatorStats[op]);
+      }
     }
+  }
+  return stats;
+}
+} // namespace
+
+SplitAssigner::SplitAssigner(int32_t numTasks, bool affinity, int32_t maxSkew)
+    : numSplits_(numTasks, 0), affinity_(affinity), maxSkew_(maxSkew) {
+  VELOX_CHECK_GT(numTasks, 0);
+}
+
+int32_t SplitAssigner::assign(const velox::connector::ConnectorSplit& split) {
+  const int32_t numTasks = numSplits_.size();
+  int32_t task = roundRobin_++ % numTasks;
+  if (affinity_) {
+    if (auto hash = affinityHash(split)) {
+      task = jumpConsistentHash(*hash, numTasks);
+      if (numSplits_[task] * numTasks >=
+          totalSplits_ + static_cast<int64_t>(maxSkew_) * numTasks) {
+        task = std::min_element(numSplits_.begin(), numSplits_.end()) -
+            numSplits_.begin();
+      }
+    }
+  }
+  ++numSplits_[task];
+  ++totalSplits_;
+  return task;
+}
+
+void LocalRunner::makeStages(
+    const std::shared_ptr<velox::exec::Task>& lastStageTask) {
+  auto onError = [self = shared_from_this()](std::exception_ptr error) {
+    self->setError(std::move(error));
   };
 
   // Mapping from task prefix to the stage index and whether it is a broadcast.
   folly::F14FastMap<std::string, std::pair<int32_t, bool>> stageMap;
+
+  // A fragment with several consumers broadcasts its output to one fan-out
+  // task per consumer.
+  const auto& filterSources = plan_->dynamicFilters();
+  const auto numConsumers = countConsumers(fragments_, filterSources);
+  folly::F14FastMap<std::string, int32_t> numFanouts;
+
   for (auto fragmentIndex = 0; fragmentIndex < fragments_.size() - 1;
        ++fragmentIndex) {
     const auto& fragment = fragments_[fragmentIndex];
@@ -294,29 +1019,107 @@ void LocalRunner::makeStages(
         stages_.size(), isBroadcast(fragment.fragment)};
     stages_.emplace_back();
 
+    auto it = numConsumers.find(fragment.taskPrefix);
+    const auto fanout = it != numConsumers.end() ? it->second : 0;
+    const auto planFragment = fanout > 1
+        ? broadcastToFanout(fragment, fanout)
+        : fragment.fragment;
+
     for (auto i = 0; i < fragment.width; ++i) {
       velox::exec::Consumer consumer = nullptr;
       auto task = velox::exec::Task::create(
           fmt::format(
               "local://{}/{}.{}",
-              params_.queryCtx->queryId(),
+              queryCtx_->queryId(),
               fragment.taskPrefix,
               i),
-          fragment.fragment,
+          planFragment,
           i,
-          params_.queryCtx,
+          queryCtx_,
           velox::exec::Task::ExecutionMode::kParallel,
           consumer,
           0,
           onError);
       stages_.back().push_back(task);
 
-      task->start(plan_->options().numDrivers);
+      if (auto directory = spillDirectory(fragment, i); !directory.empty()) {
+        task->setSpillDirectory(directory, false);
+      }
+      task->start(numDrivers(fragment));
+      if (fanout > 1) {
+        task->updateOutputBuffers(fanout, true);
+      }
     }
   }
 
   stages_.push_back({lastStageTask});
 
+  // Adds the output of the producers of 'fragment' as splits to 'tasks'.
+  auto addInputs =
+      [&](const ExecutableFragment& fragment,
+          const std::vector<std::shared_ptr<velox::exec::Task>>& tasks) {
+        for (const auto& input : fragment.inputStages) {
+          const auto [sourceStage, broadcast] =
+              stageMap[input.producerTaskPrefix];
+          const bool hasFanout = numConsumers.at(input.producerTaskPrefix) > 1;
+
+          if (input.ordered) {
+            VELOX_CHECK(
+                !hasFanout,
+                "Ordered input from a fragment with several consumers is not "
+                "supported: {}",
+                input.producerTaskPrefix);
+            VELOX_CHECK_EQ(tasks.size(), 1);
+            const auto& producers = stages_[sourceStage];
+            addSplitsInOrder(
+                tasks[0],
+                input.consumerNodeId,
+                std::make_shared<
+                    std::vector<std::weak_ptr<velox::exec::Task>>>(
+                    producers.begin(), producers.end()),
+                0);
+            continue;
+          }
+
+          std::vector<std::shared_ptr<velox::exec::RemoteConnectorSplit>>
+              sourceSplits;
+          if (hasFanout) {
+            auto fanoutTask = makeFanoutTask(
+                fragments_[sourceStage],
+                stages_[sourceStage],
+                numFanouts[input.producerTaskPrefix]++,
+                fragment.width);
+            sourceSplits.push_back(remoteSplit(fanoutTask->taskId()));
+          } else {
+            for (const auto& task : stages_[sourceStage]) {
+              sourceSplits.push_back(remoteSplit(task->taskId()));
+
+              if (broadcast) {
+                task->updateOutputBuffers(fragment.width, true);
+              }
+            }
+          }
+
+          for (auto& task : tasks) {
+            for (const auto& remote : sourceSplits) {
+              task->addSplit(input.consumerNodeId, velox::exec::Split(remote));
+            }
+            task->noMoreSplits(input.consumerNodeId);
+          }
+        }
+      };
+
+  // The source of each dynamic filter. The filters pass all keys until their
+  // source sets them.
+  folly::F14FastMap<const DynamicFilter*, int32_t> filterSourceIndex;
+  for (auto i = 0; i < filterSources.size(); ++i) {
+    for (const auto& key : filterSources[i].keys) {
+      key.filter->clear();
+      filterSourceIndex[key.filter.get()] = i;
+    }
+  }
+  scansBySource_.resize(filterSources.size());
+
   for (auto fragmentIndex = 0; fragmentIndex < fragments_.size();
        ++fragmentIndex) {
     const auto& fragment = fragments_[fragmentIndex];
@@ -325,80 +1128,285 @@ void LocalRunner::makeStages(
     std::vector<velox::core::TableScanNodePtr> scans;
     gatherScans(fragment.fragment.planNode, scans);
 
-    for (const auto& scan : scans) {
-      auto source = splitSourceForScan(*scan);
+    ScanFilters scanFilters;
+    if (!filterSources.empty()) {
+      gatherDynamicFilterScans(fragment.fragment.planNode, scanFilters);
+    }
 
-      std::vector<connector::SplitSource::SplitAndGroup> splits;
-      int32_t splitIdx = 0;
-      auto getNextSplit = [&]() {
-        if (splitIdx < splits.size()) {
-          return velox::exec::Split(std::move(splits[splitIdx++].split));
-        }
-        splits = source->getSplits(std::numeric_limits<int64_t>::max());
-        splitIdx = 1;
-        return velox::exec::Split(std::move(splits[0].split));
-      };
+    for (const auto& scan : scans) {
+      auto it = scanFilters.find(scan->id());
+      if (it == scanFilters.end()) {
+        addScanSplits(fragment, stage, scan);
+        continue;
+      }
 
-      // Distribute splits across tasks using round-robin.
-      bool allDone = false;
-      do {
-        for (auto& task : stage) {
-          auto split = getNextSplit();
-          if (!split.hasConnectorSplit()) {
-            allDone = true;
-            break;
-          }
-          task->addSplit(scan->id(), std::move(split));
-        }
-      } while (!allDone);
+      folly::F14FastSet<int32_t> sources;
+      for (const auto* filter : it->second) {
+        auto sourceIt = filterSourceIndex.find(filter);
+        VELOX_CHECK(
+            sourceIt != filterSourceIndex.end(),
+            "No source for dynamic filter {}",
+            filter->id());
+        sources.insert(sourceIt->second);
+      }
 
-      for (auto& task : stage) {
-        task->noMoreSplits(scan->id());
+      std::lock_guard<std::mutex> l(mutex_);
+      for (auto source : sources) {
+        scansBySource_[source].push_back(filteredScans_.size());
       }
+      filteredScans_.push_back(
+          {.fragmentIndex = fragmentIndex,
+           .scan = scan,
+           .numPending = static_cast<int32_t>(sources.size())});
     }
 
-    for (const auto& input : fragment.inputStages) {
-      const auto [sourceStage, broadcast] = stageMap[input.producerTaskPrefix];
+    addInputs(fragment, stage);
+  }
 
-      std::vector<std::shared_ptr<velox::exec::RemoteConnectorSplit>>
-          sourceSplits;
-      for (const auto& task : stages_[sourceStage]) {
-        sourceSplits.push_back(remoteSplit(task->taskId()));
+  for (auto i = 0; i < filterSources.size(); ++i) {
+    addInputs(filterSources[i].fragment, {makeDynamicFilterTask(i)});
+  }
+}
 
-        if (broadcast) {
-          task->updateOutputBuffers(fragment.width, true);
+std::shared_ptr<velox::exec::Task> LocalRunner::makeDynamicFilterTask(
+    int32_t sourceIndex) {
+  const auto& fragment = plan_->dynamicFilters()[sourceIndex].fragment;
+
+  // The task has one driver. Its output is copied because the producing
+  // operators may reuse their output vectors.
+  VELOX_CHECK_EQ(fragment.numDrivers, 1);
+  auto batches = std::make_shared<std::vector<velox::RowVectorPtr>>();
+  auto consumer = [batches, pool = outputPool_](
+                      velox::RowVectorPtr batch,
+                      bool drained,
+                      velox::ContinueFuture* /*future*/) {
+    if (batch != nullptr && !drained) {
+      auto copy = velox::BaseVector::create<velox::RowVector>(
+          batch->type(), batch->size(), pool.get());
+      copy->copy(batch.get(), 0, 0, batch->size());
+      batches->push_back(std::move(copy));
+    }
+    return velox::exec::BlockingReason::kNotBlocked;
+  };
+
+  auto task = velox::exec::Task::create(
+      fmt::format("local://{}/{}.0", queryCtx_->queryId(), fragment.taskPrefix),
+      fragment.fragment,
+      0,
+      queryCtx_,
+      velox::exec::Task::ExecutionMode::kParallel,
+      std::move(consumer),
+      0,
+      [self = shared_from_this()](std::exception_ptr error) {
+        self->setError(std::move(error));
+      });
+  filterTasks_.push_back(task);
+
+  // All output has been passed to the consumer when the task completes. A
+  // task that fails fails the query, whose scans then wait no more.
+  task->taskCompletionFuture()
+      .via(queryCtx_->executor())
+      .thenValue([weakSelf = weak_from_this(),
+                  weakTask = std::weak_ptr(task),
+                  sourceIndex,
+                  batches](auto&&) {
+        auto self = weakSelf.lock();
+        auto task = weakTask.lock();
+        if (self == nullptr || task == nullptr ||
+            task->state() != velox::exec::TaskState::kFinished) {
+          return;
+        }
+        try {
+          self->setDynamicFilters(
+              self->plan_->dynamicFilters()[sourceIndex], *batches);
+          self->addFilteredScanSplits(sourceIndex);
+        } catch (const std::exception&) {
+          self->setError(std::current_exception());
         }
+      });
+
+  task->start(1);
+  return task;
+}
+
+void LocalRunner::setDynamicFilters(
+    const DynamicFilterSource& source,
+    const std::vector<velox::RowVectorPtr>& batches) {
+  if (source.bloom) {
+    int64_t numRows = 0;
+    for (const auto& batch : batches) {
+      numRows += batch->size();
+    }
+
+    for (auto i = 0; i < source.keys.size(); ++i) {
+      auto bloom = std::make_shared<KeyBloomFilter>(
+          static_cast<int32_t>(std::min<int64_t>(
+              numRows, std::numeric_limits<int32_t>::max())));
+      for (const auto& batch : batches) {
+        bloom->insert(*batch->childAt(i));
       }
+      // The scan tests the range of the keys, the Bloom filter the rest.
+      auto range = bloom->range();
+      source.keys[i].filter->set(std::move(range), std::move(bloom));
+    }
+    return;
+  }
 
-      for (auto& task : stage) {
-        for (const auto& remote : sourceSplits) {
-          task->addSplit(input.consumerNodeId, velox::exec::Split(remote));
-        }
-        task->noMoreSplits(input.consumerNodeId);
+  // A global aggregation produces one row.
+  velox::RowVectorPtr result;
+  for (const auto& batch : batches) {
+    if (batch->size() > 0) {
+      result = batch;
+    }
+  }
+  if (result == nullptr || result->size() != 1) {
+    return;
+  }
+
+  velox::column_index_t channel = 0;
+  for (const auto& key : source.keys) {
+    const auto& min = result->childAt(channel++);
+    const auto& max = result->childAt(channel++);
+    const auto* values =
+        key.hasValues ? result->childAt(channel++).get() : nullptr;
+    if (auto filter = makeDynamicFilter(*min, *max, values, 0)) {
+      key.filter->set(std::move(filter));
+    }
+  }
+}
+
+void LocalRunner::addFilteredScanSplits(int32_t sourceIndex) {
+  std::vector<int32_t> ready;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    for (auto index : scansBySource_[sourceIndex]) {
+      if (--filteredScans_[index].numPending == 0) {
+        ready.push_back(index);
       }
     }
   }
+
+  for (auto index : ready) {
+    const auto& filtered = filteredScans_[index];
+    addScanSplits(
+        fragments_[filtered.fragmentIndex],
+        stages_[filtered.fragmentIndex],
+        filtered.scan);
+  }
+}
+
+void LocalRunner::addScanSplits(
+    const ExecutableFragment& fragment,
+    const std::vector<std::shared_ptr<velox::exec::Task>>& tasks,
+    const velox::core::TableScanNodePtr& scan) {
+  auto limitIt = fragment.scanLimits.find(scan->id());
+  if (limitIt != fragment.scanLimits.end()) {
+    auto limitedScan = std::make_shared<LimitedScan>(LimitedScan{
+        .tasks = {tasks.begin(), tasks.end()},
+        .nodeId = scan->id(),
+        .source = splitSourceForScan(*scan, limitIt->second),
+        .maxRows = limitIt->second,
+        .numAdded = std::vector<int64_t>(tasks.size(), 0),
+        .onError =
+            [weakSelf = weak_from_this()](std::exception_ptr error) {
+              if (auto self = weakSelf.lock()) {
+                self->setError(std::move(error));
+              }
+            }});
+    addLimitedScanSplits(limitedScan, queryCtx_->executor());
+    return;
+  }
+
+  auto source = splitSourceForScan(*scan, std::nullopt);
+
+  std::vector<connector::SplitSource::SplitAndGroup> splits;
+  int32_t splitIdx = 0;
+  auto getNextSplit = [&]() {
+    if (splitIdx < splits.size()) {
+      return velox::exec::Split(std::move(splits[splitIdx++].split));
+    }
+    splits = source->getSplits(std::numeric_limits<int64_t>::max());
+    splitIdx = 1;
+    return velox::exec::Split(std::move(splits[0].split));
+  };
+
+  SplitAssigner assigner(
+      tasks.size(),
+      plan_->options().splitAffinity,
+      plan_->options().maxAffinitySkew);
+  for (;;) {
+    auto split = getNextSplit();
+    if (!split.hasConnectorSplit()) {
+      break;
+    }
+    const auto taskIndex = assigner.assign(*split.connectorSplit);
+    tasks[taskIndex]->addSplit(scan->id(), std::move(split));
+  }
+
+  for (auto& task : tasks) {
+    task->noMoreSplits(scan->id());
+  }
+}
+
+std::shared_ptr<velox::exec::Task> LocalRunner::makeFanoutTask(
+    const ExecutableFragment& producer,
+    const std::vector<std::shared_ptr<velox::exec::Task>>& producerTasks,
+    int32_t destination,
+    int32_t consumerWidth) {
+  auto onError = [self = shared_from_this()](std::exception_ptr error) {
+    self->setError(std::move(error));
+  };
+
+  auto planFragment = fanoutPlan(producer, consumerWidth);
+  const auto exchangeId = planFragment.planNode->sources()[0]->id();
+
+  velox::exec::Consumer consumer = nullptr;
+  auto task = velox::exec::Task::create(
+      fmt::format(
+          "local://{}/{}.fanout{}",
+          queryCtx_->queryId(),
+          producer.taskPrefix,
+          destination),
+      std::move(planFragment),
+      destination,
+      queryCtx_,
+      velox::exec::Task::ExecutionMode::kParallel,
+      consumer,
+      0,
+      onError);
+  fanoutTasks_.push_back(task);
+  task->start(1);
+
+  if (outputNode(producer).kind() ==
+      velox::core::PartitionedOutputNode::Kind::kBroadcast) {
+    task->updateOutputBuffers(consumerWidth, true);
+  }
+  for (const auto& producerTask : producerTasks) {
+    task->addSplit(
+        exchangeId, velox::exec::Split(remoteSplit(producerTask->taskId())));
+  }
+  task->noMoreSplits(exchangeId);
+  return task;
 }
 
 std::vector<velox::exec::TaskStats> LocalRunner::stats() const {
   std::vector<velox::exec::TaskStats> result;
   std::lock_guard<std::mutex> l(mutex_);
   for (const auto& tasks : stages_) {
-    VELOX_CHECK(!tasks.empty());
-
-    auto stats = tasks[0]->taskStats();
-    for (auto i = 1; i < tasks.size(); ++i) {
-      const auto moreStats = tasks[i]->taskStats();
-      for (auto pipeline = 0; pipeline < stats.pipelineStats.size();
-           ++pipeline) {
-        auto& pipelineStats = stats.pipelineStats[pipeline];
-        for (auto op = 0; op < pipelineStats.operatorStats.size(); ++op) {
-          pipelineStats.operatorStats[op].add(
-              moreStats.pipelineStats[pipeline].operatorStats[op]);
-        }
-      }
+    result.push_back(aggregateStats(tasks));
+  }
+  return result;
+}
+
+std::vector<std::vector<velox::exec::TaskStats>> LocalRunner::taskStats()
+    const {
+  std::vector<std::vector<velox::exec::TaskStats>> result;
+  std::lock_guard<std::mutex> l(mutex_);
+  for (const auto& tasks : stages_) {
+    auto& stageStats = result.emplace_back();
+    for (const auto& task : tasks) {
+      stageStats.push_back(task->taskStats());
     }
-    result.push_back(std::move(stats));
   }
   return result;
 }
@@ -417,22 +1425,46 @@ std::string LocalRunner::printPlanWithStats(
 
   const auto taskStats = stats();
   folly::F14FastMap<velox::core::PlanNodeId, std::string> planNodeStats;
+  folly::F14FastMap<velox::core::PlanNodeId, ScanCacheStats> scanCacheStats;
+  ScanCacheStats queryCacheStats;
   for (const auto& stats : taskStats) {
     auto planStats = velox::exec::toPlanStats(stats);
     for (const auto& [id, nodeStats] : planStats) {
       planNodeStats[id] = nodeStats.toString(leafNodeIds.contains(id));
     }
+
+    for (const auto& pipelineStats : stats.pipelineStats) {
+      for (const auto& operatorStats : pipelineStats.operatorStats) {
+        if (operatorStats.operatorType == "TableScan") {
+          scanCacheStats[operatorStats.planNodeId].add(operatorStats);
+          queryCacheStats.add(operatorStats);
+        }
+      }
+    }
   }
 
-  return plan_->toString(
+  auto result = plan_->toString(
       true, [&](const auto& planNodeId, const auto& indentation, auto& out) {
-        addContext(planNodeId, indentation, out);
+        if (addContext) {
+          addContext(planNodeId, indentation, out);
+        }
 
         auto statsIt = planNodeStats.find(planNodeId);
         if (statsIt != planNodeStats.end()) {
           out << indentation << statsIt->second << std::endl;
         }
+
+        auto cacheIt = scanCacheStats.find(planNodeId);
+        if (cacheIt != scanCacheStats.end() &&
+            cacheIt->second.totalBytes() > 0) {
+          out << indentation << cacheIt->second.toString() << std::endl;
+        }
       });
+
+  if (queryCacheStats.totalBytes() > 0) {
+    result += fmt::format("Query {}\n", queryCacheStats.toString());
+  }
+  return result;
 }
 
 } // namespace facebook::axiom::runner
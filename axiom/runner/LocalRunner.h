@@ -18,9 +18,10 @@
 
 #include "axiom/connectors/ConnectorSplitManager.h"
 #include "axiom/runner/MultiFragmentPlan.h"
+#include "axiom/runner/QueryScheduler.h"
 #include "axiom/runner/Runner.h"
 #include "velox/connectors/Connector.h"
-#include "velox/exec/Cursor.h"
+#include "velox/exec/Task.h"
 
 namespace facebook::axiom::runner {
 
@@ -32,9 +33,11 @@ class SplitSourceFactory {
 
   /// Returns a splitSource for one TableScan across all Tasks of
   /// the fragment. The source will be invoked to produce splits for
-  /// each individual worker running the scan.
+  /// each individual worker running the scan. 'maxRows' is the number of rows
+  /// the scan needs if it is under a limit.
   virtual std::shared_ptr<connector::SplitSource> splitSourceForScan(
-      const velox::core::TableScanNode& scan) = 0;
+      const velox::core::TableScanNode& scan,
+      std::optional<int64_t> maxRows) = 0;
 };
 
 class SimpleSplitSourceFactory : public SplitSourceFactory {
@@ -47,7 +50,8 @@ class SimpleSplitSourceFactory : public SplitSourceFactory {
       : nodeSplitMap_(std::move(nodeSplitMap)) {}
 
   std::shared_ptr<connector::SplitSource> splitSourceForScan(
-      const velox::core::TableScanNode& scan) override;
+      const velox::core::TableScanNode& scan,
+      std::optional<int64_t> maxRows) override;
 
  private:
   folly::F14FastMap<
@@ -63,12 +67,35 @@ class ConnectorSplitSourceFactory : public SplitSourceFactory {
       : options_(std::move(options)) {}
 
   std::shared_ptr<connector::SplitSource> splitSourceForScan(
-      const velox::core::TableScanNode& scan) override;
+      const velox::core::TableScanNode& scan,
+      std::optional<int64_t> maxRows) override;
 
  protected:
   const connector::SplitOptions options_;
 };
 
+/// Assigns the splits of one scan to the tasks of a stage. A split with cache
+/// affinity goes to the task picked by a consistent hash of its file and
+/// offset unless that task already has 'maxSkew' more splits than the average,
+/// in which case the split goes to the task with the fewest splits. Splits
+/// without affinity are assigned round-robin.
+class SplitAssigner {
+ public:
+  SplitAssigner(int32_t numTasks, bool affinity, int32_t maxSkew);
+
+  /// Returns the index of the task for 'split'.
+  int32_t assign(const velox::connector::ConnectorSplit& split);
+
+ private:
+  std::vector<int64_t> numSplits_;
+  const bool affinity_;
+  const int32_t maxSkew_;
+  int64_t totalSplits_{0};
+  int32_t roundRobin_{0};
+};
+
+class ResultQueue;
+
 /// Runner for in-process execution of a distributed plan.
 class LocalRunner : public Runner,
                     public std::enable_shared_from_this<LocalRunner> {
@@ -87,8 +114,21 @@ class LocalRunner : public Runner,
             std::move(queryCtx),
             std::make_shared<ConnectorSplitSourceFactory>()) {}
 
-  /// First call starts execution.
-  velox::RowVectorPtr next() override;
+  /// First call starts execution. The returned future is fulfilled from a
+  /// thread of the query's executor when the last stage produces a batch. No
+  /// thread is blocked while waiting.
+  folly::SemiFuture<velox::RowVectorPtr> nextAsync() override;
+
+  void setCompletionCallback(CompletionCallback callback) override;
+
+  /// Makes the query wait for admission by 'scheduler' before starting. The
+  /// query requests the predicted memory of its fragments and the drivers of
+  /// all its tasks. The resources are released when the query completes. Must
+  /// be called before the first nextAsync().
+  void setScheduler(
+      std::shared_ptr<QueryScheduler> scheduler,
+      int32_t priority = 0,
+      std::string group = "");
 
   /// Returns a list of fragments from the 'plan' specified in constructor
   /// sorted in topological order.
@@ -107,9 +147,15 @@ class LocalRunner : public Runner,
   /// tasks are aggregated together.
   std::vector<velox::exec::TaskStats> stats() const override;
 
+  /// Returns the runtime stats of each task of each fragment in
+  /// 'fragments()'. Must be called before waitForCompletion().
+  std::vector<std::vector<velox::exec::TaskStats>> taskStats() const;
+
   /// Prints the distributed plan annotated with runtime stats. Similar to
   /// velox::exec::printPlanWithStats and velox::exec::Task::printPlanWithStats
-  /// APIs.
+  /// APIs. Table scans are annotated with the fraction of bytes served from
+  /// the memory and SSD caches. The totals for the query are appended at the
+  /// end.
   /// @param addContext Optional lambda to add context to plan nodes. Receives
   /// plan node ID, indentation and std::ostream where to append the context.
   /// Start each line of context with 'indentation' and end with a new-line
@@ -132,25 +178,125 @@ class LocalRunner : public Runner,
  private:
   void start();
 
+  // Starts execution and returns the first batch.
+  folly::SemiFuture<velox::RowVectorPtr> startAndNextBatch();
+
+  // Makes the Task for the fragment of the dynamic filter source at
+  // 'sourceIndex' in 'plan_'. When the Task finishes, sets the filters and
+  // adds the splits of the scans that wait for them.
+  std::shared_ptr<velox::exec::Task> makeDynamicFilterTask(
+      int32_t sourceIndex);
+
+  // Sets the filters of 'source' from 'batches', the output of its fragment.
+  void setDynamicFilters(
+      const DynamicFilterSource& source,
+      const std::vector<velox::RowVectorPtr>& batches);
+
+  // Adds the splits of the scans that wait for no other dynamic filter source
+  // than the one at 'sourceIndex'.
+  void addFilteredScanSplits(int32_t sourceIndex);
+
+  folly::SemiFuture<velox::RowVectorPtr> nextBatch();
+
+  QueryScheduler::Request schedulerRequest() const;
+
+  // Makes the Task for the last fragment. Its output is added to 'results'.
+  std::shared_ptr<velox::exec::Task> makeLastStageTask(
+      const std::shared_ptr<ResultQueue>& results);
+
   void makeStages(const std::shared_ptr<velox::exec::Task>& lastStageTask);
 
+  // Adds the splits of 'scan' to 'tasks', which run 'fragment'.
+  void addScanSplits(
+      const ExecutableFragment& fragment,
+      const std::vector<std::shared_ptr<velox::exec::Task>>& tasks,
+      const velox::core::TableScanNodePtr& scan);
+
+  // Makes a Task that reads the output of 'producerTasks' from buffer
+  // 'destination' and partitions it for a consumer of 'producer' with
+  // 'consumerWidth' tasks. Used for fragments with several consumers.
+  std::shared_ptr<velox::exec::Task> makeFanoutTask(
+      const ExecutableFragment& producer,
+      const std::vector<std::shared_ptr<velox::exec::Task>>& producerTasks,
+      int32_t destination,
+      int32_t consumerWidth);
+
+  // Records the first error of any Task and aborts the execution.
+  void setError(std::exception_ptr error);
+
+  // Sets the state to kFinished when the last stage has produced all its
+  // output.
+  void finish();
+
+  // Calls and clears 'completionCallback_' if set.
+  void notifyCompletion();
+
   std::shared_ptr<connector::SplitSource> splitSourceForScan(
-      const velox::core::TableScanNode& scan);
+      const velox::core::TableScanNode& scan,
+      std::optional<int64_t> maxRows);
 
-  // Serializes 'cursor_' and 'error_'.
+  // Returns the number of drivers for each task of 'fragment'.
+  int32_t numDrivers(const ExecutableFragment& fragment) const;
+
+  // Returns the spill directory for task 'worker' of 'fragment' or an empty
+  // string if the fragment does not spill. Velox spills only if the query
+  // config also enables spilling.
+  std::string spillDirectory(
+      const ExecutableFragment& fragment,
+      int32_t worker) const;
+
+  // Serializes 'results_', 'error_', 'completionCallback_', 'waiterId_',
+  // 'admission_' and 'filteredScans_'.
   mutable std::mutex mutex_;
 
   const MultiFragmentPlanPtr plan_;
   const std::vector<ExecutableFragment> fragments_;
 
-  velox::exec::CursorParameters params_;
+  const std::shared_ptr<velox::core::QueryCtx> queryCtx_;
+
+  // Pool for the results. Defaults to a child of the QueryCtx pool.
+  std::shared_ptr<velox::memory::MemoryPool> outputPool_;
 
   velox::tsan_atomic<State> state_{State::kInitialized};
 
-  std::unique_ptr<velox::exec::TaskCursor> cursor_;
+  // Batches produced by the last stage and not yet returned by nextAsync().
+  std::shared_ptr<ResultQueue> results_;
   std::vector<std::vector<std::shared_ptr<velox::exec::Task>>> stages_;
+
+  // Tasks that fan out the output of fragments with several consumers.
+  std::vector<std::shared_ptr<velox::exec::Task>> fanoutTasks_;
   std::exception_ptr error_;
   std::shared_ptr<SplitSourceFactory> splitSourceFactory_;
+  CompletionCallback completionCallback_;
+
+  std::shared_ptr<QueryScheduler> scheduler_;
+  int32_t schedulerPriority_{0};
+  std::string schedulerGroup_;
+
+  // Id of the request in the queue of 'scheduler_' while waiting for
+  // admission.
+  std::optional<QueryScheduler::WaiterId> waiterId_;
+
+  // Resources reserved from 'scheduler_' while the query runs.
+  std::unique_ptr<QueryScheduler::Admission> admission_;
+
+  // Tasks that compute the dynamic filters of 'plan_'.
+  std::vector<std::shared_ptr<velox::exec::Task>> filterTasks_;
+
+  // A scan under a DynamicFilterNode. Its splits are added when its filters
+  // are set so that the filters apply to all its rows.
+  struct FilteredScan {
+    int32_t fragmentIndex;
+    velox::core::TableScanNodePtr scan;
+
+    // Number of dynamic filter sources that have not set its filters.
+    int32_t numPending;
+  };
+
+  std::vector<FilteredScan> filteredScans_;
+
+  // Indices into 'filteredScans_' for each of 'plan_->dynamicFilters()'.
+  std::vector<std::vector<int32_t>> scansBySource_;
 };
 
 } // namespace facebook::axiom::runner
@@ -15,9 +15,27 @@
  */
 
 #include "axiom/runner/MultiFragmentPlan.h"
+#include <folly/String.h>
 
 namespace facebook::axiom::runner {
 
+namespace {
+std::string fragmentHeader(int32_t index, const ExecutableFragment& fragment) {
+  auto header = fmt::format(
+      "Fragment {}: {} numWorkers={}",
+      index,
+      fragment.taskPrefix,
+      fragment.width);
+  if (fragment.numDrivers > 0) {
+    header += fmt::format(" numDrivers={}", fragment.numDrivers);
+  }
+  if (fragment.canSpill) {
+    header += " canSpill";
+  }
+  return header + ":";
+}
+} // namespace
+
 std::string MultiFragmentPlan::toString(
     bool detailed,
     const std::function<void(
@@ -32,38 +50,56 @@ std::string MultiFragmentPlan::toString(
 
   // Map plan node to the index of the input fragment.
   folly::F14FastMap<velox::core::PlanNodeId, int32_t> planNodeToIndex;
-  for (const auto& fragment : fragments_) {
+  auto addInputs = [&](const ExecutableFragment& fragment) {
     for (const auto& input : fragment.inputStages) {
       planNodeToIndex[input.consumerNodeId] =
           taskPrefixToIndex[input.producerTaskPrefix];
     }
+  };
+  for (const auto& fragment : fragments_) {
+    addInputs(fragment);
+  }
+  for (const auto& source : dynamicFilters_) {
+    addInputs(source.fragment);
   }
 
+  auto addNodeContext = [&](const velox::core::PlanNodeId& planNodeId,
+                            std::string_view indentation,
+                            std::ostream& stream) {
+    if (addContext != nullptr) {
+      addContext(planNodeId, indentation, stream);
+    }
+    auto it = planNodeToIndex.find(planNodeId);
+    if (it != planNodeToIndex.end()) {
+      stream << indentation << "Input Fragment " << it->second << std::endl;
+    }
+  };
+
   std::stringstream out;
   for (auto i = 0; i < fragments_.size(); ++i) {
     const auto& fragment = fragments_[i];
-    out << fmt::format(
-               "Fragment {}: {} numWorkers={}:",
-               i,
-               fragment.taskPrefix,
-               fragment.width)
-        << std::endl;
+    out << fragmentHeader(i, fragment) << std::endl;
 
     out << fragment.fragment.planNode->toString(
-               detailed,
-               true,
-               [&](const velox::core::PlanNodeId& planNodeId,
-                   std::string_view indentation,
-                   std::ostream& stream) {
-                 if (addContext != nullptr) {
-                   addContext(planNodeId, indentation, stream);
-                 }
-                 auto it = planNodeToIndex.find(planNodeId);
-                 if (it != planNodeToIndex.end()) {
-                   stream << indentation << "Input Fragment " << it->second
-                          << std::endl;
-                 }
-               })
+               detailed, true, addNodeContext)
+        << std::endl;
+  }
+
+  for (auto i = 0; i < dynamicFilters_.size(); ++i) {
+    const auto& source = dynamicFilters_[i];
+    std::vector<std::string> ids;
+    for (const auto& key : source.keys) {
+      ids.push_back(key.filter->id());
+    }
+    out << fmt::format(
+               "Dynamic filter source {}: {} {}{}:",
+               i,
+               source.fragment.taskPrefix,
+               folly::join(", ", ids),
+               source.bloom ? " (bloom)" : "")
+        << std::endl
+        << source.fragment.fragment.planNode->toString(
+               detailed, true, addNodeContext)
         << std::endl;
   }
   return out.str();
@@ -74,18 +110,16 @@ std::string MultiFragmentPlan::toSummaryString(
   std::stringstream out;
   for (auto i = 0; i < fragments_.size(); ++i) {
     const auto& fragment = fragments_[i];
-    out << fmt::format(
-               "Fragment {}: {} numWorkers={}:",
-               i,
-               fragment.taskPrefix,
-               fragment.width)
-        << std::endl;
+    out << fragmentHeader(i, fragment) << std::endl;
     out << fragment.fragment.planNode->toSummaryString(options) << std::endl;
     if (!fragment.inputStages.empty()) {
       out << "Inputs: ";
       for (const auto& input : fragment.inputStages) {
         out << fmt::format(
-            " {} <- {} ", input.consumerNodeId, input.producerTaskPrefix);
+            " {} <- {}{} ",
+            input.consumerNodeId,
+            input.producerTaskPrefix,
+            input.ordered ? " (ordered)" : "");
       }
       out << std::endl;
     }
@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <folly/container/F14Map.h>
+#include "axiom/runner/DynamicFilter.h"
 #include "velox/core/PlanFragment.h"
 
 namespace facebook::axiom::runner {
@@ -27,6 +29,12 @@ struct InputStage {
 
   /// Task prefix of producer stage.
   std::string producerTaskPrefix;
+
+  /// True if the consumer reads the output of the producer tasks one after
+  /// the other in the order of the task numbers. This concatenates ordered
+  /// ranges produced by different tasks. The consumer must have one task and
+  /// one driver.
+  bool ordered{false};
 };
 
 /// Describes a fragment of a distributed plan. This allows a run
@@ -47,18 +55,58 @@ struct ExecutableFragment {
 
   int32_t width{0};
 
+  /// Number of drivers per task. 0 means the 'numDrivers' of
+  /// MultiFragmentPlan::Options.
+  int32_t numDrivers{0};
+
+  /// True if the tasks of 'this' may spill hash tables and sort buffers to
+  /// disk. Set for fragments whose predicted memory does not fit in
+  /// 'queryMemoryBudget' of MultiFragmentPlan::Options.
+  bool canSpill{false};
+
+  /// Predicted peak memory of the hash tables and sort buffers of all tasks of
+  /// 'this', in bytes.
+  int64_t predictedMemory{0};
+
   velox::core::PlanFragment fragment;
 
   /// Source fragments and Exchange node ids for remote shuffles producing input
   /// for 'this'.
   std::vector<InputStage> inputStages;
+
+  /// Number of rows needed from a TableScan of 'this' under a limit, by the id
+  /// of the TableScanNode. Splits are added to the scan only until its tasks
+  /// have produced this many rows.
+  folly::F14FastMap<velox::core::PlanNodeId, int64_t> scanLimits;
+};
+
+/// Computes dynamic filters on join keys from the build side of a hash join.
+/// 'fragment' reads the output of the fragment that produces the build side,
+/// which also sends it to the join. It produces a single row with min(k),
+/// max(k) and, if 'hasValues', an array of the distinct values of k for each
+/// key k, in the order of 'keys'. If 'bloom' is true, 'fragment' instead
+/// produces the distinct build keys, one column per key. The runner sets
+/// 'filter' of each key when 'fragment' finishes and only then adds splits to
+/// the scans under the DynamicFilterNodes that test it.
+struct DynamicFilterSource {
+  struct Key {
+    DynamicFilterPtr filter;
+    bool hasValues{false};
+  };
+
+  ExecutableFragment fragment;
+  std::vector<Key> keys;
+  bool bloom{false};
 };
 
 /// Describes a distributed plan handed to a Runner for parallel/distributed
 /// execution. The last element of 'fragments' is by convention the stage that
 /// gathers the query result. Otherwise the order of 'fragments' is not
 /// important since the producer-consumer relations are given by 'inputStages'
-/// in each fragment.
+/// in each fragment. A fragment may be the producer of several InputStages,
+/// e.g. a subquery used twice. Each consumer then gets the output as if it
+/// were the only consumer, partitioned by the PartitionedOutputNode of the
+/// producer for the width of the consumer. Such inputs cannot be 'ordered'.
 class MultiFragmentPlan {
  public:
   /// Describes options for running a MultiFragmentPlan.
@@ -73,15 +121,44 @@ class MultiFragmentPlan {
     /// Number of threads in a fragment in a worker. If 1, there are no local
     /// exchanges.
     int32_t numDrivers{4};
+
+    /// If true, scan splits are assigned to tasks by a consistent hash of the
+    /// file and offset they read. Repeated queries then read the same data on
+    /// the same worker and hit its memory and SSD cache. If false, splits are
+    /// assigned round-robin.
+    bool splitAffinity{true};
+
+    /// Number of splits a task may be assigned above the average of its stage
+    /// before splits with affinity to the task go to the least loaded task.
+    int32_t maxAffinitySkew{2};
+
+    /// Memory the query is expected to fit in, in bytes. Fragments are
+    /// allowed to spill, largest predicted memory first, until the rest fit.
+    /// 0 means no budget and no spilling.
+    int64_t queryMemoryBudget{0};
+
+    /// Directory for spill files of fragments with 'canSpill'. Spilling is
+    /// disabled if empty.
+    std::string spillDirectory;
   };
 
-  MultiFragmentPlan(std::vector<ExecutableFragment> fragments, Options options)
-      : fragments_(std::move(fragments)), options_(std::move(options)) {}
+  MultiFragmentPlan(
+      std::vector<ExecutableFragment> fragments,
+      Options options,
+      std::vector<DynamicFilterSource> dynamicFilters = {})
+      : fragments_(std::move(fragments)),
+        options_(std::move(options)),
+        dynamicFilters_(std::move(dynamicFilters)) {}
 
   const std::vector<ExecutableFragment>& fragments() const {
     return fragments_;
   }
 
+  /// Dynamic filters computed while 'fragments' run.
+  const std::vector<DynamicFilterSource>& dynamicFilters() const {
+    return dynamicFilters_;
+  }
+
   const Options& options() const {
     return options_;
   }
@@ -106,6 +183,7 @@ class MultiFragmentPlan {
  private:
   const std::vector<ExecutableFragment> fragments_;
   const Options options_;
+  const std::vector<DynamicFilterSource> dynamicFilters_;
 };
 
 using MultiFragmentPlanPtr = std::shared_ptr<const MultiFragmentPlan>;
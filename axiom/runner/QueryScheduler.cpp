@@ -0,0 +1,182 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "axiom/runner/QueryScheduler.h"
+#include "velox/common/base/Exceptions.h"
+
+namespace facebook::axiom::runner {
+
+folly::SemiFuture<std::unique_ptr<QueryScheduler::Admission>>
+QueryScheduler::admit(Request request, WaiterId* id) {
+  VELOX_CHECK_GE(request.memoryBytes, 0);
+  VELOX_CHECK_GT(request.numDrivers, 0);
+
+  std::vector<Waiter> admitted;
+  folly::SemiFuture<std::unique_ptr<Admission>> future;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    auto& queue = waiters_[request.priority][request.group];
+    queue.push_back(Waiter{.request = std::move(request), .id = nextId_++});
+    future = queue.back().promise.getSemiFuture();
+    if (id != nullptr) {
+      *id = queue.back().id;
+    }
+    ++numQueued_;
+    admitWaiters(admitted);
+  }
+  fulfill(admitted);
+  return future;
+}
+
+void QueryScheduler::cancel(WaiterId id, std::exception_ptr error) {
+  std::optional<Waiter> cancelled;
+  std::vector<Waiter> admitted;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    for (auto priorityIt = waiters_.begin();
+         priorityIt != waiters_.end() && !cancelled.has_value();
+         ++priorityIt) {
+      auto& groups = priorityIt->second;
+      for (auto groupIt = groups.begin(); groupIt != groups.end(); ++groupIt) {
+        auto& queue = groupIt->second;
+        auto it = std::find_if(queue.begin(), queue.end(), [&](auto& waiter) {
+          return waiter.id == id;
+        });
+        if (it == queue.end()) {
+          continue;
+        }
+        cancelled = std::move(*it);
+        queue.erase(it);
+        --numQueued_;
+        if (queue.empty()) {
+          groups.erase(groupIt);
+          if (groups.empty()) {
+            waiters_.erase(priorityIt);
+          }
+        }
+        break;
+      }
+    }
+    if (!cancelled.has_value()) {
+      return;
+    }
+
+    // The cancelled query may have blocked the queries behind it.
+    admitWaiters(admitted);
+  }
+  cancelled->promise.setException(folly::exception_wrapper(error));
+  fulfill(admitted);
+}
+
+QueryScheduler::Stats QueryScheduler::stats() const {
+  std::lock_guard<std::mutex> l(mutex_);
+  return Stats{
+      .numRunning = numRunning_,
+      .numQueued = numQueued_,
+      .memoryBytes = memoryBytes_,
+      .numDrivers = numDrivers_};
+}
+
+bool QueryScheduler::fits(const Request& request) const {
+  if (numRunning_ == 0) {
+    return true;
+  }
+  if (options_.maxMemoryBytes > 0 &&
+      memoryBytes_ + request.memoryBytes > options_.maxMemoryBytes) {
+    return false;
+  }
+  if (options_.maxDrivers > 0 &&
+      numDrivers_ + request.numDrivers > options_.maxDrivers) {
+    return false;
+  }
+  return true;
+}
+
+std::deque<QueryScheduler::Waiter>* QueryScheduler::nextQueue() {
+  if (waiters_.empty()) {
+    return nullptr;
+  }
+
+  // Within the highest priority, picks the group with the fewest running
+  // drivers.
+  auto& groups = waiters_.begin()->second;
+  std::deque<Waiter>* best = nullptr;
+  int32_t bestDrivers = 0;
+  for (auto& [group, queue] : groups) {
+    VELOX_DCHECK(!queue.empty());
+    auto it = groupDrivers_.find(group);
+    const auto drivers = it == groupDrivers_.end() ? 0 : it->second;
+    if (best == nullptr || drivers < bestDrivers) {
+      best = &queue;
+      bestDrivers = drivers;
+    }
+  }
+  return best;
+}
+
+void QueryScheduler::admitWaiters(std::vector<Waiter>& admitted) {
+  while (auto* queue = nextQueue()) {
+    auto& request = queue->front().request;
+    if (!fits(request)) {
+      return;
+    }
+
+    ++numRunning_;
+    --numQueued_;
+    memoryBytes_ += request.memoryBytes;
+    numDrivers_ += request.numDrivers;
+    groupDrivers_[request.group] += request.numDrivers;
+
+    const auto priority = request.priority;
+    const auto group = request.group;
+    admitted.push_back(std::move(queue->front()));
+    queue->pop_front();
+    if (queue->empty()) {
+      auto& groups = waiters_[priority];
+      groups.erase(group);
+      if (groups.empty()) {
+        waiters_.erase(priority);
+      }
+    }
+  }
+}
+
+void QueryScheduler::fulfill(std::vector<Waiter>& admitted) {
+  for (auto& waiter : admitted) {
+    waiter.promise.setValue(
+        std::make_unique<Admission>(shared_from_this(), waiter.request));
+  }
+}
+
+void QueryScheduler::release(const Request& request) {
+  std::vector<Waiter> admitted;
+  {
+    std::lock_guard<std::mutex> l(mutex_);
+    --numRunning_;
+    memoryBytes_ -= request.memoryBytes;
+    numDrivers_ -= request.numDrivers;
+    auto it = groupDrivers_.find(request.group);
+    VELOX_CHECK(it != groupDrivers_.end());
+    it->second -= request.numDrivers;
+    if (it->second == 0) {
+      groupDrivers_.erase(it);
+    }
+    admitWaiters(admitted);
+  }
+  fulfill(admitted);
+}
+
+} // namespace facebook::axiom::runner
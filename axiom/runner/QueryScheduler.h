@@ -0,0 +1,157 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <folly/container/F14Map.h>
+#include <folly/futures/Future.h>
+#include <deque>
+#include <map>
+#include <mutex>
+
+namespace facebook::axiom::runner {
+
+/// Process-level admission control for queries sharing an executor and a
+/// memory pool. A query is admitted when its predicted memory and its drivers
+/// fit next to the queries already running. Waiting queries are ordered by
+/// priority. Among queries of the same priority, the group with the fewest
+/// running drivers goes first, so that groups, e.g. users or sessions, get a
+/// fair share. A query that does not fit blocks the queries behind it so that
+/// large queries are not starved by a stream of small ones.
+class QueryScheduler : public std::enable_shared_from_this<QueryScheduler> {
+ public:
+  struct Options {
+    /// Maximum total predicted memory of running queries, in bytes. 0 means
+    /// no limit.
+    int64_t maxMemoryBytes{0};
+
+    /// Maximum total number of drivers of running queries. 0 means no limit.
+    int32_t maxDrivers{0};
+  };
+
+  /// Resources and queueing attributes of a query.
+  struct Request {
+    /// Predicted peak memory of the query, in bytes.
+    int64_t memoryBytes{0};
+
+    /// Number of drivers over all tasks of the query.
+    int32_t numDrivers{1};
+
+    /// Queries with higher priority are admitted first.
+    int32_t priority{0};
+
+    /// Fair-share group of the query.
+    std::string group;
+  };
+
+  /// Reservation of the resources of an admitted query. Releases the
+  /// resources when destroyed.
+  class Admission {
+   public:
+    Admission(std::shared_ptr<QueryScheduler> scheduler, Request request)
+        : scheduler_(std::move(scheduler)), request_(std::move(request)) {}
+
+    ~Admission() {
+      scheduler_->release(request_);
+    }
+
+    Admission(const Admission&) = delete;
+    Admission& operator=(const Admission&) = delete;
+
+    const Request& request() const {
+      return request_;
+    }
+
+   private:
+    const std::shared_ptr<QueryScheduler> scheduler_;
+    const Request request_;
+  };
+
+  struct Stats {
+    int32_t numRunning{0};
+    int32_t numQueued{0};
+    int64_t memoryBytes{0};
+    int32_t numDrivers{0};
+  };
+
+  static std::shared_ptr<QueryScheduler> create(Options options) {
+    return std::shared_ptr<QueryScheduler>(new QueryScheduler(options));
+  }
+
+  /// Identifies a waiting request for cancel().
+  using WaiterId = uint64_t;
+
+  /// Returns a future that is fulfilled with an Admission when 'request' may
+  /// run. The resources are held until the Admission is destroyed. If 'id' is
+  /// given, it is set to an id for cancel().
+  folly::SemiFuture<std::unique_ptr<Admission>> admit(
+      Request request,
+      WaiterId* id = nullptr);
+
+  /// Removes the request 'id' from the queue and fails its future with
+  /// 'error'. Does nothing if the request has already been admitted.
+  void cancel(WaiterId id, std::exception_ptr error);
+
+  Stats stats() const;
+
+ private:
+  struct Waiter {
+    Request request;
+    folly::Promise<std::unique_ptr<Admission>> promise;
+    WaiterId id{0};
+  };
+
+  explicit QueryScheduler(Options options) : options_(options) {}
+
+  // Returns true if 'request' fits next to the running queries. A query that
+  // exceeds the limits by itself runs alone.
+  bool fits(const Request& request) const;
+
+  // Returns the waiting queue to admit from next or nullptr if none.
+  std::deque<Waiter>* nextQueue();
+
+  // Moves the waiters that fit to 'admitted' and reserves their resources.
+  void admitWaiters(std::vector<Waiter>& admitted);
+
+  // Fulfills the promises of 'admitted'. Called without holding 'mutex_'.
+  void fulfill(std::vector<Waiter>& admitted);
+
+  void release(const Request& request);
+
+  const Options options_;
+
+  mutable std::mutex mutex_;
+
+  // Waiting queries by priority, highest first, and group.
+  std::map<
+      int32_t,
+      folly::F14FastMap<std::string, std::deque<Waiter>>,
+      std::greater<>>
+      waiters_;
+
+  // Drivers of running queries per group.
+  folly::F14FastMap<std::string, int32_t> groupDrivers_;
+
+  // Id of the next waiter.
+  WaiterId nextId_{0};
+
+  int32_t numRunning_{0};
+  int32_t numQueued_{0};
+  int64_t memoryBytes_{0};
+  int32_t numDrivers_{0};
+};
+
+} // namespace facebook::axiom::runner
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <folly/futures/Future.h>
 #include "axiom/common/Enums.h"
 #include "velox/exec/TaskStats.h"
 
@@ -34,13 +35,32 @@ class Runner {
 
   AXIOM_DECLARE_EMBEDDED_ENUM_NAME(State);
 
+  /// Called once when the execution reaches kFinished, kError or kCancelled.
+  /// 'error' is set unless the state is kFinished.
+  using CompletionCallback =
+      std::function<void(State state, std::exception_ptr error)>;
+
   virtual ~Runner() = default;
 
+  /// Returns a future that is fulfilled with the next batch of results or
+  /// with nullptr when there are no more results. Execution time errors are
+  /// delivered through the future. Does not block the calling thread while
+  /// waiting for results. The result is allocated in the pool of QueryCtx
+  /// given to the Runner implementation. The caller must not call nextAsync()
+  /// or next() again before the previous future is fulfilled.
+  virtual folly::SemiFuture<velox::RowVectorPtr> nextAsync() = 0;
+
   /// Returns the next batch of results. Returns nullptr when no more results.
-  /// Throws any execution time errors. The result is allocated in the pool of
-  /// QueryCtx given to the Runner implementation. The caller is responsible for
-  /// serializing calls from different threads.
-  virtual velox::RowVectorPtr next() = 0;
+  /// Blocks until a batch is ready. Throws any execution time errors. The
+  /// caller is responsible for serializing calls from different threads.
+  velox::RowVectorPtr next() {
+    return nextAsync().get();
+  }
+
+  /// Sets 'callback' to be called when the execution completes. Calls
+  /// 'callback' right away if the execution has already completed. Replaces
+  /// any previously set callback.
+  virtual void setCompletionCallback(CompletionCallback callback) = 0;
 
   /// Returns Task stats for each fragment of the plan. The stats correspond 1:1
   /// to the stages in the MultiFragmentPlan. This may be called at any time.
@@ -14,8 +14,13 @@
  * limitations under the License.
  */
 
+#include <folly/executors/CPUThreadPoolExecutor.h>
+#include <folly/synchronization/Baton.h>
+#include "axiom/runner/DynamicFilter.h"
 #include "axiom/runner/tests/DistributedPlanBuilder.h"
 #include "axiom/runner/tests/LocalRunnerTestBase.h"
+#include "velox/common/base/tests/GTestUtils.h"
+#include "velox/connectors/hive/HiveConnectorSplit.h"
 
 namespace facebook::axiom::runner {
 namespace {
@@ -194,6 +199,98 @@ TEST_F(LocalRunnerTest, count) {
   localRunner->waitForCompletion(kWaitTimeoutUs);
 }
 
+TEST_F(LocalRunnerTest, nextAsync) {
+  auto join = makeJoinPlan();
+  auto localRunner = makeRunner(join);
+
+  folly::Baton<> completed;
+  localRunner->setCompletionCallback(
+      [&](Runner::State state, std::exception_ptr error) {
+        EXPECT_EQ(Runner::State::kFinished, state);
+        EXPECT_EQ(nullptr, error);
+        completed.post();
+      });
+
+  // Reads the results from continuations on 'executor'. No thread waits for
+  // a batch.
+  folly::CPUThreadPoolExecutor executor(1);
+  std::vector<velox::RowVectorPtr> results;
+  std::function<void()> readNext = [&]() {
+    localRunner->nextAsync().via(&executor).thenValue(
+        [&](velox::RowVectorPtr batch) {
+          if (batch != nullptr) {
+            results.push_back(std::move(batch));
+            readNext();
+          }
+        });
+  };
+  readNext();
+
+  ASSERT_TRUE(
+      completed.try_wait_for(std::chrono::microseconds(kWaitTimeoutUs)));
+  EXPECT_EQ(1, results.size());
+  EXPECT_EQ(kNumRows, extractSingleInt64(results));
+  results.clear();
+  localRunner->waitForCompletion(kWaitTimeoutUs);
+
+  // The callback is called right away after completion.
+  bool called = false;
+  localRunner->setCompletionCallback(
+      [&](Runner::State state, std::exception_ptr /*error*/) {
+        EXPECT_EQ(Runner::State::kFinished, state);
+        called = true;
+      });
+  EXPECT_TRUE(called);
+}
+
+TEST_F(LocalRunnerTest, finishWithoutReadingEnd) {
+  auto localRunner = makeRunner(makeJoinPlan());
+
+  folly::Baton<> completed;
+  localRunner->setCompletionCallback(
+      [&](Runner::State state, std::exception_ptr error) {
+        EXPECT_EQ(Runner::State::kFinished, state);
+        EXPECT_EQ(nullptr, error);
+        completed.post();
+      });
+
+  // The consumer stops after the only row. The query completes regardless.
+  auto batch = localRunner->next();
+  ASSERT_NE(nullptr, batch);
+  EXPECT_EQ(kNumRows, extractSingleInt64({batch}));
+  batch.reset();
+
+  ASSERT_TRUE(
+      completed.try_wait_for(std::chrono::microseconds(kWaitTimeoutUs)));
+  EXPECT_EQ(Runner::State::kFinished, localRunner->state());
+  localRunner->waitForCompletion(kWaitTimeoutUs);
+}
+
+TEST_F(LocalRunnerTest, cancelQueued) {
+  auto scheduler = QueryScheduler::create({.maxDrivers = 1});
+
+  // Another query holds all drivers.
+  auto running = scheduler->admit(
+      QueryScheduler::Request{.memoryBytes = 0, .numDrivers = 1});
+  ASSERT_TRUE(running.isReady());
+
+  auto localRunner = makeRunner(makeJoinPlan());
+  localRunner->setScheduler(scheduler);
+  auto result = localRunner->nextAsync();
+  EXPECT_EQ(1, scheduler->stats().numQueued);
+
+  // The cancelled query leaves the queue and fails without starting.
+  localRunner->abort();
+  EXPECT_EQ(0, scheduler->stats().numQueued);
+  EXPECT_EQ(Runner::State::kCancelled, localRunner->state());
+  VELOX_ASSERT_THROW(std::move(result).get(), "Query cancelled");
+
+  // The drivers go to the next query when the running one completes.
+  std::move(running).get().reset();
+  EXPECT_EQ(0, scheduler->stats().numRunning);
+  EXPECT_EQ(0, scheduler->stats().numDrivers);
+}
+
 TEST_F(LocalRunnerTest, error) {
   auto join = makeJoinPlan("if (c0 = 111, c0 / 0, c0 + 1) as c0");
   auto localRunner = makeRunner(join);
@@ -208,6 +305,69 @@ TEST_F(LocalRunnerTest, scan) {
   checkScanCount(3);
 }
 
+TEST_F(LocalRunnerTest, cacheAffinity) {
+  // A split goes to the same task regardless of the order of the splits.
+  std::vector<std::shared_ptr<velox::connector::ConnectorSplit>> splits;
+  for (auto i = 0; i < 20; ++i) {
+    splits.push_back(
+        velox::connector::hive::HiveConnectorSplitBuilder(
+            fmt::format("/data/file{}", i / 4))
+            .connectorId(kHiveConnectorId)
+            .start((i % 4) << 20)
+            .length(1 << 20)
+            .build());
+  }
+  SplitAssigner forward(3, true, 100);
+  SplitAssigner backward(3, true, 100);
+  std::vector<int32_t> forwardTasks;
+  for (const auto& split : splits) {
+    forwardTasks.push_back(forward.assign(*split));
+  }
+  for (int32_t i = splits.size() - 1; i >= 0; --i) {
+    EXPECT_EQ(forwardTasks[i], backward.assign(*splits[i]));
+  }
+
+  // Returns the rows read by each task of the scan stage and the bytes found
+  // in memory or SSD cache. The stats are read before the tasks are released
+  // by waitForCompletion().
+  auto runScan = [&]() {
+    auto localRunner = makeRunner(makeScanPlan(3));
+    auto results = readCursor(localRunner);
+    results.clear();
+    const auto taskStats = localRunner->taskStats();
+    localRunner->waitForCompletion(kWaitTimeoutUs);
+
+    std::vector<int64_t> taskRows;
+    int64_t cachedBytes = 0;
+    for (const auto& stats : taskStats.at(0)) {
+      auto& rows = taskRows.emplace_back(0);
+      for (const auto& pipeline : stats.pipelineStats) {
+        for (const auto& op : pipeline.operatorStats) {
+          if (op.operatorType != "TableScan") {
+            continue;
+          }
+          rows += op.rawInputPositions;
+          for (const auto* name : {"ramReadBytes", "localReadBytes"}) {
+            auto it = op.runtimeStats.find(name);
+            if (it != op.runtimeStats.end()) {
+              cachedBytes += it->second.sum;
+            }
+          }
+        }
+      }
+    }
+    return std::pair(taskRows, cachedBytes);
+  };
+
+  // The second run reads the same splits on the same tasks and finds the
+  // data in the cache.
+  const auto [firstRows, firstCached] = runScan();
+  const auto [secondRows, secondCached] = runScan();
+  ASSERT_EQ(3, firstRows.size());
+  EXPECT_EQ(firstRows, secondRows);
+  EXPECT_GT(secondCached, 0);
+}
+
 TEST_F(LocalRunnerTest, broadcast) {
   auto join = makeJoinPlan("c0", true);
   auto localRunner = makeRunner(join);
@@ -256,5 +416,67 @@ TEST_F(LocalRunnerTest, lastStageWithMultipleInputs) {
   localRunner->waitForCompletion(kWaitTimeoutUs);
 }
 
+TEST_F(LocalRunnerTest, dynamicFilters) {
+  // A build side without non-null keys passes no probe keys.
+  auto noKeys = makeNullableFlatVector<int64_t>({std::nullopt});
+  auto filter = makeDynamicFilter(*noKeys, *noKeys, nullptr, 0);
+  EXPECT_FALSE(filter->testInt64(1));
+  EXPECT_FALSE(filter->testNull());
+
+  // The distinct keys make an IN filter. Without them the filter is a range.
+  auto min = makeFlatVector<int64_t>({10});
+  auto max = makeFlatVector<int64_t>({30});
+  auto values = makeArrayVector<int64_t>({{10, 20, 30}});
+  filter = makeDynamicFilter(*min, *max, values.get(), 0);
+  EXPECT_TRUE(filter->testInt64(20));
+  EXPECT_FALSE(filter->testInt64(25));
+  EXPECT_FALSE(filter->testNull());
+
+  filter = makeDynamicFilter(*min, *max, nullptr, 0);
+  EXPECT_TRUE(filter->testInt64(25));
+  EXPECT_FALSE(filter->testInt64(31));
+
+  // A dynamic filter passes all keys until set and after clear().
+  DynamicFilter dynamicFilter("dynamicFilters.1");
+  EXPECT_EQ(nullptr, dynamicFilter.filter());
+  dynamicFilter.set(std::move(filter));
+  ASSERT_NE(nullptr, dynamicFilter.filter());
+  EXPECT_FALSE(dynamicFilter.filter()->testInt64(31));
+  EXPECT_EQ(nullptr, dynamicFilter.bloom());
+  dynamicFilter.clear();
+  EXPECT_EQ(nullptr, dynamicFilter.filter());
+
+  // A Bloom filter passes every inserted key, few others and no nulls.
+  auto bloom = std::make_shared<KeyBloomFilter>(1'000);
+  bloom->insert(*makeFlatVector<int64_t>(1'000, [](auto row) { return row; }));
+  auto probe = makeFlatVector<int64_t>(
+      2'001,
+      [](auto row) { return row; },
+      [](auto row) { return row == 2'000; });
+  velox::DecodedVector decoded(*probe);
+  int32_t numFalsePositives = 0;
+  for (auto i = 0; i < 2'000; ++i) {
+    const bool passed = bloom->mayContain(decoded, velox::TypeKind::BIGINT, i);
+    if (i < 1'000) {
+      EXPECT_TRUE(passed);
+    } else if (passed) {
+      ++numFalsePositives;
+    }
+  }
+  EXPECT_LT(numFalsePositives, 100);
+  EXPECT_FALSE(bloom->mayContain(decoded, velox::TypeKind::BIGINT, 2'000));
+
+  // The range of the inserted keys is what a scan can test.
+  auto range = bloom->range();
+  ASSERT_NE(nullptr, range);
+  EXPECT_TRUE(range->testInt64(999));
+  EXPECT_FALSE(range->testInt64(1'000));
+  EXPECT_FALSE(KeyBloomFilter(10).range()->testInt64(0));
+
+  dynamicFilter.set(std::move(range), std::move(bloom));
+  EXPECT_NE(nullptr, dynamicFilter.filter());
+  EXPECT_NE(nullptr, dynamicFilter.bloom());
+}
+
 } // namespace
 } // namespace facebook::axiom::runner
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) Meta Platforms, Inc. and its affiliates.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "axiom/runner/QueryScheduler.h"
+#include <gtest/gtest.h>
+
+namespace facebook::axiom::runner {
+namespace {
+
+using Admission = std::unique_ptr<QueryScheduler::Admission>;
+
+class QuerySchedulerTest : public testing::Test {
+ protected:
+  static QueryScheduler::Request
+  request(int32_t numDrivers, int32_t priority = 0, std::string group = "") {
+    return QueryScheduler::Request{
+        .memoryBytes = numDrivers * 100,
+        .numDrivers = numDrivers,
+        .priority = priority,
+        .group = std::move(group)};
+  }
+};
+
+TEST_F(QuerySchedulerTest, maxDrivers) {
+  auto scheduler = QueryScheduler::create({.maxDrivers = 8});
+
+  auto first = scheduler->admit(request(4));
+  auto second = scheduler->admit(request(4));
+  auto third = scheduler->admit(request(4));
+  EXPECT_TRUE(first.isReady());
+  EXPECT_TRUE(second.isReady());
+  EXPECT_FALSE(third.isReady());
+  EXPECT_EQ(2, scheduler->stats().numRunning);
+  EXPECT_EQ(1, scheduler->stats().numQueued);
+  EXPECT_EQ(8, scheduler->stats().numDrivers);
+
+  // Releasing a query admits the next one.
+  std::move(first).get().reset();
+  EXPECT_TRUE(third.isReady());
+  EXPECT_EQ(0, scheduler->stats().numQueued);
+}
+
+TEST_F(QuerySchedulerTest, maxMemory) {
+  auto scheduler = QueryScheduler::create({.maxMemoryBytes = 1'000});
+
+  auto first = scheduler->admit(request(6));
+  auto second = scheduler->admit(request(6));
+  EXPECT_TRUE(first.isReady());
+  EXPECT_FALSE(second.isReady());
+  EXPECT_EQ(600, scheduler->stats().memoryBytes);
+
+  std::move(first).get().reset();
+  EXPECT_TRUE(second.isReady());
+}
+
+TEST_F(QuerySchedulerTest, oversizedRunsAlone) {
+  auto scheduler = QueryScheduler::create({.maxDrivers = 4});
+
+  // A query over the limit runs when nothing else runs.
+  auto large = scheduler->admit(request(16));
+  auto small = scheduler->admit(request(1));
+  EXPECT_TRUE(large.isReady());
+  EXPECT_FALSE(small.isReady());
+
+  std::move(large).get().reset();
+  EXPECT_TRUE(small.isReady());
+}
+
+TEST_F(QuerySchedulerTest, priority) {
+  auto scheduler = QueryScheduler::create({.maxDrivers = 4});
+
+  auto running = scheduler->admit(request(4));
+  auto low = scheduler->admit(request(4, 0));
+  auto high = scheduler->admit(request(4, 1));
+  EXPECT_FALSE(low.isReady());
+  EXPECT_FALSE(high.isReady());
+
+  std::move(running).get().reset();
+  EXPECT_TRUE(high.isReady());
+  EXPECT_FALSE(low.isReady());
+
+  std::move(high).get().reset();
+  EXPECT_TRUE(low.isReady());
+}
+
+TEST_F(QuerySchedulerTest, fairShare) {
+  auto scheduler = QueryScheduler::create({.maxDrivers = 4});
+
+  // Group 'a' has two queries running and more waiting. A waiting query of
+  // group 'b' goes ahead of them.
+  auto a1 = scheduler->admit(request(2, 0, "a"));
+  auto a2 = scheduler->admit(request(2, 0, "a"));
+  auto a3 = scheduler->admit(request(2, 0, "a"));
+  auto b1 = scheduler->admit(request(2, 0, "b"));
+  EXPECT_TRUE(a1.isReady());
+  EXPECT_TRUE(a2.isReady());
+
+  std::move(a1).get().reset();
+  EXPECT_TRUE(b1.isReady());
+  EXPECT_FALSE(a3.isReady());
+
+  std::move(a2).get().reset();
+  EXPECT_TRUE(a3.isReady());
+}
+
+TEST_F(QuerySchedulerTest, cancel) {
+  auto scheduler = QueryScheduler::create({.maxDrivers = 4});
+
+  QueryScheduler::WaiterId runningId;
+  QueryScheduler::WaiterId largeId;
+  auto running = scheduler->admit(request(2), &runningId);
+  auto large = scheduler->admit(request(4), &largeId);
+  auto small = scheduler->admit(request(2));
+  EXPECT_FALSE(large.isReady());
+  EXPECT_FALSE(small.isReady());
+
+  // Cancelling an admitted query does nothing.
+  scheduler->cancel(
+      runningId, std::make_exception_ptr(std::runtime_error("cancelled")));
+  EXPECT_TRUE(running.isReady());
+  EXPECT_EQ(1, scheduler->stats().numRunning);
+
+  // The cancelled query fails and no longer blocks the one behind it.
+  scheduler->cancel(
+      largeId, std::make_exception_ptr(std::runtime_error("cancelled")));
+  EXPECT_TRUE(large.isReady());
+  EXPECT_THROW(std::move(large).get(), std::runtime_error);
+  EXPECT_TRUE(small.isReady());
+  EXPECT_EQ(0, scheduler->stats().numQueued);
+  EXPECT_EQ(4, scheduler->stats().numDrivers);
+}
+
+} // namespace
+} // namespace facebook::axiom::runner